@@ -1,39 +1,310 @@
+#include <stdlib.h>
+#include <string.h>
+#include "hardware/sync.h"
 #include "EventMachine.h"
 
+/*
+
+Event machines
+
+The events can be stored in a pico queue_t, which takes a spin lock and disables the interrupts on each
+access, or in a lock-free ring for the queues that have a single producer and a single consumer (the
+queues between the cores). The ring uses free running head and tail counters, each one is only written
+by one side, and the data barriers ensure that the other core sees the slot contents before the counter
+that publishes (or releases) them.
+
+Pushing an event signals a SEV (queue_t already does it when it releases its lock) so a consumer
+sleeping in WFE on the other core wakes up.
+
+Producers that can't wait (IRQs) use event_try_push, which counts the events lost when the queue is full.
+Redundant events are discarded when they are processed, if the machine has a coalescer each event is
+compared with the next queued one before running its handler.
+
+The consumer calls event_mark_sleep before sleeping, the first event pushed after it stores its time so
+once awake the consumer knows how long it took to get back to its loop (event_wake_latency).
+
+*/
+
+//Gets the ring slot of a counter
+static inline uint8_t* ring_slot(evtmachine_t* machine, uint32_t counter)
+{
+    return &machine->ring[(counter & (machine->ringDepth - 1)) * machine->eventSize];
+}
+
 //Initialize the event machine
 void event_machine_init(evtmachine_t* machine, event_handler handler, uint8_t event_size, uint8_t queue_depth)
 {
     queue_init(&machine->queue, event_size, queue_depth);
+    machine->eventSize = event_size;
+    machine->type = EVQ_LOCKING;
     machine->handler = handler;
+    machine->coalescer = NULL;
+    machine->highWater = 0;
+    machine->dropped = 0;
+    machine->coalesced = 0;
+    machine->starved = 0;
+    machine->wakeTimed = false;
+}
+
+//Initialize a lock-free event machine, only one core (or context) can push events and the queue depth must be a power of two
+void event_machine_init_spsc(evtmachine_t* machine, event_handler handler, uint8_t event_size, uint8_t queue_depth)
+{
+    //The slots are found masking the counters, so the depth must be a power of two (128 at most in 8 bits)
+    hard_assert(queue_depth && !(queue_depth & (queue_depth - 1)));
+
+    machine->ring = calloc(queue_depth, event_size);
+    hard_assert(machine->ring);
+
+    machine->ringHead = 0;
+    machine->ringTail = 0;
+    machine->ringDepth = queue_depth;
+    machine->eventSize = event_size;
+    machine->type = EVQ_SPSC;
+    machine->handler = handler;
+    machine->coalescer = NULL;
+    machine->highWater = 0;
+    machine->dropped = 0;
+    machine->coalesced = 0;
+    machine->starved = 0;
+    machine->wakeTimed = false;
+}
+
+//Stores the time of the first event pushed since the consumer marked its sleep
+static inline void time_wake(evtmachine_t* machine)
+{
+    if(!machine->wakeTimed)
+    {
+        machine->wakeTime = time_us_32();
+        machine->wakeTimed = true;
+    }
+}
+
+//Sets the function that discards redundant events
+void event_set_coalescer(evtmachine_t* machine, event_coalescer coalescer)
+{
+    machine->coalescer = coalescer;
 }
 
 //Adds an event to the machine
 void event_push(evtmachine_t* machine, void* event)
 {
-    queue_add_blocking(&machine->queue, event);
+    if(machine->type == EVQ_LOCKING)
+    {
+        queue_add_blocking(&machine->queue, event);
+        time_wake(machine);
+        return;
+    }
+
+    uint32_t head = machine->ringHead;
+
+    //Wait for a free slot
+    while(head - machine->ringTail >= machine->ringDepth)
+        tight_loop_contents();
+
+    memcpy(ring_slot(machine, head), event, machine->eventSize);
+
+    //The event must be visible before the consumer sees the new head
+    __dmb();
+    machine->ringHead = head + 1;
+    time_wake(machine);
+    __sev();
+}
+
+//Adds an event to the machine without waiting, returns false (and counts the event as dropped) if the queue is full
+//This is the one to use from IRQs, a blocking push would never return if the queue is full
+bool event_try_push(evtmachine_t* machine, void* event)
+{
+    bool pushed;
+
+    if(machine->type == EVQ_LOCKING)
+    {
+        pushed = queue_try_add(&machine->queue, event);
+
+        if(pushed)
+            time_wake(machine);
+    }
+    else
+    {
+        uint32_t head = machine->ringHead;
+        pushed = head - machine->ringTail < machine->ringDepth;
+
+        if(pushed)
+        {
+            memcpy(ring_slot(machine, head), event, machine->eventSize);
+            __dmb();
+            machine->ringHead = head + 1;
+            time_wake(machine);
+            __sev();
+        }
+    }
+
+    if(!pushed)
+        machine->dropped++;
+
+    return pushed;
+}
+
+//Checks if the event is made redundant by the next queued one
+static bool is_event_coalesced(evtmachine_t* machine, void* event)
+{
+    if(machine->coalescer == NULL)
+        return false;
+
+    uint8_t next[machine->eventSize];
+
+    if(machine->type == EVQ_LOCKING)
+    {
+        if(!queue_try_peek(&machine->queue, next))
+            return false;
+    }
+    else
+    {
+        uint32_t tail = machine->ringTail;
+
+        if(tail == machine->ringHead)
+            return false;
+
+        __dmb();
+        memcpy(next, ring_slot(machine, tail), machine->eventSize);
+    }
+
+    if(!machine->coalescer(event, next))
+        return false;
+
+    machine->coalesced++;
+    return true;
 }
 
 //Processes the pending events
 void event_process_queue(evtmachine_t* machine, void* event_buffer, uint8_t max_events)
 {
     uint8_t evt_count = 0;
-    while(!queue_is_empty(&machine->queue) && evt_count++ < max_events)
+
+    if(machine->type == EVQ_LOCKING)
     {
-        queue_remove_blocking(&machine->queue, event_buffer);
-        machine->handler(event_buffer);
+        //The backlog is sampled when the queue is processed, this keeps the cost out of the producers
+        uint level = queue_get_level(&machine->queue);
+
+        if(level > machine->highWater)
+            machine->highWater = level;
+
+        while(!queue_is_empty(&machine->queue) && evt_count++ < max_events)
+        {
+            queue_remove_blocking(&machine->queue, event_buffer);
+
+            if(!is_event_coalesced(machine, event_buffer))
+                machine->handler(event_buffer);
+        }
+
+        return;
     }
+
+    uint32_t tail = machine->ringTail;
+    uint32_t head = machine->ringHead;
+
+    if(head - tail > machine->highWater)
+        machine->highWater = head - tail;
+
+    while(tail != head && evt_count++ < max_events)
+    {
+        //Read the slot after the head that published it
+        __dmb();
+        memcpy(event_buffer, ring_slot(machine, tail), machine->eventSize);
+
+        //The slot must be read before the producer can reuse it
+        __dmb();
+        machine->ringTail = ++tail;
+
+        if(!is_event_coalesced(machine, event_buffer))
+            machine->handler(event_buffer);
+
+        head = machine->ringHead;
+    }
+}
+
+//Checks if there are events waiting to be processed
+bool event_pending(evtmachine_t* machine)
+{
+    if(machine->type == EVQ_LOCKING)
+        return !queue_is_empty(&machine->queue);
+
+    return machine->ringTail != machine->ringHead;
 }
 
-//Clears the stored events in the machine
+//Checks if any class with more priority than the given one has events waiting
+static bool higher_class_pending(evtclass_t* classes, uint8_t cls)
+{
+    for(int buc = 0; buc < cls; buc++)
+    {
+        if(event_pending(classes[buc].machine))
+            return true;
+    }
+
+    return false;
+}
+
+//Processes the events of several machines by priority (the first class is the highest one)
+//Each class runs until its queue is empty or its time budget is spent, a lower class stops as soon as
+//a higher one has events waiting. A class left with events waiting is counted as starved in its machine
+void event_process_classes(evtclass_t* classes, uint8_t count)
+{
+    for(int cls = 0; cls < count; cls++)
+    {
+        evtclass_t* current = &classes[cls];
+        uint32_t start = time_us_32();
+
+        while(event_pending(current->machine))
+        {
+            if(time_us_32() - start >= current->budgetUs || higher_class_pending(classes, cls))
+            {
+                current->machine->starved++;
+                break;
+            }
+
+            event_process_queue(current->machine, current->eventBuffer, 1);
+        }
+    }
+}
+
+//Clears the stored events in the machine, must be called from the consumer
 void event_clear(evtmachine_t* machine)
 {
-    machine->queue.wptr = 0;
-    machine->queue.rptr = 0;
+    if(machine->type == EVQ_LOCKING)
+    {
+        //Remove the events through the queue so its lock protects the pointers
+        while(queue_try_remove(&machine->queue, NULL));
+        return;
+    }
+
+    machine->ringTail = machine->ringHead;
+}
+
+//Called by the consumer before it sleeps (and before checking if there are events waiting), the next push will be timed
+//A push that races with it may be missed, the latency of that wake up is just not measured
+void event_mark_sleep(evtmachine_t* machine)
+{
+    machine->wakeTimed = false;
+}
+
+//Time since the first event pushed after event_mark_sleep, in us, or 0 if no event has been pushed
+uint32_t event_wake_latency(evtmachine_t* machine)
+{
+    if(!machine->wakeTimed)
+        return 0;
+
+    return time_us_32() - machine->wakeTime;
 }
 
 //Free an event machine
 void event_free(evtmachine_t* machine)
 {
-    queue_free(&machine->queue);
+    if(machine->type == EVQ_LOCKING)
+        queue_free(&machine->queue);
+    else
+    {
+        free(machine->ring);
+        machine->ring = NULL;
+    }
+
     machine->handler = NULL;
-}
\ No newline at end of file
+}
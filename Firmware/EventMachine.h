@@ -6,21 +6,66 @@
 
 //Event handler function declaration
 typedef void(*event_handler)(void*);
+//Returns true if the next queued event makes the current one redundant, the current one is then discarded
+typedef bool(*event_coalescer)(void* current, void* next);
+
+//Storage used by an event machine
+typedef enum __attribute__((packed))
+{
+    EVQ_LOCKING,    //pico queue_t, any number of producers in any core or IRQ
+    EVQ_SPSC        //Lock-free ring, a single producer and a single consumer (one core each or the same core)
+
+} evtqueuetype_t;
 
 //Event machine struct
 typedef struct evtmachine
 {
-    //Queue to store events
+    //Queue to store events (EVQ_LOCKING)
     queue_t queue;
+    //Ring to store events (EVQ_SPSC), the slots are used with free running counters
+    uint8_t* ring;
+    volatile uint32_t ringHead; //Events pushed, only written by the producer
+    volatile uint32_t ringTail; //Events processed, only written by the consumer
+    uint8_t ringDepth;          //Power of two
+    uint8_t eventSize;
+    evtqueuetype_t type;
     //Function to process the events
     event_handler handler;
+    //Function to discard redundant events, optional
+    event_coalescer coalescer;
+    //Maximum number of events found waiting in the queue
+    volatile uint8_t highWater;
+    //Events lost because the queue was full (event_try_push) and events discarded by the coalescer
+    volatile uint32_t dropped;
+    volatile uint32_t coalesced;
+    //Times that event_process_classes left events waiting in the queue (budget spent or a higher class waiting)
+    volatile uint32_t starved;
+    //Time of the first event pushed since the consumer called event_mark_sleep, used to measure its wake up latency
+    volatile uint32_t wakeTime;
+    volatile bool wakeTimed;
 
 } evtmachine_t;
 
+//Priority class processed by event_process_classes
+typedef struct evtclass
+{
+    evtmachine_t* machine;
+    void* eventBuffer;
+    uint32_t budgetUs;  //Maximum time spent in the class on each call, at least one event is processed unless a higher class has events waiting
+
+} evtclass_t;
+
 void event_machine_init(evtmachine_t* machine, event_handler handler, uint8_t args_size, uint8_t queue_depth);
+void event_machine_init_spsc(evtmachine_t* machine, event_handler handler, uint8_t args_size, uint8_t queue_depth);
+void event_set_coalescer(evtmachine_t* machine, event_coalescer coalescer);
 void event_push(evtmachine_t* machine, void* event);
+bool event_try_push(evtmachine_t* machine, void* event);
 void event_process_queue(evtmachine_t* machine, void* event_buffer, uint8_t max_events);
+bool event_pending(evtmachine_t* machine);
+void event_process_classes(evtclass_t* classes, uint8_t count);
 void event_clear(evtmachine_t* machine);
+void event_mark_sleep(evtmachine_t* machine);
+uint32_t event_wake_latency(evtmachine_t* machine);
 void event_free(evtmachine_t* machine);
 
-#endif
\ No newline at end of file
+#endif
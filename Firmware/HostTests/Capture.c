@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include "Capture.h"
+#include "HostBoard.h"
+
+/*
+
+Logic analyzer captures of the host tests
+
+The captures are CSV files with a header row naming the channels and a row per sample or per change. The first
+column is the time in seconds (as most logic analyzers export the transitions) or, if a sample rate is given, every
+row is a sample and there's no time column (as the sample exports). The channels are mapped to the signals by the
+name of their columns, the ones not needed by the capture can be left out. Only the changes are kept, the first row
+gives the initial levels and its time is the start of the capture.
+
+*/
+
+#define CSV_MAX_LINE 1024
+#define CSV_MAX_COLUMNS 64
+
+const char* const captureSignalNames[CAP_SIGNAL_COUNT] =
+{
+    "MD_SER_DATA_IN",
+    "MD_SER_CLK",
+    "MD_RW",
+    "MD_ERASE",
+    "MD_HEAD_1",
+    "MD_HEAD_2"
+};
+
+void capture_init(capture_t* capture)
+{
+    memset(capture, 0, sizeof(capture_t));
+}
+
+void capture_free(capture_t* capture)
+{
+    free(capture->edges);
+    capture_init(capture);
+}
+
+//The edges must be added in order
+void capture_add_edge(capture_t* capture, uint64_t cycle, capturesignal_t signal, bool level)
+{
+    if(capture->edgeCount == capture->edgeCapacity)
+    {
+        capture->edgeCapacity = capture->edgeCapacity ? capture->edgeCapacity * 2 : 65536;
+        capture->edges = realloc(capture->edges, capture->edgeCapacity * sizeof(captureedge_t));
+    }
+
+    captureedge_t* edge = &capture->edges[capture->edgeCount++];
+    edge->cycle = cycle;
+    edge->signal = signal;
+    edge->level = level;
+}
+
+//Splits a row in place, the spaces and quotes around the fields are removed
+static int split_row(char* row, char* fields[CSV_MAX_COLUMNS])
+{
+    int count = 0;
+    char* field = row;
+
+    while(field && count < CSV_MAX_COLUMNS)
+    {
+        char* next = strchr(field, ',');
+
+        if(next)
+            *next++ = 0;
+
+        while(*field == ' ' || *field == '"')
+            field++;
+
+        char* end = field + strlen(field);
+
+        while(end > field && (end[-1] == ' ' || end[-1] == '"' || end[-1] == '\r' || end[-1] == '\n'))
+            *--end = 0;
+
+        fields[count++] = field;
+        field = next;
+    }
+
+    return count;
+}
+
+//Loads a capture, columns has the name of the column of each signal (NULL to skip it)
+//Returns false if the file can't be read, a row is malformed or the time goes back
+bool capture_load_csv(capture_t* capture, const char* path, uint32_t sampleRate, const char* const columns[CAP_SIGNAL_COUNT])
+{
+    FILE* file = fopen(path, "r");
+
+    if(!file)
+        return false;
+
+    static char row[CSV_MAX_LINE];
+    char* fields[CSV_MAX_COLUMNS];
+    int signalColumn[CAP_SIGNAL_COUNT];
+    bool levels[CAP_SIGNAL_COUNT];
+    bool loaded = fgets(row, sizeof(row), file) != NULL;
+    int columnCount = loaded ? split_row(row, fields) : 0;
+
+    capture_init(capture);
+
+    for(int signal = 0; signal < CAP_SIGNAL_COUNT; signal++)
+    {
+        signalColumn[signal] = -1;
+
+        for(int column = sampleRate ? 0 : 1; column < columnCount && columns[signal]; column++)
+        {
+            if(strcasecmp(fields[column], columns[signal]) == 0)
+                signalColumn[signal] = column;
+        }
+
+        capture->present[signal] = signalColumn[signal] >= 0;
+    }
+
+    double start = 0;
+    uint64_t last = 0;
+    uint64_t sample = 0;
+
+    while(loaded && fgets(row, sizeof(row), file))
+    {
+        int count = split_row(row, fields);
+
+        if(count == 1 && !fields[0][0])
+            continue;
+
+        if(count < columnCount)
+        {
+            loaded = false;
+            break;
+        }
+
+        uint64_t cycle;
+
+        if(sampleRate)
+            cycle = sample * HOST_SYS_CLOCK_HZ / sampleRate;
+        else
+        {
+            char* end;
+            double time = strtod(fields[0], &end);
+
+            if(end == fields[0])
+            {
+                loaded = false;
+                break;
+            }
+
+            if(!sample)
+                start = time;
+
+            cycle = llround((time - start) * HOST_SYS_CLOCK_HZ);
+        }
+
+        if(cycle < last)
+        {
+            loaded = false;
+            break;
+        }
+
+        for(int signal = 0; signal < CAP_SIGNAL_COUNT; signal++)
+        {
+            if(signalColumn[signal] < 0)
+                continue;
+
+            bool level = atoi(fields[signalColumn[signal]]) != 0;
+
+            if(!sample)
+                capture->initialLevel[signal] = level;
+            else if(level != levels[signal])
+                capture_add_edge(capture, cycle, signal, level);
+
+            levels[signal] = level;
+        }
+
+        last = cycle;
+        sample++;
+    }
+
+    fclose(file);
+    return loaded && sample;
+}
+
+//Saves a capture with a row per edge, the columns are named as the signals
+bool capture_save_csv(const capture_t* capture, const char* path)
+{
+    FILE* file = fopen(path, "w");
+
+    if(!file)
+        return false;
+
+    bool levels[CAP_SIGNAL_COUNT];
+
+    fprintf(file, "Time [s]");
+
+    for(int signal = 0; signal < CAP_SIGNAL_COUNT; signal++)
+    {
+        fprintf(file, ",%s", captureSignalNames[signal]);
+        levels[signal] = capture->initialLevel[signal];
+    }
+
+    for(uint32_t edge = 0; edge <= capture->edgeCount; edge++)
+    {
+        uint64_t cycle = 0;
+
+        if(edge)
+        {
+            cycle = capture->edges[edge - 1].cycle;
+            levels[capture->edges[edge - 1].signal] = capture->edges[edge - 1].level;
+        }
+
+        fprintf(file, "\n%.9f", (double)cycle / HOST_SYS_CLOCK_HZ);
+
+        for(int signal = 0; signal < CAP_SIGNAL_COUNT; signal++)
+            fprintf(file, ",%d", levels[signal]);
+    }
+
+    fprintf(file, "\n");
+    return fclose(file) == 0;
+}
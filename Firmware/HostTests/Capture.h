@@ -0,0 +1,49 @@
+#ifndef __HOST_CAPTURE__
+#define __HOST_CAPTURE__
+
+#include "pico/stdlib.h"
+
+//Logic analyzer captures of the microdrive lines, the levels of each signal and the cycles (of the simulated board)
+//where they change
+
+typedef enum
+{
+    CAP_SER_DATA,
+    CAP_SER_CLK,
+    CAP_RW,
+    CAP_ERASE,
+    CAP_HEAD_1,
+    CAP_HEAD_2,
+    CAP_SIGNAL_COUNT
+
+} capturesignal_t;
+
+typedef struct captureedge
+{
+    uint64_t cycle;
+    uint8_t signal;
+    bool level;
+
+} captureedge_t;
+
+typedef struct capture
+{
+    bool present[CAP_SIGNAL_COUNT];
+    bool initialLevel[CAP_SIGNAL_COUNT];
+
+    //Sorted by cycle
+    captureedge_t* edges;
+    uint32_t edgeCount;
+    uint32_t edgeCapacity;
+
+} capture_t;
+
+extern const char* const captureSignalNames[CAP_SIGNAL_COUNT];
+
+void capture_init(capture_t* capture);
+void capture_free(capture_t* capture);
+void capture_add_edge(capture_t* capture, uint64_t cycle, capturesignal_t signal, bool level);
+bool capture_load_csv(capture_t* capture, const char* path, uint32_t sampleRate, const char* const columns[CAP_SIGNAL_COUNT]);
+bool capture_save_csv(const capture_t* capture, const char* path);
+
+#endif
@@ -0,0 +1,669 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "HostBoard.h"
+#include "UlaModel.h"
+#include "QlModel.h"
+#include "CardImage.h"
+#include "Capture.h"
+#include "MicroDriveControl.h"
+#include "UserInterface.h"
+#include "SharedBuffers.h"
+#include "pff/pff.h"
+
+/*
+
+Replay of logic analyzer captures into the firmware
+
+CaptureReplay replay capture.csv image.mdv [--rate HZ] [SIGNAL=column...]
+
+The capture (Capture.c) is replayed into both firmware cores on the simulated board: the select chain (MD_SER_DATA_IN
+and MD_SER_CLK) and the RW/ERASE lines are driven at the times of the capture, the heads only while the QL writes
+(RW low), so the read machines get what the QL wrote. While the QL reads the firmware drives the heads and the
+edges sent by the write machines are compared with the ones of the capture: both are split in records (bursts of
+edges) and decoded following the clock of each one, so the bits must be identical and the time offsets between the
+edges are reported. The columns are named as the signals (MD_SER_DATA_IN, MD_SER_CLK, MD_RW, MD_ERASE, MD_HEAD_1 and
+MD_HEAD_2) unless mapped in the command line, e.g. MD_RW="Channel 3".
+
+The image must be the cartridge of the capture, it's rotated so the firmware starts at the sector sent first in the
+capture. The capture must start before the drive is selected, the firmware loads the image before it starts.
+
+CaptureReplay record capture.csv image.mdv [corrupted.csv]
+
+Records a session of the QL model (it selects the drive, reads some sets, rewrites a record and deselects it) as a
+capture, the image is loaded rotated so the replay has to find the first sector. The corrupted capture has a head
+edge moved in a record sent by the drive, its replay must report the difference.
+
+*/
+
+//The status machine is clamped as in MdControlTests, it would tick every cycle
+#define MIN_CLKDIV 50
+
+//Gap written by the QL before the record, it starts writing a while after the header (the replayed firmware sends
+//the header up to a few tens of us later than the recorded one, the QL must not cut it)
+#define QL_GAP_US 2800
+#define QL_TURNAROUND_US 200
+
+//Session recorded by the QL model
+#define RECORD_READ_SETS 6
+#define RECORD_ROTATION 100
+#define RECORD_MOVED_EDGE 1000
+#define RECORD_MOVED_CYCLES (3 * HOST_CYCLES_PER_US)
+
+//Records are bursts of edges, the gaps separate them
+#define BURST_GAP_CYCLES (ULA_BIT_CYCLES * 5 / 2)
+#define BURST_MIN_EDGES 16
+#define BURST_MAX_BITS 8192
+#define BURST_MATCH_CYCLES (1000 * HOST_CYCLES_PER_US)
+
+//Longest header burst, a sector one is much longer
+#define HEADER_MAX_BITS 200
+
+//Time the firmware runs after the end of the capture
+#define REPLAY_TAIL_US 10000
+
+//State of the firmware
+extern mdactivestatus_t activeStatus;
+extern uint8_t currentBufferSet;
+extern USER_INTERFACE_STATE uiState;
+extern CARTRIDGE_FORMAT cfInserted;
+extern bool mdInUse;
+extern char currentPath[PATH_BUFFER_SIZE];
+extern FATFS fatfs;
+extern FILINFO fno;
+
+bool init_screen();
+
+static const uint signalPins[CAP_SIGNAL_COUNT] = { MD_SER_DATA_IN, MD_SER_CLK, MD_RW, MD_ERASE, MD_READ_HEAD_1, MD_READ_HEAD_2 };
+
+static uint8_t mdvImage[CARTRIDGE_SECTOR_COUNT * MDV_SECTOR_SIZE];
+static uint8_t rotated[CARTRIDGE_SECTOR_COUNT * MDV_SECTOR_SIZE];
+
+static capture_t capture;
+static capture_t sent;
+static uint64_t captureStart;
+static uint32_t nextEdge;
+static bool captureLevels[CAP_SIGNAL_COUNT];
+
+static int failures = 0;
+
+//Board
+
+//Rotates the image so the sector at the given position comes first
+static void rotate_image(int first)
+{
+    for(int pos = 0; pos < CARTRIDGE_SECTOR_COUNT; pos++)
+        memcpy(&rotated[pos * MDV_SECTOR_SIZE], &mdvImage[(pos + first) % CARTRIDGE_SECTOR_COUNT * MDV_SECTOR_SIZE], MDV_SECTOR_SIZE);
+}
+
+//Stores the rotated image in the card and loads it as the user interface does once the file is chosen in the browser
+static bool load_image(void)
+{
+    if(!card_create())
+        return false;
+
+    card_store_file(0, "IMAGE   MDV", CARD_FIRST_FILE_CLUSTER, rotated, sizeof(rotated));
+
+    if(pf_mount(&fatfs) != FR_OK)
+        return false;
+
+    memset(currentPath, 0, PATH_BUFFER_SIZE);
+    strcpy(fno.fname, "IMAGE.MDV");
+    fno.fsize = sizeof(rotated);
+    cfInserted = MDV;
+    uiState = FILE_LOAD;
+
+    RUN_UNTIL(uiState == CARTRIDGE_READY, 2000000);
+    return uiState == CARTRIDGE_READY;
+}
+
+static int signal_of_pin(uint gpio)
+{
+    for(int signal = 0; signal < CAP_SIGNAL_COUNT; signal++)
+    {
+        if(signalPins[signal] == gpio)
+            return signal;
+    }
+
+    return -1;
+}
+
+//Recording
+
+static void record_edge(uint gpio, bool level, uint64_t cycle, void* context)
+{
+    (void)context;
+
+    int signal = signal_of_pin(gpio);
+
+    if(signal >= 0)
+        capture_add_edge(&capture, cycle - captureStart, signal, level);
+}
+
+//Session of the QL model, the lines and both heads are recorded from the start
+static bool record_session(void)
+{
+    uint32_t levels = host_gpio_levels();
+
+    capture_init(&capture);
+    captureStart = host_now();
+
+    for(int signal = 0; signal < CAP_SIGNAL_COUNT; signal++)
+    {
+        capture.present[signal] = true;
+        capture.initialLevel[signal] = (levels >> signalPins[signal]) & 1;
+    }
+
+    memset((void*)&perfCounters, 0, sizeof(perfCounters));
+    host_gpio_set_listener(record_edge, NULL);
+
+    ql_shift_bit(true);
+    RUN_UNTIL(perfCounters.setsServed >= RECORD_READ_SETS, 1000000);
+
+    //The QL rewrites the record of the next sector with a byte changed
+    SECTOR_RECORD_t record;
+
+    RUN_UNTIL(activeStatus == MDA_WRITE_SECTOR_GAP, 100000);
+    ql_run_cores_until(host_now() + QL_TURNAROUND_US * HOST_CYCLES_PER_US);
+    memcpy(&record, &cartridge_image[CARTRIDGE_SECTOR_SIZE * bufferSets[currentBufferSet].sector_number + CARTRIDGE_HEADER_SIZE], sizeof(record));
+    record.Data[0]++;
+    record.DataChecksum++;
+
+    ql_set_lines(MDL_WRITE_GAP);
+    ql_run_cores_until(host_now() + QL_GAP_US * HOST_CYCLES_PER_US);
+    ql_set_lines(MDL_WRITE);
+    ql_run_cores_until(ula_send_record((uint8_t*)&record, SECTOR_TRACK_DATA_SIZE) + 3 * ULA_BIT_CYCLES);
+    host_gpio_release(MD_READ_HEAD_1);
+    host_gpio_release(MD_READ_HEAD_2);
+    ql_set_lines(MDL_READ);
+
+    RUN_UNTIL(perfCounters.setsServed >= RECORD_READ_SETS * 2, 1000000);
+
+    ql_shift_bit(false);
+    RUN_UNTIL(!mdInUse, 1000);
+    host_run_us(1000);
+    host_gpio_set_listener(NULL, NULL);
+
+    printf("Recorded: %u edges, %u sets served, %u received\n", capture.edgeCount, perfCounters.setsServed, perfCounters.setsReceived);
+    return perfCounters.setsServed >= RECORD_READ_SETS * 2 && perfCounters.setsReceived == 1;
+}
+
+//Moves an edge of the head 1 in the middle of a record sent by the drive
+static bool corrupt_capture(void)
+{
+    uint32_t found = 0;
+    uint64_t previous = 0;
+    bool rw = capture.initialLevel[CAP_RW];
+
+    for(uint32_t buc = 0; buc < capture.edgeCount; buc++)
+    {
+        captureedge_t* edge = &capture.edges[buc];
+
+        if(edge->signal == CAP_RW)
+            rw = edge->level;
+
+        if(edge->signal != CAP_HEAD_1)
+            continue;
+
+        if(rw && edge->cycle - previous < BURST_GAP_CYCLES && ++found == RECORD_MOVED_EDGE)
+        {
+            captureedge_t moved = *edge;
+            moved.cycle += RECORD_MOVED_CYCLES;
+
+            for(; buc + 1 < capture.edgeCount && capture.edges[buc + 1].cycle <= moved.cycle; buc++)
+                capture.edges[buc] = capture.edges[buc + 1];
+
+            capture.edges[buc] = moved;
+            printf("Corrupted: head 1 edge at %.6f s moved %u us\n", (double)moved.cycle / HOST_SYS_CLOCK_HZ, RECORD_MOVED_CYCLES / HOST_CYCLES_PER_US);
+            return true;
+        }
+
+        previous = edge->cycle;
+    }
+
+    return false;
+}
+
+//Replay
+
+//The capture drives the heads only while the QL writes
+static void drive_heads(void)
+{
+    for(int signal = CAP_HEAD_1; signal <= CAP_HEAD_2; signal++)
+    {
+        if(!capture.present[signal] || captureLevels[CAP_RW])
+            host_gpio_release(signalPins[signal]);
+        else
+            host_gpio_drive(signalPins[signal], captureLevels[signal]);
+    }
+}
+
+//Drives the edges of the capture at the current cycle and schedules the next ones
+static void replay_edges(void* context)
+{
+    (void)context;
+
+    do
+    {
+        captureedge_t* edge = &capture.edges[nextEdge++];
+        captureLevels[edge->signal] = edge->level;
+
+        if(edge->signal < CAP_HEAD_1)
+            host_gpio_drive(signalPins[edge->signal], edge->level);
+
+        if(edge->signal >= CAP_RW)
+            drive_heads();
+    }
+    while(nextEdge < capture.edgeCount && captureStart + capture.edges[nextEdge].cycle <= host_now());
+
+    if(nextEdge < capture.edgeCount)
+        host_schedule(captureStart + capture.edges[nextEdge].cycle, replay_edges, NULL);
+}
+
+//The edges sent by the firmware are the ones of the write pins while the QL reads
+static void listen_sent(uint gpio, bool level, uint64_t cycle, void* context)
+{
+    (void)context;
+
+    if(captureLevels[CAP_RW] && (gpio == MD_WRITE_HEAD_1 || gpio == MD_WRITE_HEAD_2))
+        capture_add_edge(&sent, cycle - captureStart, gpio == MD_WRITE_HEAD_1 ? CAP_HEAD_1 : CAP_HEAD_2, level);
+}
+
+//Sets the lines at the initial levels of the capture, the heads are released
+static void start_lines(void)
+{
+    for(int signal = 0; signal < CAP_SIGNAL_COUNT; signal++)
+    {
+        captureLevels[signal] = capture.initialLevel[signal];
+
+        if(signal < CAP_HEAD_1 && capture.present[signal])
+            host_gpio_drive(signalPins[signal], captureLevels[signal]);
+    }
+
+    drive_heads();
+}
+
+static void replay_capture(void)
+{
+    capture_init(&sent);
+    captureStart = host_now();
+    nextEdge = 0;
+
+    memset((void*)&perfCounters, 0, sizeof(perfCounters));
+    host_gpio_set_listener(listen_sent, NULL);
+
+    if(capture.edgeCount)
+        host_schedule(captureStart + capture.edges[0].cycle, replay_edges, NULL);
+
+    uint64_t end = captureStart + (capture.edgeCount ? capture.edges[capture.edgeCount - 1].cycle : 0);
+    ql_run_cores_until(end + REPLAY_TAIL_US * HOST_CYCLES_PER_US);
+    host_gpio_set_listener(NULL, NULL);
+
+    printf("Replayed: %u edges in %.3f s, %u sets served, %u received, %u late sets, %u transfers cut\n", capture.edgeCount,
+        (double)(end - captureStart) / HOST_SYS_CLOCK_HZ, perfCounters.setsServed, perfCounters.setsReceived,
+        perfCounters.underruns, perfCounters.dmaAborts);
+}
+
+//Diff
+
+//Edges of a head while the QL reads, the capture ones are taken while its RW line is high
+//The cycles are allocated, they must be freed
+static uint32_t read_edges(const capture_t* source, int signal, uint64_t** edgeCycles)
+{
+    uint64_t* cycles = malloc((source->edgeCount + 1) * sizeof(uint64_t));
+    uint32_t count = 0;
+    bool rw = source == &capture ? capture.initialLevel[CAP_RW] : true;
+
+    for(uint32_t buc = 0; buc < source->edgeCount; buc++)
+    {
+        const captureedge_t* edge = &source->edges[buc];
+
+        if(edge->signal == CAP_RW)
+            rw = edge->level;
+        else if(edge->signal == signal && rw)
+            cycles[count++] = edge->cycle;
+    }
+
+    *edgeCycles = cycles;
+    return count;
+}
+
+//Finds the next burst of edges from first, the short ones (the start of a gap, glitches) are skipped
+//Returns the edges of the burst, 0 if there are no more
+static uint32_t next_burst(const uint64_t* cycles, uint32_t count, uint32_t* first)
+{
+    while(*first < count)
+    {
+        uint32_t end = *first + 1;
+
+        while(end < count && cycles[end] - cycles[end - 1] < BURST_GAP_CYCLES)
+            end++;
+
+        if(end - *first >= BURST_MIN_EDGES)
+            return end - *first;
+
+        *first = end;
+    }
+
+    return 0;
+}
+
+//Decodes a burst of differential Manchester edges, each edge is measured from the last cell boundary so the decoder
+//follows the clock of the sender. The first edge ends a zero (the line was steady during the gap), the record ends
+//at the first edge that is not at a cell boundary (the write machine has stopped and the line goes back to the gap)
+//Returns the bits, edges is set to the edges of the record
+static uint32_t decode_burst(const uint64_t* cycles, uint32_t count, uint8_t* bits, uint32_t* edges)
+{
+    uint32_t bitCount = 0;
+    uint32_t buc = 1;
+    uint64_t boundary = cycles[0];
+
+    bits[bitCount++] = 0;
+
+    for(; buc < count && bitCount < BURST_MAX_BITS; buc++)
+    {
+        uint64_t interval = cycles[buc] - boundary;
+
+        //A transition in the middle of the cell is a one, the cell ends at the next edge
+        if(interval < ULA_BIT_CYCLES * 3 / 4)
+        {
+            if(buc + 1 == count || cycles[buc + 1] - boundary >= ULA_BIT_CYCLES * 5 / 4)
+                break;
+
+            bits[bitCount++] = 1;
+            buc++;
+        }
+        else if(interval < ULA_BIT_CYCLES * 5 / 4)
+            bits[bitCount++] = 0;
+        else
+            break;
+
+        boundary = cycles[buc];
+    }
+
+    *edges = buc;
+    return bitCount;
+}
+
+//Sector of the first header sent by the drive in the capture (the first byte of track 2), -1 if there's none
+static int first_sector(void)
+{
+    static uint8_t bits[BURST_MAX_BITS];
+    uint64_t* cycles;
+    uint32_t count = read_edges(&capture, CAP_HEAD_2, &cycles);
+    uint32_t first = 0;
+    uint32_t edges;
+    int sector = -1;
+
+    for(; (edges = next_burst(cycles, count, &first)) != 0; first += edges)
+    {
+        uint32_t recordEdges;
+        uint32_t bitCount = decode_burst(&cycles[first], edges, bits, &recordEdges);
+
+        if(bitCount > HEADER_MAX_BITS)
+            continue;
+
+        //Preamble zeros and ones
+        uint32_t bit = 0;
+
+        while(bit < bitCount && !bits[bit])
+            bit++;
+
+        bit += PREAMBLE_ONE_BITS;
+
+        if(bit + 8 > bitCount)
+            continue;
+
+        sector = 0;
+
+        for(int buc = 0; buc < 8; buc++)
+            sector |= bits[bit + buc] << buc;
+
+        break;
+    }
+
+    free(cycles);
+    return sector;
+}
+
+//Compares the records sent by the firmware on a head with the ones of the capture
+static void diff_head(int signal)
+{
+    static uint8_t sentBits[BURST_MAX_BITS];
+    static uint8_t capturedBits[BURST_MAX_BITS];
+    int track = signal - CAP_HEAD_1 + 1;
+    uint64_t* sentCycles;
+    uint64_t* capturedCycles;
+    uint32_t sentCount = read_edges(&sent, signal, &sentCycles);
+    uint32_t capturedCount = read_edges(&capture, signal, &capturedCycles);
+    bool* matched = calloc(capturedCount / BURST_MIN_EDGES + 1, sizeof(bool));
+    uint32_t records = 0;
+    uint32_t identical = 0;
+    uint32_t missing = 0;
+    uint32_t extra = 0;
+    uint64_t maxOffset = 0;
+    uint32_t sentFirst = 0;
+    uint32_t sentEdges;
+
+    for(; (sentEdges = next_burst(sentCycles, sentCount, &sentFirst)) != 0; sentFirst += sentEdges)
+    {
+        uint32_t capturedFirst = 0;
+        uint32_t capturedEdges;
+        uint32_t burst = 0;
+        double at = (double)sentCycles[sentFirst] / HOST_SYS_CLOCK_HZ;
+
+        records++;
+
+        for(; (capturedEdges = next_burst(capturedCycles, capturedCount, &capturedFirst)) != 0; capturedFirst += capturedEdges, burst++)
+        {
+            uint64_t start = capturedCycles[capturedFirst];
+
+            if(!matched[burst] && start + BURST_MATCH_CYCLES > sentCycles[sentFirst] && start < sentCycles[sentFirst] + BURST_MATCH_CYCLES)
+                break;
+        }
+
+        if(!capturedEdges)
+        {
+            printf("Track %d record at %.6f s: not in the capture\n", track, at);
+            extra++;
+            continue;
+        }
+
+        matched[burst] = true;
+
+        uint32_t recordEdges;
+        uint32_t capturedRecordEdges;
+        uint32_t sentBitCount = decode_burst(&sentCycles[sentFirst], sentEdges, sentBits, &recordEdges);
+        uint32_t capturedBitCount = decode_burst(&capturedCycles[capturedFirst], capturedEdges, capturedBits, &capturedRecordEdges);
+        uint32_t bit = 0;
+
+        while(bit < sentBitCount && bit < capturedBitCount && sentBits[bit] == capturedBits[bit])
+            bit++;
+
+        if(bit < sentBitCount || bit < capturedBitCount)
+        {
+            printf("Track %d record at %.6f s: differs at bit %u (firmware %u bits, capture %u bits)\n", track, at, bit,
+                sentBitCount, capturedBitCount);
+            continue;
+        }
+
+        //Same bits, so the same edges
+        for(uint32_t buc = 0; buc < recordEdges; buc++)
+        {
+            uint64_t a = sentCycles[sentFirst + buc];
+            uint64_t b = capturedCycles[capturedFirst + buc];
+            uint64_t offset = a > b ? a - b : b - a;
+
+            if(offset > maxOffset)
+                maxOffset = offset;
+        }
+
+        identical++;
+    }
+
+    //Records of the capture not sent by the firmware
+    uint32_t capturedFirst = 0;
+    uint32_t capturedEdges;
+
+    for(uint32_t burst = 0; (capturedEdges = next_burst(capturedCycles, capturedCount, &capturedFirst)) != 0; capturedFirst += capturedEdges, burst++)
+    {
+        if(!matched[burst])
+        {
+            printf("Track %d record at %.6f s: not sent by the firmware\n", track, (double)capturedCycles[capturedFirst] / HOST_SYS_CLOCK_HZ);
+            missing++;
+        }
+    }
+
+    printf("Track %d: %u records sent, %u identical, %u differ, %u not in the capture, %u not sent, edges up to %.3f us apart\n",
+        track, records, identical, records - identical - extra, extra, missing, (double)maxOffset / HOST_CYCLES_PER_US);
+
+    free(sentCycles);
+    free(capturedCycles);
+    free(matched);
+
+    if(identical != records || missing)
+        failures++;
+}
+
+int main(int argc, char** argv)
+{
+    bool record = argc >= 4 && strcmp(argv[1], "record") == 0;
+    bool replay = argc >= 4 && strcmp(argv[1], "replay") == 0;
+    const char* columns[CAP_SIGNAL_COUNT];
+    uint32_t sampleRate = 0;
+
+    memcpy(columns, captureSignalNames, sizeof(columns));
+
+    for(int arg = 4; replay && arg < argc; arg++)
+    {
+        char* value = strchr(argv[arg], '=');
+
+        if(strcmp(argv[arg], "--rate") == 0 && arg + 1 < argc)
+        {
+            sampleRate = strtoul(argv[++arg], NULL, 10);
+            continue;
+        }
+
+        for(int signal = 0; value && signal < CAP_SIGNAL_COUNT; signal++)
+        {
+            if(strncmp(argv[arg], captureSignalNames[signal], value - argv[arg]) == 0 && !captureSignalNames[signal][value - argv[arg]])
+                columns[signal] = value + 1;
+        }
+    }
+
+    if(!record && !replay)
+    {
+        printf("Usage: CaptureReplay replay capture.csv image.mdv [--rate HZ] [SIGNAL=column...]\n");
+        printf("       CaptureReplay record capture.csv image.mdv [corrupted.csv]\n");
+        return 1;
+    }
+
+    FILE* file = fopen(argv[3], "rb");
+    bool read = file && fread(mdvImage, 1, sizeof(mdvImage), file) == sizeof(mdvImage);
+
+    if(file)
+        fclose(file);
+
+    if(!read)
+    {
+        printf("Can't load %s\n", argv[3]);
+        return 1;
+    }
+
+    if(replay && !capture_load_csv(&capture, argv[2], sampleRate, columns))
+    {
+        printf("Can't load the capture %s\n", argv[2]);
+        return 1;
+    }
+
+    host_board_reset();
+    host_pio_set_min_clkdiv(MIN_CLKDIV);
+    ula_seed(1);
+
+    //The user interface is connected, the QL doesn't select the drive yet
+    host_gpio_drive(PIN_UI_DETECT, false);
+    host_gpio_drive(MD_SER_CLK, false);
+    host_gpio_drive(MD_SER_DATA_IN, false);
+    ql_set_lines(MDL_READ);
+
+    init_MD_control();
+    init_user_interface();
+    init_screen();
+
+    host_gpio_connect(MD_READ_HEAD_1, MD_WRITE_HEAD_1);
+    host_gpio_connect(MD_READ_HEAD_2, MD_WRITE_HEAD_2);
+
+    if(record)
+    {
+        rotate_image(RECORD_ROTATION);
+
+        if(!load_image() || !record_session() || !capture_save_csv(&capture, argv[2]))
+        {
+            printf("Session not recorded\n");
+            return 1;
+        }
+
+        if(argc > 4 && (!corrupt_capture() || !capture_save_csv(&capture, argv[4])))
+        {
+            printf("Corrupted capture not saved\n");
+            return 1;
+        }
+
+        return 0;
+    }
+
+    for(int signal = 0; signal < CAP_SIGNAL_COUNT; signal++)
+    {
+        if(!capture.present[signal])
+            printf("%s: not in the capture\n", columns[signal]);
+    }
+
+    if(!capture.present[CAP_SER_DATA] || !capture.present[CAP_SER_CLK] || !capture.present[CAP_RW] || !capture.present[CAP_ERASE])
+        return 1;
+
+    int sector = first_sector();
+    int first = 0;
+
+    while(first < CARTRIDGE_SECTOR_COUNT && mdvImage[first * MDV_SECTOR_SIZE + MDV_PREAMBLE_SIZE + 1] != sector)
+        first++;
+
+    if(first == CARTRIDGE_SECTOR_COUNT)
+    {
+        printf("The first sector of the capture (%d) is not in the image, the replay starts at the first one\n", sector);
+        first = 0;
+    }
+    else
+        printf("First sector of the capture: %d, position %d of the image\n", sector, first);
+
+    rotate_image(first);
+    start_lines();
+
+    if(!load_image())
+    {
+        printf("Image not loaded by the user interface\n");
+        return 1;
+    }
+
+    replay_capture();
+
+    for(int signal = CAP_HEAD_1; signal <= CAP_HEAD_2; signal++)
+    {
+        if(capture.present[signal])
+            diff_head(signal);
+    }
+
+    if(host_gpio_contentions())
+    {
+        printf("%u pin contentions\n", host_gpio_contentions());
+        failures++;
+    }
+
+    if(failures)
+    {
+        printf("CaptureReplay: %d failures\n", failures);
+        return 1;
+    }
+
+    printf("CaptureReplay: identical\n");
+    return 0;
+}
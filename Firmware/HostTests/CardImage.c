@@ -0,0 +1,111 @@
+#include <string.h>
+#include "CardImage.h"
+#include "SdCard.h"
+
+/*
+
+Card images for the tests of the SD card layer
+
+The card is formatted as FAT32 with an empty root directory, the files are stored in consecutive clusters with a
+short name (8.3 without the dot, as stored in the directory entry) and can be read back straight from the card to
+check what the firmware wrote.
+
+*/
+
+static void store_word(uint8_t* buffer, uint16_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+}
+
+static void store_dword(uint8_t* buffer, uint32_t value)
+{
+    store_word(buffer, value);
+    store_word(buffer + 2, value >> 16);
+}
+
+//Sets a FAT entry
+static void set_fat_entry(uint32_t cluster, uint32_t value)
+{
+    uint8_t sector[512];
+    uint32_t fatSector = CARD_RESERVED_SECTORS + cluster * 4 / 512;
+
+    sd_card_read(fatSector, sector);
+    store_dword(&sector[cluster * 4 % 512], value);
+    sd_card_write(fatSector, sector);
+}
+
+//Stores a file in consecutive clusters starting at firstCluster and adds it to the root directory
+//Returns the first cluster after the file
+uint32_t card_store_file(uint8_t entry, const char* name, uint32_t firstCluster, const uint8_t* data, uint32_t size)
+{
+    uint8_t sector[512];
+    uint32_t clusters = (size + CARD_CLUSTER_SIZE - 1) / CARD_CLUSTER_SIZE;
+
+    for(uint32_t buc = 0; buc < clusters; buc++)
+        set_fat_entry(firstCluster + buc, buc == clusters - 1 ? 0x0FFFFFFF : firstCluster + buc + 1);
+
+    for(uint32_t pos = 0; pos < size; pos += 512)
+    {
+        memset(sector, 0, sizeof(sector));
+        memcpy(sector, &data[pos], size - pos < 512 ? size - pos : 512);
+        sd_card_write(CARD_CLUSTER_SECTOR(firstCluster) + pos / 512, sector);
+    }
+
+    sd_card_read(CARD_CLUSTER_SECTOR(2), sector);
+    uint8_t* dirEntry = &sector[entry * 32];
+    memcpy(dirEntry, name, 11);
+    dirEntry[11] = 0x20;
+    store_word(&dirEntry[20], firstCluster >> 16);
+    store_word(&dirEntry[26], firstCluster);
+    store_dword(&dirEntry[28], size);
+    sd_card_write(CARD_CLUSTER_SECTOR(2), sector);
+
+    return firstCluster + clusters;
+}
+
+//Reads a file stored by card_store_file
+void card_read_file(uint32_t firstCluster, uint8_t* data, uint32_t size)
+{
+    uint8_t sector[512];
+
+    for(uint32_t pos = 0; pos < size; pos += 512)
+    {
+        sd_card_read(CARD_CLUSTER_SECTOR(firstCluster) + pos / 512, sector);
+        memcpy(&data[pos], sector, size - pos < 512 ? size - pos : 512);
+    }
+}
+
+//Formats the card, the root directory is empty
+bool card_create(void)
+{
+    uint8_t sector[512] = { 0 };
+
+    if(!sd_card_create(CARD_SECTORS))
+        return false;
+
+    //Boot sector
+    memcpy(sector, "\xEB\x58\x90MSWIN4.1", 11);
+    store_word(&sector[11], 512);
+    sector[13] = CARD_CLUSTER_SECTORS;
+    store_word(&sector[14], CARD_RESERVED_SECTORS);
+    sector[16] = 1;
+    sector[21] = 0xF8;
+    store_word(&sector[24], 63);
+    store_word(&sector[26], 255);
+    store_dword(&sector[32], CARD_SECTORS);
+    store_dword(&sector[36], CARD_FAT_SECTORS);
+    store_dword(&sector[44], 2);
+    store_word(&sector[48], 1);
+    store_word(&sector[50], 6);
+    memcpy(&sector[82], "FAT32   ", 8);
+    sector[510] = 0x55;
+    sector[511] = 0xAA;
+    sd_card_write(0, sector);
+
+    set_fat_entry(0, 0x0FFFFFF8);
+    set_fat_entry(1, 0x0FFFFFFF);
+    set_fat_entry(2, 0x0FFFFFFF);
+
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef __HOST_CARDIMAGE__
+#define __HOST_CARDIMAGE__
+
+#include "pico/stdlib.h"
+
+//FAT32 card image on the SD card model, with 32 KB clusters and the files stored contiguously in the root directory
+
+#define CARD_CLUSTER_SECTORS 64
+#define CARD_RESERVED_SECTORS 32
+#define CARD_CLUSTERS 70000
+#define CARD_FAT_SECTORS ((CARD_CLUSTERS + 2) * 4 / 512 + 1)
+#define CARD_SECTORS (CARD_RESERVED_SECTORS + CARD_FAT_SECTORS + CARD_CLUSTERS * CARD_CLUSTER_SECTORS)
+#define CARD_CLUSTER_SECTOR(CLUSTER) (CARD_RESERVED_SECTORS + CARD_FAT_SECTORS + ((CLUSTER) - 2) * CARD_CLUSTER_SECTORS)
+#define CARD_CLUSTER_SIZE (CARD_CLUSTER_SECTORS * 512)
+
+//The root directory is the cluster 2, the files start at the cluster 3
+#define CARD_FIRST_FILE_CLUSTER 3
+
+bool card_create(void);
+uint32_t card_store_file(uint8_t entry, const char* name, uint32_t firstCluster, const uint8_t* data, uint32_t size);
+void card_read_file(uint32_t firstCluster, uint8_t* data, uint32_t size);
+
+#endif
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "SharedBuffers.h"
+#include "UserInterface.h"
+#include "pff/pff.h"
+#include "SdCard.h"
+#include "CardImage.h"
+
+/*
+
+Load and save benchmark of the SD card layer
+
+Petit FatFs and diskio.c run unchanged on the SD card model of SdCard.c, which counts the SPI calls,
+the DMA exchanges and the bytes moved by each one. The benchmark is built with PF_USE_DMA set to 1 and
+to 0 (the per-byte path of the original firmware), both executables run the same scenarios:
+
+ - MPD load with a single pf_read (the original load) and with pf_read_stream in transfer chunks
+ - MDV load sector by sector (load_mdv_sector)
+ - Whole MPD save with pf_write and with pf_write_stream
+
+The card model has no access time, so the load time is estimated from the counted traffic at CLK_FAST
+plus a fixed cost per blocking SPI call and per DMA exchange. The card latency of the single block
+commands would make the difference bigger on a real card.
+
+*/
+
+//Estimated costs on the RP2040, a byte at CLK_FAST and the CPU time around each exchange
+#define SPI_BYTE_US (8.0 * 1000000.0 / CLK_FAST)
+#define SPI_CALL_US 0.3     //Call, FIFO polling and the gap between frames of spi_write_read_blocking
+#define DMA_SETUP_US 2.0    //Configuring and starting the two channels
+
+uint8_t cartridge_image[CART_SIZE];
+
+uint8_t mpdData[CART_MPD_SIZE];
+uint8_t mdvData[CART_MDV_SIZE];
+
+int failures = 0;
+
+//Formats the card and stores the test images
+static bool create_card()
+{
+    if(!card_create())
+        return false;
+
+    for(uint32_t buc = 0; buc < CART_MPD_SIZE; buc++)
+        mpdData[buc] = rand();
+
+    for(uint32_t buc = 0; buc < CART_MDV_SIZE; buc++)
+        mdvData[buc] = rand();
+
+    uint32_t nextCluster = card_store_file(0, "CART    MPD", CARD_FIRST_FILE_CLUSTER, mpdData, CART_MPD_SIZE);
+    card_store_file(1, "CART    MDV", nextCluster + 1, mdvData, CART_MDV_SIZE);
+
+    return true;
+}
+
+//Copy of load_mdv_sector
+bool load_mdv_sector(uint8_t sector)
+{
+    UINT readSize = 0;
+
+    int bufferPos = sector * CARTRIDGE_SECTOR_SIZE;
+    int filePos = sector * MDV_SECTOR_SIZE + MDV_PREAMBLE_SIZE; //skip preamble
+
+    if(pf_lseek(filePos))
+        return false;
+
+    if(pf_read(&cartridge_image[bufferPos], MDV_HEADER_SIZE, &readSize))
+        return false;
+
+    if(readSize != MDV_HEADER_SIZE)
+        return false;
+
+    filePos += MDV_HEADER_SIZE + MDV_PREAMBLE_SIZE;
+    bufferPos += MPD_HEADER_SIZE;
+
+    if(pf_lseek(filePos))
+        return false;
+
+    if(pf_read(&cartridge_image[bufferPos], MPD_DATA_SIZE, &readSize))
+        return false;
+
+    if(readSize != MPD_DATA_SIZE)
+        return false;
+
+    return true;
+}
+
+bool load_mpd_read()
+{
+    UINT readSize;
+    return !pf_read(cartridge_image, CART_MPD_SIZE, &readSize) && readSize == CART_MPD_SIZE;
+}
+
+bool load_mpd_stream()
+{
+    UINT readSize;
+
+    for(uint32_t pos = 0; pos < CART_MPD_SIZE; pos += TRANSFER_CHUNK_SIZE)
+    {
+        uint32_t length = CART_MPD_SIZE - pos < TRANSFER_CHUNK_SIZE ? CART_MPD_SIZE - pos : TRANSFER_CHUNK_SIZE;
+
+        if(pf_read_stream(&cartridge_image[pos], length, &readSize) || readSize != length)
+            return false;
+    }
+
+    return true;
+}
+
+bool load_mdv()
+{
+    for(int sector = 0; sector < CARTRIDGE_SECTOR_COUNT; sector++)
+    {
+        if(!load_mdv_sector(sector))
+            return false;
+    }
+
+    return true;
+}
+
+bool save_mpd_write()
+{
+    UINT writeSize;
+    return !pf_write(cartridge_image, CART_MPD_SIZE, &writeSize) && writeSize == CART_MPD_SIZE && !pf_write(0, 0, &writeSize);
+}
+
+bool save_mpd_stream()
+{
+    UINT writeSize;
+
+    for(uint32_t pos = 0; pos < CART_MPD_SIZE; pos += TRANSFER_CHUNK_SIZE)
+    {
+        uint32_t length = CART_MPD_SIZE - pos < TRANSFER_CHUNK_SIZE ? CART_MPD_SIZE - pos : TRANSFER_CHUNK_SIZE;
+
+        if(pf_write_stream(&cartridge_image[pos], length, &writeSize) || writeSize != length)
+            return false;
+    }
+
+    return !pf_write(0, 0, &writeSize);
+}
+
+//Checks that the MDV sectors were loaded to their place in the cartridge image
+bool check_mdv()
+{
+    for(int sector = 0; sector < CARTRIDGE_SECTOR_COUNT; sector++)
+    {
+        const uint8_t* mdvSector = &mdvData[sector * MDV_SECTOR_SIZE];
+        const uint8_t* cartridgeSector = &cartridge_image[sector * CARTRIDGE_SECTOR_SIZE];
+
+        if(memcmp(cartridgeSector, &mdvSector[MDV_PREAMBLE_SIZE], MDV_HEADER_SIZE) ||
+            memcmp(&cartridgeSector[MPD_HEADER_SIZE], &mdvSector[MDV_PREAMBLE_SIZE * 2 + MDV_HEADER_SIZE], MPD_DATA_SIZE))
+            return false;
+    }
+
+    return true;
+}
+
+//Saves and loads back the MPD file
+bool check_save()
+{
+    memcpy(mpdData, cartridge_image, CART_MPD_SIZE);
+    memset(cartridge_image, 0, CART_MPD_SIZE);
+
+    return !pf_lseek(0) && load_mpd_stream() && !memcmp(cartridge_image, mpdData, CART_MPD_SIZE);
+}
+
+//Runs a scenario, checks its result and prints its traffic and estimated time
+void run_scenario(const char* name, const char* path, bool (*scenario)(), bool (*check)())
+{
+    if(pf_open(path))
+    {
+        failures++;
+        printf("Can't open %s\n", path);
+        return;
+    }
+
+    //A save writes a new pattern
+    for(uint32_t buc = 0; buc < CART_MPD_SIZE; buc++)
+        cartridge_image[buc] = rand();
+
+    sd_card_reset_traffic();
+    bool done = scenario();
+    sdtraffic_t traffic = sdTraffic;
+
+    if(!done || !check())
+    {
+        failures++;
+        printf("%s: failed\n", name);
+        return;
+    }
+
+    double estimatedUs = (traffic.spiBytes + traffic.dmaBytes) * SPI_BYTE_US + traffic.spiCalls * SPI_CALL_US + 
+        traffic.dmaTransfers * DMA_SETUP_US;
+
+    printf("%-20s %6u %8u %8u %6u %8u %6u %6u %8.1f\n", name, traffic.commands, traffic.spiCalls, traffic.spiBytes,
+        traffic.dmaTransfers, traffic.dmaBytes, traffic.blocksRead, traffic.blocksWritten, estimatedUs / 1000);
+}
+
+bool check_mpd()
+{
+    return !memcmp(cartridge_image, mpdData, CART_MPD_SIZE);
+}
+
+int main()
+{
+    FATFS fatfs;
+
+    srand(1);
+
+    if(!create_card() || pf_mount(&fatfs))
+    {
+        printf("Can't create the card\n");
+        return 1;
+    }
+
+    printf("DiskLoadBench, PF_USE_DMA %d, estimated at %d Hz + %.1f us per SPI call + %.1f us per DMA exchange\n",
+        PF_USE_DMA, CLK_FAST, SPI_CALL_US, DMA_SETUP_US);
+    printf("%-20s %6s %8s %8s %6s %8s %6s %6s %8s\n", "Scenario", "Cmds", "SpiCalls", "SpiBytes", "Dmas", "DmaBytes",
+        "BlkRd", "BlkWr", "Est ms");
+
+    run_scenario("MPD load pf_read", "CART.MPD", load_mpd_read, check_mpd);
+    run_scenario("MPD load stream", "CART.MPD", load_mpd_stream, check_mpd);
+    run_scenario("MDV load sectors", "CART.MDV", load_mdv, check_mdv);
+    run_scenario("MPD save pf_write", "CART.MPD", save_mpd_write, check_save);
+    run_scenario("MPD save stream", "CART.MPD", save_mpd_stream, check_save);
+
+    if(failures)
+    {
+        printf("DiskLoadBench: %d scenarios failed\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <pthread.h>
+#include "EventMachine.h"
+
+/*
+
+Stress test of the event machines
+
+A producer thread pushes numbered events (blocking pushes and then try pushes) while the consumer thread
+processes them. Every event carries a payload derived from its number so a slot read before it was
+completely written (or after it was reused) is detected. The consumer must see the events in order,
+without duplicates, and the try pushes must be either received or counted as dropped.
+
+Both queue types are tested, the time per event is reported for comparison. The wake up latency is
+checked too, it must be timed from the first event pushed after the consumer marked its sleep.
+
+*/
+
+#define BLOCKING_EVENTS 1000000
+#define TRY_EVENTS 1000000
+#define QUEUE_DEPTH 8
+
+typedef struct testevent
+{
+    uint32_t number;
+    uint32_t payload[3];
+
+} testevent_t;
+
+evtmachine_t machine;
+
+volatile uint32_t expected;     //Number of the next event, events can be skipped only if they were dropped
+volatile uint32_t received;
+volatile uint32_t errors;
+volatile bool producerDone;
+
+static uint32_t payload_of(uint32_t number, int word)
+{
+    return (number ^ 0x5A5A5A5A) * (word + 3);
+}
+
+void test_handler(void* event)
+{
+    testevent_t* evt = (testevent_t*)event;
+
+    if(evt->number < expected)
+        errors++;
+
+    for(int buc = 0; buc < 3; buc++)
+    {
+        if(evt->payload[buc] != payload_of(evt->number, buc))
+            errors++;
+    }
+
+    expected = evt->number + 1;
+    received++;
+}
+
+void* producer(void* arg)
+{
+    (void)arg;
+    testevent_t event;
+
+    for(uint32_t number = 0; number < BLOCKING_EVENTS + TRY_EVENTS; number++)
+    {
+        event.number = number;
+
+        for(int buc = 0; buc < 3; buc++)
+            event.payload[buc] = payload_of(number, buc);
+
+        if(number < BLOCKING_EVENTS)
+            event_push(&machine, &event);
+        else
+            event_try_push(&machine, &event);
+    }
+
+    producerDone = true;
+    return NULL;
+}
+
+void* consumer(void* arg)
+{
+    (void)arg;
+    testevent_t event;
+
+    while(!producerDone || event_pending(&machine))
+    {
+        if(event_pending(&machine))
+            event_process_queue(&machine, &event, QUEUE_DEPTH);
+        else
+            tight_loop_contents();
+    }
+
+    return NULL;
+}
+
+//Runs the producer and the consumer on a machine, returns the number of failures
+int run_stress(const char* name, bool spsc)
+{
+    if(spsc)
+        event_machine_init_spsc(&machine, test_handler, sizeof(testevent_t), QUEUE_DEPTH);
+    else
+        event_machine_init(&machine, test_handler, sizeof(testevent_t), QUEUE_DEPTH);
+
+    expected = 0;
+    received = 0;
+    errors = 0;
+    producerDone = false;
+
+    uint64_t start = time_us_64();
+
+    pthread_t producerThread, consumerThread;
+    pthread_create(&consumerThread, NULL, consumer, NULL);
+    pthread_create(&producerThread, NULL, producer, NULL);
+    pthread_join(producerThread, NULL);
+    pthread_join(consumerThread, NULL);
+
+    uint64_t elapsed = time_us_64() - start;
+    int failures = errors;
+
+    //Every try push is received or dropped, the blocking ones are always received
+    if(received + machine.dropped != BLOCKING_EVENTS + TRY_EVENTS || received < BLOCKING_EVENTS)
+        failures++;
+
+    printf("%s: %u received, %u dropped, %u errors, high water %u, %.0f ns/event\n", name, received, machine.dropped,
+        errors, machine.highWater, elapsed * 1000.0 / (BLOCKING_EVENTS + TRY_EVENTS));
+
+    event_free(&machine);
+    return failures;
+}
+
+//Checks the wake up latency of a machine, returns the number of failures
+int check_wake_latency(const char* name, bool spsc)
+{
+    testevent_t event = { 0 };
+    int failures = 0;
+
+    if(spsc)
+        event_machine_init_spsc(&machine, test_handler, sizeof(testevent_t), QUEUE_DEPTH);
+    else
+        event_machine_init(&machine, test_handler, sizeof(testevent_t), QUEUE_DEPTH);
+
+    //Nothing pushed since the mark
+    event_mark_sleep(&machine);
+    sleep_ms(2);
+    failures += event_wake_latency(&machine) != 0;
+
+    //Timed from the first push, the second one doesn't move it
+    event_push(&machine, &event);
+    sleep_ms(5);
+    event_try_push(&machine, &event);
+    uint32_t latency = event_wake_latency(&machine);
+    failures += latency < 5000;
+
+    //A new mark starts again
+    event_mark_sleep(&machine);
+    failures += event_wake_latency(&machine) != 0;
+
+    printf("%s: wake latency %u us after a 5 ms sleep, %d failures\n", name, latency, failures);
+
+    event_free(&machine);
+    return failures;
+}
+
+int main()
+{
+    int failures = run_stress("EVQ_SPSC", true);
+    failures += run_stress("EVQ_LOCKING", false);
+    failures += check_wake_latency("EVQ_SPSC", true);
+    failures += check_wake_latency("EVQ_LOCKING", false);
+
+    if(failures)
+    {
+        printf("EventMachineTests: %d failures\n", failures);
+        return 1;
+    }
+
+    printf("EventMachineTests: passed\n");
+    return 0;
+}
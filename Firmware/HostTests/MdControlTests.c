@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hardware/gpio.h"
+#include "HostBoard.h"
+#include "UlaModel.h"
+#include "QlModel.h"
+#include "CardImage.h"
+#include "SdCard.h"
+#include "MicroDriveControl.h"
+#include "UserInterface.h"
+#include "SharedBuffers.h"
+#include "pff/pff.h"
+
+/*
+
+Tests of the MD control and the user interface cores on the simulated board
+
+MicroDriveControl.c and UserInterface.c run unchanged, both cores are run in turns by the QL model (QlModel.c).
+The test drives the lines as the QL and the ULA do:
+
+- The cartridge is loaded from an image in the card model, two of its sectors have wrong checksums.
+- The QL selects the drive and reads a header (write gap, write), then writes the sector after it (read gap,
+  read) and reads the next header, so the whole mdLineTransitions/mdTransitionActions cycle is walked. The header
+  sent by the write machines is decoded back and the record written by the ULA must be stored in the cartridge
+  with its checksums verified, then the same with a corrupt record.
+- Two gap changes queued before the MD core runs must be coalesced.
+- The QL deselects the drive and the cartridge is saved, only the runs of dirty sectors (the written ones and the
+  ones fixed by the validation) must be written and the file must match the expected cartridge.
+
+The dividers of the state machines are clamped so the status machine doesn't tick every cycle, the test would be
+too slow. The read machines run at that divider anyway and the status changes are seen a few cycles later.
+
+*/
+
+#define MIN_CLKDIV 50
+
+//Sectors with wrong checksums in the card image, fixed by the validation
+#define BAD_DATA_SECTOR 3
+#define BAD_EXTRA_SECTOR 100
+
+#define QL_CHECKSUM(SUM) ((uint16_t)((SUM) + 0x0F0F))
+
+//State of the firmware
+extern mdstatus_t mdStatus;
+extern mdactivestatus_t activeStatus;
+extern uint8_t currentBufferSet;
+extern USER_INTERFACE_STATE uiState;
+extern CARTRIDGE_FORMAT cfInserted;
+extern bool mdInUse;
+extern char currentPath[PATH_BUFFER_SIZE];
+extern FATFS fatfs;
+extern FILINFO fno;
+extern sectorcheck_t sectorCheck;
+
+bool init_screen();
+
+static uint8_t expected[CART_SIZE];
+static uint8_t fileImage[CART_SIZE];
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    printf("%s: %s\n", what, ok ? "ok" : "FAILED");
+
+    if(!ok)
+        failures++;
+}
+
+//Cartridge
+
+static uint16_t sum_bytes(const uint8_t* data, uint32_t count)
+{
+    uint16_t sum = 0;
+
+    for(uint32_t buc = 0; buc < count; buc++)
+        sum += data[buc];
+
+    return sum;
+}
+
+//A record with random data and correct checksums
+static void make_record(SECTOR_RECORD_t* record, uint8_t file, uint8_t block)
+{
+    record->HeaderData[0] = file;
+    record->HeaderData[1] = block;
+    record->HeaderChecksum = QL_CHECKSUM(file + block);
+
+    for(int buc = 0; buc < sizeof(record->FilePreamble); buc++)
+        record->FilePreamble[buc] = ula_random();
+
+    for(int buc = 0; buc < sizeof(record->Data); buc++)
+        record->Data[buc] = ula_random();
+
+    record->DataChecksum = QL_CHECKSUM(sum_bytes(record->Data, sizeof(record->Data)));
+
+    for(int buc = 0; buc < sizeof(record->ExtraBytes); buc++)
+        record->ExtraBytes[buc] = buc % 2 == 0 ? 0xAA : 0x55;
+
+    record->ExtraBytesChecksum = 0x3b19;
+}
+
+//A valid cartridge, the file has two sectors with wrong checksums
+static void make_cartridge(void)
+{
+    for(int sector = 0; sector < CARTRIDGE_SECTOR_COUNT; sector++)
+    {
+        SECTOR_t* image = (SECTOR_t*)&expected[CARTRIDGE_SECTOR_SIZE * sector];
+
+        image->Header.HeaderData[0] = 0xFF;
+        image->Header.HeaderData[1] = sector;
+        memcpy(&image->Header.HeaderData[2], "HOST TESTS", 10);
+        image->Header.HeaderData[12] = ula_random();
+        image->Header.HeaderData[13] = ula_random();
+        image->Header.Checksum = QL_CHECKSUM(sum_bytes(image->Header.HeaderData, sizeof(image->Header.HeaderData)));
+
+        make_record(&image->Record, sector / 16, sector % 16);
+    }
+
+    memcpy(fileImage, expected, CART_SIZE);
+    ((SECTOR_t*)&fileImage[CARTRIDGE_SECTOR_SIZE * BAD_DATA_SECTOR])->Record.DataChecksum++;
+    ((SECTOR_t*)&fileImage[CARTRIDGE_SECTOR_SIZE * BAD_EXTRA_SECTOR])->Record.ExtraBytes[7] = 0;
+}
+
+//ULA
+
+//Writes a record as the ULA does, the lines are released once it has been sent
+static void ula_write_record(const SECTOR_RECORD_t* record)
+{
+    uint64_t end = ula_send_record((const uint8_t*)record, SECTOR_TRACK_DATA_SIZE);
+
+    ql_run_cores_until(end + 3 * ULA_BIT_CYCLES);
+    host_gpio_release(MD_READ_HEAD_1);
+    host_gpio_release(MD_READ_HEAD_2);
+}
+
+//Decodes the header sent by the write machines and compares it with the one of the cartridge sector
+static bool check_sent_header(uint8_t sector)
+{
+    uint8_t header[CARTRIDGE_HEADER_SIZE];
+
+    return ula_receive_record(header, HEADER_TRACK_DATA_SIZE) &&
+        memcmp(header, &cartridge_image[CARTRIDGE_SECTOR_SIZE * sector], CARTRIDGE_HEADER_SIZE) == 0;
+}
+
+//Scenario
+
+static bool load_cartridge(void)
+{
+    if(!card_create())
+        return false;
+
+    card_store_file(0, "CART    MPD", CARD_FIRST_FILE_CLUSTER, fileImage, CART_SIZE);
+
+    if(pf_mount(&fatfs))
+        return false;
+
+    //The file has been selected in the browser
+    memset(currentPath, 0, PATH_BUFFER_SIZE);
+    strcpy(fno.fname, "CART.MPD");
+    fno.fsize = CART_SIZE;
+    cfInserted = MPD;
+    uiState = FILE_LOAD;
+
+    RUN_UNTIL(uiState == CARTRIDGE_READY, 1000000);
+    return uiState == CARTRIDGE_READY;
+}
+
+//The QL reads a header and writes the record of its sector, then the next header starts
+static void write_sector(uint8_t sector, const SECTOR_RECORD_t* record)
+{
+    char what[64];
+
+    //Write gap, the write gap alarm starts sending the header
+    RUN_UNTIL(activeStatus == MDA_WRITE_HEADER, QL_WRITE_GAP_US + 1000);
+    snprintf(what, sizeof(what), "Sector %u, write gap then header sent", sector);
+    check(activeStatus == MDA_WRITE_HEADER && currentBufferSet == sector % BUFFER_SET_COUNT, what);
+
+    RUN_UNTIL(activeStatus == MDA_WRITE_SECTOR_GAP, 5000);
+    snprintf(what, sizeof(what), "Sector %u, header decoded by the ULA", sector);
+    check(activeStatus == MDA_WRITE_SECTOR_GAP && check_sent_header(sector), what);
+
+    //Read gap and read, the ULA writes the record
+    ql_set_lines(MDL_WRITE_GAP);
+    RUN_UNTIL(activeStatus == MDA_READ_SECTOR_GAP, 1000);
+    snprintf(what, sizeof(what), "Sector %u, read gap", sector);
+    check(activeStatus == MDA_READ_SECTOR_GAP, what);
+
+    ql_set_lines(MDL_WRITE);
+    RUN_UNTIL(activeStatus == MDA_READ_SECTOR, 1000);
+    snprintf(what, sizeof(what), "Sector %u, read", sector);
+    check(activeStatus == MDA_READ_SECTOR, what);
+
+    ula_write_record(record);
+
+    //Back to read, the next header starts and the UI stores the set
+    ula_listen_write();
+    ql_set_lines(MDL_READ);
+    RUN_UNTIL(activeStatus == MDA_WRITE_HEADER_GAP && bufferSets[sector % BUFFER_SET_COUNT].ready, 1000);
+    snprintf(what, sizeof(what), "Sector %u, write gap of the next header", sector);
+    check(activeStatus == MDA_WRITE_HEADER_GAP && currentBufferSet == (sector + 1) % BUFFER_SET_COUNT, what);
+}
+
+static void run_transfers(void)
+{
+    SECTOR_RECORD_t record;
+    uint32_t coalesced;
+
+    //Select the drive, the status machine pushes the current lines (read) once it's enabled
+    ql_set_lines(MDL_READ);
+    ula_listen_write();
+    ql_shift_bit(true);
+    RUN_UNTIL(mdInUse && activeStatus == MDA_WRITE_HEADER_GAP, SHIFTER_SELECT_US + 1000);
+    check(mdStatus == MDS_SELECTED && mdInUse && activeStatus == MDA_WRITE_HEADER_GAP, "Selected, write gap");
+
+    //A good record for the sector 0
+    make_record(&record, 1, 0);
+    memcpy(&((SECTOR_t*)&expected[0])->Record, &record, CARTRIDGE_DATA_SIZE);
+    write_sector(0, &record);
+
+    SECTOR_t* stored = (SECTOR_t*)&cartridge_image[0];
+    check(memcmp(&stored->Record, &record, CARTRIDGE_DATA_SIZE) == 0 && sectorCheck.good == 1 && sectorCheck.bad == 0,
+        "Sector 0, record stored with good checksums");
+
+    //A corrupt one for the sector 1, it's stored as the QL wrote it and counted as bad
+    make_record(&record, 1, 1);
+    record.Data[10] ^= 0x40;
+    memcpy(&((SECTOR_t*)&expected[CARTRIDGE_SECTOR_SIZE])->Record, &record, CARTRIDGE_DATA_SIZE);
+    write_sector(1, &record);
+
+    stored = (SECTOR_t*)&cartridge_image[CARTRIDGE_SECTOR_SIZE];
+    check(memcmp(&stored->Record, &record, CARTRIDGE_DATA_SIZE) == 0 && sectorCheck.bad == 1 &&
+        sectorCheck.lastBadSector == 1 && sectorCheck.lastBadChecks == SECTOR_CHECK_DATA, "Sector 1, bad data checksum found");
+
+    //A read gap and a write gap queued before the MD core runs, the first one is discarded
+    coalesced = mdEventQueue.coalesced;
+    ql_set_lines(MDL_WRITE_GAP);
+    host_run_us(5);
+    ql_set_lines(MDL_READ);
+    host_run_us(5);
+    ql_run_cores_until(host_now() + 100 * HOST_CYCLES_PER_US);
+    check(mdEventQueue.coalesced == coalesced + 1 && activeStatus == MDA_WRITE_HEADER_GAP && currentBufferSet == 2,
+        "Gap changes coalesced");
+
+    //A change to write is never discarded, the read gap before it must start the read machines
+    coalesced = mdEventQueue.coalesced;
+    ql_set_lines(MDL_WRITE_GAP);
+    host_run_us(5);
+    ql_set_lines(MDL_WRITE);
+    host_run_us(5);
+    ql_set_lines(MDL_READ);
+    host_run_us(5);
+    ql_run_cores_until(host_now() + 100 * HOST_CYCLES_PER_US);
+    check(mdEventQueue.coalesced == coalesced && activeStatus == MDA_WRITE_SECTOR_GAP, "Change to write not coalesced");
+
+    //Deselect the drive
+    ql_shift_bit(false);
+    RUN_UNTIL(!mdInUse, 1000);
+    check(mdStatus == MDS_DESELECTED && !mdInUse && activeStatus == MDA_IDLE, "Deselected");
+}
+
+static void run_save(void)
+{
+    //Let the background validation finish
+    RUN_UNTIL(false, 10000);
+    sd_card_reset_traffic();
+
+    host_gpio_drive(PIN_BTN_SELECT, false);
+    RUN_UNTIL(uiState == SAVING, 100000);
+    host_gpio_release(PIN_BTN_SELECT);
+    RUN_UNTIL(uiState != SAVING, 1000000);
+
+    card_read_file(CARD_FIRST_FILE_CLUSTER, fileImage, CART_SIZE);
+
+    //Sectors 0 to 3 (written and fixed) in five SD blocks, the sector 100 (fixed) in two
+    printf("Save: %u blocks written\n", sdTraffic.blocksWritten);
+    check(uiState == DELAY && sdTraffic.blocksWritten == 7, "Only the dirty runs saved");
+    check(memcmp(cartridge_image, expected, CART_SIZE) == 0, "Cartridge validated");
+    check(memcmp(fileImage, expected, CART_SIZE) == 0, "Saved file matches the cartridge");
+}
+
+int main()
+{
+    host_board_reset();
+    host_pio_set_min_clkdiv(MIN_CLKDIV);
+    ula_seed(1);
+
+    //The user interface is connected, the QL doesn't select the drive yet
+    host_gpio_drive(PIN_UI_DETECT, false);
+    host_gpio_drive(MD_SER_CLK, false);
+    host_gpio_drive(MD_SER_DATA_IN, false);
+
+    init_MD_control();
+    init_user_interface();
+    init_screen();
+
+    host_gpio_connect(MD_READ_HEAD_1, MD_WRITE_HEAD_1);
+    host_gpio_connect(MD_READ_HEAD_2, MD_WRITE_HEAD_2);
+
+    make_cartridge();
+    check(load_cartridge(), "Cartridge loaded");
+
+    if(!failures)
+    {
+        run_transfers();
+        run_save();
+    }
+
+    check(host_gpio_contentions() == 0, "No pin contentions");
+
+    if(failures)
+    {
+        printf("MdControlTests: %d failures\n", failures);
+        return 1;
+    }
+
+    printf("MdControlTests: passed\n");
+    return 0;
+}
@@ -0,0 +1,660 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <ctype.h>
+
+/*
+
+Host PIO assembler
+
+Generates the same C header as pioasm from PIO_machines.pio so the host tests run the real programs and not a copy
+of them. Only the syntax used by the firmware is supported: .program, .side_set (opt and pindirs), .wrap_target,
+.wrap, .origin, public labels, the nine instructions with side set and delay, and the ';' and '//' comments.
+Any other directive or a malformed instruction stops the build with the line where it was found.
+
+*/
+
+#define MAX_PROGRAMS 8
+#define MAX_INSTRUCTIONS 32
+#define MAX_LABELS 32
+#define MAX_TOKENS 16
+#define MAX_LINE 256
+
+typedef struct
+{
+    char name[64];
+    int address;
+    bool isPublic;
+
+} label_t;
+
+typedef struct
+{
+    char name[64];
+    int origin;
+    int sideSetCount;
+    bool sideSetOptional;
+    bool sideSetPindirs;
+    int wrapTarget;
+    int wrap;
+    int length;
+    uint16_t instructions[MAX_INSTRUCTIONS];
+    label_t labels[MAX_LABELS];
+    int labelCount;
+
+    //Source lines of the instructions, they are encoded once all the labels are known
+    char source[MAX_INSTRUCTIONS][MAX_LINE];
+    int sourceLine[MAX_INSTRUCTIONS];
+
+} program_t;
+
+program_t programs[MAX_PROGRAMS];
+int programCount = 0;
+const char* sourceName;
+
+static void fail(int line, const char* message, const char* detail)
+{
+    fprintf(stderr, "%s:%d: %s%s%s\n", sourceName, line, message, detail ? ": " : "", detail ? detail : "");
+    exit(1);
+}
+
+//Splits a line in tokens, commas are separators and a delay "[n]" is always its own token
+static int tokenize(char* text, char* tokens[], int line)
+{
+    int count = 0;
+    char* pos = text;
+
+    while(*pos)
+    {
+        while(*pos && (isspace((unsigned char)*pos) || *pos == ','))
+            pos++;
+
+        if(!*pos)
+            break;
+
+        if(count == MAX_TOKENS)
+            fail(line, "too many tokens", NULL);
+
+        tokens[count++] = pos;
+
+        if(*pos == '[')
+        {
+            while(*pos && *pos != ']')
+                pos++;
+
+            if(*pos)
+                pos++;
+        }
+        else
+        {
+            while(*pos && !isspace((unsigned char)*pos) && *pos != ',' && *pos != '[')
+                pos++;
+        }
+
+        if(*pos == '[')
+        {
+            //Keep the bracket, it starts the next token
+            if(pos + strlen(pos) + 1 >= text + MAX_LINE)
+                fail(line, "line too long", NULL);
+
+            memmove(pos + 1, pos, strlen(pos) + 1);
+            *pos++ = 0;
+        }
+        else if(*pos)
+            *pos++ = 0;
+    }
+
+    return count;
+}
+
+static bool parse_number(const char* text, int* value)
+{
+    char* end;
+    long parsed;
+
+    if(text[0] == '0' && (text[1] == 'b' || text[1] == 'B'))
+        parsed = strtol(text + 2, &end, 2);
+    else
+        parsed = strtol(text, &end, 0);
+
+    if(end == text || *end)
+        return false;
+
+    *value = (int)parsed;
+    return true;
+}
+
+static int number(const char* text, int line)
+{
+    int value;
+
+    if(!parse_number(text, &value))
+        fail(line, "invalid number", text);
+
+    return value;
+}
+
+static int find_label(program_t* program, const char* name)
+{
+    for(int buc = 0; buc < program->labelCount; buc++)
+    {
+        if(!strcmp(program->labels[buc].name, name))
+            return program->labels[buc].address;
+    }
+
+    return -1;
+}
+
+//Jump target, a label or an absolute address
+static int target(program_t* program, const char* text, int line)
+{
+    int address = find_label(program, text);
+
+    if(address < 0 && !parse_number(text, &address))
+        fail(line, "unknown label", text);
+
+    if(address < 0 || address >= MAX_INSTRUCTIONS)
+        fail(line, "jump target out of range", text);
+
+    return address;
+}
+
+static int lookup(const char* text, const char* const names[], int count)
+{
+    for(int buc = 0; buc < count; buc++)
+    {
+        if(names[buc] && !strcmp(text, names[buc]))
+            return buc;
+    }
+
+    return -1;
+}
+
+static int operand(const char* text, const char* const names[], int count, int line)
+{
+    int value = lookup(text, names, count);
+
+    if(value < 0)
+        fail(line, "invalid operand", text);
+
+    return value;
+}
+
+static const char* const jmpConditions[] = { "", "!x", "x--", "!y", "y--", "x!=y", "pin", "!osre" };
+static const char* const waitSources[] = { "gpio", "pin", "irq" };
+static const char* const inSources[] = { "pins", "x", "y", "null", NULL, NULL, "isr", "osr" };
+static const char* const outDestinations[] = { "pins", "x", "y", "null", "pindirs", "pc", "isr", "exec" };
+static const char* const movDestinations[] = { "pins", "x", "y", NULL, "exec", "pc", "isr", "osr" };
+static const char* const movSources[] = { "pins", "x", "y", "null", NULL, "status", "isr", "osr" };
+static const char* const setDestinations[] = { "pins", "x", "y", NULL, "pindirs" };
+
+//IRQ index with the optional "rel" suffix
+static int irq_index(char* tokens[], int* used, int count, int line)
+{
+    int index = number(tokens[*used], line);
+    (*used)++;
+
+    if(index < 0 || index > 7)
+        fail(line, "invalid irq index", tokens[*used - 1]);
+
+    if(*used < count && !strcmp(tokens[*used], "rel"))
+    {
+        index |= 0x10;
+        (*used)++;
+    }
+
+    return index;
+}
+
+static uint16_t encode(program_t* program, char* text, int line)
+{
+    char* tokens[MAX_TOKENS];
+    int count = tokenize(text, tokens, line);
+    int delay = 0;
+    int sideSet = -1;
+    uint16_t instruction;
+    int used = 1;
+
+    //Delay and side set are at the end, in any order
+    while(count > 1)
+    {
+        if(tokens[count - 1][0] == '[')
+        {
+            char value[32];
+            size_t length = strlen(tokens[count - 1]);
+
+            if(length < 3 || length > sizeof(value) || tokens[count - 1][length - 1] != ']')
+                fail(line, "invalid delay", tokens[count - 1]);
+
+            memcpy(value, tokens[count - 1] + 1, length - 2);
+            value[length - 2] = 0;
+            delay = number(value, line);
+            count--;
+        }
+        else if(count > 2 && !strcmp(tokens[count - 2], "side"))
+        {
+            sideSet = number(tokens[count - 1], line);
+            count -= 2;
+        }
+        else
+            break;
+    }
+
+    const char* op = tokens[0];
+
+    if(!strcmp(op, "nop"))
+        instruction = 0xA042;   //mov y, y
+    else if(!strcmp(op, "jmp"))
+    {
+        int condition = 0;
+
+        if(count == 3)
+        {
+            condition = operand(tokens[1], jmpConditions, 8, line);
+            used = 2;
+        }
+        else if(count != 2)
+            fail(line, "invalid jmp", NULL);
+
+        instruction = 0x0000 | (condition << 5) | target(program, tokens[used], line);
+        used++;
+    }
+    else if(!strcmp(op, "wait"))
+    {
+        if(count < 4)
+            fail(line, "invalid wait", NULL);
+
+        int polarity = number(tokens[1], line);
+        int source = operand(tokens[2], waitSources, 3, line);
+        int index;
+        used = 3;
+
+        if(source == 2)
+            index = irq_index(tokens, &used, count, line);
+        else
+            index = number(tokens[used++], line);
+
+        if(polarity < 0 || polarity > 1 || index < 0 || index > 31)
+            fail(line, "invalid wait operands", NULL);
+
+        instruction = 0x2000 | (polarity << 7) | (source << 5) | index;
+    }
+    else if(!strcmp(op, "in") || !strcmp(op, "out"))
+    {
+        bool isIn = op[0] == 'i';
+
+        if(count < 3)
+            fail(line, "invalid in/out", NULL);
+
+        int place = isIn ? operand(tokens[1], inSources, 8, line) : operand(tokens[1], outDestinations, 8, line);
+        int bits = number(tokens[2], line);
+
+        if(bits < 1 || bits > 32)
+            fail(line, "invalid bit count", tokens[2]);
+
+        instruction = (isIn ? 0x4000 : 0x6000) | (place << 5) | (bits & 31);
+        used = 3;
+    }
+    else if(!strcmp(op, "push") || !strcmp(op, "pull"))
+    {
+        bool isPull = op[1] == 'u' && op[2] == 'l';
+        bool conditional = false;
+        bool block = true;
+
+        for(; used < count; used++)
+        {
+            if(!strcmp(tokens[used], isPull ? "ifempty" : "iffull"))
+                conditional = true;
+            else if(!strcmp(tokens[used], "block"))
+                block = true;
+            else if(!strcmp(tokens[used], "noblock"))
+                block = false;
+            else
+                break;
+        }
+
+        instruction = 0x8000 | (isPull << 7) | (conditional << 6) | (block << 5);
+    }
+    else if(!strcmp(op, "mov"))
+    {
+        if(count < 3)
+            fail(line, "invalid mov", NULL);
+
+        int destination = operand(tokens[1], movDestinations, 8, line);
+        const char* source = tokens[2];
+        int operation = 0;
+
+        if(source[0] == '!' || source[0] == '~')
+        {
+            operation = 1;
+            source++;
+        }
+        else if(source[0] == ':' && source[1] == ':')
+        {
+            operation = 2;
+            source += 2;
+        }
+
+        //The operator can be written apart from the source
+        if(!*source)
+        {
+            if(count < 4)
+                fail(line, "invalid mov", NULL);
+
+            source = tokens[3];
+            used = 4;
+        }
+        else
+            used = 3;
+
+        instruction = 0xA000 | (destination << 5) | (operation << 3) | operand(source, movSources, 8, line);
+    }
+    else if(!strcmp(op, "irq"))
+    {
+        int mode = 0;
+
+        if(count > 1 && (!strcmp(tokens[1], "set") || !strcmp(tokens[1], "nowait")))
+            used = 2;
+        else if(count > 1 && !strcmp(tokens[1], "wait"))
+        {
+            mode = 1;
+            used = 2;
+        }
+        else if(count > 1 && !strcmp(tokens[1], "clear"))
+        {
+            mode = 2;
+            used = 2;
+        }
+
+        if(used >= count)
+            fail(line, "invalid irq", NULL);
+
+        instruction = 0xC000 | (mode << 5) | irq_index(tokens, &used, count, line);
+    }
+    else if(!strcmp(op, "set"))
+    {
+        if(count < 3)
+            fail(line, "invalid set", NULL);
+
+        int value = number(tokens[2], line);
+
+        if(value < 0 || value > 31)
+            fail(line, "invalid set value", tokens[2]);
+
+        instruction = 0xE000 | (operand(tokens[1], setDestinations, 5, line) << 5) | value;
+        used = 3;
+    }
+    else
+        fail(line, "unknown instruction", op);
+
+    if(used != count)
+        fail(line, "unexpected operand", tokens[used]);
+
+    //Delay and side set share the five bits, the optional side set takes one more bit for the enable
+    int sideBits = program->sideSetCount + (program->sideSetOptional ? 1 : 0);
+    int maxDelay = (1 << (5 - sideBits)) - 1;
+
+    if(delay < 0 || delay > maxDelay)
+        fail(line, "delay out of range", NULL);
+
+    if(sideSet >= 0)
+    {
+        if(!program->sideSetCount)
+            fail(line, "side set without .side_set", NULL);
+
+        if(sideSet >= (1 << program->sideSetCount))
+            fail(line, "side set value out of range", NULL);
+
+        if(program->sideSetOptional)
+            sideSet |= 1 << program->sideSetCount;
+
+        instruction |= sideSet << (13 - sideBits);
+    }
+    else if(program->sideSetCount && !program->sideSetOptional)
+        fail(line, "side set required", NULL);
+
+    return instruction | (delay << 8);
+}
+
+//Removes the comments and the surrounding blanks
+static char* clean_line(char* text)
+{
+    char* comment = strchr(text, ';');
+
+    if(comment)
+        *comment = 0;
+
+    comment = strstr(text, "//");
+
+    if(comment)
+        *comment = 0;
+
+    while(isspace((unsigned char)*text))
+        text++;
+
+    size_t length = strlen(text);
+
+    while(length && isspace((unsigned char)text[length - 1]))
+        text[--length] = 0;
+
+    return text;
+}
+
+static void parse(FILE* input)
+{
+    char buffer[MAX_LINE];
+    int line = 0;
+    program_t* program = NULL;
+
+    while(fgets(buffer, sizeof(buffer), input))
+    {
+        line++;
+        char* text = clean_line(buffer);
+
+        if(!*text)
+            continue;
+
+        if(text[0] == '.')
+        {
+            char* tokens[MAX_TOKENS];
+            int count = tokenize(text, tokens, line);
+
+            if(!strcmp(tokens[0], ".program"))
+            {
+                if(count != 2 || programCount == MAX_PROGRAMS)
+                    fail(line, "invalid .program", NULL);
+
+                program = &programs[programCount++];
+                memset(program, 0, sizeof(*program));
+                snprintf(program->name, sizeof(program->name), "%s", tokens[1]);
+                program->origin = -1;
+                program->wrapTarget = -1;
+                program->wrap = -1;
+                continue;
+            }
+
+            if(!program)
+                fail(line, "directive outside a program", tokens[0]);
+
+            if(!strcmp(tokens[0], ".side_set"))
+            {
+                if(count < 2)
+                    fail(line, "invalid .side_set", NULL);
+
+                program->sideSetCount = number(tokens[1], line);
+
+                for(int buc = 2; buc < count; buc++)
+                {
+                    if(!strcmp(tokens[buc], "opt"))
+                        program->sideSetOptional = true;
+                    else if(!strcmp(tokens[buc], "pindirs"))
+                        program->sideSetPindirs = true;
+                    else
+                        fail(line, "invalid .side_set option", tokens[buc]);
+                }
+
+                if(program->sideSetCount < 1 || program->sideSetCount + program->sideSetOptional > 5)
+                    fail(line, "invalid side set count", NULL);
+            }
+            else if(!strcmp(tokens[0], ".wrap_target"))
+                program->wrapTarget = program->length;
+            else if(!strcmp(tokens[0], ".wrap"))
+            {
+                if(!program->length)
+                    fail(line, ".wrap before any instruction", NULL);
+
+                program->wrap = program->length - 1;
+            }
+            else if(!strcmp(tokens[0], ".origin") && count == 2)
+                program->origin = number(tokens[1], line);
+            else
+                fail(line, "unsupported directive", tokens[0]);
+
+            continue;
+        }
+
+        if(!program)
+            fail(line, "instruction outside a program", text);
+
+        //Labels, optionally public, can share the line with an instruction
+        char* colon = strchr(text, ':');
+
+        if(colon && colon[1] != ':')
+        {
+            *colon = 0;
+            char* name = clean_line(text);
+            bool isPublic = false;
+
+            if(!strncmp(name, "public", 6) && isspace((unsigned char)name[6]))
+            {
+                isPublic = true;
+                name = clean_line(name + 6);
+            }
+
+            if(!*name || find_label(program, name) >= 0 || program->labelCount == MAX_LABELS)
+                fail(line, "invalid or duplicated label", name);
+
+            label_t* label = &program->labels[program->labelCount++];
+            snprintf(label->name, sizeof(label->name), "%s", name);
+            label->address = program->length;
+            label->isPublic = isPublic;
+
+            text = clean_line(colon + 1);
+
+            if(!*text)
+                continue;
+        }
+
+        if(program->length == MAX_INSTRUCTIONS)
+            fail(line, "program too long", NULL);
+
+        snprintf(program->source[program->length], MAX_LINE, "%s", text);
+        program->sourceLine[program->length++] = line;
+    }
+
+    for(int buc = 0; buc < programCount; buc++)
+    {
+        program = &programs[buc];
+
+        if(!program->length)
+            fail(line, "empty program", program->name);
+
+        if(program->wrapTarget < 0)
+            program->wrapTarget = 0;
+
+        if(program->wrap < 0)
+            program->wrap = program->length - 1;
+
+        for(int ins = 0; ins < program->length; ins++)
+        {
+            //The tokens are split in place, the source is kept for the header comments
+            char text[MAX_LINE];
+            memcpy(text, program->source[ins], MAX_LINE);
+            program->instructions[ins] = encode(program, text, program->sourceLine[ins]);
+        }
+    }
+}
+
+static void write_header(FILE* output)
+{
+    fprintf(output, "// -------------------------------------------------- //\n");
+    fprintf(output, "// This file is autogenerated by the host PIO assembler //\n");
+    fprintf(output, "//                    DO NOT EDIT!                    //\n");
+    fprintf(output, "// -------------------------------------------------- //\n\n");
+    fprintf(output, "#pragma once\n\n#include \"hardware/pio.h\"\n\n");
+
+    for(int buc = 0; buc < programCount; buc++)
+    {
+        program_t* program = &programs[buc];
+
+        fprintf(output, "// %s\n\n", program->name);
+        fprintf(output, "#define %s_wrap_target %d\n", program->name, program->wrapTarget);
+        fprintf(output, "#define %s_wrap %d\n", program->name, program->wrap);
+
+        for(int lab = 0; lab < program->labelCount; lab++)
+        {
+            if(program->labels[lab].isPublic)
+                fprintf(output, "#define %s_offset_%s %du\n", program->name, program->labels[lab].name, program->labels[lab].address);
+        }
+
+        fprintf(output, "\nstatic const uint16_t %s_program_instructions[] = {\n", program->name);
+
+        for(int ins = 0; ins < program->length; ins++)
+        {
+            fprintf(output, "    0x%04x, //%2d: %s\n", program->instructions[ins], ins, program->source[ins]);
+        }
+
+        fprintf(output, "};\n\n");
+        fprintf(output, "static const struct pio_program %s_program = {\n", program->name);
+        fprintf(output, "    .instructions = %s_program_instructions,\n", program->name);
+        fprintf(output, "    .length = %d,\n", program->length);
+        fprintf(output, "    .origin = %d,\n};\n\n", program->origin);
+        fprintf(output, "static inline pio_sm_config %s_program_get_default_config(uint offset) {\n", program->name);
+        fprintf(output, "    pio_sm_config c = pio_get_default_sm_config();\n");
+        fprintf(output, "    sm_config_set_wrap(&c, offset + %s_wrap_target, offset + %s_wrap);\n", program->name, program->name);
+
+        if(program->sideSetCount)
+        {
+            fprintf(output, "    sm_config_set_sideset(&c, %d, %s, %s);\n", program->sideSetCount + program->sideSetOptional,
+                program->sideSetOptional ? "true" : "false", program->sideSetPindirs ? "true" : "false");
+        }
+
+        fprintf(output, "    return c;\n}\n\n");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if(argc != 3)
+    {
+        fprintf(stderr, "Usage: PioAsm <source.pio> <output.pio.h>\n");
+        return 1;
+    }
+
+    sourceName = argv[1];
+    FILE* input = fopen(argv[1], "r");
+
+    if(!input)
+    {
+        fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    parse(input);
+    fclose(input);
+
+    FILE* output = fopen(argv[2], "w");
+
+    if(!output)
+    {
+        fprintf(stderr, "Cannot create %s\n", argv[2]);
+        return 1;
+    }
+
+    write_header(output);
+    fclose(output);
+
+    return 0;
+}
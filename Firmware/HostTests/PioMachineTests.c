@@ -0,0 +1,561 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "HostBoard.h"
+#include "UlaModel.h"
+#include "MicroDriveControl.h"
+#include "SharedBuffers.h"
+#include "PIO_machines.pio.h"
+
+/*
+
+Tests of the PIO programs on the emulator of the host board
+
+The programs are the ones of PIO_machines.pio, assembled by PioAsm, loaded and configured as init_PIO_machines
+does. The tests drive the pins as the ULA and the QL do:
+
+- Read: both tracks are sent as differential Manchester (a transition at the start of every bit and another one
+  in the middle of the ones), with the preamble, a clock error, a random jitter on each edge and track 2 skewed.
+  The words moved by the DMAs must be the data bits. The jmp pin instructions are traced to report where the
+  machine samples the line: the data samples (the jmp right after a wait) and the dispatch (the jmp that
+  selects the next wait) against the nearest edge sent by the ULA, the worst case of the hunt path included.
+- Read tolerance: the same read with the ULA clock off by up to 5% and jitter, and up to 10% without it, so the
+  sample point and the hunt path are checked against both ends of the bit.
+- Read after a burst: a few zeros and the eight ones of a sync pattern right after the gap must not sync the
+  machine, it needs the 24 zeros of the pattern.
+- Write: the preamble counters are loaded in X/Y and the data is fed by the DMAs as the firmware does, the
+  edges of the write pins are decoded back and the machines must stall (TXSTALL) once the data is sent.
+- Status and shifter: changes of the RW/ERASE lines and the bits shifted through SER_DATA must reach the
+  FIFO and raise the IRQ 0 of their PIO, the shifter must output the bit on SER_DATA_OUT.
+
+*/
+
+#define PREAMBLE_BITS (PREAMBLE_ZERO_BITS + PREAMBLE_ONE_BITS)
+
+typedef struct track
+{
+    ulatrack_t ula;
+
+    //Samples of the read machine, distance to the nearest edge in cycles
+    uint32_t samples;
+    uint64_t minSampleMargin;
+    uint64_t minDispatchMargin;
+
+} track_t;
+
+static track_t tracks[2];
+
+static uint smExecRead, smExecWrite;
+static uint smRead[2], smWrite[2], smStatus, smShifter;
+static uint rxOffset, txOffset, statusOffset, shiftOffset;
+
+//Kind of each jmp pin of the read program, found from the instruction before it
+static bool isDataSample[PIO_INSTRUCTION_COUNT];
+static bool isDispatch[PIO_INSTRUCTION_COUNT];
+
+//Machines
+
+//Same sequence and configuration as init_PIO_machines, so the offsets and the machines are the same too
+static void init_machines(void)
+{
+    host_board_reset();
+
+    pio_gpio_init(pio0, MD_READ_HEAD_1);
+    pio_gpio_init(pio0, MD_READ_HEAD_2);
+    pio_gpio_init(pio0, MD_RW);
+    pio_gpio_init(pio0, MD_ERASE);
+    gpio_pull_up(MD_ERASE);
+    gpio_pull_down(MD_READ_HEAD_1);
+    gpio_pull_down(MD_READ_HEAD_2);
+
+    pio_gpio_init(pio1, MD_WRITE_HEAD_1);
+    pio_gpio_init(pio1, MD_WRITE_HEAD_2);
+    pio_gpio_init(pio1, MD_SER_DATA_IN);
+    pio_gpio_init(pio1, MD_SER_CLK);
+    pio_gpio_init(pio1, MD_SER_DATA_OUT);
+    gpio_pull_down(MD_WRITE_HEAD_1);
+    gpio_pull_down(MD_WRITE_HEAD_2);
+
+    //The read and write pins of each head are tied on the PCB
+    host_gpio_connect(MD_READ_HEAD_1, MD_WRITE_HEAD_1);
+    host_gpio_connect(MD_READ_HEAD_2, MD_WRITE_HEAD_2);
+
+    smExecRead = pio_claim_unused_sm(pio0, true);
+    pio_sm_exec(pio0, smExecRead, pio_encode_irq_set(false, 7));
+    smExecWrite = pio_claim_unused_sm(pio1, true);
+    pio_sm_exec(pio1, smExecWrite, pio_encode_irq_set(false, 7));
+
+    rxOffset = pio_add_program(pio0, &microdrive_read_program);
+
+    for(int track = 0; track < 2; track++)
+    {
+        uint pin = track ? MD_READ_HEAD_2 : MD_READ_HEAD_1;
+        smRead[track] = pio_claim_unused_sm(pio0, true);
+
+        pio_sm_config cfg = microdrive_read_program_get_default_config(rxOffset);
+        sm_config_set_clkdiv(&cfg, (200000000 / 100000) / 40);
+        sm_config_set_set_pins(&cfg, pin, 1);
+        sm_config_set_in_pins(&cfg, pin);
+        sm_config_set_jmp_pin(&cfg, pin);
+        sm_config_set_in_shift(&cfg, true, true, 32);
+        sm_config_set_out_shift(&cfg, true, false, 1);
+        pio_sm_init(pio0, smRead[track], rxOffset, &cfg);
+
+        //load_PIO_read_pattern
+        pio_sm_exec(pio0, smRead[track], pio_encode_mov_not(pio_x, pio_null));
+        pio_sm_exec(pio0, smRead[track], pio_encode_in(pio_x, 8));
+        pio_sm_exec(pio0, smRead[track], pio_encode_mov(pio_x, pio_isr));
+        pio_sm_exec(pio0, smRead[track], pio_encode_mov(pio_isr, pio_null));
+
+        pio_sm_set_enabled(pio0, smRead[track], true);
+    }
+
+    statusOffset = pio_add_program(pio0, &microdrive_status_program);
+    smStatus = pio_claim_unused_sm(pio0, true);
+    pio_sm_config statusCfg = microdrive_status_program_get_default_config(statusOffset);
+    sm_config_set_clkdiv(&statusCfg, 1);
+    sm_config_set_set_pins(&statusCfg, MD_RW, 2);
+    sm_config_set_in_pins(&statusCfg, MD_RW);
+    sm_config_set_in_shift(&statusCfg, false, false, 0);
+    pio_sm_init(pio0, smStatus, statusOffset, &statusCfg);
+    pio_sm_set_enabled(pio0, smStatus, true);
+
+    txOffset = pio_add_program(pio1, &microdrive_write_program);
+
+    for(int track = 0; track < 2; track++)
+    {
+        uint pin = track ? MD_WRITE_HEAD_2 : MD_WRITE_HEAD_1;
+        smWrite[track] = pio_claim_unused_sm(pio1, true);
+
+        pio_sm_config cfg = microdrive_write_program_get_default_config(txOffset);
+        sm_config_set_clkdiv(&cfg, 125);
+        sm_config_set_set_pins(&cfg, pin, 1);
+        sm_config_set_sideset_pins(&cfg, pin);
+        sm_config_set_out_shift(&cfg, true, true, 8);
+        pio_sm_init(pio1, smWrite[track], txOffset, &cfg);
+        pio_sm_set_enabled(pio1, smWrite[track], true);
+    }
+
+    shiftOffset = pio_add_program(pio1, &microdrive_shift_select_program);
+    smShifter = pio_claim_unused_sm(pio1, true);
+    pio_sm_config shiftCfg = microdrive_shift_select_program_get_default_config(shiftOffset);
+    sm_config_set_clkdiv(&shiftCfg, (200000000 / 21500) / 32);
+    sm_config_set_set_pins(&shiftCfg, MD_SER_DATA_IN, 3);
+    sm_config_set_in_pins(&shiftCfg, MD_SER_DATA_IN);
+    sm_config_set_out_pins(&shiftCfg, MD_SER_DATA_OUT, 1);
+    sm_config_set_in_shift(&shiftCfg, false, false, 0);
+    sm_config_set_out_shift(&shiftCfg, true, false, 0);
+    pio_sm_init(pio1, smShifter, shiftOffset, &shiftCfg);
+    pio_sm_set_enabled(pio1, smShifter, true);
+}
+
+static void find_read_samples(void)
+{
+    const uint16_t* program = microdrive_read_program.instructions;
+
+    for(uint buc = 1; buc < microdrive_read_program.length; buc++)
+    {
+        bool jmpPin = (program[buc] & 0xE000) == 0x0000 && (program[buc] & 0x00E0) == 0x00C0;
+        bool afterWaitPin = (program[buc - 1] & 0xE000) == 0x2000 && (program[buc - 1] & 0x0060) == 0x0020;
+
+        isDataSample[rxOffset + buc] = jmpPin && afterWaitPin;
+        isDispatch[rxOffset + buc] = jmpPin && !afterWaitPin;
+    }
+}
+
+//Read
+
+static void trace_read(uint sm, uint pc, uint16_t instruction, bool stalled, uint64_t cycle, void* context)
+{
+    (void)sm;
+    (void)instruction;
+    track_t* track = context;
+    ulatrack_t* ula = &track->ula;
+
+    //Only the samples while the ULA sends, the line doesn't change after the last edge
+    if(stalled || pc >= PIO_INSTRUCTION_COUNT || !ula->edgeCount || cycle < ula->edges[0] || cycle > ula_track_end(ula))
+        return;
+
+    uint64_t margin = ula_edge_margin(ula, cycle);
+
+    if(isDataSample[pc])
+    {
+        track->samples++;
+
+        if(margin < track->minSampleMargin)
+            track->minSampleMargin = margin;
+    }
+    else if(isDispatch[pc] && margin < track->minDispatchMargin)
+        track->minDispatchMargin = margin;
+}
+
+//Same as flush_PIO_read_machine
+static bool flush_read_machine(uint sm, uint dma, uint32_t totalTransfers)
+{
+    uint32_t pendingTransfers = dma_channel_hw_addr(dma)->transfer_count;
+
+    if(pendingTransfers == 0)
+        return true;
+
+    if(pendingTransfers == totalTransfers && pio_sm_is_rx_fifo_empty(pio0, sm))
+        return false;
+
+    uint fifoLevel = pio_sm_get_rx_fifo_level(pio0, sm);
+
+    for(int buc = 0; buc < 32; buc++)
+    {
+        if(pio_sm_get_rx_fifo_level(pio0, sm) != fifoLevel || dma_channel_hw_addr(dma)->transfer_count != pendingTransfers)
+            break;
+
+        pio_sm_exec_wait_blocking(pio0, sm, pio_encode_in(pio_null, 1));
+    }
+
+    return dma_channel_hw_addr(dma)->transfer_count <= pio_sm_get_rx_fifo_level(pio0, sm);
+}
+
+//Sends both tracks to the read machines, the burst is a number of zeros and the eight ones of the sync pattern
+//sent right after the gap before the preamble. Returns the number of failures
+static int run_read(const char* name, uint32_t dataBytes, int clockError, uint32_t jitter, uint32_t skewBits,
+    uint32_t burstZeros)
+{
+    uint8_t data[2][SECTOR_TRACK_DATA_SIZE];
+    uint32_t received[2][SECTOR_RX_WORDS + 1];
+    uint32_t words = (dataBytes * 8 + 31) / 32;
+    int dmas[2];
+    int failures = 0;
+
+    init_machines();
+    find_read_samples();
+
+    for(int track = 0; track < 2; track++)
+    {
+        track_t* state = &tracks[track];
+        ula_track_init(&state->ula, track ? MD_READ_HEAD_2 : MD_READ_HEAD_1);
+        state->samples = 0;
+        state->minSampleMargin = UINT64_MAX;
+        state->minDispatchMargin = UINT64_MAX;
+
+        for(uint32_t buc = 0; buc < dataBytes; buc++)
+            data[track][buc] = ula_random();
+
+        if(burstZeros)
+        {
+            ula_add_bits(&state->ula, 0, burstZeros);
+            ula_add_bits(&state->ula, 1, PREAMBLE_ONE_BITS);
+        }
+
+        ula_add_bits(&state->ula, 0, PREAMBLE_ZERO_BITS);
+        ula_add_bits(&state->ula, 1, PREAMBLE_ONE_BITS);
+        ula_add_bytes(&state->ula, data[track], dataBytes);
+
+        host_pio_set_trace(pio0, smRead[track], trace_read, state);
+        memset(received[track], 0, sizeof(received[track]));
+
+        dmas[track] = dma_claim_unused_channel(true);
+        dma_channel_config cfg = dma_channel_get_default_config(dmas[track]);
+        channel_config_set_dreq(&cfg, pio_get_dreq(pio0, smRead[track], false));
+        channel_config_set_read_increment(&cfg, false);
+        channel_config_set_write_increment(&cfg, true);
+        channel_config_set_transfer_data_size(&cfg, DMA_SIZE_32);
+        dma_channel_configure(dmas[track], &cfg, received[track], &pio0->rxf[smRead[track]], words, true);
+
+        host_gpio_drive(state->ula.gpio, false);
+    }
+
+    //End of the gap, the ULA starts to send a while later
+    host_run_us(10);
+    pio_interrupt_clear(pio0, 7);
+
+    uint64_t start = host_now() + 20 * HOST_CYCLES_PER_US;
+    ula_make_edges(&tracks[0].ula, start, clockError, jitter);
+    ula_make_edges(&tracks[1].ula, start + skewBits * ULA_BIT_CYCLES, clockError, jitter);
+    ula_start_track(&tracks[0].ula);
+    ula_start_track(&tracks[1].ula);
+
+    uint64_t end = ula_track_end(&tracks[1].ula);
+
+    if(ula_track_end(&tracks[0].ula) > end)
+        end = ula_track_end(&tracks[0].ula);
+
+    host_run_until(end + 3 * ULA_BIT_CYCLES);
+
+    for(int track = 0; track < 2; track++)
+    {
+        track_t* state = &tracks[track];
+        bool complete = flush_read_machine(smRead[track], dmas[track], words);
+        host_run_us(1);
+        hostsmstats_t stats = host_pio_stats(pio0, smRead[track]);
+
+        bool match = complete && memcmp(received[track], data[track], dataBytes) == 0;
+
+        printf("%s track %d: %s, %u samples, data sample %.2f us from an edge, dispatch %.2f us, RX FIFO max %u, %u stalls\n",
+            name, track + 1, match ? "ok" : "FAILED", state->samples, state->minSampleMargin / (double)HOST_CYCLES_PER_US,
+            state->minDispatchMargin / (double)HOST_CYCLES_PER_US, stats.maxRxLevel, stats.rxStalls);
+
+        if(!match || stats.rxStalls)
+            failures++;
+    }
+
+    return failures;
+}
+
+//Tolerance of the read machines: the sample (5/8 of the bit) and the dispatch of the hunt path (5 cycles before the
+//next bit) share the bit, a fast ULA eats the dispatch margin and a slow one the margin after the mid-bit transition.
+//The machines must decode with the ULA clock off by up to 5% and each edge moved by up to 0.375 us, and up to 10% with
+//a clean line
+static int run_read_tolerance(void)
+{
+    static const int clockErrors[] = { -50, -25, 0, 25, 50 };
+    static const uint32_t jitters[] = { 0, HOST_CYCLES_PER_US / 8, HOST_CYCLES_PER_US / 4, HOST_CYCLES_PER_US * 3 / 8 };
+    char name[64];
+    int failures = 0;
+
+    for(uint32_t error = 0; error < sizeof(clockErrors) / sizeof(clockErrors[0]); error++)
+    {
+        for(uint32_t jitter = 0; jitter < sizeof(jitters) / sizeof(jitters[0]); jitter++)
+        {
+            sprintf(name, "Read sector, ULA clock %+.1f%%, %.3f us jitter", clockErrors[error] / 10.0,
+                jitters[jitter] / (double)HOST_CYCLES_PER_US);
+            failures += run_read(name, SECTOR_TRACK_DATA_SIZE, clockErrors[error], jitters[jitter], 4, 0);
+        }
+    }
+
+    failures += run_read("Read sector, ULA clock -10.0%", SECTOR_TRACK_DATA_SIZE, -100, 0, 4, 0);
+    failures += run_read("Read sector, ULA clock +10.0%", SECTOR_TRACK_DATA_SIZE, 100, 0, 4, 0);
+
+    return failures;
+}
+
+//Write
+
+static int run_write(const char* name, uint32_t dataBytes)
+{
+    uint8_t source[SECTOR_TRACK_DATA_SIZE * 2];
+    uint32_t zeros[2] = { TRACK_1_PREAMBLE_ZERO_BITS, TRACK_2_PREAMBLE_ZERO_BITS };
+    int failures = 0;
+
+    init_machines();
+
+    for(uint32_t buc = 0; buc < dataBytes * 2; buc++)
+        source[buc] = ula_random();
+
+    //begin_PIO_write_gap
+    pio_sm_exec(pio1, smExecWrite, pio_encode_irq_set(false, 7));
+
+    for(int track = 0; track < 2; track++)
+    {
+        pio_sm_exec_wait_blocking(pio1, smWrite[track], pio_encode_set(pio_x, zeros[track] / 2 - 1));
+        pio_sm_exec_wait_blocking(pio1, smWrite[track], pio_encode_set(pio_y, PREAMBLE_ONE_BITS - 1));
+    }
+
+    ula_listen_write();
+
+    for(int track = 0; track < 2; track++)
+        pio_sm_exec_wait_blocking(pio1, smWrite[track], pio_encode_jmp(txOffset + microdrive_write_offset_tx_gap));
+
+    //enable_write_DMAs, track 2 is the high byte of each halfword
+    for(int track = 0; track < 2; track++)
+    {
+        int dma = dma_claim_unused_channel(true);
+        dma_channel_config cfg = dma_channel_get_default_config(dma);
+        channel_config_set_dreq(&cfg, pio_get_dreq(pio1, smWrite[track], true));
+        channel_config_set_read_increment(&cfg, true);
+        channel_config_set_write_increment(&cfg, false);
+        channel_config_set_transfer_data_size(&cfg, DMA_SIZE_16);
+        channel_config_set_bswap(&cfg, track == 1);
+        dma_channel_configure(dma, &cfg, &pio1->txf[smWrite[track]], source, dataBytes, true);
+    }
+
+    host_run_us(20);
+
+    //end_PIO_write_gap
+    pio1->fdebug = (1u << (PIO_FDEBUG_TXSTALL_LSB + smWrite[0])) | (1u << (PIO_FDEBUG_TXSTALL_LSB + smWrite[1]));
+    pio_interrupt_clear(pio1, 7);
+
+    host_run_us((TRACK_2_PREAMBLE_ZERO_BITS + PREAMBLE_ONE_BITS + dataBytes * 8) * 10 + 50);
+
+    for(int track = 0; track < 2; track++)
+    {
+        static uint8_t bits[ULA_MAX_BITS];
+        uint32_t count = zeros[track] + PREAMBLE_ONE_BITS + dataBytes * 8;
+        int missing = ula_decode_write(track, bits, count);
+        bool match = missing == 0;
+
+        for(uint32_t bit = 0; bit < count && match; bit++)
+        {
+            uint8_t expected = 0;
+
+            if(bit >= zeros[track] + PREAMBLE_ONE_BITS)
+            {
+                uint32_t dataBit = bit - zeros[track] - PREAMBLE_ONE_BITS;
+                expected = (source[(dataBit / 8) * 2 + track] >> (dataBit % 8)) & 1;
+            }
+            else if(bit >= zeros[track])
+                expected = 1;
+
+            if(bits[bit] != expected)
+                match = false;
+        }
+
+        bool stalled = pio1->fdebug & (1u << (PIO_FDEBUG_TXSTALL_LSB + smWrite[track]));
+        hostsmstats_t stats = host_pio_stats(pio1, smWrite[track]);
+
+        printf("%s track %d: %s, %u bits, %d missing transitions, %s, TX FIFO max %u\n", name, track + 1,
+            match ? "ok" : "FAILED", count, missing, stalled ? "stalled at the end" : "NOT STALLED", stats.maxTxLevel);
+
+        if(!match || !stalled)
+            failures++;
+    }
+
+    if(host_gpio_contentions())
+    {
+        printf("%s: %u pin contentions\n", name, host_gpio_contentions());
+        failures++;
+    }
+
+    ula_stop_listening();
+    return failures;
+}
+
+//Status and shifter
+
+static uint32_t irqValues[8];
+static uint32_t irqValueCount;
+static uint64_t irqCycle;
+
+static void status_handler(void)
+{
+    if(irqValueCount < 8)
+        irqValues[irqValueCount++] = pio_sm_get(pio0, smStatus);
+
+    irqCycle = host_now();
+    pio_interrupt_clear(pio0, 0);
+}
+
+static void shifter_handler(void)
+{
+    if(irqValueCount < 8)
+        irqValues[irqValueCount++] = pio_sm_get(pio1, smShifter);
+
+    pio_interrupt_clear(pio1, 0);
+}
+
+static int run_status(void)
+{
+    //RW and ERASE: read, write gap, write and read again
+    const uint8_t states[] = { 3, 1, 0, 3 };
+    uint64_t maxLatency = 0;
+    int failures = 0;
+
+    init_machines();
+    irqValueCount = 0;
+
+    pio_set_irq0_source_enabled(pio0, pis_interrupt0, true);
+    irq_set_exclusive_handler(PIO0_IRQ_0, status_handler);
+    irq_set_enabled(PIO0_IRQ_0, true);
+
+    //select_PIO_status
+    pio_sm_exec(pio0, smExecRead, pio_encode_irq_set(false, 6));
+
+    for(uint buc = 0; buc < sizeof(states); buc++)
+    {
+        uint64_t changed = host_now();
+        host_gpio_drive(MD_RW, states[buc] & 1);
+        host_gpio_drive(MD_ERASE, states[buc] >> 1);
+        host_run_us(100);
+
+        if(irqValueCount == buc + 1 && irqCycle - changed > maxLatency)
+            maxLatency = irqCycle - changed;
+    }
+
+    bool match = irqValueCount == sizeof(states);
+
+    for(uint buc = 0; buc < irqValueCount && match; buc++)
+        match = irqValues[buc] == states[buc];
+
+    printf("Status machine: %s, %u changes notified, %.2f us to the handler\n", match ? "ok" : "FAILED", irqValueCount,
+        maxLatency / (double)HOST_CYCLES_PER_US);
+
+    if(!match)
+        failures++;
+
+    return failures;
+}
+
+static int run_shifter(void)
+{
+    //The QL shifts a one through the chain to select the first drive and zeros to deselect it
+    const uint8_t bits[] = { 1, 0, 0 };
+    const uint64_t clockCycles = HOST_SYS_CLOCK_HZ / 21500;
+    bool outputs[sizeof(bits)];
+    int failures = 0;
+
+    init_machines();
+    irqValueCount = 0;
+
+    pio_set_irq0_source_enabled(pio1, pis_interrupt0, true);
+    irq_set_exclusive_handler(PIO1_IRQ_0, shifter_handler);
+    irq_set_enabled(PIO1_IRQ_0, true);
+
+    host_gpio_drive(MD_SER_CLK, false);
+    host_gpio_drive(MD_SER_DATA_IN, false);
+
+    //start_PIO_shifter
+    pio_sm_exec(pio1, smExecWrite, pio_encode_irq_set(false, 6));
+    host_run_us(100);
+
+    for(uint buc = 0; buc < sizeof(bits); buc++)
+    {
+        host_gpio_drive(MD_SER_DATA_IN, bits[buc]);
+        host_wait(clockCycles / 4);
+        host_gpio_drive(MD_SER_CLK, true);
+        host_wait(clockCycles / 2);
+        host_gpio_drive(MD_SER_CLK, false);
+        host_wait(clockCycles / 4);
+        outputs[buc] = gpio_get(MD_SER_DATA_OUT);
+    }
+
+    host_run_us(100);
+
+    //Only the changes are pushed
+    bool match = irqValueCount == 2 && irqValues[0] == 1 && irqValues[1] == 0;
+
+    for(uint buc = 0; buc < sizeof(bits); buc++)
+        match &= outputs[buc] == bits[buc];
+
+    printf("Shifter machine: %s, %u changes notified\n", match ? "ok" : "FAILED", irqValueCount);
+
+    if(!match)
+        failures++;
+
+    return failures;
+}
+
+int main()
+{
+    int failures = 0;
+
+    ula_seed(1);
+
+    failures += run_read("Read header", HEADER_TRACK_DATA_SIZE, 0, 0, 4, 0);
+    failures += run_read("Read sector", SECTOR_TRACK_DATA_SIZE, 0, 0, 4, 0);
+    failures += run_read("Read sector, 0.5 us jitter", SECTOR_TRACK_DATA_SIZE, 0, HOST_CYCLES_PER_US / 2, 4, 0);
+    failures += run_read("Read sector after a burst", SECTOR_TRACK_DATA_SIZE, 0, 0, 4, 16);
+    failures += run_read_tolerance();
+    failures += run_write("Write header", HEADER_TRACK_DATA_SIZE);
+    failures += run_write("Write sector", SECTOR_TRACK_DATA_SIZE);
+    failures += run_status();
+    failures += run_shifter();
+
+    if(failures)
+    {
+        printf("PioMachineTests: %d failures\n", failures);
+        return 1;
+    }
+
+    printf("PioMachineTests: passed\n");
+    return 0;
+}
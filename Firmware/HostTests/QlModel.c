@@ -0,0 +1,47 @@
+#include "QlModel.h"
+#include "MicroDriveControl.h"
+#include "UserInterface.h"
+
+/*
+
+QL model of the host tests
+
+MicroDriveControl.c and UserInterface.c run unchanged, the loops of both cores are run in turns on the single
+thread of the board (run_MD_control_step and run_user_interface_step), each one sleeps as the firmware does and
+the board advances while they wait. The QL changes its lines between the steps, only the board runs while it
+shifts a bit through the select chain so the cores see the change afterwards.
+
+*/
+
+//Runs a loop iteration of each core, returns false once the deadline has passed
+bool ql_step_cores(uint64_t deadline)
+{
+    run_MD_control_step();
+    run_user_interface_step();
+
+    return host_now() < deadline;
+}
+
+void ql_run_cores_until(uint64_t cycle)
+{
+    while(ql_step_cores(cycle));
+}
+
+//Lines as the status machine reads them, bit 0 is RW and bit 1 is ERASE
+void ql_set_lines(uint8_t lines)
+{
+    host_gpio_drive(MD_RW, lines & 1);
+    host_gpio_drive(MD_ERASE, lines >> 1);
+}
+
+//Shifts a bit through the select chain
+void ql_shift_bit(bool bit)
+{
+    host_gpio_drive(MD_SER_DATA_IN, bit);
+    host_wait(QL_SER_CLOCK_CYCLES / 4);
+    host_gpio_drive(MD_SER_CLK, true);
+    host_wait(QL_SER_CLOCK_CYCLES / 2);
+    host_gpio_drive(MD_SER_CLK, false);
+    host_wait(QL_SER_CLOCK_CYCLES / 4);
+    host_gpio_drive(MD_SER_DATA_IN, false);
+}
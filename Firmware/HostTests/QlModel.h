@@ -0,0 +1,24 @@
+#ifndef __HOST_QLMODEL__
+#define __HOST_QLMODEL__
+
+#include "pico/stdlib.h"
+#include "HostBoard.h"
+
+//QL side of the simulated board, drives the select chain and the RW/ERASE lines while both firmware cores run
+
+//Serial clock of the select chain
+#define QL_SER_CLOCK_CYCLES (HOST_SYS_CLOCK_HZ / 21500)
+
+bool ql_step_cores(uint64_t deadline);
+void ql_run_cores_until(uint64_t cycle);
+void ql_set_lines(uint8_t lines);
+void ql_shift_bit(bool bit);
+
+//Runs both cores until the condition holds or the timeout (in us) expires
+#define RUN_UNTIL(CONDITION, TIMEOUT_US) \
+    { \
+        uint64_t deadline = host_now() + (uint64_t)(TIMEOUT_US) * HOST_CYCLES_PER_US; \
+        while(!(CONDITION) && ql_step_cores(deadline)); \
+    }
+
+#endif
@@ -0,0 +1,569 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "HostBoard.h"
+#include "UlaModel.h"
+#include "QlModel.h"
+#include "CardImage.h"
+#include "SampleImages.h"
+#include "MicroDriveControl.h"
+#include "UserInterface.h"
+#include "SharedBuffers.h"
+#include "pff/pff.h"
+
+/*
+
+End to end benchmark of a QL session on the simulated board
+
+Both firmware cores run as in MdControlTests, the image given in the command line is stored in the card model
+and loaded by the user interface. The QL and the ULA models then run two sessions on the drive:
+
+- LOAD mdv1_name: the QL selects the drive and keeps reading, it takes the map from the record of the sector 0,
+  then the blocks of the directory (file 0) to find the file and then the blocks of the file, each one as it
+  passes under the head. The blocks must match the ones of the image.
+- FORMAT mdv1_name: the QL writes a whole revolution of headers counting down from 255 (the firmware knows that
+  it's a format from that sector) with blank records, reads a revolution back to find the good sectors and
+  writes the map in the sector 0 and the directory in DIRECTORY_SECTOR, as MicroDriveTools lays out a new
+  cartridge. The cartridge image must then hold what the QL wrote, the firmware skips the sector 254 while
+  formatting and damages the sector 13 once it has been read (Minerva expects both).
+
+Each session reports the time from the selection to the last record, the buffer sets served and received per
+second, the late ones (not filled by the UI core when the MD core needed them), the transfers cut and the worst
+gap and wake latencies of the cores. The times are simulated, so they don't depend on the host running the
+benchmark, only on the firmware.
+
+*/
+
+//The status machine is clamped as in MdControlTests, it would tick every cycle
+#define MIN_CLKDIV 50
+
+//Gap written by the QL before each header and record
+#define QL_GAP_US 2800
+
+//Longest record, a sector with the preamble of track 2 and the checks of the end of the transfer
+#define RECORD_TIMEOUT_US ((TRACK_2_PREAMBLE_ZERO_BITS + PREAMBLE_ONE_BITS + SECTOR_TRACK_DATA_SIZE * 8 + 100) * 10)
+
+//Records passing under the head in a revolution, a header and a sector for each set
+#define REVOLUTION_RECORDS (CARTRIDGE_SECTOR_COUNT * 2)
+#define LOAD_REVOLUTIONS 4
+
+//Map of the sectors, in the record of the sector 0
+#define MAP_FILE 0xF8
+#define FREE_SECTOR 0xFD
+#define DAMAGED_SECTOR 0xFF
+#define DIRECTORY_SECTOR 245
+
+//Sectors changed by the firmware while formatting
+#define FORMAT_SKIPPED_SECTOR 254
+#define FORMAT_DAMAGED_SECTOR 13
+
+#define QL_CHECKSUM(SUM) ((uint16_t)((SUM) + 0x0F0F))
+
+//Directory entries and file headers
+#define FILE_HEADER_SIZE 64
+#define MAX_FILE_BLOCKS 255
+
+//State of the firmware
+extern mdactivestatus_t activeStatus;
+extern USER_INTERFACE_STATE uiState;
+extern CARTRIDGE_FORMAT cfInserted;
+extern bool mdInUse;
+extern char currentPath[PATH_BUFFER_SIZE];
+extern FATFS fatfs;
+extern FILINFO fno;
+
+bool init_screen();
+
+static uint8_t mdvImage[CARTRIDGE_SECTOR_COUNT * MDV_SECTOR_SIZE];
+static uint8_t sampleImage[CART_SIZE];
+static uint8_t formatted[CART_SIZE];
+
+static uint64_t sessionStart;
+
+static int failures = 0;
+
+static void check(bool ok, const char* what)
+{
+    printf("%s: %s\n", what, ok ? "ok" : "FAILED");
+
+    if(!ok)
+        failures++;
+}
+
+//Records
+
+static uint16_t sum_bytes(const uint8_t* data, uint32_t count)
+{
+    uint16_t sum = 0;
+
+    for(uint32_t buc = 0; buc < count; buc++)
+        sum += data[buc];
+
+    return sum;
+}
+
+static bool header_valid(const SECTOR_HEADER_t* header)
+{
+    return header->HeaderData[0] == 0xFF && header->Checksum == QL_CHECKSUM(sum_bytes(header->HeaderData, 14));
+}
+
+static bool record_valid(const SECTOR_RECORD_t* record)
+{
+    return record->HeaderChecksum == QL_CHECKSUM(record->HeaderData[0] + record->HeaderData[1]) &&
+        record->DataChecksum == QL_CHECKSUM(sum_bytes(record->Data, sizeof(record->Data)));
+}
+
+static void make_header(SECTOR_HEADER_t* header, uint8_t sector, const char* medium, uint16_t mediumId)
+{
+    header->HeaderData[0] = 0xFF;
+    header->HeaderData[1] = sector;
+    memset(&header->HeaderData[2], ' ', 10);
+    memcpy(&header->HeaderData[2], medium, strlen(medium) < 10 ? strlen(medium) : 10);
+    header->HeaderData[12] = mediumId;
+    header->HeaderData[13] = mediumId >> 8;
+    header->Checksum = QL_CHECKSUM(sum_bytes(header->HeaderData, 14));
+}
+
+static void make_record(SECTOR_RECORD_t* record, uint8_t file, uint8_t block, const uint8_t* data)
+{
+    record->HeaderData[0] = file;
+    record->HeaderData[1] = block;
+    record->HeaderChecksum = QL_CHECKSUM(file + block);
+
+    memset(record->FilePreamble, 0, 6);
+    memset(&record->FilePreamble[6], 0xFF, 2);
+
+    if(data)
+        memcpy(record->Data, data, sizeof(record->Data));
+    else
+        memset(record->Data, 0, sizeof(record->Data));
+
+    record->DataChecksum = QL_CHECKSUM(sum_bytes(record->Data, sizeof(record->Data)));
+
+    for(int buc = 0; buc < sizeof(record->ExtraBytes); buc++)
+        record->ExtraBytes[buc] = buc % 2 == 0 ? 0xAA : 0x55;
+
+    record->ExtraBytesChecksum = 0x3b19;
+}
+
+//Position of a sector in a cartridge image, -1 if no header has its number
+static int find_sector(const uint8_t* image, uint8_t sector)
+{
+    for(int pos = 0; pos < CARTRIDGE_SECTOR_COUNT; pos++)
+    {
+        const SECTOR_HEADER_t* header = (const SECTOR_HEADER_t*)&image[CARTRIDGE_SECTOR_SIZE * pos];
+
+        if(header->HeaderData[0] == 0xFF && header->HeaderData[1] == sector)
+            return pos;
+    }
+
+    return -1;
+}
+
+//Drive
+
+//Loads an image stored in the card as the user interface does once the file is chosen in the browser
+static bool load_image(const char* name)
+{
+    memset(currentPath, 0, PATH_BUFFER_SIZE);
+    strcpy(fno.fname, name);
+    fno.fsize = sizeof(mdvImage);
+    cfInserted = MDV;
+    uiState = FILE_LOAD;
+
+    RUN_UNTIL(uiState == CARTRIDGE_READY, 2000000);
+    return uiState == CARTRIDGE_READY;
+}
+
+static bool select_drive(void)
+{
+    memset((void*)&perfCounters, 0, sizeof(perfCounters));
+    sessionStart = host_now();
+
+    ql_set_lines(MDL_READ);
+    ql_shift_bit(true);
+    RUN_UNTIL(mdInUse && activeStatus == MDA_WRITE_HEADER_GAP, SHIFTER_SELECT_US + 1000);
+
+    return mdInUse && activeStatus == MDA_WRITE_HEADER_GAP;
+}
+
+//Deselects the drive and prints the counters of the session
+static void deselect_drive(const char* session)
+{
+    double seconds = (host_now() - sessionStart) / (double)HOST_SYS_CLOCK_HZ;
+
+    ql_shift_bit(false);
+    RUN_UNTIL(!mdInUse, 1000);
+
+    printf("%s: %.2f s, %u sets served, %u received, %.1f sets/s, %u late sets, %u transfers cut\n", session, seconds,
+        perfCounters.setsServed, perfCounters.setsReceived, (perfCounters.setsServed + perfCounters.setsReceived) / seconds,
+        perfCounters.underruns, perfCounters.dmaAborts);
+    printf("%s: gap latency max %u us, MD core wake max %u us, UI core wake max %u us\n", session,
+        perfCounters.gapLatencyMax, perfCounters.mdWakeLatencyMax, perfCounters.uiWakeLatencyMax);
+}
+
+//Waits for the next record sent by the drive and decodes it as the QL does
+//Returns false if it was not received intact, isHeader is set anyway
+static bool receive_record(uint8_t* data, bool* isHeader)
+{
+    mdactivestatus_t gap = activeStatus;
+    *isHeader = gap == MDA_WRITE_HEADER_GAP;
+
+    ula_listen_write();
+    RUN_UNTIL(activeStatus != gap, QL_WRITE_GAP_US + 1000);
+    mdactivestatus_t transfer = activeStatus;
+    RUN_UNTIL(activeStatus != transfer, RECORD_TIMEOUT_US);
+    ula_stop_listening();
+
+    return transfer == (*isHeader ? MDA_WRITE_HEADER : MDA_WRITE_SECTOR) &&
+        ula_receive_record(data, *isHeader ? HEADER_TRACK_DATA_SIZE : SECTOR_TRACK_DATA_SIZE);
+}
+
+//The drive sends records while the QL reads
+static bool drive_sending(void)
+{
+    return mdInUse && (activeStatus == MDA_WRITE_HEADER_GAP || activeStatus == MDA_WRITE_SECTOR_GAP);
+}
+
+//The QL writes a record after its gap, the lines are released once it has been sent
+static void write_record(const void* data, uint32_t trackBytes)
+{
+    ql_set_lines(MDL_WRITE_GAP);
+    ql_run_cores_until(host_now() + QL_GAP_US * HOST_CYCLES_PER_US);
+    ql_set_lines(MDL_WRITE);
+
+    uint64_t end = ula_send_record(data, trackBytes);
+
+    ql_run_cores_until(end + 3 * ULA_BIT_CYCLES);
+    host_gpio_release(MD_READ_HEAD_1);
+    host_gpio_release(MD_READ_HEAD_2);
+}
+
+//The QL reads headers until the one of the sector passes and writes its record in the gap after it
+static bool write_sector(uint8_t sector, const SECTOR_RECORD_t* record)
+{
+    SECTOR_RECORD_t received;
+    bool isHeader;
+
+    for(int records = 0; records < REVOLUTION_RECORDS * 2 && drive_sending(); records++)
+    {
+        bool ok = receive_record((uint8_t*)&received, &isHeader);
+        SECTOR_HEADER_t* header = (SECTOR_HEADER_t*)&received;
+
+        if(isHeader && ok && header_valid(header) && header->HeaderData[1] == sector)
+        {
+            write_record(record, SECTOR_TRACK_DATA_SIZE);
+            ql_set_lines(MDL_READ);
+            RUN_UNTIL(activeStatus == MDA_WRITE_HEADER_GAP, 1000);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//Sessions
+
+//LOAD mdv1_name, returns the length of the file (without its header), 0 if it was not loaded
+static uint32_t ql_load(const char* name)
+{
+    static uint8_t map[512];
+    static uint8_t directory[MAX_FILE_BLOCKS * 512];
+    static bool blockLoaded[MAX_FILE_BLOCKS];
+    SECTOR_RECORD_t received;
+    int headerSector = -1;
+    bool mapLoaded = false;
+    int directoryBlocks = 0;
+    int fileNumber = -1;
+    int fileBlocks = 0;
+    uint32_t fileLength = 0;
+    int loaded = 0;
+    int wrongBlocks = 0;
+
+    if(!select_drive())
+        return 0;
+
+    for(int records = 0; records < REVOLUTION_RECORDS * LOAD_REVOLUTIONS && drive_sending(); records++)
+    {
+        bool isHeader;
+        bool ok = receive_record((uint8_t*)&received, &isHeader);
+
+        if(isHeader)
+        {
+            SECTOR_HEADER_t* header = (SECTOR_HEADER_t*)&received;
+            headerSector = ok && header_valid(header) ? header->HeaderData[1] : -1;
+            continue;
+        }
+
+        if(!ok || headerSector < 0 || !record_valid(&received))
+            continue;
+
+        uint8_t file = received.HeaderData[0];
+        uint8_t block = received.HeaderData[1];
+
+        if(!mapLoaded)
+        {
+            //Nothing else can be done without the map
+            if(headerSector != 0 || file != MAP_FILE)
+                continue;
+
+            memcpy(map, received.Data, sizeof(map));
+            mapLoaded = true;
+
+            for(int sector = 0; sector < CARTRIDGE_SECTOR_COUNT; sector++)
+                directoryBlocks += map[sector * 2] == 0;
+
+            memset(blockLoaded, 0, sizeof(blockLoaded));
+            continue;
+        }
+
+        if(fileNumber < 0)
+        {
+            if(file != 0 || block >= directoryBlocks || blockLoaded[block])
+                continue;
+
+            memcpy(&directory[block * 512], received.Data, 512);
+            blockLoaded[block] = true;
+
+            if(++loaded < directoryBlocks)
+                continue;
+
+            //Whole directory, its first entry is its own header
+            uint32_t directoryLength = directory[0] << 24 | directory[1] << 16 | directory[2] << 8 | directory[3];
+
+            for(uint32_t entry = FILE_HEADER_SIZE; entry < directoryLength && fileNumber < 0; entry += FILE_HEADER_SIZE)
+            {
+                uint8_t* header = &directory[entry];
+                uint16_t nameLength = header[14] << 8 | header[15];
+                uint32_t length = header[0] << 24 | header[1] << 16 | header[2] << 8 | header[3];
+
+                if(length && nameLength == strlen(name) && strncasecmp((char*)&header[16], name, nameLength) == 0)
+                {
+                    fileNumber = entry / FILE_HEADER_SIZE;
+                    fileLength = length;
+                    fileBlocks = (length + 511) / 512;
+                }
+            }
+
+            if(fileNumber < 0 || fileBlocks > MAX_FILE_BLOCKS)
+                break;
+
+            memset(blockLoaded, 0, sizeof(blockLoaded));
+            loaded = 0;
+            continue;
+        }
+
+        if(file != fileNumber || block >= fileBlocks || blockLoaded[block])
+            continue;
+
+        //The block must be the one of the image
+        int pos = find_sector(sampleImage, headerSector);
+
+        if(pos < 0 || memcmp(received.Data, &sampleImage[CARTRIDGE_SECTOR_SIZE * pos + CARTRIDGE_HEADER_SIZE +
+            offsetof(SECTOR_RECORD_t, Data)], sizeof(received.Data)) != 0)
+            wrongBlocks++;
+
+        blockLoaded[block] = true;
+
+        if(++loaded == fileBlocks)
+            break;
+    }
+
+    deselect_drive("LOAD");
+
+    printf("LOAD: map %s, %d directory blocks, file %d with %d blocks, %d loaded, %d differ from the image\n",
+        mapLoaded ? "loaded" : "not found", directoryBlocks, fileNumber, fileBlocks, loaded, wrongBlocks);
+
+    return fileNumber >= 0 && loaded == fileBlocks && !wrongBlocks ? fileLength - FILE_HEADER_SIZE : 0;
+}
+
+//FORMAT mdv1_name, the expected cartridge is left in formatted
+static bool ql_format(const char* medium)
+{
+    SECTOR_HEADER_t header;
+    SECTOR_RECORD_t record;
+    SECTOR_RECORD_t received;
+    bool good[CARTRIDGE_SECTOR_COUNT + 1];
+    bool seen[CARTRIDGE_SECTOR_COUNT + 1];
+    uint16_t mediumId = ula_random();
+    int headerSector = -1;
+
+    if(!select_drive())
+        return false;
+
+    //A whole revolution of headers and blank records, the last ones overwrite the first
+    for(int sector = CARTRIDGE_SECTOR_COUNT; sector >= 0; sector--)
+    {
+        make_header(&header, sector, medium, mediumId);
+        make_record(&record, FREE_SECTOR, 0, NULL);
+        write_record(&header, HEADER_TRACK_DATA_SIZE);
+        write_record(&record, SECTOR_TRACK_DATA_SIZE);
+
+        if(sector < CARTRIDGE_SECTOR_COUNT)
+        {
+            memcpy(&formatted[CARTRIDGE_SECTOR_SIZE * sector], &header, CARTRIDGE_HEADER_SIZE);
+            memcpy(&formatted[CARTRIDGE_SECTOR_SIZE * sector + CARTRIDGE_HEADER_SIZE], &record, CARTRIDGE_DATA_SIZE);
+        }
+    }
+
+    //A revolution read back, until a header passes again
+    memset(good, 0, sizeof(good));
+    memset(seen, 0, sizeof(seen));
+    ql_set_lines(MDL_READ);
+    RUN_UNTIL(activeStatus == MDA_WRITE_HEADER_GAP, 1000);
+
+    for(int records = 0; records < REVOLUTION_RECORDS * 2 && drive_sending(); records++)
+    {
+        bool isHeader;
+        bool ok = receive_record((uint8_t*)&received, &isHeader);
+
+        if(isHeader)
+        {
+            SECTOR_HEADER_t* sent = (SECTOR_HEADER_t*)&received;
+            headerSector = ok && header_valid(sent) ? sent->HeaderData[1] : -1;
+
+            if(headerSector >= 0 && seen[headerSector])
+                break;
+
+            if(headerSector >= 0)
+                seen[headerSector] = true;
+        }
+        else if(ok && headerSector >= 0 && record_valid(&received))
+            good[headerSector] = true;
+    }
+
+    //Map and directory
+    uint8_t map[512];
+    uint8_t directory[512];
+    int goodSectors = 0;
+
+    for(int sector = 0; sector < CARTRIDGE_SECTOR_COUNT; sector++)
+    {
+        map[sector * 2] = good[sector] ? FREE_SECTOR : DAMAGED_SECTOR;
+        map[sector * 2 + 1] = 0;
+        goodSectors += good[sector];
+    }
+
+    map[0] = MAP_FILE;
+    map[DIRECTORY_SECTOR * 2] = 0;
+    map[510] = 0x01;
+    map[511] = DIRECTORY_SECTOR;
+
+    memset(directory, 0, sizeof(directory));
+    directory[3] = FILE_HEADER_SIZE;
+
+    make_record(&record, MAP_FILE, 0, map);
+    bool written = write_sector(0, &record);
+    memcpy(&formatted[CARTRIDGE_SECTOR_SIZE * 0 + CARTRIDGE_HEADER_SIZE], &record, CARTRIDGE_DATA_SIZE);
+
+    make_record(&record, 0, 0, directory);
+    written = write_sector(DIRECTORY_SECTOR, &record) && written;
+    memcpy(&formatted[CARTRIDGE_SECTOR_SIZE * DIRECTORY_SECTOR + CARTRIDGE_HEADER_SIZE], &record, CARTRIDGE_DATA_SIZE);
+
+    deselect_drive("FORMAT");
+
+    printf("FORMAT: %d good sectors, map %s\n", goodSectors, written ? "and directory written" : "or directory not written");
+
+    return written && goodSectors == CARTRIDGE_SECTOR_COUNT - 1 && !good[FORMAT_SKIPPED_SECTOR];
+}
+
+//Compares the cartridge image with the one written by the QL, sector by sector
+static void check_formatted(void)
+{
+    int missing = 0;
+    int differ = 0;
+    int damaged = -1;
+
+    for(int sector = 0; sector < CARTRIDGE_SECTOR_COUNT; sector++)
+    {
+        int pos = find_sector(cartridge_image, sector);
+
+        if(pos < 0)
+        {
+            missing++;
+            continue;
+        }
+
+        if(memcmp(&cartridge_image[CARTRIDGE_SECTOR_SIZE * pos], &formatted[CARTRIDGE_SECTOR_SIZE * sector], CARTRIDGE_SECTOR_SIZE) != 0)
+        {
+            if(sector == FORMAT_DAMAGED_SECTOR)
+                damaged = sector;
+            else
+                differ++;
+        }
+    }
+
+    printf("Cartridge: %d sectors missing, %d differ from the ones written, sector %d %s\n", missing, differ,
+        FORMAT_DAMAGED_SECTOR, damaged < 0 ? "intact" : "damaged");
+    check(!missing && !differ && damaged == FORMAT_DAMAGED_SECTOR, "Cartridge holds the formatted medium");
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 3)
+    {
+        printf("Usage: QlSessionBench image.mdv file\n");
+        return 1;
+    }
+
+    host_board_reset();
+    host_pio_set_min_clkdiv(MIN_CLKDIV);
+    ula_seed(1);
+
+    //The user interface is connected, the QL doesn't select the drive yet
+    host_gpio_drive(PIN_UI_DETECT, false);
+    host_gpio_drive(MD_SER_CLK, false);
+    host_gpio_drive(MD_SER_DATA_IN, false);
+
+    init_MD_control();
+    init_user_interface();
+    init_screen();
+
+    host_gpio_connect(MD_READ_HEAD_1, MD_WRITE_HEAD_1);
+    host_gpio_connect(MD_READ_HEAD_2, MD_WRITE_HEAD_2);
+
+    FILE* file = fopen(argv[1], "rb");
+    bool read = file && fread(mdvImage, 1, sizeof(mdvImage), file) == sizeof(mdvImage);
+
+    if(file)
+        fclose(file);
+
+    if(!read || !load_sample_mdv(argv[1], sampleImage))
+    {
+        printf("Can't load %s\n", argv[1]);
+        return 1;
+    }
+
+    if(!card_create())
+    {
+        printf("Can't create the card\n");
+        return 1;
+    }
+
+    card_store_file(0, "IMAGE   MDV", CARD_FIRST_FILE_CLUSTER, mdvImage, sizeof(mdvImage));
+    check(pf_mount(&fatfs) == FR_OK && load_image("IMAGE.MDV"), "Cartridge loaded");
+
+    if(!failures)
+    {
+        uint32_t length = ql_load(argv[2]);
+        printf("LOAD: %s, %u bytes\n", argv[2], length);
+        check(length != 0, "File loaded");
+
+        check(ql_format("BENCH"), "Cartridge formatted");
+
+        //Let the UI core store the last records
+        RUN_UNTIL(false, 10000);
+        check_formatted();
+    }
+
+    check(host_gpio_contentions() == 0, "No pin contentions");
+
+    if(failures)
+    {
+        printf("QlSessionBench: %d failures\n", failures);
+        return 1;
+    }
+
+    printf("QlSessionBench: passed\n");
+    return 0;
+}
@@ -0,0 +1,32 @@
+#include <stdio.h>
+#include "SampleImages.h"
+#include "SharedBuffers.h"
+#include "UserInterface.h"
+
+//Loads a MDV image to a cartridge image, with the same layout as load_mdv_sector
+bool load_sample_mdv(const char* path, uint8_t* image)
+{
+    FILE* file = fopen(path, "rb");
+
+    if(!file)
+        return false;
+
+    static uint8_t mdvSector[MDV_SECTOR_SIZE];
+    bool loaded = true;
+
+    for(int sector = 0; sector < CARTRIDGE_SECTOR_COUNT && loaded; sector++)
+    {
+        loaded = fread(mdvSector, 1, MDV_SECTOR_SIZE, file) == MDV_SECTOR_SIZE;
+
+        uint8_t* cartridgeSector = &image[CARTRIDGE_SECTOR_SIZE * sector];
+
+        for(int buc = 0; buc < MDV_HEADER_SIZE; buc++)
+            cartridgeSector[buc] = mdvSector[MDV_PREAMBLE_SIZE + buc];
+
+        for(int buc = 0; buc < MPD_DATA_SIZE; buc++)
+            cartridgeSector[MPD_HEADER_SIZE + buc] = mdvSector[MDV_PREAMBLE_SIZE * 2 + MDV_HEADER_SIZE + buc];
+    }
+
+    fclose(file);
+    return loaded;
+}
@@ -0,0 +1,8 @@
+#ifndef __SAMPLEIMAGES__
+#define __SAMPLEIMAGES__
+
+#include "pico/stdlib.h"
+
+bool load_sample_mdv(const char* path, uint8_t* image);
+
+#endif
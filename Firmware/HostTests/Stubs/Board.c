@@ -0,0 +1,367 @@
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/irq.h"
+#include "hardware/timer.h"
+#include "hardware/sync.h"
+#include "HostBoard.h"
+
+/*
+
+Clock, scheduler, alarms and IRQs of the simulated board
+
+The board advances from one activity to the next: a cycle of a state machine, a timed callback of a test or an
+alarm. After each one the DMAs move what their DREQs allow and the handlers of the asserted IRQ lines run, as the
+hardware does their handlers are not reentered while they run, even if they wait.
+
+The waits of the SDK functions run the board, so the code under test sees the time pass while it waits and the
+handlers preempt it there. A busy loop costs TIGHT_LOOP_CYCLES per iteration and a WFE sleeps until the next
+activity of the board.
+
+*/
+
+#define TIGHT_LOOP_CYCLES 20
+
+typedef struct hostevent
+{
+    uint64_t cycle;
+    uint64_t order;     //Callbacks of the same cycle run in the order they were scheduled
+    host_callback_t callback;
+    void* context;
+
+} hostevent_t;
+
+typedef struct hostalarm
+{
+    bool armed;
+    uint64_t cycle;
+    hardware_alarm_callback_t callback;
+
+} hostalarm_t;
+
+static uint64_t now;
+
+static hostevent_t* events;
+static uint32_t eventCount;
+static uint32_t eventCapacity;
+static uint64_t eventOrder;
+
+static hostalarm_t alarms[NUM_TIMERS];
+
+static irq_handler_t handlers[IRQ_COUNT];
+static uint32_t irqEnabled;
+static uint32_t irqActive;
+
+//Timed callbacks, a binary heap ordered by cycle
+
+static bool event_before(const hostevent_t* a, const hostevent_t* b)
+{
+    return a->cycle < b->cycle || (a->cycle == b->cycle && a->order < b->order);
+}
+
+static void swap_events(uint32_t a, uint32_t b)
+{
+    hostevent_t event = events[a];
+    events[a] = events[b];
+    events[b] = event;
+}
+
+static hostevent_t pop_event(void)
+{
+    hostevent_t first = events[0];
+    events[0] = events[--eventCount];
+
+    for(uint32_t pos = 0;;)
+    {
+        uint32_t smallest = pos;
+        uint32_t left = pos * 2 + 1;
+        uint32_t right = left + 1;
+
+        if(left < eventCount && event_before(&events[left], &events[smallest]))
+            smallest = left;
+
+        if(right < eventCount && event_before(&events[right], &events[smallest]))
+            smallest = right;
+
+        if(smallest == pos)
+            break;
+
+        swap_events(pos, smallest);
+        pos = smallest;
+    }
+
+    return first;
+}
+
+void host_schedule(uint64_t cycle, host_callback_t callback, void* context)
+{
+    if(eventCount == eventCapacity)
+    {
+        eventCapacity = eventCapacity ? eventCapacity * 2 : 256;
+        events = realloc(events, eventCapacity * sizeof(hostevent_t));
+        hard_assert(events);
+    }
+
+    uint32_t pos = eventCount++;
+    events[pos] = (hostevent_t){ cycle, eventOrder++, callback, context };
+
+    while(pos && event_before(&events[pos], &events[(pos - 1) / 2]))
+    {
+        swap_events(pos, (pos - 1) / 2);
+        pos = (pos - 1) / 2;
+    }
+}
+
+//Board
+
+uint64_t host_now(void)
+{
+    return now;
+}
+
+static uint64_t next_activity(void)
+{
+    uint64_t next = host_pio_next_tick();
+    uint64_t alarm = host_timer_next_alarm();
+
+    if(alarm < next)
+        next = alarm;
+
+    if(eventCount && events[0].cycle < next)
+        next = events[0].cycle;
+
+    return next;
+}
+
+void host_run_until(uint64_t cycle)
+{
+    for(;;)
+    {
+        uint64_t next = next_activity();
+
+        if(next > cycle)
+            break;
+
+        if(next > now)
+            now = next;
+
+        while(eventCount && events[0].cycle <= now)
+        {
+            hostevent_t event = pop_event();
+            event.callback(event.context);
+        }
+
+        host_timer_fire(now);
+        host_pio_tick(now);
+        host_dma_service();
+        host_irq_service();
+    }
+
+    if(cycle > now)
+        now = cycle;
+}
+
+void host_run_us(uint64_t us)
+{
+    host_run_until(now + us * HOST_CYCLES_PER_US);
+}
+
+void host_wait(uint64_t cycles)
+{
+    host_run_until(now + cycles);
+}
+
+void host_board_reset(void)
+{
+    now = 0;
+    eventCount = 0;
+    eventOrder = 0;
+    host_pio_reset();
+    host_dma_reset();
+    host_gpio_reset();
+    host_timer_reset();
+    host_irq_reset();
+}
+
+//Time
+
+uint64_t time_us_64(void)
+{
+    return now / HOST_CYCLES_PER_US;
+}
+
+uint32_t time_us_32(void)
+{
+    return (uint32_t)time_us_64();
+}
+
+absolute_time_t get_absolute_time(void)
+{
+    return time_us_64();
+}
+
+uint32_t to_ms_since_boot(absolute_time_t t)
+{
+    return t / 1000;
+}
+
+void sleep_us(uint64_t us)
+{
+    host_wait(us * HOST_CYCLES_PER_US);
+}
+
+void sleep_ms(uint32_t ms)
+{
+    sleep_us((uint64_t)ms * 1000);
+}
+
+void tight_loop_contents(void)
+{
+    host_wait(TIGHT_LOOP_CYCLES);
+}
+
+void __wfe(void)
+{
+    uint64_t next = next_activity();
+    host_run_until(next > now ? next : now + 1);
+}
+
+bool best_effort_wfe_or_timeout(absolute_time_t timeout_timestamp)
+{
+    if(get_absolute_time() >= timeout_timestamp)
+        return true;
+
+    __wfe();
+    return get_absolute_time() >= timeout_timestamp;
+}
+
+//Alarms
+
+void host_timer_reset(void)
+{
+    memset(alarms, 0, sizeof(alarms));
+}
+
+uint64_t host_timer_next_alarm(void)
+{
+    uint64_t next = UINT64_MAX;
+
+    for(uint alarm = 0; alarm < NUM_TIMERS; alarm++)
+    {
+        if(alarms[alarm].armed && alarms[alarm].cycle < next)
+            next = alarms[alarm].cycle;
+    }
+
+    return next;
+}
+
+void host_timer_fire(uint64_t cycle)
+{
+    for(uint alarm = 0; alarm < NUM_TIMERS; alarm++)
+    {
+        if(alarms[alarm].armed && alarms[alarm].cycle <= cycle)
+        {
+            alarms[alarm].armed = false;
+
+            if(alarms[alarm].callback)
+                alarms[alarm].callback(alarm);
+        }
+    }
+}
+
+void hardware_alarm_claim(uint alarm_num)
+{
+    (void)alarm_num;
+}
+
+void hardware_alarm_unclaim(uint alarm_num)
+{
+    hardware_alarm_cancel(alarm_num);
+}
+
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback)
+{
+    alarms[alarm_num].callback = callback;
+}
+
+//Returns true if the target has already passed, the alarm is not armed then
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t)
+{
+    uint64_t cycle = t * HOST_CYCLES_PER_US;
+
+    alarms[alarm_num].armed = cycle > now;
+    alarms[alarm_num].cycle = cycle;
+    return !alarms[alarm_num].armed;
+}
+
+void hardware_alarm_cancel(uint alarm_num)
+{
+    alarms[alarm_num].armed = false;
+}
+
+//IRQs
+
+void host_irq_reset(void)
+{
+    memset(handlers, 0, sizeof(handlers));
+    irqEnabled = 0;
+    irqActive = 0;
+}
+
+static bool irq_asserted(uint num)
+{
+    switch(num)
+    {
+        case PIO0_IRQ_0: return host_pio_irq_level(0, 0);
+        case PIO0_IRQ_1: return host_pio_irq_level(0, 1);
+        case PIO1_IRQ_0: return host_pio_irq_level(1, 0);
+        case PIO1_IRQ_1: return host_pio_irq_level(1, 1);
+        case DMA_IRQ_0: return host_dma_irq_level(0);
+        case DMA_IRQ_1: return host_dma_irq_level(1);
+        default: return false;
+    }
+}
+
+void host_irq_service(void)
+{
+    for(uint num = 0; num < IRQ_COUNT; num++)
+    {
+        uint32_t mask = 1u << num;
+
+        if(!(irqEnabled & mask) || (irqActive & mask) || !handlers[num] || !irq_asserted(num))
+            continue;
+
+        irqActive |= mask;
+        handlers[num]();
+        irqActive &= ~mask;
+    }
+}
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler)
+{
+    handlers[num] = handler;
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler)
+{
+    if(handlers[num] == handler)
+        handlers[num] = NULL;
+}
+
+irq_handler_t irq_get_exclusive_handler(uint num)
+{
+    return handlers[num];
+}
+
+void irq_set_enabled(uint num, bool enabled)
+{
+    if(enabled)
+        irqEnabled |= 1u << num;
+    else
+        irqEnabled &= ~(1u << num);
+}
+
+bool irq_is_enabled(uint num)
+{
+    return irqEnabled & (1u << num);
+}
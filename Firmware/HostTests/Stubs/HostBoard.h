@@ -0,0 +1,91 @@
+#ifndef __HOST_BOARD__
+#define __HOST_BOARD__
+
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+
+/*
+
+Simulated board of the host tests
+
+A single thread runs everything on a simulated clock counted in system cycles: the PIO state machines at their
+dividers, the DMA channels paced by their DREQs, the alarms, the timed callbacks of the tests and the IRQ handlers.
+Nothing moves while the code under test runs, the board only advances inside host_run_until, which is what the
+waits of the stubbed SDK functions (sleeps, blocking execs, busy loops) call.
+
+The tests drive the pins as the ULA does and listen to the levels the board outputs, the pins tied on the PCB
+are connected as a net so they see each other.
+
+*/
+
+#define HOST_SYS_CLOCK_HZ 200000000
+#define HOST_CYCLES_PER_US (HOST_SYS_CLOCK_HZ / 1000000)
+
+typedef void (*host_callback_t)(void* context);
+
+//Board
+
+uint64_t host_now(void);
+void host_schedule(uint64_t cycle, host_callback_t callback, void* context);
+void host_run_until(uint64_t cycle);
+void host_run_us(uint64_t us);
+void host_wait(uint64_t cycles);
+void host_board_reset(void);
+
+//GPIO
+
+typedef void (*host_gpio_listener_t)(uint gpio, bool level, uint64_t cycle, void* context);
+
+void host_gpio_reset(void);
+void host_gpio_drive(uint gpio, bool level);
+void host_gpio_release(uint gpio);
+void host_gpio_connect(uint gpio, uint other);
+uint32_t host_gpio_levels(void);
+void host_gpio_outputs_changed(void);
+void host_gpio_set_listener(host_gpio_listener_t listener, void* context);
+uint32_t host_gpio_contentions(void);
+
+//PIO
+
+//Called after each cycle of a traced state machine, pc is the address of the executed instruction
+typedef void (*host_pio_trace_t)(uint sm, uint pc, uint16_t instruction, bool stalled, uint64_t cycle, void* context);
+
+typedef struct hostsmstats
+{
+    uint8_t maxRxLevel;     //Highest RX FIFO level seen
+    uint8_t maxTxLevel;     //Highest TX FIFO level seen
+    uint32_t rxStalls;      //Cycles stalled on a full RX FIFO
+    uint32_t txStalls;      //Cycles stalled on an empty TX FIFO
+    uint32_t cycles;        //Cycles run while enabled
+
+} hostsmstats_t;
+
+void host_pio_reset(void);
+uint64_t host_pio_next_tick(void);
+void host_pio_tick(uint64_t cycle);
+void host_pio_set_min_clkdiv(uint div);
+void host_pio_set_trace(PIO pio, uint sm, host_pio_trace_t trace, void* context);
+hostsmstats_t host_pio_stats(PIO pio, uint sm);
+void host_pio_reset_stats(void);
+void host_pio_pin_outputs(uint index, uint32_t* values, uint32_t* directions);
+bool host_pio_irq_level(uint index, uint line);
+bool host_pio_dreq(uint dreq);
+bool host_pio_fifo_address(const volatile void* address, uint* dreq);
+void host_pio_fifo_write(uint dreq, uint32_t value);
+uint32_t host_pio_fifo_read(uint dreq);
+
+//DMA
+
+void host_dma_reset(void);
+void host_dma_service(void);
+bool host_dma_irq_level(uint line);
+
+//Alarms and IRQs
+
+void host_timer_reset(void);
+uint64_t host_timer_next_alarm(void);
+void host_timer_fire(uint64_t cycle);
+void host_irq_reset(void);
+void host_irq_service(void);
+
+#endif
@@ -0,0 +1,345 @@
+#include <string.h>
+#include "hardware/dma.h"
+#include "hardware/spi.h"
+#include "HostBoard.h"
+#include "SdCard.h"
+
+/*
+
+DMA channels of the simulated board
+
+A channel paced by a PIO DREQ moves a transfer each time the board finds its FIFO ready (not full for a TX one,
+not empty for a RX one), all the ready transfers of a board cycle are moved at once. As in the hardware a narrow
+write to a FIFO register is replicated over the 32 bits of the bus and the byte swap reverses the bytes of each
+transfer. A channel without DREQ copies the whole block when it's triggered.
+
+The SPI channels are not paced, a TX channel writing to the data register of a port and a RX channel reading it,
+started together, exchange their bytes with the SD card model.
+
+*/
+
+typedef struct hostdmachannel
+{
+    dma_channel_config config;
+    bool claimed;
+    bool busy;
+    bool fromFifo;
+    bool toFifo;
+    uint fifoDreq;
+
+} hostdmachannel_t;
+
+dma_channel_hw_t hostDmaHw[NUM_DMA_CHANNELS];
+
+static hostdmachannel_t channels[NUM_DMA_CHANNELS];
+static uint32_t interrupts;
+static uint32_t interruptEnables[2];
+
+static bool is_spi_register(const volatile void* address)
+{
+    return address == &spi0->hw.dr || address == &spi1->hw.dr;
+}
+
+static uint32_t read_memory(const volatile void* address, enum dma_channel_transfer_size size)
+{
+    switch(size)
+    {
+        case DMA_SIZE_8: return *(const volatile uint8_t*)address;
+        case DMA_SIZE_16: return *(const volatile uint16_t*)address;
+        default: return *(const volatile uint32_t*)address;
+    }
+}
+
+static void write_memory(volatile void* address, enum dma_channel_transfer_size size, uint32_t value)
+{
+    switch(size)
+    {
+        case DMA_SIZE_8: *(volatile uint8_t*)address = value; break;
+        case DMA_SIZE_16: *(volatile uint16_t*)address = value; break;
+        default: *(volatile uint32_t*)address = value; break;
+    }
+}
+
+static uint32_t swap_bytes(uint32_t value, enum dma_channel_transfer_size size)
+{
+    switch(size)
+    {
+        case DMA_SIZE_16: return ((value & 0xFF) << 8) | ((value >> 8) & 0xFF);
+        case DMA_SIZE_32: return __builtin_bswap32(value);
+        default: return value;
+    }
+}
+
+//Narrow writes to the peripherals are replicated over the bus
+static uint32_t replicate(uint32_t value, enum dma_channel_transfer_size size)
+{
+    switch(size)
+    {
+        case DMA_SIZE_8: return (value & 0xFF) * 0x01010101u;
+        case DMA_SIZE_16: return (value & 0xFFFF) * 0x00010001u;
+        default: return value;
+    }
+}
+
+static void finish(uint channel)
+{
+    channels[channel].busy = false;
+    interrupts |= 1u << channel;
+}
+
+//Moves a transfer of a channel
+static void transfer(uint channel)
+{
+    hostdmachannel_t* state = &channels[channel];
+    dma_channel_hw_t* hw = &hostDmaHw[channel];
+    uint step = 1u << state->config.size;
+    uint32_t value;
+
+    if(state->fromFifo)
+        value = host_pio_fifo_read(state->fifoDreq);
+    else
+        value = read_memory(hw->read_addr, state->config.size);
+
+    if(state->config.byteSwap)
+        value = swap_bytes(value, state->config.size);
+
+    if(state->toFifo)
+        host_pio_fifo_write(state->fifoDreq, replicate(value, state->config.size));
+    else
+        write_memory(hw->write_addr, state->config.size, value);
+
+    if(state->config.readIncrement)
+        hw->read_addr = (const volatile uint8_t*)hw->read_addr + step;
+
+    if(state->config.writeIncrement)
+        hw->write_addr = (volatile uint8_t*)hw->write_addr + step;
+
+    if(--hw->transfer_count == 0)
+        finish(channel);
+}
+
+//Exchanges the bytes of a TX and a RX SPI channel with the card
+static void spi_exchange(uint tx, uint rx)
+{
+    dma_channel_hw_t* txHw = &hostDmaHw[tx];
+    dma_channel_hw_t* rxHw = &hostDmaHw[rx];
+
+    if(txHw->transfer_count != rxHw->transfer_count)
+        return;
+
+    sd_card_dma_exchange(txHw->read_addr, channels[tx].config.readIncrement, rxHw->write_addr,
+        channels[rx].config.writeIncrement, txHw->transfer_count);
+
+    txHw->transfer_count = 0;
+    rxHw->transfer_count = 0;
+    finish(tx);
+    finish(rx);
+}
+
+static void start_channels(uint32_t mask)
+{
+    int spiTx = -1;
+    int spiRx = -1;
+
+    for(uint channel = 0; channel < NUM_DMA_CHANNELS; channel++)
+    {
+        if(!(mask & (1u << channel)) || !channels[channel].config.enable)
+            continue;
+
+        if(!hostDmaHw[channel].transfer_count)
+        {
+            finish(channel);
+            continue;
+        }
+
+        channels[channel].busy = true;
+
+        if(is_spi_register(hostDmaHw[channel].write_addr))
+            spiTx = channel;
+        else if(is_spi_register(hostDmaHw[channel].read_addr))
+            spiRx = channel;
+    }
+
+    if(spiTx >= 0 && spiRx >= 0)
+        spi_exchange(spiTx, spiRx);
+
+    host_dma_service();
+}
+
+//Board interface
+
+void host_dma_reset(void)
+{
+    memset(channels, 0, sizeof(channels));
+    memset(hostDmaHw, 0, sizeof(hostDmaHw));
+    interrupts = 0;
+    interruptEnables[0] = 0;
+    interruptEnables[1] = 0;
+}
+
+void host_dma_service(void)
+{
+    for(uint channel = 0; channel < NUM_DMA_CHANNELS; channel++)
+    {
+        hostdmachannel_t* state = &channels[channel];
+
+        if(!state->busy)
+            continue;
+
+        if(state->config.dreq == DREQ_FORCE)
+        {
+            while(state->busy)
+                transfer(channel);
+        }
+        else if(state->config.dreq < DREQ_SPI0_TX)
+        {
+            while(state->busy && host_pio_dreq(state->config.dreq))
+                transfer(channel);
+        }
+    }
+}
+
+bool host_dma_irq_level(uint line)
+{
+    return interrupts & interruptEnables[line];
+}
+
+//SDK functions
+
+int dma_claim_unused_channel(bool required)
+{
+    for(uint channel = 0; channel < NUM_DMA_CHANNELS; channel++)
+    {
+        if(!channels[channel].claimed)
+        {
+            channels[channel].claimed = true;
+            return channel;
+        }
+    }
+
+    if(required)
+        abort();
+
+    return -1;
+}
+
+void dma_channel_unclaim(uint channel)
+{
+    channels[channel].claimed = false;
+}
+
+dma_channel_config dma_channel_get_default_config(uint channel)
+{
+    (void)channel;
+    dma_channel_config config = { true, false, false, true, DMA_SIZE_32, DREQ_FORCE };
+    return config;
+}
+
+void channel_config_set_transfer_data_size(dma_channel_config* c, enum dma_channel_transfer_size size)
+{
+    c->size = size;
+}
+
+void channel_config_set_dreq(dma_channel_config* c, uint dreq)
+{
+    c->dreq = dreq;
+}
+
+void channel_config_set_read_increment(dma_channel_config* c, bool incr)
+{
+    c->readIncrement = incr;
+}
+
+void channel_config_set_write_increment(dma_channel_config* c, bool incr)
+{
+    c->writeIncrement = incr;
+}
+
+void channel_config_set_bswap(dma_channel_config* c, bool bswap)
+{
+    c->byteSwap = bswap;
+}
+
+void channel_config_set_enable(dma_channel_config* c, bool enable)
+{
+    c->enable = enable;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr, const volatile void* read_addr, uint transfer_count, bool trigger)
+{
+    hostdmachannel_t* state = &channels[channel];
+    state->config = *config;
+    state->fromFifo = host_pio_fifo_address(read_addr, &state->fifoDreq);
+    state->toFifo = !state->fromFifo && host_pio_fifo_address(write_addr, &state->fifoDreq);
+
+    hostDmaHw[channel].read_addr = read_addr;
+    hostDmaHw[channel].write_addr = write_addr;
+    hostDmaHw[channel].transfer_count = transfer_count;
+
+    if(trigger)
+        start_channels(1u << channel);
+}
+
+void dma_channel_start(uint channel)
+{
+    start_channels(1u << channel);
+}
+
+void dma_start_channel_mask(uint32_t chan_mask)
+{
+    start_channels(chan_mask);
+}
+
+void dma_channel_abort(uint channel)
+{
+    channels[channel].busy = false;
+}
+
+bool dma_channel_is_busy(uint channel)
+{
+    return channels[channel].busy;
+}
+
+void dma_channel_wait_for_finish_blocking(uint channel)
+{
+    while(dma_channel_is_busy(channel))
+        tight_loop_contents();
+}
+
+static void set_irq_enabled(uint line, uint channel, bool enabled)
+{
+    if(enabled)
+        interruptEnables[line] |= 1u << channel;
+    else
+        interruptEnables[line] &= ~(1u << channel);
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled)
+{
+    set_irq_enabled(0, channel, enabled);
+}
+
+void dma_channel_set_irq1_enabled(uint channel, bool enabled)
+{
+    set_irq_enabled(1, channel, enabled);
+}
+
+bool dma_channel_get_irq0_status(uint channel)
+{
+    return interrupts & interruptEnables[0] & (1u << channel);
+}
+
+bool dma_channel_get_irq1_status(uint channel)
+{
+    return interrupts & interruptEnables[1] & (1u << channel);
+}
+
+void dma_channel_acknowledge_irq0(uint channel)
+{
+    interrupts &= ~(1u << channel);
+}
+
+void dma_channel_acknowledge_irq1(uint channel)
+{
+    interrupts &= ~(1u << channel);
+}
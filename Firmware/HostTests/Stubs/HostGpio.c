@@ -0,0 +1,280 @@
+#include <string.h>
+#include "hardware/gpio.h"
+#include "HostBoard.h"
+
+/*
+
+Pins of the simulated board
+
+The level of a pin is resolved from everything connected to its net (the pins tied on the PCB): a level driven
+by the test wins (it's the ULA, stronger than the pull ups), then the outputs of the pins (SIO or PIO as selected
+by their function), then the pulls, and a floating net keeps its last level. Two outputs driving different levels,
+or an output against the level driven by the test, are counted as a contention. The levels are resolved each time
+a driver changes, so the listener gets every edge with the cycle where it happened.
+
+*/
+
+typedef struct hostpin
+{
+    uint8_t function;
+    bool sioOut;
+    bool sioOutput;
+    bool pullUp;
+    bool pullDown;
+    bool driven;
+    bool drivenLevel;
+    uint8_t net;
+
+} hostpin_t;
+
+static hostpin_t pins[NUM_BANK0_GPIOS];
+static uint32_t levels;
+static uint32_t contentions;
+static bool contending;
+static host_gpio_listener_t listener;
+static void* listenerContext;
+
+//Output of a pin, returns false if it doesn't drive its net
+static bool pin_output(uint gpio, uint32_t pioValues[2], uint32_t pioDirs[2], bool* level)
+{
+    hostpin_t* pin = &pins[gpio];
+
+    switch(pin->function)
+    {
+        case GPIO_FUNC_SIO:
+            *level = pin->sioOut;
+            return pin->sioOutput;
+
+        case GPIO_FUNC_PIO0:
+        case GPIO_FUNC_PIO1:
+        {
+            uint index = pin->function - GPIO_FUNC_PIO0;
+            *level = (pioValues[index] >> gpio) & 1;
+            return (pioDirs[index] >> gpio) & 1;
+        }
+
+        default:
+            return false;
+    }
+}
+
+typedef struct hostnet
+{
+    bool driven;
+    bool drivenLevel;
+    bool output;
+    bool outputLevel;
+    bool pullUp;
+    bool pullDown;
+
+} hostnet_t;
+
+static void resolve(void)
+{
+    hostnet_t nets[NUM_BANK0_GPIOS];
+    uint32_t pioValues[2];
+    uint32_t pioDirs[2];
+    uint32_t resolved = 0;
+    bool contention = false;
+
+    memset(nets, 0, sizeof(nets));
+    host_pio_pin_outputs(0, &pioValues[0], &pioDirs[0]);
+    host_pio_pin_outputs(1, &pioValues[1], &pioDirs[1]);
+
+    for(uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++)
+    {
+        hostnet_t* net = &nets[pins[gpio].net];
+        bool outputLevel;
+
+        if(pins[gpio].driven)
+        {
+            net->driven = true;
+            net->drivenLevel = pins[gpio].drivenLevel;
+        }
+
+        if(pin_output(gpio, pioValues, pioDirs, &outputLevel))
+        {
+            if(net->output && outputLevel != net->outputLevel)
+                contention = true;
+
+            net->output = true;
+            net->outputLevel = outputLevel;
+        }
+
+        net->pullUp |= pins[gpio].pullUp;
+        net->pullDown |= pins[gpio].pullDown;
+    }
+
+    for(uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++)
+    {
+        hostnet_t* net = &nets[gpio];
+
+        if(net->driven && net->output && net->drivenLevel != net->outputLevel)
+            contention = true;
+    }
+
+    for(uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++)
+    {
+        hostnet_t* net = &nets[pins[gpio].net];
+        bool level;
+
+        if(net->driven)
+            level = net->drivenLevel;
+        else if(net->output)
+            level = net->outputLevel;
+        else if(net->pullUp != net->pullDown)
+            level = net->pullUp;
+        else
+            level = (levels >> gpio) & 1;
+
+        if(level)
+            resolved |= 1u << gpio;
+    }
+
+    if(contention && !contending)
+        contentions++;
+
+    contending = contention;
+
+    uint32_t changed = resolved ^ levels;
+    levels = resolved;
+
+    if(listener && changed)
+    {
+        for(uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++)
+        {
+            if(changed & (1u << gpio))
+                listener(gpio, (levels >> gpio) & 1, host_now(), listenerContext);
+        }
+    }
+}
+
+//Board interface
+
+void host_gpio_reset(void)
+{
+    memset(pins, 0, sizeof(pins));
+
+    for(uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++)
+    {
+        pins[gpio].function = GPIO_FUNC_NULL;
+        pins[gpio].pullDown = true;
+        pins[gpio].net = gpio;
+    }
+
+    levels = 0;
+    contentions = 0;
+    contending = false;
+    listener = NULL;
+}
+
+void host_gpio_drive(uint gpio, bool level)
+{
+    pins[gpio].driven = true;
+    pins[gpio].drivenLevel = level;
+    resolve();
+}
+
+void host_gpio_release(uint gpio)
+{
+    pins[gpio].driven = false;
+    resolve();
+}
+
+void host_gpio_connect(uint gpio, uint other)
+{
+    uint8_t oldNet = pins[other].net;
+
+    for(uint buc = 0; buc < NUM_BANK0_GPIOS; buc++)
+    {
+        if(pins[buc].net == oldNet)
+            pins[buc].net = pins[gpio].net;
+    }
+
+    resolve();
+}
+
+uint32_t host_gpio_levels(void)
+{
+    return levels;
+}
+
+void host_gpio_outputs_changed(void)
+{
+    resolve();
+}
+
+void host_gpio_set_listener(host_gpio_listener_t newListener, void* context)
+{
+    listener = newListener;
+    listenerContext = context;
+}
+
+uint32_t host_gpio_contentions(void)
+{
+    return contentions;
+}
+
+//SDK functions
+
+void gpio_init(uint gpio)
+{
+    pins[gpio].sioOutput = false;
+    pins[gpio].sioOut = false;
+    gpio_set_function(gpio, GPIO_FUNC_SIO);
+}
+
+void gpio_set_function(uint gpio, uint fn)
+{
+    pins[gpio].function = fn;
+    resolve();
+}
+
+uint gpio_get_function(uint gpio)
+{
+    return pins[gpio].function;
+}
+
+void gpio_set_pulls(uint gpio, bool up, bool down)
+{
+    pins[gpio].pullUp = up;
+    pins[gpio].pullDown = down;
+    resolve();
+}
+
+void gpio_disable_pulls(uint gpio)
+{
+    gpio_set_pulls(gpio, false, false);
+}
+
+void gpio_pull_up(uint gpio)
+{
+    gpio_set_pulls(gpio, true, false);
+}
+
+void gpio_pull_down(uint gpio)
+{
+    gpio_set_pulls(gpio, false, true);
+}
+
+void gpio_set_dir(uint gpio, bool out)
+{
+    pins[gpio].sioOutput = out;
+    resolve();
+}
+
+bool gpio_is_dir_out(uint gpio)
+{
+    return pins[gpio].sioOutput;
+}
+
+void gpio_put(uint gpio, bool value)
+{
+    pins[gpio].sioOut = value;
+    resolve();
+}
+
+bool gpio_get(uint gpio)
+{
+    return (levels >> gpio) & 1;
+}
@@ -0,0 +1,1092 @@
+#include <string.h>
+#include "hardware/pio.h"
+#include "hardware/gpio.h"
+#include "HostBoard.h"
+
+/*
+
+PIO emulator
+
+Each state machine runs one cycle at each tick of its clock divider (a 16.8 fixed point as in the hardware),
+with the behaviour described in the RP2040 datasheet:
+
+ - An instruction that can't complete (a WAIT not satisfied, an IN or PUSH on a full RX FIFO, an OUT or PULL on
+   an empty TX FIFO, an IRQ WAIT) stalls and runs again on the next cycle, its side set is applied anyway.
+   The delay cycles start once the instruction completes.
+ - The autopush happens when the IN reaches the threshold, the autopull when an OUT finds the OSR empty.
+ - An instruction written to INSTR runs immediately on a disabled machine and on the next cycle of an enabled
+   one (cancelling a stall or a delay), writing another one before that cycle replaces it. It doesn't advance the
+   PC unless it is a jump.
+ - MOV to ISR or OSR resets its shift counter, the restart empties the OSR and clears the ISR.
+ - The IRQ flags 0 to 3 and the FIFO levels drive the two interrupt lines of each block.
+
+The pins of a block are shared by its machines, the GPIO module resolves them with the rest of the drivers.
+The machines can be clocked slower than configured with host_pio_set_min_clkdiv, the status machine polls the
+lines at the system clock and it would dominate the simulation time of a whole cartridge.
+
+*/
+
+#define FIFO_DEPTH 4
+#define EXEC_PC PIO_INSTRUCTION_COUNT
+
+typedef struct hostsm
+{
+    pio_sm_config config;
+    bool claimed;
+    bool enabled;
+    uint8_t pc;
+    uint32_t x;
+    uint32_t y;
+    uint32_t isr;
+    uint32_t osr;
+    uint8_t isrCount;
+    uint8_t osrCount;
+    uint8_t delay;
+    bool execPending;           //Instruction written to INSTR (or by OUT/MOV EXEC) waiting for its cycle
+    bool execStalled;           //The running instruction came from INSTR and it stalled
+    uint16_t execInstruction;
+    bool irqWaiting;            //The flag of an IRQ WAIT is set, waiting for its clear
+    uint32_t rxFifo[FIFO_DEPTH];
+    uint8_t rxRead;
+    uint8_t rxLevel;
+    uint32_t txFifo[FIFO_DEPTH];
+    uint8_t txRead;
+    uint8_t txLevel;
+    uint64_t nextTick;          //In 1/256 of cycle
+    hostsmstats_t stats;
+    host_pio_trace_t trace;
+    void* traceContext;
+
+} hostsm_t;
+
+typedef struct hostpio
+{
+    uint16_t memory[PIO_INSTRUCTION_COUNT];
+    uint32_t usedMemory;
+    uint8_t irqFlags;
+    uint32_t inte[2];
+    uint32_t fdebug;
+    uint32_t pinValues;
+    uint32_t pinDirs;
+    hostsm_t sm[NUM_PIO_STATE_MACHINES];
+
+} hostpio_t;
+
+pio_hw_t hostPioHw[2];
+
+static hostpio_t pios[2];
+static uint32_t minClkdiv;
+
+static uint threshold(uint8_t value)
+{
+    return value ? value : 32;
+}
+
+//Applies the flags cleared by the firmware and publishes the current ones
+static void sync_fdebug(uint index)
+{
+    uint32_t written = hostPioHw[index].fdebug;
+
+    if(!(written & HOST_FDEBUG_PUBLISHED))
+        pios[index].fdebug &= ~written;
+
+    hostPioHw[index].fdebug = pios[index].fdebug | HOST_FDEBUG_PUBLISHED;
+}
+
+static void set_fdebug(uint index, uint lsb, uint sm)
+{
+    sync_fdebug(index);
+    pios[index].fdebug |= 1u << (lsb + sm);
+    sync_fdebug(index);
+}
+
+static uint block_index(PIO pio)
+{
+    uint index = pio - hostPioHw;
+    sync_fdebug(index);
+    return index;
+}
+
+static hostsm_t* machine(PIO pio, uint sm)
+{
+    return &pios[block_index(pio)].sm[sm];
+}
+
+//FIFOs
+
+static bool rx_push(hostsm_t* sm, uint32_t value)
+{
+    if(sm->rxLevel == FIFO_DEPTH)
+        return false;
+
+    sm->rxFifo[(sm->rxRead + sm->rxLevel) % FIFO_DEPTH] = value;
+
+    if(++sm->rxLevel > sm->stats.maxRxLevel)
+        sm->stats.maxRxLevel = sm->rxLevel;
+
+    return true;
+}
+
+static uint32_t rx_pop(hostsm_t* sm)
+{
+    uint32_t value = sm->rxFifo[sm->rxRead];
+    sm->rxRead = (sm->rxRead + 1) % FIFO_DEPTH;
+    sm->rxLevel--;
+    return value;
+}
+
+static bool tx_push(hostsm_t* sm, uint32_t value)
+{
+    if(sm->txLevel == FIFO_DEPTH)
+        return false;
+
+    sm->txFifo[(sm->txRead + sm->txLevel) % FIFO_DEPTH] = value;
+
+    if(++sm->txLevel > sm->stats.maxTxLevel)
+        sm->stats.maxTxLevel = sm->txLevel;
+
+    return true;
+}
+
+static uint32_t tx_pop(hostsm_t* sm)
+{
+    uint32_t value = sm->txFifo[sm->txRead];
+    sm->txRead = (sm->txRead + 1) % FIFO_DEPTH;
+    sm->txLevel--;
+    return value;
+}
+
+//Pins
+
+static void write_pins(uint32_t* reg, uint base, uint count, uint32_t value)
+{
+    uint32_t mask = 0;
+    uint32_t bits = 0;
+
+    for(uint buc = 0; buc < count; buc++)
+    {
+        uint pin = (base + buc) & 31;
+        mask |= 1u << pin;
+        bits |= ((value >> buc) & 1u) << pin;
+    }
+
+    uint32_t updated = (*reg & ~mask) | bits;
+
+    if(updated != *reg)
+    {
+        *reg = updated;
+        host_gpio_outputs_changed();
+    }
+}
+
+static bool read_pin(uint pin)
+{
+    return (host_gpio_levels() >> (pin & 31)) & 1;
+}
+
+//Input pins rotated so the IN base is the bit 0
+static uint32_t read_in_pins(hostsm_t* sm)
+{
+    uint32_t levels = host_gpio_levels();
+    uint base = sm->config.inBase & 31;
+    return base ? (levels >> base) | (levels << (32 - base)) : levels;
+}
+
+static void side_set(hostpio_t* pio, hostsm_t* sm, uint16_t instruction)
+{
+    uint count = sm->config.sideSetCount;
+
+    if(!count)
+        return;
+
+    if(sm->config.sideSetOptional && !(instruction & 0x1000))
+        return;
+
+    uint bits = count - (sm->config.sideSetOptional ? 1 : 0);
+    uint value = (instruction >> (13 - count)) & ((1u << bits) - 1);
+
+    write_pins(sm->config.sideSetPindirs ? &pio->pinDirs : &pio->pinValues, sm->config.sideSetBase, bits, value);
+}
+
+static uint delay_cycles(hostsm_t* sm, uint16_t instruction)
+{
+    return (instruction >> 8) & ((1u << (5 - sm->config.sideSetCount)) - 1);
+}
+
+//Shift registers
+
+static void shift_in(hostsm_t* sm, uint32_t data, uint count)
+{
+    if(count == 32)
+        sm->isr = data;
+    else
+    {
+        data &= (1u << count) - 1;
+        sm->isr = sm->config.inShiftRight ? (sm->isr >> count) | (data << (32 - count)) : (sm->isr << count) | data;
+    }
+
+    sm->isrCount = sm->isrCount + count > 32 ? 32 : sm->isrCount + count;
+}
+
+static uint32_t shift_out(hostsm_t* sm, uint count)
+{
+    uint32_t data;
+
+    if(count == 32)
+    {
+        data = sm->osr;
+        sm->osr = 0;
+    }
+    else if(sm->config.outShiftRight)
+    {
+        data = sm->osr & ((1u << count) - 1);
+        sm->osr >>= count;
+    }
+    else
+    {
+        data = sm->osr >> (32 - count);
+        sm->osr <<= count;
+    }
+
+    sm->osrCount = sm->osrCount + count > 32 ? 32 : sm->osrCount + count;
+    return data;
+}
+
+static uint32_t reverse(uint32_t value)
+{
+    uint32_t reversed = 0;
+
+    for(int buc = 0; buc < 32; buc++)
+        reversed |= ((value >> buc) & 1u) << (31 - buc);
+
+    return reversed;
+}
+
+static uint irq_index(uint index, uint sm)
+{
+    return index & 0x10 ? (index & 4) | ((index + sm) & 3) : index & 7;
+}
+
+static void queue_exec(hostsm_t* sm, uint16_t instruction)
+{
+    sm->execPending = true;
+    sm->execInstruction = instruction;
+}
+
+//Runs an instruction, returns false if it stalls
+static bool execute(uint index, uint smIndex, uint16_t instruction, bool* jumped)
+{
+    hostpio_t* pio = &pios[index];
+    hostsm_t* sm = &pio->sm[smIndex];
+    pio_sm_config* config = &sm->config;
+    uint field = (instruction >> 5) & 7;
+    uint value = instruction & 0x1F;
+    uint32_t data;
+
+    switch(instruction >> 13)
+    {
+        case 0: //JMP
+        {
+            bool taken;
+
+            switch(field)
+            {
+                case 0: taken = true; break;
+                case 1: taken = !sm->x; break;
+                case 2: taken = sm->x != 0; sm->x--; break;
+                case 3: taken = !sm->y; break;
+                case 4: taken = sm->y != 0; sm->y--; break;
+                case 5: taken = sm->x != sm->y; break;
+                case 6: taken = read_pin(config->jmpPin); break;
+                default: taken = sm->osrCount < threshold(config->pullThreshold); break;
+            }
+
+            if(taken)
+            {
+                sm->pc = value;
+                *jumped = true;
+            }
+
+            return true;
+        }
+
+        case 1: //WAIT
+        {
+            bool polarity = instruction & 0x80;
+
+            switch(field & 3)
+            {
+                case 0:
+                    return read_pin(value) == polarity;
+
+                case 1:
+                    return read_pin(config->inBase + value) == polarity;
+
+                case 2:
+                {
+                    uint irq = irq_index(value, smIndex);
+                    bool flag = (pio->irqFlags >> irq) & 1;
+
+                    if(flag != polarity)
+                        return false;
+
+                    if(polarity)
+                        pio->irqFlags &= ~(1u << irq);
+
+                    return true;
+                }
+
+                default:
+                    return true;
+            }
+        }
+
+        case 2: //IN
+        {
+            uint count = value ? value : 32;
+
+            switch(field)
+            {
+                case 0: data = read_in_pins(sm); break;
+                case 1: data = sm->x; break;
+                case 2: data = sm->y; break;
+                case 6: data = sm->isr; break;
+                case 7: data = sm->osr; break;
+                default: data = 0; break;
+            }
+
+            bool push = config->autopush && sm->isrCount + count >= threshold(config->pushThreshold);
+
+            if(push && sm->rxLevel == FIFO_DEPTH)
+            {
+                set_fdebug(index, PIO_FDEBUG_RXSTALL_LSB, smIndex);
+                sm->stats.rxStalls++;
+                return false;
+            }
+
+            shift_in(sm, data, count);
+
+            if(push)
+            {
+                rx_push(sm, sm->isr);
+                sm->isr = 0;
+                sm->isrCount = 0;
+            }
+
+            return true;
+        }
+
+        case 3: //OUT
+        {
+            uint count = value ? value : 32;
+
+            if(config->autopull && sm->osrCount >= threshold(config->pullThreshold))
+            {
+                if(!sm->txLevel)
+                {
+                    set_fdebug(index, PIO_FDEBUG_TXSTALL_LSB, smIndex);
+                    sm->stats.txStalls++;
+                    return false;
+                }
+
+                sm->osr = tx_pop(sm);
+                sm->osrCount = 0;
+            }
+
+            data = shift_out(sm, count);
+
+            switch(field)
+            {
+                case 0: write_pins(&pio->pinValues, config->outBase, config->outCount, data); break;
+                case 1: sm->x = data; break;
+                case 2: sm->y = data; break;
+                case 4: write_pins(&pio->pinDirs, config->outBase, config->outCount, data); break;
+                case 5: sm->pc = data & 31; *jumped = true; break;
+                case 6: sm->isr = data; sm->isrCount = count; break;
+                case 7: queue_exec(sm, data); break;
+                default: break;
+            }
+
+            return true;
+        }
+
+        case 4: //PUSH and PULL
+        {
+            bool block = instruction & 0x20;
+            bool conditional = instruction & 0x40;
+
+            if(!(instruction & 0x80))
+            {
+                if(conditional && sm->isrCount < threshold(config->pushThreshold))
+                    return true;
+
+                if(!rx_push(sm, sm->isr) && block)
+                {
+                    set_fdebug(index, PIO_FDEBUG_RXSTALL_LSB, smIndex);
+                    sm->stats.rxStalls++;
+                    return false;
+                }
+
+                sm->isr = 0;
+                sm->isrCount = 0;
+            }
+            else
+            {
+                if(conditional && sm->osrCount < threshold(config->pullThreshold))
+                    return true;
+
+                if(sm->txLevel)
+                    sm->osr = tx_pop(sm);
+                else if(block)
+                {
+                    set_fdebug(index, PIO_FDEBUG_TXSTALL_LSB, smIndex);
+                    sm->stats.txStalls++;
+                    return false;
+                }
+                else
+                    sm->osr = sm->x;
+
+                sm->osrCount = 0;
+            }
+
+            return true;
+        }
+
+        case 5: //MOV
+        {
+            switch(instruction & 7)
+            {
+                case 0: data = read_in_pins(sm); break;
+                case 1: data = sm->x; break;
+                case 2: data = sm->y; break;
+                case 5: data = (config->movStatusRx ? sm->rxLevel : sm->txLevel) < config->movStatusLevel ? 0xFFFFFFFF : 0; break;
+                case 6: data = sm->isr; break;
+                case 7: data = sm->osr; break;
+                default: data = 0; break;
+            }
+
+            switch((instruction >> 3) & 3)
+            {
+                case 1: data = ~data; break;
+                case 2: data = reverse(data); break;
+                default: break;
+            }
+
+            switch(field)
+            {
+                case 0: write_pins(&pio->pinValues, config->outBase, config->outCount, data); break;
+                case 1: sm->x = data; break;
+                case 2: sm->y = data; break;
+                case 4: queue_exec(sm, data); break;
+                case 5: sm->pc = data & 31; *jumped = true; break;
+                case 6: sm->isr = data; sm->isrCount = 0; break;
+                case 7: sm->osr = data; sm->osrCount = 0; break;
+                default: break;
+            }
+
+            return true;
+        }
+
+        case 6: //IRQ
+        {
+            uint8_t flag = 1u << irq_index(value, smIndex);
+
+            if(instruction & 0x40)
+            {
+                pio->irqFlags &= ~flag;
+                return true;
+            }
+
+            if(!sm->irqWaiting)
+                pio->irqFlags |= flag;
+
+            sm->irqWaiting = (instruction & 0x20) && (pio->irqFlags & flag);
+            return !sm->irqWaiting;
+        }
+
+        default: //SET
+        {
+            switch(field)
+            {
+                case 0: write_pins(&pio->pinValues, config->setBase, config->setCount, value); break;
+                case 1: sm->x = value; break;
+                case 2: sm->y = value; break;
+                case 4: write_pins(&pio->pinDirs, config->setBase, config->setCount, value); break;
+                default: break;
+            }
+
+            return true;
+        }
+    }
+}
+
+//Runs a cycle of a machine
+static void run_cycle(uint index, uint smIndex)
+{
+    hostpio_t* pio = &pios[index];
+    hostsm_t* sm = &pio->sm[smIndex];
+    uint16_t instruction;
+    bool fromExec;
+    uint pc;
+
+    if(sm->execPending)
+    {
+        instruction = sm->execInstruction;
+        fromExec = true;
+        sm->execPending = false;
+        sm->execStalled = false;
+        sm->irqWaiting = false;
+        sm->delay = 0;
+    }
+    else if(sm->delay)
+    {
+        sm->delay--;
+        return;
+    }
+    else if(sm->execStalled)
+    {
+        instruction = sm->execInstruction;
+        fromExec = true;
+    }
+    else
+    {
+        instruction = pio->memory[sm->pc];
+        fromExec = false;
+    }
+
+    pc = fromExec ? EXEC_PC : sm->pc;
+    side_set(pio, sm, instruction);
+
+    bool jumped = false;
+    bool completed = execute(index, smIndex, instruction, &jumped);
+
+    if(!completed)
+    {
+        //A stalled INSTR keeps its own copy, a new exec queued while it runs replaces it
+        if(fromExec && !sm->execPending)
+            sm->execStalled = true;
+    }
+    else
+    {
+        sm->execStalled = false;
+
+        if(!jumped && !fromExec)
+            sm->pc = sm->pc == sm->config.wrapTop ? sm->config.wrapBottom : (sm->pc + 1) & 31;
+
+        //The delay of an OUT or MOV EXEC is ignored
+        sm->delay = sm->execPending ? 0 : delay_cycles(sm, instruction);
+    }
+
+    if(sm->trace)
+        sm->trace(smIndex, pc, instruction, !completed, host_now(), sm->traceContext);
+}
+
+static uint64_t period(hostsm_t* sm)
+{
+    uint64_t div = sm->config.clkdiv ? sm->config.clkdiv : 65536 * 256;
+    return div < minClkdiv * 256 ? minClkdiv * 256 : div;
+}
+
+//Board interface
+
+void host_pio_reset(void)
+{
+    memset(pios, 0, sizeof(pios));
+    memset(hostPioHw, 0, sizeof(hostPioHw));
+    minClkdiv = 0;
+
+    for(uint index = 0; index < 2; index++)
+    {
+        for(uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++)
+        {
+            pios[index].sm[sm].config = pio_get_default_sm_config();
+            pios[index].sm[sm].osrCount = 32;
+        }
+
+        sync_fdebug(index);
+    }
+}
+
+uint64_t host_pio_next_tick(void)
+{
+    uint64_t next = UINT64_MAX;
+
+    for(uint index = 0; index < 2; index++)
+    {
+        for(uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++)
+        {
+            if(pios[index].sm[sm].enabled && (pios[index].sm[sm].nextTick >> 8) < next)
+                next = pios[index].sm[sm].nextTick >> 8;
+        }
+    }
+
+    return next;
+}
+
+void host_pio_tick(uint64_t cycle)
+{
+    for(uint index = 0; index < 2; index++)
+    {
+        sync_fdebug(index);
+
+        for(uint smIndex = 0; smIndex < NUM_PIO_STATE_MACHINES; smIndex++)
+        {
+            hostsm_t* sm = &pios[index].sm[smIndex];
+
+            while(sm->enabled && (sm->nextTick >> 8) <= cycle)
+            {
+                run_cycle(index, smIndex);
+                sm->nextTick += period(sm);
+                sm->stats.cycles++;
+            }
+        }
+    }
+}
+
+void host_pio_set_min_clkdiv(uint div)
+{
+    minClkdiv = div;
+}
+
+void host_pio_set_trace(PIO pio, uint sm, host_pio_trace_t trace, void* context)
+{
+    hostsm_t* machineState = machine(pio, sm);
+    machineState->trace = trace;
+    machineState->traceContext = context;
+}
+
+hostsmstats_t host_pio_stats(PIO pio, uint sm)
+{
+    return machine(pio, sm)->stats;
+}
+
+void host_pio_reset_stats(void)
+{
+    for(uint index = 0; index < 2; index++)
+    {
+        for(uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++)
+            memset(&pios[index].sm[sm].stats, 0, sizeof(hostsmstats_t));
+    }
+}
+
+void host_pio_pin_outputs(uint index, uint32_t* values, uint32_t* directions)
+{
+    *values = pios[index].pinValues;
+    *directions = pios[index].pinDirs;
+}
+
+bool host_pio_irq_level(uint index, uint line)
+{
+    hostpio_t* pio = &pios[index];
+    uint32_t status = (uint32_t)(pio->irqFlags & 0x0F) << 8;
+
+    for(uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++)
+    {
+        if(pio->sm[sm].rxLevel)
+            status |= 1u << sm;
+
+        if(pio->sm[sm].txLevel < FIFO_DEPTH)
+            status |= 1u << (sm + 4);
+    }
+
+    return status & pio->inte[line];
+}
+
+//DREQs are numbered as in the RP2040, 8 per block with the TX FIFOs first
+bool host_pio_dreq(uint dreq)
+{
+    hostsm_t* sm = &pios[dreq / 8].sm[dreq & 3];
+    return dreq & 4 ? sm->rxLevel != 0 : sm->txLevel < FIFO_DEPTH;
+}
+
+bool host_pio_fifo_address(const volatile void* address, uint* dreq)
+{
+    for(uint index = 0; index < 2; index++)
+    {
+        for(uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++)
+        {
+            if(address == &hostPioHw[index].txf[sm] || address == &hostPioHw[index].rxf[sm])
+            {
+                *dreq = index * 8 + (address == &hostPioHw[index].rxf[sm] ? 4 : 0) + sm;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void host_pio_fifo_write(uint dreq, uint32_t value)
+{
+    if(!tx_push(&pios[dreq / 8].sm[dreq & 3], value))
+        set_fdebug(dreq / 8, PIO_FDEBUG_TXOVER_LSB, dreq & 3);
+}
+
+uint32_t host_pio_fifo_read(uint dreq)
+{
+    hostsm_t* sm = &pios[dreq / 8].sm[dreq & 3];
+
+    if(!sm->rxLevel)
+    {
+        set_fdebug(dreq / 8, PIO_FDEBUG_RXUNDER_LSB, dreq & 3);
+        return 0;
+    }
+
+    return rx_pop(sm);
+}
+
+//Configuration
+
+pio_sm_config pio_get_default_sm_config(void)
+{
+    pio_sm_config config;
+    memset(&config, 0, sizeof(config));
+    config.clkdiv = 256;
+    config.wrapBottom = 0;
+    config.wrapTop = 31;
+    config.inShiftRight = true;
+    config.outShiftRight = true;
+    config.outCount = 32;
+    config.setCount = 5;
+    return config;
+}
+
+void sm_config_set_wrap(pio_sm_config* c, uint wrap_target, uint wrap)
+{
+    c->wrapBottom = wrap_target;
+    c->wrapTop = wrap;
+}
+
+void sm_config_set_sideset(pio_sm_config* c, uint bit_count, bool optional, bool pindirs)
+{
+    c->sideSetCount = bit_count;
+    c->sideSetOptional = optional;
+    c->sideSetPindirs = pindirs;
+}
+
+void sm_config_set_sideset_pins(pio_sm_config* c, uint sideset_base)
+{
+    c->sideSetBase = sideset_base;
+}
+
+void sm_config_set_clkdiv(pio_sm_config* c, float div)
+{
+    uint16_t divInt = (uint16_t)div;
+    uint8_t divFrac = (uint8_t)((div - divInt) * 256);
+    sm_config_set_clkdiv_int_frac(c, divInt, divFrac);
+}
+
+void sm_config_set_clkdiv_int_frac(pio_sm_config* c, uint16_t div_int, uint8_t div_frac)
+{
+    c->clkdiv = ((uint32_t)div_int << 8) | div_frac;
+}
+
+void sm_config_set_set_pins(pio_sm_config* c, uint set_base, uint set_count)
+{
+    c->setBase = set_base;
+    c->setCount = set_count;
+}
+
+void sm_config_set_out_pins(pio_sm_config* c, uint out_base, uint out_count)
+{
+    c->outBase = out_base;
+    c->outCount = out_count;
+}
+
+void sm_config_set_in_pins(pio_sm_config* c, uint in_base)
+{
+    c->inBase = in_base;
+}
+
+void sm_config_set_jmp_pin(pio_sm_config* c, uint pin)
+{
+    c->jmpPin = pin;
+}
+
+void sm_config_set_in_shift(pio_sm_config* c, bool shift_right, bool autopush, uint push_threshold)
+{
+    c->inShiftRight = shift_right;
+    c->autopush = autopush;
+    c->pushThreshold = push_threshold & 31;
+}
+
+void sm_config_set_out_shift(pio_sm_config* c, bool shift_right, bool autopull, uint pull_threshold)
+{
+    c->outShiftRight = shift_right;
+    c->autopull = autopull;
+    c->pullThreshold = pull_threshold & 31;
+}
+
+void sm_config_set_mov_status(pio_sm_config* c, enum pio_mov_status_type status_sel, uint status_n)
+{
+    c->movStatusRx = status_sel == STATUS_RX_LESSTHAN;
+    c->movStatusLevel = status_n;
+}
+
+//Programs and state machines
+
+//Same placement as the SDK, the highest free space, the jumps are relocated to the offset
+uint pio_add_program(PIO pio, const pio_program_t* program)
+{
+    hostpio_t* state = &pios[block_index(pio)];
+    uint32_t mask = (1u << program->length) - 1;
+    int offset = program->origin;
+
+    if(offset < 0)
+    {
+        for(offset = PIO_INSTRUCTION_COUNT - program->length; offset >= 0; offset--)
+        {
+            if(!(state->usedMemory & (mask << offset)))
+                break;
+        }
+    }
+
+    if(offset < 0 || (state->usedMemory & (mask << offset)))
+        abort();
+
+    for(uint buc = 0; buc < program->length; buc++)
+    {
+        uint16_t instruction = program->instructions[buc];
+        state->memory[offset + buc] = instruction >> 13 ? instruction : instruction + offset;
+    }
+
+    state->usedMemory |= mask << offset;
+    return offset;
+}
+
+void pio_remove_program(PIO pio, const pio_program_t* program, uint loaded_offset)
+{
+    pios[block_index(pio)].usedMemory &= ~(((1u << program->length) - 1) << loaded_offset);
+}
+
+void pio_clear_instruction_memory(PIO pio)
+{
+    pios[block_index(pio)].usedMemory = 0;
+}
+
+int pio_claim_unused_sm(PIO pio, bool required)
+{
+    hostpio_t* state = &pios[block_index(pio)];
+
+    for(uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++)
+    {
+        if(!state->sm[sm].claimed)
+        {
+            state->sm[sm].claimed = true;
+            return sm;
+        }
+    }
+
+    if(required)
+        abort();
+
+    return -1;
+}
+
+void pio_sm_claim(PIO pio, uint sm)
+{
+    machine(pio, sm)->claimed = true;
+}
+
+void pio_sm_unclaim(PIO pio, uint sm)
+{
+    machine(pio, sm)->claimed = false;
+}
+
+void pio_gpio_init(PIO pio, uint pin)
+{
+    gpio_set_function(pin, pio == pio0 ? GPIO_FUNC_PIO0 : GPIO_FUNC_PIO1);
+}
+
+uint pio_get_index(PIO pio)
+{
+    return block_index(pio);
+}
+
+uint pio_get_dreq(PIO pio, uint sm, bool is_tx)
+{
+    return block_index(pio) * 8 + (is_tx ? 0 : 4) + sm;
+}
+
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config* config)
+{
+    pio_sm_set_enabled(pio, sm, false);
+
+    if(config)
+        pio_sm_set_config(pio, sm, config);
+    else
+    {
+        pio_sm_config defaultConfig = pio_get_default_sm_config();
+        pio_sm_set_config(pio, sm, &defaultConfig);
+    }
+
+    pio_sm_clear_fifos(pio, sm);
+
+    const uint32_t fdebug_sm_mask =
+            (1u << PIO_FDEBUG_TXOVER_LSB) |
+            (1u << PIO_FDEBUG_RXUNDER_LSB) |
+            (1u << PIO_FDEBUG_TXSTALL_LSB) |
+            (1u << PIO_FDEBUG_RXSTALL_LSB);
+    pio->fdebug = fdebug_sm_mask << sm;
+
+    pio_sm_restart(pio, sm);
+    pio_sm_clkdiv_restart(pio, sm);
+    pio_sm_exec(pio, sm, pio_encode_jmp(initial_pc));
+}
+
+void pio_sm_set_config(PIO pio, uint sm, const pio_sm_config* config)
+{
+    machine(pio, sm)->config = *config;
+}
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled)
+{
+    hostsm_t* state = machine(pio, sm);
+
+    if(enabled && !state->enabled)
+        state->nextTick = (host_now() + 1) << 8;
+
+    state->enabled = enabled;
+}
+
+void pio_sm_restart(PIO pio, uint sm)
+{
+    hostsm_t* state = machine(pio, sm);
+    state->isr = 0;
+    state->isrCount = 0;
+    state->osrCount = 32;
+    state->delay = 0;
+    state->irqWaiting = false;
+    state->execPending = false;
+    state->execStalled = false;
+}
+
+void pio_sm_clkdiv_restart(PIO pio, uint sm)
+{
+    machine(pio, sm)->nextTick = (host_now() + 1) << 8;
+}
+
+void pio_sm_exec(PIO pio, uint sm, uint instr)
+{
+    hostsm_t* state = machine(pio, sm);
+    queue_exec(state, instr);
+
+    if(!state->enabled)
+        run_cycle(block_index(pio), sm);
+}
+
+bool pio_sm_is_exec_stalled(PIO pio, uint sm)
+{
+    hostsm_t* state = machine(pio, sm);
+    return state->execPending || state->execStalled;
+}
+
+void pio_sm_exec_wait_blocking(PIO pio, uint sm, uint instr)
+{
+    pio_sm_exec(pio, sm, instr);
+
+    while(pio_sm_is_exec_stalled(pio, sm))
+        tight_loop_contents();
+}
+
+uint8_t pio_sm_get_pc(PIO pio, uint sm)
+{
+    return machine(pio, sm)->pc;
+}
+
+//FIFOs
+
+void pio_sm_clear_fifos(PIO pio, uint sm)
+{
+    hostsm_t* state = machine(pio, sm);
+    state->rxLevel = 0;
+    state->txLevel = 0;
+}
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data)
+{
+    host_pio_fifo_write(pio_get_dreq(pio, sm, true), data);
+}
+
+uint32_t pio_sm_get(PIO pio, uint sm)
+{
+    return host_pio_fifo_read(pio_get_dreq(pio, sm, false));
+}
+
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data)
+{
+    while(pio_sm_is_tx_fifo_full(pio, sm))
+        tight_loop_contents();
+
+    pio_sm_put(pio, sm, data);
+}
+
+uint32_t pio_sm_get_blocking(PIO pio, uint sm)
+{
+    while(pio_sm_is_rx_fifo_empty(pio, sm))
+        tight_loop_contents();
+
+    return pio_sm_get(pio, sm);
+}
+
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm)
+{
+    return machine(pio, sm)->rxLevel == 0;
+}
+
+bool pio_sm_is_rx_fifo_full(PIO pio, uint sm)
+{
+    return machine(pio, sm)->rxLevel == FIFO_DEPTH;
+}
+
+uint pio_sm_get_rx_fifo_level(PIO pio, uint sm)
+{
+    return machine(pio, sm)->rxLevel;
+}
+
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm)
+{
+    return machine(pio, sm)->txLevel == 0;
+}
+
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm)
+{
+    return machine(pio, sm)->txLevel == FIFO_DEPTH;
+}
+
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm)
+{
+    return machine(pio, sm)->txLevel;
+}
+
+//IRQ flags and interrupts
+
+bool pio_interrupt_get(PIO pio, uint pio_interrupt_num)
+{
+    return (pios[block_index(pio)].irqFlags >> pio_interrupt_num) & 1;
+}
+
+void pio_interrupt_clear(PIO pio, uint pio_interrupt_num)
+{
+    pios[block_index(pio)].irqFlags &= ~(1u << pio_interrupt_num);
+}
+
+static void set_irq_source(PIO pio, uint line, enum pio_interrupt_source source, bool enabled)
+{
+    hostpio_t* state = &pios[block_index(pio)];
+
+    if(enabled)
+        state->inte[line] |= 1u << source;
+    else
+        state->inte[line] &= ~(1u << source);
+}
+
+void pio_set_irq0_source_enabled(PIO pio, enum pio_interrupt_source source, bool enabled)
+{
+    set_irq_source(pio, 0, source, enabled);
+}
+
+void pio_set_irq1_source_enabled(PIO pio, enum pio_interrupt_source source, bool enabled)
+{
+    set_irq_source(pio, 1, source, enabled);
+}
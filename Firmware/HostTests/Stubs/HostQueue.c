@@ -0,0 +1,119 @@
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/util/queue.h"
+
+/*
+
+Host implementation of the SDK queue, shared by the threaded tests and the simulated board
+
+The queue keeps one slot free as the SDK one does, so a queue of N elements holds N events.
+
+*/
+
+void queue_init(queue_t* q, uint element_size, uint element_count)
+{
+    pthread_mutex_init(&q->lock, NULL);
+    q->data = calloc(element_count + 1, element_size);
+    q->wptr = 0;
+    q->rptr = 0;
+    q->element_size = element_size;
+    q->element_count = element_count;
+}
+
+void queue_free(queue_t* q)
+{
+    free(q->data);
+    q->data = NULL;
+    pthread_mutex_destroy(&q->lock);
+}
+
+//Gets the level, the lock must be taken
+static uint get_level(queue_t* q)
+{
+    int32_t level = q->wptr - q->rptr;
+
+    if(level < 0)
+        level += q->element_count + 1;
+
+    return level;
+}
+
+static uint16_t next_pointer(queue_t* q, uint16_t pointer)
+{
+    return ++pointer > q->element_count ? 0 : pointer;
+}
+
+uint queue_get_level(queue_t* q)
+{
+    pthread_mutex_lock(&q->lock);
+    uint level = get_level(q);
+    pthread_mutex_unlock(&q->lock);
+    return level;
+}
+
+bool queue_is_empty(queue_t* q)
+{
+    return queue_get_level(q) == 0;
+}
+
+bool queue_is_full(queue_t* q)
+{
+    return queue_get_level(q) == q->element_count;
+}
+
+bool queue_try_add(queue_t* q, const void* data)
+{
+    pthread_mutex_lock(&q->lock);
+    bool added = get_level(q) < q->element_count;
+
+    if(added)
+    {
+        memcpy(&q->data[q->wptr * q->element_size], data, q->element_size);
+        q->wptr = next_pointer(q, q->wptr);
+    }
+
+    pthread_mutex_unlock(&q->lock);
+    return added;
+}
+
+//Removes (or only reads) the oldest element, data can be NULL
+static bool take_element(queue_t* q, void* data, bool remove)
+{
+    pthread_mutex_lock(&q->lock);
+    bool taken = get_level(q) != 0;
+
+    if(taken)
+    {
+        if(data)
+            memcpy(data, &q->data[q->rptr * q->element_size], q->element_size);
+
+        if(remove)
+            q->rptr = next_pointer(q, q->rptr);
+    }
+
+    pthread_mutex_unlock(&q->lock);
+    return taken;
+}
+
+bool queue_try_remove(queue_t* q, void* data)
+{
+    return take_element(q, data, true);
+}
+
+bool queue_try_peek(queue_t* q, void* data)
+{
+    return take_element(q, data, false);
+}
+
+void queue_add_blocking(queue_t* q, const void* data)
+{
+    while(!queue_try_add(q, data))
+        tight_loop_contents();
+}
+
+void queue_remove_blocking(queue_t* q, void* data)
+{
+    while(!queue_try_remove(q, data))
+        tight_loop_contents();
+}
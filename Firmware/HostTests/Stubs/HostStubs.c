@@ -0,0 +1,57 @@
+#define _POSIX_C_SOURCE 200809L
+#include <sched.h>
+#include <time.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+/*
+
+Host implementation of the stubbed SDK functions
+
+The time comes from the monotonic clock. The busy waits yield so a test can run the producer and the
+consumer of a queue as two threads even on a single CPU. The queue is in HostQueue.c.
+
+*/
+
+uint64_t time_us_64(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+uint32_t time_us_32(void)
+{
+    return (uint32_t)time_us_64();
+}
+
+absolute_time_t get_absolute_time(void)
+{
+    return time_us_64();
+}
+
+uint32_t to_ms_since_boot(absolute_time_t t)
+{
+    return t / 1000;
+}
+
+void sleep_us(uint64_t us)
+{
+    struct timespec delay = { us / 1000000, (us % 1000000) * 1000L };
+    nanosleep(&delay, NULL);
+}
+
+void sleep_ms(uint32_t ms)
+{
+    sleep_us((uint64_t)ms * 1000);
+}
+
+void tight_loop_contents(void)
+{
+    sched_yield();
+}
+
+void __wfe(void)
+{
+    sched_yield();
+}
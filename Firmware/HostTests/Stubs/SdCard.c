@@ -0,0 +1,320 @@
+#define _POSIX_C_SOURCE 200809L
+#define _FILE_OFFSET_BITS 64
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "SdCard.h"
+#include "hardware/spi.h"
+#include "hardware/dma.h"
+
+/*
+
+SD card model for the host build of diskio.c
+
+The card is a block addressed SDv2 card in SPI mode, it answers each byte sent by the SPI port (or by the
+DMAs) with the next byte of its output, 0xFF when it has nothing to send. Commands are answered in the
+next byte, single and multiple block reads and writes are supported, the multiple block read goes on
+sending blocks until CMD12 arrives. The card has no access time, the traffic is what matters.
+
+The blocks are stored in a sparse temporary file.
+
+*/
+
+#define SD_BLOCK_SIZE 512
+#define SD_OUTPUT_SIZE (SD_BLOCK_SIZE + 16)
+
+typedef enum
+{
+    SD_IDLE,            //Waiting for commands
+    SD_WRITE_TOKEN,     //CMD24 received, waiting for the data token
+    SD_WRITE_TOKENS,    //CMD25 running, waiting for a data or stop token
+    SD_WRITE_DATA       //Receiving a data block and its CRC
+
+} sdstate_t;
+
+sdtraffic_t sdTraffic;
+
+static FILE* cardFile;
+static uint32_t cardSectors;
+
+static sdstate_t state = SD_IDLE;
+static bool appCommand;
+static bool idle = true;
+
+static uint8_t command[6];
+static uint8_t commandLength;
+
+static uint8_t output[SD_OUTPUT_SIZE];
+static uint16_t outputLength;
+static uint16_t outputPos;
+
+static bool streaming;          //CMD18 running
+static uint32_t nextSector;     //Next block read or written by a multiple block command
+
+static uint8_t block[SD_BLOCK_SIZE + 2];
+static uint16_t blockPos;
+static bool multipleWrite;
+
+bool sd_card_create(uint32_t sectors)
+{
+    cardFile = tmpfile();
+    cardSectors = sectors;
+
+    return cardFile && ftruncate(fileno(cardFile), (off_t)sectors * SD_BLOCK_SIZE) == 0;
+}
+
+bool sd_card_read(uint32_t sector, uint8_t* buffer)
+{
+    if(sector >= cardSectors)
+        return false;
+
+    return pread(fileno(cardFile), buffer, SD_BLOCK_SIZE, (off_t)sector * SD_BLOCK_SIZE) == SD_BLOCK_SIZE;
+}
+
+bool sd_card_write(uint32_t sector, const uint8_t* buffer)
+{
+    if(sector >= cardSectors)
+        return false;
+
+    return pwrite(fileno(cardFile), buffer, SD_BLOCK_SIZE, (off_t)sector * SD_BLOCK_SIZE) == SD_BLOCK_SIZE;
+}
+
+void sd_card_reset_traffic(void)
+{
+    memset(&sdTraffic, 0, sizeof(sdTraffic));
+}
+
+//Replaces the pending output
+static void respond(const uint8_t* bytes, uint16_t length)
+{
+    memcpy(output, bytes, length);
+    outputLength = length;
+    outputPos = 0;
+}
+
+//Queues a data block (token, data and CRC) after the pending output
+static void queue_block(uint32_t sector)
+{
+    uint16_t length = outputLength - outputPos;
+    memmove(output, &output[outputPos], length);
+
+    output[length++] = 0xFF;
+    output[length++] = 0xFE;
+
+    if(!sd_card_read(sector, &output[length]))
+        memset(&output[length], 0, SD_BLOCK_SIZE);
+
+    length += SD_BLOCK_SIZE;
+    output[length++] = 0;
+    output[length++] = 0;
+
+    outputLength = length;
+    outputPos = 0;
+    sdTraffic.blocksRead++;
+}
+
+static void execute_command()
+{
+    uint8_t index = command[0] & 0x3F;
+    uint32_t arg = (uint32_t)command[1] << 24 | command[2] << 16 | command[3] << 8 | command[4];
+    uint8_t r1 = idle ? 0x01 : 0x00;
+    bool application = appCommand;
+
+    appCommand = false;
+    sdTraffic.commands++;
+
+    if(application && (index == 41 || index == 23))
+    {
+        if(index == 41)
+            idle = false;
+
+        respond((const uint8_t[]){ 0x00 }, 1);
+        return;
+    }
+
+    switch(index)
+    {
+        case 0:
+            idle = true;
+            streaming = false;
+            state = SD_IDLE;
+            respond((const uint8_t[]){ 0x01 }, 1);
+            break;
+
+        case 8:
+            respond((const uint8_t[]){ r1, 0x00, 0x00, 0x01, arg & 0xFF }, 5);
+            break;
+
+        case 55:
+            appCommand = true;
+            respond(&r1, 1);
+            break;
+
+        case 58:
+            respond((const uint8_t[]){ r1, 0xC0, 0xFF, 0x80, 0x00 }, 5); //Powered up, block addressing
+            break;
+
+        case 12:
+            //Stuff byte, R1 and a short busy time
+            streaming = false;
+            respond((const uint8_t[]){ 0xFF, 0x00, 0x00, 0x00 }, 4);
+            break;
+
+        case 16:
+            respond(&r1, 1);
+            break;
+
+        case 17:
+            respond((const uint8_t[]){ 0x00 }, 1);
+            queue_block(arg);
+            break;
+
+        case 18:
+            respond((const uint8_t[]){ 0x00 }, 1);
+            streaming = true;
+            nextSector = arg;
+            break;
+
+        case 24:
+        case 25:
+            respond((const uint8_t[]){ 0x00 }, 1);
+            state = index == 24 ? SD_WRITE_TOKEN : SD_WRITE_TOKENS;
+            multipleWrite = index == 25;
+            nextSector = arg;
+            break;
+
+        default:
+            respond((const uint8_t[]){ 0x04 }, 1); //Illegal command
+            break;
+    }
+}
+
+//Exchanges a byte with the card
+static uint8_t sd_exchange(uint8_t in)
+{
+    if(streaming && outputPos == outputLength)
+        queue_block(nextSector++);
+
+    uint8_t out = outputPos < outputLength ? output[outputPos++] : 0xFF;
+
+    switch(state)
+    {
+        case SD_WRITE_TOKEN:
+        case SD_WRITE_TOKENS:
+
+            if(in == 0xFE || in == 0xFC)
+            {
+                state = SD_WRITE_DATA;
+                blockPos = 0;
+            }
+            else if(in == 0xFD && state == SD_WRITE_TOKENS)
+            {
+                //Stop token, busy while the card programs the blocks
+                state = SD_IDLE;
+                respond((const uint8_t[]){ 0xFF, 0x00, 0x00, 0x00 }, 4);
+            }
+
+            return out;
+
+        case SD_WRITE_DATA:
+
+            block[blockPos++] = in;
+
+            if(blockPos == SD_BLOCK_SIZE + 2)
+            {
+                sd_card_write(nextSector++, block);
+                sdTraffic.blocksWritten++;
+
+                //Data accepted and a short busy time
+                state = multipleWrite ? SD_WRITE_TOKENS : SD_IDLE;
+                respond((const uint8_t[]){ 0x05, 0x00, 0x00 }, 3);
+            }
+
+            return out;
+
+        default:
+            break;
+    }
+
+    //Commands start with 01b, a running transfer only sends 0xFF
+    if(commandLength == 0 && (in & 0xC0) != 0x40)
+        return out;
+
+    command[commandLength++] = in;
+
+    if(commandLength == 6)
+    {
+        commandLength = 0;
+        execute_command();
+    }
+
+    return out;
+}
+
+//SPI port
+
+spi_inst_t hostSpi0;
+spi_inst_t hostSpi1;
+
+uint spi_init(spi_inst_t* spi, uint baudrate)
+{
+    return spi_set_baudrate(spi, baudrate);
+}
+
+uint spi_set_baudrate(spi_inst_t* spi, uint baudrate)
+{
+    spi->baudrate = baudrate;
+    return baudrate;
+}
+
+void spi_set_format(spi_inst_t* spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order)
+{
+    (void)spi;
+    (void)data_bits;
+    (void)cpol;
+    (void)cpha;
+    (void)order;
+}
+
+int spi_write_read_blocking(spi_inst_t* spi, const uint8_t* src, uint8_t* dst, size_t len)
+{
+    (void)spi;
+    sdTraffic.spiCalls++;
+    sdTraffic.spiBytes += len;
+
+    for(size_t buc = 0; buc < len; buc++)
+        dst[buc] = sd_exchange(src[buc]);
+
+    return len;
+}
+
+uint spi_get_dreq(spi_inst_t* spi, bool is_tx)
+{
+    return (spi == spi0 ? DREQ_SPI0_TX : DREQ_SPI1_TX) + (is_tx ? 0 : 1);
+}
+
+spi_hw_t* spi_get_hw(spi_inst_t* spi)
+{
+    return &spi->hw;
+}
+
+//Bytes of a TX and a RX DMA channel started together, the DMA module calls it
+void sd_card_dma_exchange(const volatile void* source, bool readIncrement, volatile void* destination, bool writeIncrement, uint count)
+{
+    const volatile uint8_t* sourceByte = source;
+    volatile uint8_t* destinationByte = destination;
+
+    for(uint buc = 0; buc < count; buc++)
+    {
+        *destinationByte = sd_exchange(*sourceByte);
+
+        if(readIncrement)
+            sourceByte++;
+
+        if(writeIncrement)
+            destinationByte++;
+    }
+
+    sdTraffic.dmaTransfers++;
+    sdTraffic.dmaBytes += count;
+}
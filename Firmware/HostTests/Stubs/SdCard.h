@@ -0,0 +1,27 @@
+#ifndef __HOST_SDCARD__
+#define __HOST_SDCARD__
+
+#include "pico/stdlib.h"
+
+//Traffic seen by the SD card model
+typedef struct sdtraffic
+{
+    uint32_t spiCalls;      //spi_write_read_blocking calls
+    uint32_t spiBytes;      //Bytes exchanged by those calls
+    uint32_t dmaTransfers;  //DMA exchanges (a TX and a RX channel started together)
+    uint32_t dmaBytes;      //Bytes exchanged by the DMAs
+    uint32_t commands;      //Commands received by the card
+    uint32_t blocksRead;    //Data blocks started by the card, a multiple block read starts one more while CMD12 is sent
+    uint32_t blocksWritten; //Data blocks written to the card
+
+} sdtraffic_t;
+
+extern sdtraffic_t sdTraffic;
+
+bool sd_card_create(uint32_t sectors);
+bool sd_card_read(uint32_t sector, uint8_t* buffer);
+bool sd_card_write(uint32_t sector, const uint8_t* buffer);
+void sd_card_reset_traffic(void);
+void sd_card_dma_exchange(const volatile void* source, bool readIncrement, volatile void* destination, bool writeIncrement, uint count);
+
+#endif
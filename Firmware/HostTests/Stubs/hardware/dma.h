@@ -0,0 +1,71 @@
+#ifndef __HOST_HARDWARE_DMA__
+#define __HOST_HARDWARE_DMA__
+
+//Host replacement of the SDK header, the channels are run by HostDma.c. The PIO channels are paced by the FIFO
+//levels, a TX and a RX SPI channel started together exchange their bytes with the SD card model of SdCard.c
+
+#include "pico/stdlib.h"
+
+#define NUM_DMA_CHANNELS 12
+
+#define DREQ_PIO0_TX0 0
+#define DREQ_PIO0_RX0 4
+#define DREQ_PIO1_TX0 8
+#define DREQ_PIO1_RX0 12
+#define DREQ_SPI0_TX 16
+#define DREQ_SPI0_RX 17
+#define DREQ_SPI1_TX 18
+#define DREQ_SPI1_RX 19
+#define DREQ_FORCE 0x3F
+
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+
+typedef struct
+{
+    bool readIncrement;
+    bool writeIncrement;
+    bool byteSwap;
+    bool enable;
+    enum dma_channel_transfer_size size;
+    uint dreq;
+
+} dma_channel_config;
+
+typedef struct
+{
+    const volatile void* read_addr;
+    volatile void* write_addr;
+    volatile uint32_t transfer_count;
+
+} dma_channel_hw_t;
+
+extern dma_channel_hw_t hostDmaHw[NUM_DMA_CHANNELS];
+
+static inline dma_channel_hw_t* dma_channel_hw_addr(uint channel)
+{
+    return &hostDmaHw[channel];
+}
+
+int dma_claim_unused_channel(bool required);
+void dma_channel_unclaim(uint channel);
+dma_channel_config dma_channel_get_default_config(uint channel);
+void channel_config_set_transfer_data_size(dma_channel_config* c, enum dma_channel_transfer_size size);
+void channel_config_set_dreq(dma_channel_config* c, uint dreq);
+void channel_config_set_read_increment(dma_channel_config* c, bool incr);
+void channel_config_set_write_increment(dma_channel_config* c, bool incr);
+void channel_config_set_bswap(dma_channel_config* c, bool bswap);
+void channel_config_set_enable(dma_channel_config* c, bool enable);
+void dma_channel_configure(uint channel, const dma_channel_config* config, volatile void* write_addr, const volatile void* read_addr, uint transfer_count, bool trigger);
+void dma_channel_start(uint channel);
+void dma_start_channel_mask(uint32_t chan_mask);
+void dma_channel_abort(uint channel);
+bool dma_channel_is_busy(uint channel);
+void dma_channel_wait_for_finish_blocking(uint channel);
+void dma_channel_set_irq0_enabled(uint channel, bool enabled);
+void dma_channel_set_irq1_enabled(uint channel, bool enabled);
+bool dma_channel_get_irq0_status(uint channel);
+bool dma_channel_get_irq1_status(uint channel);
+void dma_channel_acknowledge_irq0(uint channel);
+void dma_channel_acknowledge_irq1(uint channel);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef __HOST_HARDWARE_GPIO__
+#define __HOST_HARDWARE_GPIO__
+
+//Host replacement of the SDK header, the pins are resolved by HostGpio.c with the PIO outputs, the pulls and the
+//levels driven by the tests
+
+#include "pico/stdlib.h"
+
+#define NUM_BANK0_GPIOS 30
+
+#define GPIO_OUT 1
+#define GPIO_IN 0
+
+#define GPIO_FUNC_SPI 1
+#define GPIO_FUNC_UART 2
+#define GPIO_FUNC_I2C 3
+#define GPIO_FUNC_PWM 4
+#define GPIO_FUNC_SIO 5
+#define GPIO_FUNC_PIO0 6
+#define GPIO_FUNC_PIO1 7
+#define GPIO_FUNC_NULL 0x1F
+
+void gpio_init(uint gpio);
+void gpio_set_function(uint gpio, uint fn);
+uint gpio_get_function(uint gpio);
+void gpio_disable_pulls(uint gpio);
+void gpio_pull_up(uint gpio);
+void gpio_pull_down(uint gpio);
+void gpio_set_pulls(uint gpio, bool up, bool down);
+void gpio_set_dir(uint gpio, bool out);
+bool gpio_is_dir_out(uint gpio);
+void gpio_put(uint gpio, bool value);
+bool gpio_get(uint gpio);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef __HOST_HARDWARE_I2C__
+#define __HOST_HARDWARE_I2C__
+
+//Host replacement of the SDK header, there is nothing connected to the bus of the simulated board (HostI2c.c),
+//the writes are accepted and counted
+
+#include "pico/stdlib.h"
+
+typedef struct i2c_inst
+{
+    uint32_t writes;
+    uint32_t bytes;
+
+} i2c_inst_t;
+
+extern i2c_inst_t hostI2c[2];
+
+#define i2c0 (&hostI2c[0])
+#define i2c1 (&hostI2c[1])
+
+uint i2c_init(i2c_inst_t* i2c, uint baudrate);
+int i2c_write_blocking(i2c_inst_t* i2c, uint8_t addr, const uint8_t* src, size_t len, bool nostop);
+
+#endif
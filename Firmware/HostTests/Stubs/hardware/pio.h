@@ -0,0 +1,211 @@
+#ifndef __HOST_HARDWARE_PIO__
+#define __HOST_HARDWARE_PIO__
+
+//Host replacement of the SDK header, the state machines are run by the emulator of HostPio.c
+//The FIFO registers only give the DMA an address to recognize, the firmware reads the FIFOs with the functions.
+//FDEBUG is write one to clear as in the hardware, the emulator publishes it with the HOST_FDEBUG_PUBLISHED bit set
+//so a write of the firmware (that never has that bit) is seen as the mask of the flags to clear
+
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+
+#define NUM_PIO_STATE_MACHINES 4
+#define PIO_INSTRUCTION_COUNT 32
+
+#define PIO_FDEBUG_RXSTALL_LSB 0
+#define PIO_FDEBUG_RXUNDER_LSB 8
+#define PIO_FDEBUG_TXOVER_LSB 16
+#define PIO_FDEBUG_TXSTALL_LSB 24
+#define HOST_FDEBUG_PUBLISHED (1u << 4)
+
+typedef struct
+{
+    volatile uint32_t fdebug;
+    volatile uint32_t txf[NUM_PIO_STATE_MACHINES];
+    volatile uint32_t rxf[NUM_PIO_STATE_MACHINES];
+
+} pio_hw_t;
+
+typedef pio_hw_t* PIO;
+
+extern pio_hw_t hostPioHw[2];
+
+#define pio0 (&hostPioHw[0])
+#define pio1 (&hostPioHw[1])
+
+typedef struct
+{
+    uint32_t clkdiv;            //Divider in 1/256 units
+    uint8_t wrapBottom;
+    uint8_t wrapTop;
+    uint8_t jmpPin;
+    uint8_t sideSetCount;       //Bits of the side set, the enable bit included
+    bool sideSetOptional;
+    bool sideSetPindirs;
+    bool movStatusRx;
+    uint8_t movStatusLevel;
+    bool inShiftRight;
+    bool outShiftRight;
+    bool autopush;
+    bool autopull;
+    uint8_t pushThreshold;      //32 is stored as 0 as in the hardware
+    uint8_t pullThreshold;
+    uint8_t inBase;
+    uint8_t outBase;
+    uint8_t outCount;
+    uint8_t setBase;
+    uint8_t setCount;
+    uint8_t sideSetBase;
+
+} pio_sm_config;
+
+typedef struct pio_program
+{
+    const uint16_t* instructions;
+    uint8_t length;
+    int8_t origin;
+
+} pio_program_t;
+
+enum pio_fifo_join { PIO_FIFO_JOIN_NONE = 0, PIO_FIFO_JOIN_TX = 1, PIO_FIFO_JOIN_RX = 2 };
+enum pio_mov_status_type { STATUS_TX_LESSTHAN = 0, STATUS_RX_LESSTHAN = 1 };
+
+enum pio_interrupt_source
+{
+    pis_sm0_rx_fifo_not_empty = 0,
+    pis_sm1_rx_fifo_not_empty = 1,
+    pis_sm2_rx_fifo_not_empty = 2,
+    pis_sm3_rx_fifo_not_empty = 3,
+    pis_sm0_tx_fifo_not_full = 4,
+    pis_sm1_tx_fifo_not_full = 5,
+    pis_sm2_tx_fifo_not_full = 6,
+    pis_sm3_tx_fifo_not_full = 7,
+    pis_interrupt0 = 8,
+    pis_interrupt1 = 9,
+    pis_interrupt2 = 10,
+    pis_interrupt3 = 11
+};
+
+//Same values as the SDK, the low three bits are the field of the instruction
+enum pio_src_dest
+{
+    pio_pins = 0u,
+    pio_x = 1u,
+    pio_y = 2u,
+    pio_null = 3u | 0x20u | 0x80u,
+    pio_pindirs = 4u | 0x08u | 0x40u | 0x80u,
+    pio_exec_mov = 4u | 0x08u | 0x10u | 0x20u | 0x40u,
+    pio_status = 5u | 0x08u | 0x10u | 0x20u | 0x80u,
+    pio_pc = 5u | 0x08u | 0x20u | 0x40u,
+    pio_isr = 6u | 0x20u,
+    pio_osr = 7u | 0x10u | 0x20u,
+    pio_exec_out = 7u | 0x08u | 0x20u | 0x40u | 0x80u
+};
+
+//Instruction encoding
+
+static inline uint pio_encode_jmp(uint addr)
+{
+    return addr & 0x1F;
+}
+
+static inline uint pio_encode_in(enum pio_src_dest src, uint count)
+{
+    return 0x4000 | ((src & 7u) << 5) | (count & 0x1F);
+}
+
+static inline uint pio_encode_out(enum pio_src_dest dest, uint count)
+{
+    return 0x6000 | ((dest & 7u) << 5) | (count & 0x1F);
+}
+
+static inline uint pio_encode_mov(enum pio_src_dest dest, enum pio_src_dest src)
+{
+    return 0xA000 | ((dest & 7u) << 5) | (src & 7u);
+}
+
+static inline uint pio_encode_mov_not(enum pio_src_dest dest, enum pio_src_dest src)
+{
+    return 0xA000 | ((dest & 7u) << 5) | (1u << 3) | (src & 7u);
+}
+
+static inline uint pio_encode_irq_set(bool relative, uint irq)
+{
+    return 0xC000 | (relative ? 0x10 : 0) | (irq & 7);
+}
+
+static inline uint pio_encode_irq_clear(bool relative, uint irq)
+{
+    return 0xC040 | (relative ? 0x10 : 0) | (irq & 7);
+}
+
+static inline uint pio_encode_set(enum pio_src_dest dest, uint value)
+{
+    return 0xE000 | ((dest & 7u) << 5) | (value & 0x1F);
+}
+
+static inline uint pio_encode_nop(void)
+{
+    return pio_encode_mov(pio_y, pio_y);
+}
+
+//Configuration
+
+pio_sm_config pio_get_default_sm_config(void);
+void sm_config_set_wrap(pio_sm_config* c, uint wrap_target, uint wrap);
+void sm_config_set_sideset(pio_sm_config* c, uint bit_count, bool optional, bool pindirs);
+void sm_config_set_sideset_pins(pio_sm_config* c, uint sideset_base);
+void sm_config_set_clkdiv(pio_sm_config* c, float div);
+void sm_config_set_clkdiv_int_frac(pio_sm_config* c, uint16_t div_int, uint8_t div_frac);
+void sm_config_set_set_pins(pio_sm_config* c, uint set_base, uint set_count);
+void sm_config_set_out_pins(pio_sm_config* c, uint out_base, uint out_count);
+void sm_config_set_in_pins(pio_sm_config* c, uint in_base);
+void sm_config_set_jmp_pin(pio_sm_config* c, uint pin);
+void sm_config_set_in_shift(pio_sm_config* c, bool shift_right, bool autopush, uint push_threshold);
+void sm_config_set_out_shift(pio_sm_config* c, bool shift_right, bool autopull, uint pull_threshold);
+void sm_config_set_mov_status(pio_sm_config* c, enum pio_mov_status_type status_sel, uint status_n);
+
+//Programs and state machines
+
+uint pio_add_program(PIO pio, const pio_program_t* program);
+void pio_remove_program(PIO pio, const pio_program_t* program, uint loaded_offset);
+void pio_clear_instruction_memory(PIO pio);
+int pio_claim_unused_sm(PIO pio, bool required);
+void pio_sm_claim(PIO pio, uint sm);
+void pio_sm_unclaim(PIO pio, uint sm);
+void pio_gpio_init(PIO pio, uint pin);
+uint pio_get_index(PIO pio);
+uint pio_get_dreq(PIO pio, uint sm, bool is_tx);
+
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config* config);
+void pio_sm_set_config(PIO pio, uint sm, const pio_sm_config* config);
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+void pio_sm_restart(PIO pio, uint sm);
+void pio_sm_clkdiv_restart(PIO pio, uint sm);
+void pio_sm_exec(PIO pio, uint sm, uint instr);
+bool pio_sm_is_exec_stalled(PIO pio, uint sm);
+void pio_sm_exec_wait_blocking(PIO pio, uint sm, uint instr);
+uint8_t pio_sm_get_pc(PIO pio, uint sm);
+
+//FIFOs
+
+void pio_sm_clear_fifos(PIO pio, uint sm);
+void pio_sm_put(PIO pio, uint sm, uint32_t data);
+uint32_t pio_sm_get(PIO pio, uint sm);
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data);
+uint32_t pio_sm_get_blocking(PIO pio, uint sm);
+bool pio_sm_is_rx_fifo_empty(PIO pio, uint sm);
+bool pio_sm_is_rx_fifo_full(PIO pio, uint sm);
+uint pio_sm_get_rx_fifo_level(PIO pio, uint sm);
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm);
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm);
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm);
+
+//IRQ flags and interrupts
+
+bool pio_interrupt_get(PIO pio, uint pio_interrupt_num);
+void pio_interrupt_clear(PIO pio, uint pio_interrupt_num);
+void pio_set_irq0_source_enabled(PIO pio, enum pio_interrupt_source source, bool enabled);
+void pio_set_irq1_source_enabled(PIO pio, enum pio_interrupt_source source, bool enabled);
+
+#endif
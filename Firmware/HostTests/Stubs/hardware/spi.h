@@ -0,0 +1,38 @@
+#ifndef __HOST_HARDWARE_SPI__
+#define __HOST_HARDWARE_SPI__
+
+//Host replacement of the SDK header, the SPI port is wired to the SD card model of SdCard.c
+
+#include "pico/stdlib.h"
+
+typedef struct
+{
+    volatile uint32_t dr;
+
+} spi_hw_t;
+
+typedef struct spi_inst
+{
+    spi_hw_t hw;
+    uint baudrate;
+
+} spi_inst_t;
+
+typedef enum { SPI_CPOL_0, SPI_CPOL_1 } spi_cpol_t;
+typedef enum { SPI_CPHA_0, SPI_CPHA_1 } spi_cpha_t;
+typedef enum { SPI_LSB_FIRST, SPI_MSB_FIRST } spi_order_t;
+
+extern spi_inst_t hostSpi0;
+extern spi_inst_t hostSpi1;
+
+#define spi0 (&hostSpi0)
+#define spi1 (&hostSpi1)
+
+uint spi_init(spi_inst_t* spi, uint baudrate);
+uint spi_set_baudrate(spi_inst_t* spi, uint baudrate);
+void spi_set_format(spi_inst_t* spi, uint data_bits, spi_cpol_t cpol, spi_cpha_t cpha, spi_order_t order);
+int spi_write_read_blocking(spi_inst_t* spi, const uint8_t* src, uint8_t* dst, size_t len);
+uint spi_get_dreq(spi_inst_t* spi, bool is_tx);
+spi_hw_t* spi_get_hw(spi_inst_t* spi);
+
+#endif
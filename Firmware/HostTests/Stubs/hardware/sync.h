@@ -0,0 +1,31 @@
+#ifndef __HOST_HARDWARE_SYNC__
+#define __HOST_HARDWARE_SYNC__
+
+//Host replacement of the SDK header, the barriers are real fences so the lock-free code can be tested with threads
+//The events are not used to sleep, a waiting thread just yields (HostStubs.c) or the simulated board runs until
+//its next activity (Board.c)
+
+#include "pico/stdlib.h"
+
+#define __dmb() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __sev() ((void)0)
+
+void __wfe(void);
+
+//The cores are not told apart, the IRQ handlers only run while the board advances so there is nothing to mask
+static inline uint get_core_num(void)
+{
+    return 0;
+}
+
+static inline uint32_t save_and_disable_interrupts(void)
+{
+    return 0;
+}
+
+static inline void restore_interrupts(uint32_t status)
+{
+    (void)status;
+}
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef __HOST_HARDWARE_TIMER__
+#define __HOST_HARDWARE_TIMER__
+
+//Host replacement of the SDK header, the alarms fire on the simulated clock of the board (Board.c)
+
+#include "pico/stdlib.h"
+
+#define NUM_TIMERS 4
+
+typedef void (*hardware_alarm_callback_t)(uint alarm_num);
+
+void hardware_alarm_claim(uint alarm_num);
+void hardware_alarm_unclaim(uint alarm_num);
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback);
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t);
+void hardware_alarm_cancel(uint alarm_num);
+
+#endif
@@ -0,0 +1,6 @@
+#ifndef __HOST_PICO_BINARY_INFO__
+#define __HOST_PICO_BINARY_INFO__
+
+//Host replacement of the SDK header, the host builds carry no binary info
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef __HOST_PICO_STDLIB__
+#define __HOST_PICO_STDLIB__
+
+//Host replacement of the SDK header, only the types and functions used by the sources built in the host tests
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+typedef unsigned int uint;
+typedef uint64_t absolute_time_t;
+
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+absolute_time_t get_absolute_time(void);
+uint32_t to_ms_since_boot(absolute_time_t t);
+void sleep_ms(uint32_t ms);
+void sleep_us(uint64_t us);
+void tight_loop_contents(void);
+bool best_effort_wfe_or_timeout(absolute_time_t timeout_timestamp);
+
+static inline absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us)
+{
+    return t + us;
+}
+
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms)
+{
+    return get_absolute_time() + (uint64_t)ms * 1000;
+}
+
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to)
+{
+    return (int64_t)(to - from);
+}
+
+//Error codes of the SDK (pico/error.h)
+enum pico_error_codes
+{
+    PICO_OK = 0,
+    PICO_ERROR_GENERIC = -1,
+    PICO_ERROR_TIMEOUT = -2
+};
+
+//Enabled in every build as in the SDK
+#define hard_assert(x) ((x) ? (void)0 : abort())
+
+//The SDK header includes the GPIO functions too
+#include "hardware/gpio.h"
+
+#endif
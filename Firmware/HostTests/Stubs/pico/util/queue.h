@@ -0,0 +1,31 @@
+#ifndef __HOST_PICO_QUEUE__
+#define __HOST_PICO_QUEUE__
+
+//Host replacement of the SDK queue, a ring protected by a mutex instead of a spin lock
+
+#include <pthread.h>
+#include "pico/stdlib.h"
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    uint8_t* data;
+    uint16_t wptr;
+    uint16_t rptr;
+    uint element_size;
+    uint element_count;
+
+} queue_t;
+
+void queue_init(queue_t* q, uint element_size, uint element_count);
+void queue_free(queue_t* q);
+uint queue_get_level(queue_t* q);
+bool queue_is_empty(queue_t* q);
+bool queue_is_full(queue_t* q);
+bool queue_try_add(queue_t* q, const void* data);
+bool queue_try_remove(queue_t* q, void* data);
+bool queue_try_peek(queue_t* q, void* data);
+void queue_add_blocking(queue_t* q, const void* data);
+void queue_remove_blocking(queue_t* q, void* data);
+
+#endif
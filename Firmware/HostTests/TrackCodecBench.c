@@ -0,0 +1,318 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "TrackCodec.h"
+#include "SharedBuffers.h"
+#include "SampleImages.h"
+
+/*
+
+Received records, original decoder against the packed one
+
+The original firmware received one byte per bit, found the preamble end in the buffer and rebuilt each
+byte from eight buffer bytes (read_buffer_set_pair). Now the read machines hunt the sync pattern and
+pack the data bits in words (LSB first), the CPU flushes the last partial word, and decode_track_pair
+merges the tracks a word at a time.
+
+Every record of the sample images is written as the ULA would do it, with some trash before the preamble
+and after the data, and received both ways. Both outputs must be identical to the cartridge data. Then
+both decoders are timed over all the records and the time per sector (header and data) is reported.
+
+*/
+
+//Size of the receive buffers of the original firmware
+#define EXPANDED_HEADER_BUFFER_SIZE 128
+#define EXPANDED_SECTOR_BUFFER_SIZE 2980
+
+#define BENCH_PASSES 20
+
+uint8_t cartridge_image[CART_SIZE];
+
+int failures = 0;
+
+typedef struct receivedtrack
+{
+    uint8_t expanded[EXPANDED_SECTOR_BUFFER_SIZE];
+    uint8_t packed[SECTOR_BUFFER_SIZE] __attribute__((aligned(4)));
+
+} receivedtrack_t;
+
+//Received records of an image, two tracks of each header and sector
+typedef struct receivedsector
+{
+    receivedtrack_t header[2];
+    receivedtrack_t sector[2];
+
+} receivedsector_t;
+
+receivedsector_t received[CARTRIDGE_SECTOR_COUNT];
+
+//Original implementation of find_preamble_end
+int8_t find_preamble_end(uint8_t* buffer)
+{
+    uint8_t zeroCount = 0;
+    uint8_t oneCount = 0;
+
+    //We need to find at least 16 zeros followed by 8 ones (0x00, 0x00, 0xFF)
+    for(int buc = 0; buc < 100; buc++)
+    {
+        if(buffer[buc] == 0)
+        {
+            if(oneCount != 0) //Do we came here form a one?
+            {
+                //Reset everything
+                zeroCount = 1;
+                oneCount = 0;
+            }
+            else
+                zeroCount++; //Increment count
+
+        }
+        else
+        {
+            if(zeroCount < 16) //Did we found a one before having eight zeros?
+            {
+                //Reset everything
+                oneCount = 0;
+                zeroCount = 0;
+            }
+            else
+                oneCount++; //Increment count
+        }
+
+        //Have we found the eight ones?
+        if(oneCount == 8)
+            return buc + 1;
+    }
+
+    //Error! We haven't found the gap end!!
+    return -1;
+
+}
+
+//Original implementation of read_buffer_set_pair, without the format detection
+void expanded_read_buffer_set_pair(uint8_t* destination, uint8_t* track1Buffer, uint8_t* track2Buffer, bool isHeader)
+{
+    uint16_t track1Pos = find_preamble_end(track1Buffer);
+    uint16_t track2Pos = find_preamble_end(track2Buffer);
+
+    uint16_t size = isHeader ? HEADER_TRACK_DATA_SIZE : SECTOR_TRACK_DATA_SIZE;
+
+    for(uint16_t buc = 0; buc < size; buc++)
+    {
+        *destination = track1Buffer[track1Pos] |
+            track1Buffer[track1Pos + 1] << 1 |
+            track1Buffer[track1Pos + 2] << 2 |
+            track1Buffer[track1Pos + 3] << 3 |
+            track1Buffer[track1Pos + 4] << 4 |
+            track1Buffer[track1Pos + 5] << 5 |
+            track1Buffer[track1Pos + 6] << 6 |
+            track1Buffer[track1Pos + 7] << 7;
+
+        track1Pos += 8;
+        destination++;
+
+        *destination = track2Buffer[track2Pos] |
+            track2Buffer[track2Pos + 1] << 1 |
+            track2Buffer[track2Pos + 2] << 2 |
+            track2Buffer[track2Pos + 3] << 3 |
+            track2Buffer[track2Pos + 4] << 4 |
+            track2Buffer[track2Pos + 5] << 5 |
+            track2Buffer[track2Pos + 6] << 6 |
+            track2Buffer[track2Pos + 7] << 7;
+
+        track2Pos += 8;
+        destination++;
+
+    }
+}
+
+//Receives a bit stream as a read machine and its DMA do it (microdrive_read and flush_PIO_read_machine)
+void pio_receive(uint32_t* words, const uint8_t* bits, uint16_t bitCount, uint16_t wordCount)
+{
+    uint32_t x = 0xFF000000; //load_PIO_read_pattern
+    uint32_t isr = 0xFFFFFFFF; //rx_gap, the zeros of the pattern must be received
+    uint8_t shiftCount = 0;
+    bool hunting = true;
+    uint16_t stored = 0;
+
+    for(int buc = 0; buc < bitCount && stored < wordCount; buc++)
+    {
+        isr = (isr >> 1) | ((uint32_t)bits[buc] << 31);
+
+        if(hunting)
+        {
+            //The ISR is rewritten after each bit, so the shift counter never reaches the autopush threshold
+            if(isr == x)
+            {
+                isr = 0;
+                hunting = false;
+            }
+
+            continue;
+        }
+
+        if(++shiftCount == 32)
+        {
+            words[stored++] = isr;
+            isr = 0;
+            shiftCount = 0;
+        }
+    }
+
+    //The ULA stopped writting, zeros are shifted in until the partial word is pushed
+    if(stored < wordCount && shiftCount)
+        words[stored] = isr >> (32 - shiftCount);
+}
+
+//Writes a record as the ULA does, trash, the preamble, the data and some trash after it, one byte per bit
+uint16_t ula_stream(uint8_t* bits, const uint8_t* source, uint16_t trackSize, bool isTrack2)
+{
+    uint16_t count = 0;
+
+    //Trash before the preamble, never eight ones in a row
+    int trash = rand() % 7;
+
+    for(int buc = 0; buc < trash; buc++)
+        bits[count++] = rand() & 1;
+
+    uint16_t zeros = (isTrack2 ? TRACK_2_PREAMBLE_ZERO_BITS : TRACK_1_PREAMBLE_ZERO_BITS) + rand() % 8;
+
+    for(int buc = 0; buc < zeros; buc++)
+        bits[count++] = 0;
+
+    for(int buc = 0; buc < PREAMBLE_ONE_BITS; buc++)
+        bits[count++] = 1;
+
+    for(int buc = 0; buc < trackSize; buc++)
+    {
+        for(int bit = 0; bit < 8; bit++)
+            bits[count++] = (source[buc * 2 + isTrack2] >> bit) & 1;
+    }
+
+    trash = rand() % 8;
+
+    for(int buc = 0; buc < trash; buc++)
+        bits[count++] = rand() & 1;
+
+    return count;
+}
+
+//Receives a track both ways
+void receive_track(receivedtrack_t* track, const uint8_t* source, bool isHeader, bool isTrack2)
+{
+    uint16_t trackSize = isHeader ? HEADER_TRACK_DATA_SIZE : SECTOR_TRACK_DATA_SIZE;
+
+    //The original buffers were filled by the DMA, the bits after the stream are left from previous transfers
+    for(int buc = 0; buc < EXPANDED_SECTOR_BUFFER_SIZE; buc++)
+        track->expanded[buc] = rand() & 1;
+
+    uint16_t bitCount = ula_stream(track->expanded, source, trackSize, isTrack2);
+
+    memset(track->packed, 0, sizeof(track->packed));
+    pio_receive((uint32_t*)track->packed, track->expanded, bitCount, isHeader ? HEADER_RX_WORDS : SECTOR_RX_WORDS);
+}
+
+//Decodes a record both ways and checks them against the cartridge data
+void check_record(const char* image, uint8_t sector, bool isHeader)
+{
+    static uint8_t expanded[CARTRIDGE_DATA_SIZE] __attribute__((aligned(4)));
+    static uint8_t packed[CARTRIDGE_DATA_SIZE] __attribute__((aligned(4)));
+
+    receivedtrack_t* tracks = isHeader ? received[sector].header : received[sector].sector;
+    uint16_t trackSize = isHeader ? HEADER_TRACK_DATA_SIZE : SECTOR_TRACK_DATA_SIZE;
+    uint8_t* source = &cartridge_image[CARTRIDGE_SECTOR_SIZE * sector + (isHeader ? 0 : CARTRIDGE_HEADER_SIZE)];
+
+    expanded_read_buffer_set_pair(expanded, tracks[0].expanded, tracks[1].expanded, isHeader);
+    decode_track_pair(packed, tracks[0].packed, tracks[1].packed, trackSize, 0, 0);
+
+    if(memcmp(expanded, source, trackSize * 2) || memcmp(packed, source, trackSize * 2))
+    {
+        failures++;
+        printf("%s: sector %d %s decoded data differs\n", image, sector, isHeader ? "header" : "data");
+    }
+}
+
+//Times a decoder over all the received sectors, returns ns per sector
+double time_decoder(bool packed)
+{
+    static uint8_t record[CARTRIDGE_DATA_SIZE] __attribute__((aligned(4)));
+    volatile uint32_t sink = 0;
+
+    uint64_t start = time_us_64();
+
+    for(int pass = 0; pass < BENCH_PASSES; pass++)
+    {
+        for(int sector = 0; sector < CARTRIDGE_SECTOR_COUNT; sector++)
+        {
+            receivedsector_t* set = &received[sector];
+
+            if(packed)
+            {
+                decode_track_pair(record, set->header[0].packed, set->header[1].packed, HEADER_TRACK_DATA_SIZE, 0, 12);
+                sink += decode_track_pair(record, set->sector[0].packed, set->sector[1].packed, SECTOR_TRACK_DATA_SIZE, 12, 524);
+            }
+            else
+            {
+                expanded_read_buffer_set_pair(record, set->header[0].expanded, set->header[1].expanded, true);
+                expanded_read_buffer_set_pair(record, set->sector[0].expanded, set->sector[1].expanded, false);
+            }
+
+            sink += record[sector % CARTRIDGE_DATA_SIZE];
+        }
+    }
+
+    uint64_t elapsed = time_us_64() - start;
+    return elapsed * 1000.0 / (BENCH_PASSES * CARTRIDGE_SECTOR_COUNT);
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        printf("Usage: TrackCodecBench image.mdv...\n");
+        return 1;
+    }
+
+    srand(1);
+
+    double expandedNs = 0;
+    double packedNs = 0;
+
+    for(int image = 1; image < argc; image++)
+    {
+        if(!load_sample_mdv(argv[image], cartridge_image))
+        {
+            printf("Can't load %s\n", argv[image]);
+            return 1;
+        }
+
+        for(int sector = 0; sector < CARTRIDGE_SECTOR_COUNT; sector++)
+        {
+            uint8_t* source = &cartridge_image[CARTRIDGE_SECTOR_SIZE * sector];
+
+            receive_track(&received[sector].header[0], source, true, false);
+            receive_track(&received[sector].header[1], source, true, true);
+            receive_track(&received[sector].sector[0], source + CARTRIDGE_HEADER_SIZE, false, false);
+            receive_track(&received[sector].sector[1], source + CARTRIDGE_HEADER_SIZE, false, true);
+
+            check_record(argv[image], sector, true);
+            check_record(argv[image], sector, false);
+        }
+
+        expandedNs += time_decoder(false);
+        packedNs += time_decoder(true);
+    }
+
+    printf("TrackCodecBench: %d images, %d records\n", argc - 1, (argc - 1) * CARTRIDGE_SECTOR_COUNT * 2);
+    printf("  expanded decoder: %.0f ns/sector\n", expandedNs / (argc - 1));
+    printf("  packed decoder:   %.0f ns/sector (with the checksum sums)\n", packedNs / (argc - 1));
+
+    if(failures)
+    {
+        printf("TrackCodecBench: %d records differ\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
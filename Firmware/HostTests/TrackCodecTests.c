@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "TrackCodec.h"
+#include "SharedBuffers.h"
+
+/*
+
+Unit tests of the track codec
+
+The received track buffers are the data bits packed LSB first, on a little endian CPU that is just the
+track bytes one after the other, so the buffers are built from random cartridge data split by tracks.
+Each decoded record must match the data and the returned sum must match a plain byte by byte sum.
+
+*/
+
+#define PASSES 1000
+
+int failures = 0;
+
+#define CHECK(CONDITION, ...) do { if(!(CONDITION)) { failures++; printf(__VA_ARGS__); printf("\n"); } } while(0)
+
+uint8_t data[CARTRIDGE_DATA_SIZE + 4] __attribute__((aligned(4)));
+uint8_t decoded[CARTRIDGE_DATA_SIZE + 4] __attribute__((aligned(4)));
+uint8_t track1[SECTOR_BUFFER_SIZE] __attribute__((aligned(4)));
+uint8_t track2[SECTOR_BUFFER_SIZE] __attribute__((aligned(4)));
+
+//Splits interleaved data in the two packed tracks
+void split_tracks(const uint8_t* source, uint16_t trackSize)
+{
+    for(int buc = 0; buc < trackSize; buc++)
+    {
+        track1[buc] = source[buc * 2];
+        track2[buc] = source[buc * 2 + 1];
+    }
+}
+
+uint16_t sum_bytes(const uint8_t* source, uint16_t start, uint16_t end)
+{
+    uint16_t sum = 0;
+
+    for(int buc = start; buc < end; buc++)
+        sum += source[buc];
+
+    return sum;
+}
+
+//Decodes a random record and checks the data and the sum of a range
+void check_record(uint16_t trackSize, uint16_t sumStart, uint16_t sumEnd)
+{
+    uint16_t size = trackSize * 2;
+
+    for(int buc = 0; buc < size; buc++)
+        data[buc] = rand();
+
+    split_tracks(data, trackSize);
+
+    //Bytes after the record must not be touched
+    memset(decoded, 0xA5, sizeof(decoded));
+
+    uint16_t sum = decode_track_pair(decoded, track1, track2, trackSize, sumStart, sumEnd);
+
+    CHECK(memcmp(decoded, data, size) == 0, "Track size %d: decoded data differs", trackSize);
+    CHECK(decoded[size] == 0xA5, "Track size %d: decoder wrote past the record", trackSize);
+    CHECK(sum == sum_bytes(data, sumStart, sumEnd), "Track size %d: sum %d-%d is %04X, expected %04X", trackSize,
+        sumStart, sumEnd, sum, sum_bytes(data, sumStart, sumEnd));
+}
+
+int main()
+{
+    srand(1);
+
+    for(int pass = 0; pass < PASSES; pass++)
+    {
+        //Headers, the firmware adds the first 12 bytes
+        check_record(HEADER_TRACK_DATA_SIZE, 0, 12);
+        check_record(HEADER_TRACK_DATA_SIZE, 0, 0);
+
+        //Sectors, the record data range used by the firmware, the whole record and a random aligned range
+        check_record(SECTOR_TRACK_DATA_SIZE, 12, 524);
+        check_record(SECTOR_TRACK_DATA_SIZE, 0, SECTOR_TRACK_DATA_SIZE * 2);
+
+        uint16_t start = (rand() % (SECTOR_TRACK_DATA_SIZE / 2)) & ~3;
+        uint16_t end = start + ((rand() % 512) & ~3);
+
+        if(end > SECTOR_TRACK_DATA_SIZE * 2)
+            end = SECTOR_TRACK_DATA_SIZE * 2;
+
+        check_record(SECTOR_TRACK_DATA_SIZE, start, end);
+    }
+
+    //Saturated bytes, the sum lanes must carry into the result
+    memset(data, 0xFF, sizeof(data));
+    split_tracks(data, SECTOR_TRACK_DATA_SIZE);
+    uint16_t sum = decode_track_pair(decoded, track1, track2, SECTOR_TRACK_DATA_SIZE, 12, 524);
+    CHECK(sum == (uint16_t)(512 * 0xFF), "Saturated sum is %04X, expected %04X", sum, (uint16_t)(512 * 0xFF));
+
+    if(failures)
+    {
+        printf("TrackCodecTests: %d failures\n", failures);
+        return 1;
+    }
+
+    printf("TrackCodecTests: passed\n");
+    return 0;
+}
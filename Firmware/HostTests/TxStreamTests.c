@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <string.h>
+#include "HostBoard.h"
+#include "UlaModel.h"
+#include "QlModel.h"
+#include "CardImage.h"
+#include "MicroDriveControl.h"
+#include "UserInterface.h"
+#include "SharedBuffers.h"
+#include "pff/pff.h"
+
+/*
+
+Conformance of the sent bit streams
+
+The write machines used to send expanded buffers, one byte per bit, prepared by write_buffer_set_pair.
+Now the write DMAs move the interleaved cartridge data in 16 bit transfers (track 2 swaps the bytes),
+the PIO FIFO gets the halfword replicated in both halves, the machines autopull each 8 bits shifting
+right (LSB first) and generate the preamble from the X and Y counters.
+
+The streams are the ones sent by the firmware itself: both cores run on the simulated board (QlModel.c),
+each sample image is stored in the card model and loaded by the user interface, then the QL selects the
+drive and keeps reading so the MD core sends every header and sector through init_PIO_machines,
+begin_PIO_write_gap and enable_write_DMAs. The edges of the write pins are decoded back by the ULA model.
+
+For every record of the sample images both streams must be identical up to the last data bit. The
+expanded buffers were sent with a few extra bits (7 on track 1 and 3 on track 2) with whatever was left
+in the buffers, the write machines now stop after the data, the ULA ignores them in both cases.
+
+*/
+
+//Bits sent by the expanded transfers (QL_PREAMBLE_SIZE + QL_HEADER_SIZE/QL_SECTOR_SIZE) of the original firmware
+#define EXPANDED_HEADER_BITS (48 + 71)
+#define EXPANDED_SECTOR_BITS (48 + 2455)
+#define STREAM_BITS 2560
+
+//The status machine is clamped as in MdControlTests, it would tick every cycle
+#define MIN_CLKDIV 125
+
+//Longest record, a sector with the preamble of track 2 and the checks of the end of the transfer
+#define RECORD_TIMEOUT_US ((TRACK_2_PREAMBLE_ZERO_BITS + PREAMBLE_ONE_BITS + SECTOR_TRACK_DATA_SIZE * 8 + 100) * 10)
+
+//State of the firmware
+extern mdactivestatus_t activeStatus;
+extern uint8_t currentBufferSet;
+extern USER_INTERFACE_STATE uiState;
+extern CARTRIDGE_FORMAT cfInserted;
+extern bool mdInUse;
+extern char currentPath[PATH_BUFFER_SIZE];
+extern FATFS fatfs;
+extern FILINFO fno;
+
+bool init_screen();
+
+static uint8_t mdvImage[CARTRIDGE_SECTOR_COUNT * MDV_SECTOR_SIZE];
+
+static int failures = 0;
+
+//Original implementation of write_buffer_set_pair, the buffers are zeroed as the original global ones
+static void expanded_write_buffer_set_pair(uint8_t* source, uint8_t* track1Buffer, uint8_t* track2Buffer, bool isHeader)
+{
+    track2Buffer += 4; //we skip four bits on buffer 2 to respect the skewing done by the ULA
+
+    for(int buc = 0; buc < PREAMBLE_ZERO_BITS; buc++)
+    {
+        track1Buffer[buc] = 0;
+        track2Buffer[buc] = 0;
+    } 
+
+    track1Buffer += PREAMBLE_ZERO_BITS;
+    track2Buffer += PREAMBLE_ZERO_BITS;
+
+    for(int buc = 0; buc < PREAMBLE_ONE_BITS; buc++)
+    {
+        track1Buffer[buc] = 1;
+        track2Buffer[buc] = 1;
+    } 
+
+    track1Buffer += PREAMBLE_ONE_BITS;
+    track2Buffer += PREAMBLE_ONE_BITS;
+
+    uint16_t copySize = isHeader ? HEADER_TRACK_DATA_SIZE : SECTOR_TRACK_DATA_SIZE;
+
+    for(int buc = 0; buc < copySize; buc++)
+    {
+        uint8_t t1b = *source;
+        source++;
+        uint8_t t2b = *source;
+        source++;
+
+        for(int buc = 0; buc < 8; buc++)
+        {
+            *track1Buffer = (t1b >> buc) & 1;
+            *track2Buffer = (t2b >> buc) & 1;
+            track1Buffer++;
+            track2Buffer++;
+        }
+    }
+}
+
+//Compares the streams sent for a record with the expanded ones, both tracks
+static void check_record(const char* image, uint8_t sector, bool isHeader)
+{
+    static uint8_t expanded1[STREAM_BITS], expanded2[STREAM_BITS], sent[STREAM_BITS];
+    const uint16_t zeros[2] = { TRACK_1_PREAMBLE_ZERO_BITS, TRACK_2_PREAMBLE_ZERO_BITS };
+
+    uint8_t* source = &cartridge_image[CARTRIDGE_SECTOR_SIZE * sector + (isHeader ? 0 : CARTRIDGE_HEADER_SIZE)];
+    uint16_t dataBits = (isHeader ? HEADER_TRACK_DATA_SIZE : SECTOR_TRACK_DATA_SIZE) * 8;
+    uint16_t expandedBits = isHeader ? EXPANDED_HEADER_BITS : EXPANDED_SECTOR_BITS;
+
+    memset(expanded1, 0, sizeof(expanded1));
+    memset(expanded2, 0, sizeof(expanded2));
+    expanded_write_buffer_set_pair(source, expanded1, expanded2, isHeader);
+
+    bool same = true;
+
+    for(int track = 0; track < 2; track++)
+    {
+        uint16_t sentBits = zeros[track] + PREAMBLE_ONE_BITS + dataBits;
+
+        same = same && sentBits <= expandedBits && ula_decode_write(track, sent, sentBits) == 0 &&
+            memcmp(sent, track ? expanded2 : expanded1, sentBits) == 0;
+    }
+
+    if(!same)
+    {
+        failures++;
+        printf("%s: sector %d %s streams differ\n", image, sector, isHeader ? "header" : "data");
+    }
+}
+
+//Loads an image stored in the card as the user interface does once the file is chosen in the browser
+static bool load_image(const char* name)
+{
+    memset(currentPath, 0, PATH_BUFFER_SIZE);
+    strcpy(fno.fname, name);
+    fno.fsize = sizeof(mdvImage);
+    cfInserted = MDV;
+    uiState = FILE_LOAD;
+
+    RUN_UNTIL(uiState == CARTRIDGE_READY, 2000000);
+    return uiState == CARTRIDGE_READY;
+}
+
+//The QL selects the drive and reads the whole cartridge, every record sent is checked
+//Returns the number of records checked
+static int check_image(const char* image)
+{
+    static bool checked[CARTRIDGE_SECTOR_COUNT][2];
+    int records = 0;
+
+    memset(checked, 0, sizeof(checked));
+
+    ql_set_lines(MDL_READ);
+    ql_shift_bit(true);
+    RUN_UNTIL(mdInUse && activeStatus == MDA_WRITE_HEADER_GAP, SHIFTER_SELECT_US + 1000);
+
+    for(int record = 0; record < CARTRIDGE_SECTOR_COUNT * 2 && mdInUse; record++)
+    {
+        //The set has been chosen once the gap starts, the write gap alarm starts sending it
+        mdactivestatus_t gap = activeStatus;
+        bool isHeader = gap == MDA_WRITE_HEADER_GAP;
+        uint8_t sector = bufferSets[currentBufferSet].sector_number;
+
+        ula_listen_write();
+        RUN_UNTIL(activeStatus != gap, QL_WRITE_GAP_US + 1000);
+        mdactivestatus_t transfer = activeStatus;
+        RUN_UNTIL(activeStatus != transfer, RECORD_TIMEOUT_US);
+
+        if(transfer != (isHeader ? MDA_WRITE_HEADER : MDA_WRITE_SECTOR) ||
+            activeStatus != (isHeader ? MDA_WRITE_SECTOR_GAP : MDA_WRITE_HEADER_GAP))
+            break;
+
+        check_record(image, sector, isHeader);
+        checked[sector][isHeader] = true;
+    }
+
+    ula_stop_listening();
+    ql_shift_bit(false);
+    RUN_UNTIL(!mdInUse, 1000);
+
+    for(int sector = 0; sector < CARTRIDGE_SECTOR_COUNT; sector++)
+        records += checked[sector][0] + checked[sector][1];
+
+    return records;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        printf("Usage: TxStreamTests image.mdv...\n");
+        return 1;
+    }
+
+    host_board_reset();
+    host_pio_set_min_clkdiv(MIN_CLKDIV);
+
+    //The user interface is connected, the QL doesn't select the drive yet
+    host_gpio_drive(PIN_UI_DETECT, false);
+    host_gpio_drive(MD_SER_CLK, false);
+    host_gpio_drive(MD_SER_DATA_IN, false);
+
+    init_MD_control();
+    init_user_interface();
+    init_screen();
+
+    host_gpio_connect(MD_READ_HEAD_1, MD_WRITE_HEAD_1);
+    host_gpio_connect(MD_READ_HEAD_2, MD_WRITE_HEAD_2);
+
+    //Every image in its own file, IMAGE1.MDV and so on
+    uint32_t cluster = CARD_FIRST_FILE_CLUSTER;
+    char name[16];
+
+    if(argc - 1 > 9 || !card_create())
+    {
+        printf("Can't create the card\n");
+        return 1;
+    }
+
+    for(int image = 1; image < argc; image++)
+    {
+        FILE* file = fopen(argv[image], "rb");
+        bool loaded = file && fread(mdvImage, 1, sizeof(mdvImage), file) == sizeof(mdvImage);
+
+        if(file)
+            fclose(file);
+
+        if(!loaded)
+        {
+            printf("Can't load %s\n", argv[image]);
+            return 1;
+        }
+
+        sprintf(name, "IMAGE%d  MDV", image);
+        cluster = card_store_file(image - 1, name, cluster, mdvImage, sizeof(mdvImage));
+    }
+
+    if(pf_mount(&fatfs))
+    {
+        printf("Can't mount the card\n");
+        return 1;
+    }
+
+    for(int image = 1; image < argc; image++)
+    {
+        sprintf(name, "IMAGE%d.MDV", image);
+
+        if(!load_image(name))
+        {
+            printf("%s: not loaded by the user interface\n", argv[image]);
+            failures++;
+            continue;
+        }
+
+        int records = check_image(argv[image]);
+
+        if(records != CARTRIDGE_SECTOR_COUNT * 2)
+        {
+            printf("%s: %d records sent\n", argv[image], records);
+            failures++;
+        }
+    }
+
+    if(host_gpio_contentions())
+    {
+        printf("%u pin contentions\n", host_gpio_contentions());
+        failures++;
+    }
+
+    if(failures)
+    {
+        printf("TxStreamTests: %d failures\n", failures);
+        return 1;
+    }
+
+    printf("TxStreamTests: %d images, %d records identical\n", argc - 1, (argc - 1) * CARTRIDGE_SECTOR_COUNT * 2);
+    return 0;
+}
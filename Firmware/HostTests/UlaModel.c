@@ -0,0 +1,296 @@
+#include <string.h>
+#include "UlaModel.h"
+#include "MicroDriveControl.h"
+#include "SharedBuffers.h"
+
+/*
+
+ULA model of the host tests
+
+Sending: the bits of a track are added (the preamble and the data, LSB first) and turned into the edges of a
+differential Manchester line (a transition at the start of every bit and another one in the middle of the ones),
+the line starts low. The board drives each edge at its cycle on the read pin of the head. Whole records are sent
+on both tracks with their preamble and track 2 four bits later, as the ULA skews them.
+
+Receiving: the edges of both write pins are recorded from ula_listen_write and decoded back into cells, a write
+starts with the line going high for the gap so the recording must start before the gap or during it.
+
+*/
+
+static uint32_t randomState = 1;
+
+static ulatrack_t recordTracks[2];
+
+static uint64_t writeEdges[2][ULA_MAX_BITS * 2];
+static uint32_t writeEdgeCount[2];
+static bool writeFirstLevel[2];
+
+void ula_seed(uint32_t seed)
+{
+    randomState = seed;
+}
+
+uint32_t ula_random(void)
+{
+    randomState = randomState * 1664525 + 1013904223;
+    return randomState >> 8;
+}
+
+//Sending
+
+void ula_track_init(ulatrack_t* track, uint gpio)
+{
+    track->gpio = gpio;
+    track->bitCount = 0;
+    track->edgeCount = 0;
+    track->nextEdge = 0;
+    track->level = false;
+}
+
+void ula_add_bits(ulatrack_t* track, uint8_t value, uint32_t count)
+{
+    for(uint32_t buc = 0; buc < count; buc++)
+        track->bits[track->bitCount++] = value;
+}
+
+void ula_add_bytes(ulatrack_t* track, const uint8_t* data, uint32_t count)
+{
+    for(uint32_t buc = 0; buc < count; buc++)
+    {
+        for(int bit = 0; bit < 8; bit++)
+            track->bits[track->bitCount++] = (data[buc] >> bit) & 1;
+    }
+}
+
+//Edges of the bits, the period is stretched by the clock error (in parts per thousand) and each edge is moved by
+//a random jitter of up to the given cycles
+void ula_make_edges(ulatrack_t* track, uint64_t start, int clockError, uint32_t jitter)
+{
+    double period = ULA_BIT_CYCLES * (1000.0 + clockError) / 1000.0;
+    uint64_t last = 0;
+
+    track->edgeCount = 0;
+
+    for(uint32_t bit = 0; bit < track->bitCount; bit++)
+    {
+        for(int half = 0; half < (track->bits[bit] ? 2 : 1); half++)
+        {
+            double offset = start + (bit + half * 0.5) * period;
+
+            if(jitter)
+                offset += (int32_t)(ula_random() % (jitter * 2 + 1)) - (int32_t)jitter;
+
+            uint64_t edge = (uint64_t)offset;
+
+            if(edge <= last)
+                edge = last + 1;
+
+            track->edges[track->edgeCount++] = last = edge;
+        }
+    }
+
+    track->nextEdge = 0;
+    track->level = false;
+}
+
+static void drive_edge(void* context)
+{
+    ulatrack_t* track = context;
+
+    track->level = !track->level;
+    host_gpio_drive(track->gpio, track->level);
+
+    if(++track->nextEdge < track->edgeCount)
+        host_schedule(track->edges[track->nextEdge], drive_edge, track);
+}
+
+//Drives the line low and schedules the edges, the line is left driven after the last one
+void ula_start_track(ulatrack_t* track)
+{
+    host_gpio_drive(track->gpio, false);
+
+    if(track->edgeCount)
+        host_schedule(track->edges[0], drive_edge, track);
+}
+
+//Cycle of the last edge of the track
+uint64_t ula_track_end(const ulatrack_t* track)
+{
+    return track->edgeCount ? track->edges[track->edgeCount - 1] : 0;
+}
+
+//Sends a record a while after now, the bytes are interleaved as in the cartridge image (the even ones go to track 1)
+//Returns the cycle of the last edge, the lines are left driven
+uint64_t ula_send_record(const uint8_t* data, uint32_t trackBytes)
+{
+    uint8_t trackData[SECTOR_TRACK_DATA_SIZE];
+    uint64_t start = host_now() + 20 * HOST_CYCLES_PER_US;
+    uint64_t end = 0;
+
+    for(int track = 0; track < 2; track++)
+    {
+        ulatrack_t* ula = &recordTracks[track];
+        ula_track_init(ula, track ? MD_READ_HEAD_2 : MD_READ_HEAD_1);
+
+        for(uint32_t buc = 0; buc < trackBytes; buc++)
+            trackData[buc] = data[buc * 2 + track];
+
+        ula_add_bits(ula, 0, PREAMBLE_ZERO_BITS);
+        ula_add_bits(ula, 1, PREAMBLE_ONE_BITS);
+        ula_add_bytes(ula, trackData, trackBytes);
+        ula_make_edges(ula, start + track * 4 * ULA_BIT_CYCLES, 0, 0);
+        ula_start_track(ula);
+
+        if(ula_track_end(ula) > end)
+            end = ula_track_end(ula);
+    }
+
+    return end;
+}
+
+//Distance from a cycle to the nearest edge of the track
+uint64_t ula_edge_margin(const ulatrack_t* track, uint64_t cycle)
+{
+    uint32_t low = 0;
+    uint32_t high = track->edgeCount;
+
+    while(low < high)
+    {
+        uint32_t mid = (low + high) / 2;
+
+        if(track->edges[mid] < cycle)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    uint64_t margin = UINT64_MAX;
+
+    if(low < track->edgeCount)
+        margin = track->edges[low] - cycle;
+
+    if(low > 0 && cycle - track->edges[low - 1] < margin)
+        margin = cycle - track->edges[low - 1];
+
+    return margin;
+}
+
+//Receiving
+
+static void listen_write(uint gpio, bool level, uint64_t cycle, void* context)
+{
+    (void)context;
+
+    int track = gpio == MD_WRITE_HEAD_1 ? 0 : gpio == MD_WRITE_HEAD_2 ? 1 : -1;
+
+    if(track < 0 || writeEdgeCount[track] == ULA_MAX_BITS * 2)
+        return;
+
+    if(!writeEdgeCount[track])
+        writeFirstLevel[track] = level;
+
+    writeEdges[track][writeEdgeCount[track]++] = cycle;
+}
+
+//Starts recording the edges of the write pins, the previous ones are discarded
+void ula_listen_write(void)
+{
+    writeEdgeCount[0] = writeEdgeCount[1] = 0;
+    host_gpio_set_listener(listen_write, NULL);
+}
+
+void ula_stop_listening(void)
+{
+    host_gpio_set_listener(NULL, NULL);
+}
+
+//Edges recorded on a track
+uint32_t ula_write_edges(int track)
+{
+    return writeEdgeCount[track];
+}
+
+//Level of the line at a cycle, relative to the one before the first recorded edge
+static bool level_at(int track, uint64_t cycle)
+{
+    uint32_t low = 0;
+    uint32_t high = writeEdgeCount[track];
+
+    //Edges up to the cycle
+    while(low < high)
+    {
+        uint32_t mid = (low + high) / 2;
+
+        if(writeEdges[track][mid] <= cycle)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return (low & 1) == 0;
+}
+
+//Decodes the cells sent by a write machine, the first cell starts a bit before the first falling edge
+//Returns the number of cells without the transition at their start, -1 if nothing was sent
+int ula_decode_write(int track, uint8_t* bits, uint32_t count)
+{
+    int missing = 0;
+
+    //If the recording started before the gap the first edge is its start (line high), the next one ends the
+    //first zero of the preamble
+    uint32_t firstFalling = writeFirstLevel[track] ? 1 : 0;
+
+    if(writeEdgeCount[track] < firstFalling + 1)
+        return -1;
+
+    uint64_t cellStart = writeEdges[track][firstFalling] - ULA_BIT_CYCLES;
+
+    for(uint32_t cell = 0; cell < count; cell++)
+    {
+        uint64_t at = cellStart + cell * ULA_BIT_CYCLES;
+        bool first = level_at(track, at + ULA_BIT_CYCLES / 4);
+        bool second = level_at(track, at + ULA_BIT_CYCLES * 3 / 4);
+
+        //Every bit starts with a transition
+        if(cell && level_at(track, at - ULA_BIT_CYCLES / 4) == first)
+            missing++;
+
+        bits[cell] = first != second;
+    }
+
+    return missing;
+}
+
+//Decodes a record sent by the write machines, both tracks must start with their preamble (track 2 has four more zeros)
+//and every bit with a transition. The bytes are interleaved as in the cartridge image
+bool ula_receive_record(uint8_t* data, uint32_t trackBytes)
+{
+    static uint8_t bits[TRACK_2_PREAMBLE_ZERO_BITS + PREAMBLE_ONE_BITS + SECTOR_TRACK_DATA_SIZE * 8];
+
+    for(int track = 0; track < 2; track++)
+    {
+        uint32_t zeros = track ? TRACK_2_PREAMBLE_ZERO_BITS : TRACK_1_PREAMBLE_ZERO_BITS;
+        uint32_t dataStart = zeros + PREAMBLE_ONE_BITS;
+
+        if(ula_decode_write(track, bits, dataStart + trackBytes * 8) != 0)
+            return false;
+
+        for(uint32_t bit = 0; bit < dataStart; bit++)
+        {
+            if(bits[bit] != (bit >= zeros))
+                return false;
+        }
+
+        for(uint32_t buc = 0; buc < trackBytes; buc++)
+        {
+            uint8_t value = 0;
+
+            for(int bit = 0; bit < 8; bit++)
+                value |= bits[dataStart + buc * 8 + bit] << bit;
+
+            data[buc * 2 + track] = value;
+        }
+    }
+
+    return true;
+}
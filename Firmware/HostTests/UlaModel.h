@@ -0,0 +1,45 @@
+#ifndef __HOST_ULAMODEL__
+#define __HOST_ULAMODEL__
+
+#include "pico/stdlib.h"
+#include "HostBoard.h"
+
+//ULA side of the head lines of the simulated board, sends tracks to the read machines and decodes what the
+//write machines send
+
+#define ULA_BIT_CYCLES (HOST_SYS_CLOCK_HZ / 100000)
+#define ULA_MAX_BITS 4096
+
+typedef struct ulatrack
+{
+    uint gpio;
+
+    //Bits sent by the ULA and the cycles of their edges
+    uint8_t bits[ULA_MAX_BITS];
+    uint32_t bitCount;
+    uint64_t edges[ULA_MAX_BITS * 2];
+    uint32_t edgeCount;
+    uint32_t nextEdge;
+    bool level;
+
+} ulatrack_t;
+
+void ula_seed(uint32_t seed);
+uint32_t ula_random(void);
+
+void ula_track_init(ulatrack_t* track, uint gpio);
+void ula_add_bits(ulatrack_t* track, uint8_t value, uint32_t count);
+void ula_add_bytes(ulatrack_t* track, const uint8_t* data, uint32_t count);
+void ula_make_edges(ulatrack_t* track, uint64_t start, int clockError, uint32_t jitter);
+void ula_start_track(ulatrack_t* track);
+uint64_t ula_track_end(const ulatrack_t* track);
+uint64_t ula_edge_margin(const ulatrack_t* track, uint64_t cycle);
+uint64_t ula_send_record(const uint8_t* data, uint32_t trackBytes);
+
+void ula_listen_write(void);
+void ula_stop_listening(void);
+uint32_t ula_write_edges(int track);
+int ula_decode_write(int track, uint8_t* bits, uint32_t count);
+bool ula_receive_record(uint8_t* data, uint32_t trackBytes);
+
+#endif
@@ -3,19 +3,21 @@
 #include "hardware/irq.h"
 #include "hardware/dma.h"
 #include "hardware/timer.h"
+#include "hardware/sync.h"
 #include "MicroDriveControl.h"
 #include "SharedBuffers.h"
 #include "SharedEvents.h"
 #include "EventMachine.h"
+#include "Trace.h"
 #include "PIO_machines.pio.h"
 
 bool isCartridgeInserted = false;
-bool secondBufferSet = false;
+uint8_t currentBufferSet = 0;
 
 mdstatus_t mdStatus = MDS_DESELECTED;
 mdactivestatus_t activeStatus = MDA_IDLE;
 
-evtmachine_t mdEventQueue;
+uint32_t statusEdgeTime = 0; //Time of the last status change, the gap latency is measured from it
 
 uint track1DMA;
 uint track2DMA;
@@ -47,6 +49,51 @@ int sm_write_head_2;
 int sm_shifter;
 int sm_exec_write;
 
+//Traces an event of the MD core with its current state
+#define MD_TRACE(EVENT, ARGS) trace_event(EVENT, ARGS, activeStatus, currentBufferSet)
+
+#define MD_ACTIVE_STATUS_ROW(STATE, READ_GAP, WRITE_GAP, READ_DATA, WRITE_DATA, HEADER, TRANSFER, GAP, NEXT_SET, RELEASE, ENTER) \
+    [STATE] = { { READ_GAP, WRITE_GAP, READ_DATA, WRITE_DATA }, HEADER, TRANSFER, GAP, NEXT_SET, RELEASE, ENTER },
+
+//Active status table, generated from MD_ACTIVE_STATUS_TABLE
+static const mdstatusrow_t mdStatusTable[MDA_STATE_COUNT] = { MD_ACTIVE_STATUS_TABLE(MD_ACTIVE_STATUS_ROW) };
+
+//Checks of each row of the table, a wrong row breaks the build
+#define MD_ACTIVE_STATUS_CHECK(STATE, READ_GAP, WRITE_GAP, READ_DATA, WRITE_DATA, HEADER, TRANSFER, GAP, NEXT_SET, RELEASE, ENTER) \
+    _Static_assert(READ_GAP <= MDA_UNCHANGED && WRITE_GAP <= MDA_UNCHANGED && READ_DATA <= MDA_UNCHANGED && WRITE_DATA <= MDA_UNCHANGED, \
+        #STATE ": the next states must be states of the table or MDA_UNCHANGED"); \
+    _Static_assert(READ_DATA == MDA_UNCHANGED || (GAP && TRANSFER == MDX_READ), #STATE ": only a read gap can start receiving data"); \
+    _Static_assert(WRITE_DATA == MDA_UNCHANGED || (GAP && TRANSFER == MDX_WRITE), #STATE ": only a write gap can start sending data"); \
+    _Static_assert(!GAP || TRANSFER != MDX_NONE, #STATE ": a gap must prepare a transfer"); \
+    _Static_assert((RELEASE != MTU_NONE) == NEXT_SET, #STATE ": the buffer set must be released when the state moves to the next one");
+
+MD_ACTIVE_STATUS_TABLE(MD_ACTIVE_STATUS_CHECK)
+
+//Transition started by each status line change
+static const mdtransition_t mdLineTransitions[] =
+{
+    [MDL_WRITE] = MDT_READ_DATA,
+    [MDL_WRITE_GAP] = MDT_READ_GAP,
+    [MDL_INVALID] = MDT_COUNT,
+    [MDL_READ] = MDT_WRITE_GAP
+};
+
+//Function that runs each transition
+static void (*const mdTransitionActions[MDT_COUNT])() =
+{
+    [MDT_READ_GAP] = begin_read_gap,
+    [MDT_WRITE_GAP] = begin_write_gap,
+    [MDT_READ_DATA] = end_read_gap,
+    [MDT_WRITE_DATA] = end_write_gap
+};
+
+//Changes the active status and traces the change
+void set_active_status(mdactivestatus_t nextState)
+{
+    MD_TRACE(TRC_STATE_CHANGED, (activeStatus << 8) | nextState);
+    activeStatus = nextState;
+}
+
 //enable the microdrive
 void select_md()
 {
@@ -70,15 +117,24 @@ void deselect_md()
 
     //We store the previous state to check if we need to notify the UI about any buffer change
     mdactivestatus_t previousState = activeStatus;
+    const mdstatusrow_t* previousRow = &mdStatusTable[previousState];
 
     //We reset the active status, this may cause the last buffer that was being read or written
     //to be sent again to the ULA if it was a header, but this should not cause any trouble as the QL
     //does not deselect the drive while it's doing a write/format operation
-    activeStatus = MDA_IDLE;
+    set_active_status(MDA_IDLE);
 
     //Abort the alarms if pending
     abort_shifter_alarm();
     abort_write_gap_alarm();
+    abort_write_finish_alarm();
+
+    //Keep the last bits if we were being written, the UI will process the buffer set
+    finish_transfer(previousState);
+
+    //Disable the write DMAs before the write machines are flushed
+    if(previousRow->transfer == MDX_WRITE)
+        disable_DMAs(false);
 
     //Ensure both transfer machines are idle
     sleep_PIO_write();
@@ -87,11 +143,9 @@ void deselect_md()
     //Disable the status machine
     deselect_PIO_status();
     
-    //Disable the DMAs if they're active
-    if(activeStatus >= MDA_READ_HEADER_GAP && activeStatus <= MDA_READ_SECTOR)
+    //Disable the read DMAs if they were active
+    if(previousRow->transfer == MDX_READ)
         disable_DMAs(true);
-    else if(activeStatus >= MDA_WRITE_HEADER_GAP && activeStatus <= MDA_WRITE_SECTOR)
-        disable_DMAs(false);
 
     //Set dir to input to avoid problems
     gpio_put(MD_HEAD_DIR, 1);
@@ -110,162 +164,105 @@ void deselect_md()
 //This is called at the beginning of the gaps and when the device is deselected
 void check_ui_notifications(mdactivestatus_t previousState, bool fromGap)
 {
-    switch(previousState)
-    {
-        case MDA_READ_SECTOR:   //We were reading a sector from the ULA, notify the UI that it needs to write the buffers to the cartridge
-                                //image and fill the buffers with the next sector
-        {
-            mtuevent_t readEvt;
-            readEvt.event = MTU_BUFFERSET_WRITTEN;
-            //If we are called from a gap routine the buffer set has already been changed
-            //but if we are being called from the deselection method then the bufferset has not been changed.
-            if(fromGap)
-                readEvt.arg = secondBufferSet ? 0 : 1;
-            else
-                readEvt.arg = secondBufferSet ? 1 : 0;
-
-            event_push(&mdToUiEventQueue, &readEvt);
-        }
-            break;
+    //If we were reading (writting) a sector the UI needs to store (send) the buffer set and fill it with the next sector
+    uint8_t releaseEvent = mdStatusTable[previousState].releaseEvent;
 
-        case MDA_WRITE_SECTOR:  //We were writting a sector to the ULA, notify the UI that it needs to fill the buffers with the next sector
-        {
-            mtuevent_t writeEvt;
-            writeEvt.event = MTU_BUFFERSET_READ;
-            //If we are called from a gap routine the buffer set has already been changed
-            //but if we are being called from the deselection method then the bufferset has not been changed.
-            if(fromGap)
-                writeEvt.arg = secondBufferSet ? 0 : 1;
-            else
-                writeEvt.arg = secondBufferSet ? 1 : 0;
-
-            event_push(&mdToUiEventQueue, &writeEvt);
-        }
+    if(releaseEvent != MTU_NONE)
+    {
+        mtuevent_t releaseEvt;
+        releaseEvt.event = releaseEvent;
+        releaseEvt.arg = release_buffer_set(fromGap);
 
-            break;
+        if(releaseEvent == MTU_BUFFERSET_WRITTEN)
+            perfCounters.setsReceived++;
+        else
+            perfCounters.setsServed++;
 
+        event_push(&mdToUiEventQueue, &releaseEvt);
     }
 
-    switch(activeStatus)
-    {
-        case MDA_READ_HEADER_GAP:
-        case MDA_READ_SECTOR_GAP:
-        {
-            mtuevent_t readEvt;
-            readEvt.event = MTU_MD_READING;
-            event_push(&mdToUiEventQueue, &readEvt);
-        }
-            break;
+    //Notify the UI if we are reading or writting, these only update the leds so we don't wait for the UI
+    //if it's busy (a lost one is counted in the queue and fixed by the next one)
+    uint8_t enterEvent = mdStatusTable[activeStatus].enterEvent;
 
-        case MDA_WRITE_HEADER_GAP:
-        case MDA_WRITE_SECTOR_GAP:
-        {
-            mtuevent_t writeEvt;
-            writeEvt.event = MTU_MD_WRITTING;
-            event_push(&mdToUiEventQueue, &writeEvt);
-        }
-            break;
+    if(enterEvent != MTU_NONE)
+    {
+        mtuevent_t enterEvt;
+        enterEvt.event = enterEvent;
+        event_try_push(&mdToUiStatusQueue, &enterEvt);
     }
 }
 
+//Returns a buffer set to the UI so it can process it and fill it with a new sector
+//If we are called from a gap routine the buffer set has already been changed
+//but if we are being called from the deselection method then the bufferset has not been changed.
+uint8_t release_buffer_set(bool fromGap)
+{
+    uint8_t bufferSet = fromGap ? (currentBufferSet + BUFFER_SET_COUNT - 1) % BUFFER_SET_COUNT : currentBufferSet;
+    bufferSets[bufferSet].ready = false;
+    return bufferSet;
+}
+
 //This code is always executed in any gap start, resets the PIO machines, checks for buffer set changes
-//Returns if the next buffer is a header or a sector (true = header, false = sector)
+//Returns the state of the new gap, it reads or writes a header or a sector depending on the previous state (see MD_ACTIVE_STATUS_TABLE)
 //Sets which set of buffers we're going to use
-bool common_gap_code(uint8_t** selectedTrack1Buffer, uint8_t** selectedTrack2Buffer, bool forRead)
+mdactivestatus_t common_gap_code(mdtransition_t transition, uint8_t** selectedTrack1Buffer, uint8_t** selectedTrack2Buffer)
 {
-    //Abort any pending write gap alarm
+    const mdstatusrow_t* row = &mdStatusTable[activeStatus];
+    mdactivestatus_t nextState = row->next[transition];
+    bool isHeader = mdStatusTable[nextState].header;
+
+    //Abort any pending write gap or write finish alarm
     abort_write_gap_alarm();
+    abort_write_finish_alarm();
+
+    //If the ULA was writting to us push the last partial word before the read machines are reset
+    finish_transfer(activeStatus);
+
+    //Abort the write DMA's before the write machines are flushed, they would refill them
+    if(row->transfer == MDX_WRITE)
+        disable_DMAs(false);
 
     //Send the TX machine to sleep if this is a RX, else send it to the gap
-    if(forRead)
+    if(transition == MDT_READ_GAP)
         sleep_PIO_write();
     else
         begin_PIO_write_gap();
 
     begin_PIO_read_gap();
 
-    //Abort the DMA's if they were active
-    if(activeStatus >= MDA_READ_HEADER_GAP && activeStatus <= MDA_READ_SECTOR)
+    //Abort the read DMA's if they were active, they may still be moving the last word flushed from the machines
+    if(row->transfer == MDX_READ)
         disable_DMAs(true);
-    else if(activeStatus >= MDA_WRITE_HEADER_GAP && activeStatus <= MDA_WRITE_SECTOR)
-        disable_DMAs(false);
 
-    //Depending on our previous state this will read/write a header or a sector
-    //When the QL formats a cartridge it writes the header and the sector, but when it
-    //writes data it will read the header and then write the sector so we
-    //must ensure that we don't restart at a header at the incorrect place
+    //If we were reading or writting a sector then the next is a header and we need to change the buffer set
+    if(row->nextBufferSet)
+        currentBufferSet = (currentBufferSet + 1) % BUFFER_SET_COUNT;
 
-    //IDLE -> header
-    //READ_HEADER_GAP -> header
-    //READ_HEADER -> sector
-    //READ_SECTOR_GAP -> sector
-    //READ_SECTOR -> header
-    //WRITE_HEADER_GAP -> header
-    //WRITE_HEADER -> sector
-    //WRITE_SECTOR_GAP -> sector
-    //WRITE_SECTOR -> header
-
-    bool isHeader;
-
-    switch(activeStatus)
-    {
-        case MDA_IDLE:
-        case MDA_READ_HEADER_GAP:
-        case MDA_READ_SECTOR:
-        case MDA_WRITE_HEADER_GAP:
-        case MDA_WRITE_SECTOR:
-
-            isHeader = true;
-            break;
-
-        case MDA_READ_HEADER:
-        case MDA_READ_SECTOR_GAP:
-        case MDA_WRITE_HEADER:
-        case MDA_WRITE_SECTOR_GAP:
-
-            isHeader = false;
-            break;
-    }
-
-    //Lets check if we need to switch buffers
     if(isHeader)
     {
-        switch(activeStatus)
+        //The UI has not filled the set yet, we go on with stale data as the ULA cannot wait
+        if(!bufferSets[currentBufferSet].ready)
         {
-            //If we were reading or writting a sector then the next is a header and we need to change the buffer set
-            case MDA_READ_SECTOR:
-            case MDA_WRITE_SECTOR:
-                secondBufferSet = !secondBufferSet;
-                break;
+            perfCounters.underruns++;
+            MD_TRACE(TRC_BUFFERSET_UNDERRUN, 0);
         }
 
+        //Read the set after the flag that published it
+        __dmb();
+
         //Choose the correct buffers
-        if(secondBufferSet)
-        {
-            *selectedTrack1Buffer = header_2_track_1;
-            *selectedTrack2Buffer = header_2_track_2;
-        }
-        else
-        {
-            *selectedTrack1Buffer = header_1_track_1;
-            *selectedTrack2Buffer = header_1_track_2;
-        }
+        *selectedTrack1Buffer = bufferSets[currentBufferSet].header_track_1;
+        *selectedTrack2Buffer = bufferSets[currentBufferSet].header_track_2;
     }
     else
     {
         //Choose the correct buffers
-        if(secondBufferSet)
-        {
-            *selectedTrack1Buffer = sector_2_track_1;
-            *selectedTrack2Buffer = sector_2_track_2;
-        }
-        else
-        {
-            *selectedTrack1Buffer = sector_1_track_1;
-            *selectedTrack2Buffer = sector_1_track_2;
-        }
+        *selectedTrack1Buffer = bufferSets[currentBufferSet].sector_track_1;
+        *selectedTrack2Buffer = bufferSets[currentBufferSet].sector_track_2;
     }
-    return isHeader;
+
+    return nextState;
 }
 
 //Start the write gap process, prepares all the buffers and DMAs and notifies to the UI if needed
@@ -278,22 +275,22 @@ void begin_write_gap()
     uint8_t* track2Buffer;
 
     //Execute the common code to the gaps and get if the next that needs to be read is a header or a sector
-    bool isHeader = common_gap_code(&track1Buffer, &track2Buffer, false);
+    //The buffers are not used, the data goes straight from the cartridge image to the ULA
+    mdactivestatus_t nextState = common_gap_code(MDT_WRITE_GAP, &track1Buffer, &track2Buffer);
     mdactivestatus_t previousState = activeStatus;
+    bool isHeader = mdStatusTable[nextState].header;
     
     //Set our new active status
-    if(isHeader)
-        activeStatus = MDA_WRITE_HEADER_GAP;
-    else
-        activeStatus = MDA_WRITE_SECTOR_GAP;
+    set_active_status(nextState);
 
     //Clear any pending data in the FIFOs
     pio_sm_clear_fifos(pio1, sm_write_head_1);
     pio_sm_clear_fifos(pio1, sm_write_head_2);
 
-    //Enable the write DMA's. This will send the buffers data to the ULA
-    //once the read machines are triggered
-    enable_write_DMAs(track1Buffer, track2Buffer, isHeader);
+    //Enable the write DMA's. This will send the cartridge data to the ULA
+    //once the write machines are triggered
+    enable_write_DMAs(get_bufferset_source(isHeader), isHeader);
+    MD_TRACE(TRC_WRITE_DMA_ARMED, isHeader);
 
     //Start the write gap timeout
     begin_write_gap_alarm();
@@ -308,21 +305,21 @@ void begin_write_gap()
 //End the read gap, this starts writting a buffer set to the ULA
 void end_write_gap()
 {
-     //Change our active state to the proper one
-    switch(activeStatus)
-    {
-        case MDA_WRITE_HEADER_GAP:
-            activeStatus = MDA_WRITE_HEADER;
-            break;
-        case MDA_WRITE_SECTOR_GAP:
-            activeStatus = MDA_WRITE_SECTOR;
-            break;
-        default:
-            return;
-    }
+    //Change our active state to the proper one, only write gaps can end sending data
+    mdactivestatus_t nextState = mdStatusTable[activeStatus].next[MDT_WRITE_DATA];
+
+    if(nextState == MDA_UNCHANGED)
+        return;
+
+    //The header of this set goes to the ULA, it must not be decoded back to the cartridge
+    if(mdStatusTable[nextState].header)
+        set_header_received(false);
+
+    set_active_status(nextState);
 
     //Enable the PIO write machines
     end_PIO_write_gap();
+    MD_TRACE(TRC_WRITE_STARTED, 0);
 }
 
 //Start the read gap process, prepares all the buffers and DMAs and notifies to the UI if needed
@@ -335,14 +332,12 @@ void begin_read_gap()
     uint8_t* track2Buffer;
 
     //Execute the common code to the gaps and get if the next that needs to be read is a header or a sector
-    bool isHeader = common_gap_code(&track1Buffer, &track2Buffer, true);
+    mdactivestatus_t nextState = common_gap_code(MDT_READ_GAP, &track1Buffer, &track2Buffer);
     mdactivestatus_t previousState = activeStatus;
+    bool isHeader = mdStatusTable[nextState].header;
     
     //Set our new active status
-    if(isHeader)
-        activeStatus = MDA_READ_HEADER_GAP;
-    else
-        activeStatus = MDA_READ_SECTOR_GAP;
+    set_active_status(nextState);
 
     //Clear any pending data in the FIFOs
     pio_sm_clear_fifos(pio0, sm_read_head_1);
@@ -351,6 +346,7 @@ void begin_read_gap()
     //Enable the read DMA's. This will fill the buffers with data from the ULA
     //once the read machines are triggered
     enable_read_DMAs(track1Buffer, track2Buffer, isHeader);
+    MD_TRACE(TRC_READ_DMA_ARMED, isHeader);
 
     //Set dir to input
     gpio_put(MD_HEAD_DIR, 1);
@@ -367,24 +363,102 @@ void end_read_gap()
     
     //There are no concerns about timmings, we run at 200Mhz so we should be able to catch every single
     //bit without losing any, and even in the case that by any chance we miss a bit it will not be a problem
-    //because the microdrive/ULA sends a calibration preamble that will be discarded by the UI processing
-    //mechanism.
+    //because the microdrive/ULA sends a calibration preamble that the read machines hunt and discard.
 
-    //Change our active state to the proper one
-    switch(activeStatus)
-    {
-        case MDA_READ_HEADER_GAP:
-            activeStatus = MDA_READ_HEADER;
-            break;
-        case MDA_READ_SECTOR_GAP:
-            activeStatus = MDA_READ_SECTOR;
-            break;
-        default:
-            return;
-    }
+    //Change our active state to the proper one, only read gaps can end receiving data
+    mdactivestatus_t nextState = mdStatusTable[activeStatus].next[MDT_READ_DATA];
+
+    if(nextState == MDA_UNCHANGED)
+        return;
+
+    set_active_status(nextState);
 
     //Enable the PIO read machines
     end_PIO_read_gap();
+    MD_TRACE(TRC_READ_STARTED, 0);
+}
+
+//Gets the cartridge data of the current buffer set, the write DMAs read it directly
+static inline uint8_t* get_bufferset_source(bool isHeader)
+{
+    uint8_t sector = bufferSets[currentBufferSet].sector_number;
+    uint8_t* source = &cartridge_image[CARTRIDGE_SECTOR_SIZE * sector];
+
+    return isHeader ? source : source + CARTRIDGE_HEADER_SIZE;
+}
+
+//Flags if the header of the current buffer set has been written by the ULA
+static inline void set_header_received(bool received)
+{
+    bufferSets[currentBufferSet].header_received = received;
+}
+
+//Flags if the sector of the current buffer set has been written by the ULA
+static inline void set_sector_received(bool received)
+{
+    bufferSets[currentBufferSet].sector_received = received;
+}
+
+//Ends a transfer from the ULA, pushes the last bits and flags if the UI must decode the buffers,
+//if the ULA stopped before sending all the data (or the preamble was not found) the buffers contain trash
+//Returns if the whole header or sector was received
+bool finish_read_transfer(mdactivestatus_t readStatus)
+{
+    bool isHeader = readStatus == MDA_READ_HEADER;
+    bool received = flush_PIO_read_machines(isHeader);
+    MD_TRACE(TRC_READ_FINISHED, received);
+
+    if(isHeader)
+        set_header_received(received);
+    else
+        set_sector_received(received);
+
+    return received;
+}
+
+//Checks if the write DMAs and machines have sent all the data to the ULA
+static inline bool is_write_transfer_finished()
+{
+    return !dma_channel_is_busy(track1DMA) && !dma_channel_is_busy(track2DMA) &&
+        is_PIO_write_finished(sm_write_head_1) && is_PIO_write_finished(sm_write_head_2);
+}
+
+//Ends the transfer of a status that is being left, must be called before the machines and DMAs are reset
+//The transfers cut before all their data was received or sent are counted as aborted, the gaps are always
+//cut by the ULA and their DMAs are idle or waiting for the preamble so they are not counted
+void finish_transfer(mdactivestatus_t state)
+{
+    const mdstatusrow_t* row = &mdStatusTable[state];
+
+    if(row->gap)
+        return;
+
+    if(row->transfer == MDX_READ)
+    {
+        if(!finish_read_transfer(state))
+            perfCounters.dmaAborts++;
+    }
+    else if(row->transfer == MDX_WRITE)
+    {
+        if(!is_write_transfer_finished())
+            perfCounters.dmaAborts++;
+    }
+}
+
+//Adds the time elapsed since the last status change to the gap latency histogram, called once the gap DMAs are armed
+//If more status changes were queued the latency is measured from the last one
+void record_gap_latency()
+{
+    uint32_t latency = time_us_32() - statusEdgeTime;
+    uint8_t bucket = 0;
+
+    while(bucket < GAP_LATENCY_BUCKETS - 1 && latency >= (2u << bucket))
+        bucket++;
+
+    perfCounters.gapLatency[bucket]++;
+
+    if(latency > perfCounters.gapLatencyMax)
+        perfCounters.gapLatencyMax = latency;
 }
 
 //Shifter selection alarm expired
@@ -394,7 +468,7 @@ void shifter_alarm(uint alarm_num)
 
     mdcontrolevent_t event;
     event.event = MDE_SELECT_TIMEOUT_EXPIRED;
-    event_push(&mdEventQueue, &event);
+    event_try_push(&mdEventQueue, &event);
 }
 
 //Write gap end alarm
@@ -404,13 +478,23 @@ void write_gap_alarm(uint alarm_num)
     abort_write_gap_alarm();
 
     //If our previous state is not a write gap we ignore the alarm, for sanity
-    if(activeStatus != MDA_WRITE_HEADER_GAP && activeStatus != MDA_WRITE_SECTOR_GAP)
+    if(mdStatusTable[activeStatus].next[MDT_WRITE_DATA] == MDA_UNCHANGED)
         return;
 
     //Create the event
     mdcontrolevent_t evtGap;
     evtGap.event = MDE_WRITE_GAP_FINISHED;
-    event_push(&mdEventQueue, &evtGap);
+    event_try_push(&mdEventQueue, &evtGap);
+}
+
+//Write finish check alarm, the MD core checks again if the write machines have sent all the data
+void write_finish_alarm(uint alarm_num)
+{
+    abort_write_finish_alarm();
+
+    mdcontrolevent_t event;
+    event.event = MDE_CHECK_WRITE_FINISH;
+    event_try_push(&mdEventQueue, &event);
 }
 
 //Function to cancel the shifter alarm
@@ -425,6 +509,12 @@ static inline void abort_write_gap_alarm()
     hardware_alarm_cancel(WRITE_GAP_ALARM);
 }
 
+//Function to cancel the write finish alarm
+static inline void abort_write_finish_alarm()
+{
+    hardware_alarm_cancel(WRITE_FINISH_ALARM);
+}
+
 //Function to start the shifter selected alarm
 static inline void begin_shifter_alarm()
 {
@@ -437,6 +527,14 @@ static inline void begin_write_gap_alarm()
     hardware_alarm_set_target(WRITE_GAP_ALARM, delayed_by_us(get_absolute_time(), QL_WRITE_GAP_US));
 }
 
+//Function to start the write finish alarm
+static inline void begin_write_finish_alarm()
+{
+    //The target is very close, if it has already passed the alarm is not armed and we queue the check ourselves
+    if(hardware_alarm_set_target(WRITE_FINISH_ALARM, delayed_by_us(get_absolute_time(), WRITE_FINISH_CHECK_US)))
+        write_finish_alarm(WRITE_FINISH_ALARM);
+}
+
 //Lets the shifter PIO machine to run
 static inline void start_PIO_shifter()
 {
@@ -470,25 +568,58 @@ static inline void end_PIO_read_gap()
     //pio_sm_exec(pio0, sm_exec_read, pio_encode_irq_clear(false, 7));
 }
 
+//Empties the FIFO and the OSR of a write machine, a transfer cut short leaves there the bits of its last bytes and
+//they would be sent after the preamble of the next transfer. The write DMAs must be disabled, else they would refill them.
+//The OSR is filled with zeros (this resets its shift counter) and then all of them are shifted out, so the out never
+//stalls and the FIFO is empty so there is nothing to autopull after it. The machine must be out of its data loop
+static inline void flush_PIO_write_machine(uint sm)
+{
+    pio_sm_clear_fifos(pio1, sm);
+    pio_sm_exec_wait_blocking(pio1, sm, pio_encode_mov(pio_osr, pio_null));
+    pio_sm_exec_wait_blocking(pio1, sm, pio_encode_out(pio_null, 32));
+}
+
 //Put write PIO machine to sleep
 static inline void sleep_PIO_write()
 {
     pio_sm_exec(pio1, sm_exec_write, pio_encode_irq_set(false, 7));
-    pio_sm_exec(pio1, sm_write_head_1, pio_encode_jmp(txProgramOffset + microdrive_write_offset_tx_sleep));
-    pio_sm_exec(pio1, sm_write_head_2, pio_encode_jmp(txProgramOffset + microdrive_write_offset_tx_sleep));
+    pio_sm_exec_wait_blocking(pio1, sm_write_head_1, pio_encode_jmp(txProgramOffset + microdrive_write_offset_tx_sleep));
+    pio_sm_exec_wait_blocking(pio1, sm_write_head_2, pio_encode_jmp(txProgramOffset + microdrive_write_offset_tx_sleep));
+    flush_PIO_write_machine(sm_write_head_1);
+    flush_PIO_write_machine(sm_write_head_2);
 }
 
 //Send write machines to the gap state
 static inline void begin_PIO_write_gap()
 {
     pio_sm_exec(pio1, sm_exec_write, pio_encode_irq_set(false, 7));
-    pio_sm_exec(pio1, sm_write_head_1, pio_encode_jmp(txProgramOffset + microdrive_write_offset_tx_gap));
-    pio_sm_exec(pio1, sm_write_head_2, pio_encode_jmp(txProgramOffset + microdrive_write_offset_tx_gap));
+
+    //Load the preamble counters, X = zero pairs - 1, Y = ones - 1. Track 2 sends four more zeros to respect the skewing done by the ULA
+    //The write machines run slow, we wait for each instruction to finish so the next one does not replace it
+    pio_sm_exec_wait_blocking(pio1, sm_write_head_1, pio_encode_set(pio_x, TRACK_1_PREAMBLE_ZERO_BITS / 2 - 1));
+    pio_sm_exec_wait_blocking(pio1, sm_write_head_1, pio_encode_set(pio_y, PREAMBLE_ONE_BITS - 1));
+    pio_sm_exec_wait_blocking(pio1, sm_write_head_2, pio_encode_set(pio_x, TRACK_2_PREAMBLE_ZERO_BITS / 2 - 1));
+    pio_sm_exec_wait_blocking(pio1, sm_write_head_2, pio_encode_set(pio_y, PREAMBLE_ONE_BITS - 1));
+
+    pio_sm_exec_wait_blocking(pio1, sm_write_head_1, pio_encode_jmp(txProgramOffset + microdrive_write_offset_tx_gap));
+    pio_sm_exec_wait_blocking(pio1, sm_write_head_2, pio_encode_jmp(txProgramOffset + microdrive_write_offset_tx_gap));
+
+    //Flushed once the machines have left the data loop (they wait for the IRQ), an out there would send a bit
+    flush_PIO_write_machine(sm_write_head_1);
+    flush_PIO_write_machine(sm_write_head_2);
+}
+
+//Checks if a write machine has sent all its data, it stalls when it needs a new byte and the FIFO is empty
+static inline bool is_PIO_write_finished(uint sm)
+{
+    return pio1->fdebug & (1u << (PIO_FDEBUG_TXSTALL_LSB + sm));
 }
 
 //Exit write machines from the gap state
 static inline void end_PIO_write_gap()
 {
+    //Clear the stall flags, these mark the end of the transfer
+    pio1->fdebug = (1u << (PIO_FDEBUG_TXSTALL_LSB + sm_write_head_1)) | (1u << (PIO_FDEBUG_TXSTALL_LSB + sm_write_head_2));
     pio_interrupt_clear(pio1, 7);
     //pio_sm_exec(pio1, sm_exec_write, pio_encode_irq_clear(false, 7));
 }
@@ -497,6 +628,10 @@ static inline void end_PIO_write_gap()
 void process_md_event(void* event)
 {
     mdcontrolevent_t* mdevt = (mdcontrolevent_t*)event;
+
+    //The write finish check is repeated by an alarm until the machines stall, tracing it would flood the ring
+    if(mdevt->event != MDE_CHECK_WRITE_FINISH)
+        MD_TRACE(TRC_MD_EVENT, ((uint32_t)mdevt->event << 16) | mdevt->args);
     
     switch(mdevt->event)
     {
@@ -537,23 +672,18 @@ void process_md_event(void* event)
             if(mdStatus != MDS_SELECTED || !isCartridgeInserted)
                 return;
 
-            switch((mdlinestatus_t)mdevt->args)
+            //Dispatch the transition started by the new line status
             {
-                case MDL_READ: //ULA wants to read from us
-
-                    begin_write_gap(); //Write to the ULA
-                    break;
-                
-                case MDL_WRITE_GAP: //ULA entered a write gap
-
-                    begin_read_gap();
-                    break;
+                mdtransition_t transition = mdLineTransitions[mdevt->args & 3];
 
-                case MDL_WRITE: //ULA exited from a write gap and entered in a real write
+                if(transition == MDT_COUNT)
+                    return;
 
-                    end_read_gap();
-                    break;
+                mdTransitionActions[transition]();
 
+                //The gap DMAs are armed at this point
+                if(transition == MDT_READ_GAP || transition == MDT_WRITE_GAP)
+                    record_gap_latency();
             }
 
             break;
@@ -575,11 +705,10 @@ void process_md_event(void* event)
             //Have both tracks finished writting?
             if(track1DMAFired && track2DMAFired)
             {
-                if(!pio_sm_is_tx_fifo_empty(pio1, sm_write_head_1) || !pio_sm_is_tx_fifo_empty(pio1, sm_write_head_2))
+                //The FIFOs may still hold a few bytes, check again later instead of keeping the core busy
+                if(!is_PIO_write_finished(sm_write_head_1) || !is_PIO_write_finished(sm_write_head_2))
                 {
-                    mdcontrolevent_t checkEvt;
-                    checkEvt.event = MDE_CHECK_WRITE_FINISH;
-                    event_push(&mdEventQueue, &checkEvt);
+                    begin_write_finish_alarm();
                     break;
                 }
 
@@ -590,9 +719,13 @@ void process_md_event(void* event)
 
         case MDE_CHECK_WRITE_FINISH:
 
-            if(!pio_sm_is_tx_fifo_empty(pio1, sm_write_head_1) || !pio_sm_is_tx_fifo_empty(pio1, sm_write_head_2))
+            //A gap may have started (and reset the fired flags) after the alarm queued the check
+            if(!track1DMAFired || !track2DMAFired)
+                break;
+
+            if(!is_PIO_write_finished(sm_write_head_1) || !is_PIO_write_finished(sm_write_head_2))
             {
-                event_push(&mdEventQueue, mdevt);
+                begin_write_finish_alarm();
                 break;
             }
 
@@ -604,6 +737,21 @@ void process_md_event(void* event)
 
 }
 
+//Discards a status change that is followed by another one when both start a gap (read or write gap)
+//Starting the second gap straight from the previous state ends with the same buffer set, header/sector
+//and UI notifications, so the first one only wastes time. A change to MDL_WRITE must always be processed
+//as it starts the read machines of the gap before it.
+bool coalesce_md_event(void* current, void* next)
+{
+    mdcontrolevent_t* currentEvt = (mdcontrolevent_t*)current;
+    mdcontrolevent_t* nextEvt = (mdcontrolevent_t*)next;
+
+    if(currentEvt->event != MDE_MD_STATUS_CHANGED || nextEvt->event != MDE_MD_STATUS_CHANGED)
+        return false;
+
+    return currentEvt->args != MDL_WRITE && nextEvt->args != MDL_WRITE;
+}
+
 //Handler to process events received from the UI
 void process_ui_event(void* event)
 {
@@ -614,8 +762,8 @@ void process_ui_event(void* event)
         case UTM_CARTRIDGE_INSERTED:
             
             isCartridgeInserted = true;
-            activeStatus = MDA_IDLE; //The deselect should have reset this, we do it just for sanity
-            secondBufferSet = false; //Reset the active buffer set, we do it just for sanity
+            set_active_status(MDA_IDLE); //The deselect should have reset this, we do it just for sanity
+            currentBufferSet = 0; //Reset the active buffer set, we do it just for sanity
             track1DMAFired = false;
             track2DMAFired = false;
             
@@ -627,12 +775,13 @@ void process_ui_event(void* event)
             
             reset_transfer_machines();  //Reset the PIO TX/RX machines
             abort_write_gap_alarm();    //Abort any pending write alarm
+            abort_write_finish_alarm();
             disable_DMAs(true);         //Disable all DMA transfers
             disable_DMAs(false);
             gpio_put(MD_HEAD_DIR, 1);   //Set dir to input, for sanity
 
-            activeStatus = MDA_IDLE;    //we start in the idle status
-            secondBufferSet = false;    //Reset the active buffer set
+            set_active_status(MDA_IDLE);    //we start in the idle status
+            currentBufferSet = 0;       //Reset the active buffer set
             track1DMAFired = false;     //This is already called in disable_dma, left for sanity
             track2DMAFired = false;
 
@@ -646,11 +795,12 @@ void track1_write_irq()
 {
     //Clear the interrupt flag
     dma_channel_acknowledge_irq0(track1DMA);
+    MD_TRACE(TRC_DMA_WRITE_IRQ, 1);
     //Create irq event
     mdcontrolevent_t writeEvent;
     writeEvent.event = MDE_DMA_WRITE_IRQ;
     writeEvent.args = 1; //Indicates the track number
-    event_push(&mdEventQueue, &writeEvent);
+    event_try_push(&mdEventQueue, &writeEvent);
 }
 
 //The PIO machine has finished sending data to the ULA.
@@ -658,11 +808,12 @@ void track2_write_irq()
 {
     //Clear the interrupt flag
     dma_channel_acknowledge_irq1(track2DMA);
+    MD_TRACE(TRC_DMA_WRITE_IRQ, 2);
     //Create irq event
     mdcontrolevent_t writeEvent;
     writeEvent.event = MDE_DMA_WRITE_IRQ;
     writeEvent.args = 2; //Indicates the track number
-    event_push(&mdEventQueue, &writeEvent);
+    event_try_push(&mdEventQueue, &writeEvent);
 }
 
 //Notification from the PIO about a status change
@@ -673,16 +824,22 @@ void status_irq()
 
     //Read the status from the machine's FIFO
     uint8_t newMdStatus = pio_sm_get(pio0, sm_status);
+    MD_TRACE(TRC_STATUS_IRQ, newMdStatus);
 
     if(newMdStatus == MDL_INVALID)
+    {
+        perfCounters.invalidStatus++;
         return;
+    }
+
+    statusEdgeTime = time_us_32();
 
     //Create event and push it to the queue
     //Consider go back to a static or predefined event.
     mdcontrolevent_t statusEvent;
     statusEvent.event = MDE_MD_STATUS_CHANGED;
     statusEvent.args = newMdStatus;
-    event_push(&mdEventQueue, &statusEvent);
+    event_try_push(&mdEventQueue, &statusEvent);
 }
 
 //Notification from the PIO about the shifter change
@@ -693,13 +850,14 @@ void shifter_irq()
 
     //Read the shifter status from the machine's FIFO
     uint8_t newSelStatus = pio_sm_get(pio1, sm_shifter);
+    MD_TRACE(TRC_SHIFTER_IRQ, newSelStatus);
 
     //Create event and push it to the queue
     //Consider go back to a static or predefined event.
     mdcontrolevent_t shifterEvent;
     shifterEvent.event = MDE_SHIFT_CHANGED;
     shifterEvent.args = newSelStatus;
-    event_push(&mdEventQueue, &shifterEvent);
+    event_try_push(&mdEventQueue, &shifterEvent);
 }
 
 //Initialize the DMA channels and preconfigure the config structures
@@ -718,28 +876,29 @@ void init_DMAs()
     channel_config_set_dreq(&track1ReadConfig, pio_get_dreq(pio0, sm_read_head_1, false));
     channel_config_set_read_increment(&track1ReadConfig, false);
     channel_config_set_write_increment(&track1ReadConfig, true);
-    channel_config_set_transfer_data_size(&track1ReadConfig, DMA_SIZE_8);
+    channel_config_set_transfer_data_size(&track1ReadConfig, DMA_SIZE_32);
 
     //configure the track2 read config
     track2ReadConfig = dma_channel_get_default_config(track2DMA);
     channel_config_set_dreq(&track2ReadConfig, pio_get_dreq(pio0, sm_read_head_2, false));
     channel_config_set_read_increment(&track2ReadConfig, false);
     channel_config_set_write_increment(&track2ReadConfig, true);
-    channel_config_set_transfer_data_size(&track2ReadConfig, DMA_SIZE_8);
+    channel_config_set_transfer_data_size(&track2ReadConfig, DMA_SIZE_32);
 
     //configure the track1 write config
     track1WriteConfig = dma_channel_get_default_config(track1DMA);
     channel_config_set_dreq(&track1WriteConfig, pio_get_dreq(pio1, sm_write_head_1, true));
     channel_config_set_read_increment(&track1WriteConfig, true);
     channel_config_set_write_increment(&track1WriteConfig, false);
-    channel_config_set_transfer_data_size(&track1WriteConfig, DMA_SIZE_8);
+    channel_config_set_transfer_data_size(&track1WriteConfig, DMA_SIZE_16);
 
     //configure the track2 write config
     track2WriteConfig = dma_channel_get_default_config(track2DMA);
     channel_config_set_dreq(&track2WriteConfig, pio_get_dreq(pio1, sm_write_head_2, true));
     channel_config_set_read_increment(&track2WriteConfig, true);
     channel_config_set_write_increment(&track2WriteConfig, false);
-    channel_config_set_transfer_data_size(&track2WriteConfig, DMA_SIZE_8);
+    channel_config_set_transfer_data_size(&track2WriteConfig, DMA_SIZE_16);
+    channel_config_set_bswap(&track2WriteConfig, true); //track 2 is the high byte of each halfword
 
     track1DisabledConfig = dma_channel_get_default_config(track1DMA);
     channel_config_set_enable(&track1DisabledConfig, false);
@@ -769,15 +928,15 @@ void enable_read_DMAs(uint8_t* buffer_track_1, uint8_t* buffer_track_2, bool isH
     dma_channel_set_irq1_enabled(track2DMA, true);
     */
 
-    //Configure and start channels
+    //Configure and start channels, the read machines push packed 32 bit words
     dma_channel_configure(track1DMA, &track1ReadConfig, buffer_track_1, &pio0->rxf[sm_read_head_1], isHeader? 
-        HEADER_BUFFER_SIZE : SECTOR_BUFFER_SIZE, true);
+        HEADER_RX_WORDS : SECTOR_RX_WORDS, true);
     dma_channel_configure(track2DMA, &track2ReadConfig, buffer_track_2, &pio0->rxf[sm_read_head_2], isHeader? 
-        HEADER_BUFFER_SIZE : SECTOR_BUFFER_SIZE, true);
+        HEADER_RX_WORDS : SECTOR_RX_WORDS, true);
 }
 
 //Enable DMAs to send data to the PIO machines
-void enable_write_DMAs(uint8_t* buffer_track_1, uint8_t* buffer_track_2, bool isHeader)
+void enable_write_DMAs(uint8_t* source, bool isHeader)
 {
     //Set IRQ handlers
     irq_set_exclusive_handler(DMA_IRQ_0, track1_write_irq);
@@ -787,15 +946,16 @@ void enable_write_DMAs(uint8_t* buffer_track_1, uint8_t* buffer_track_2, bool is
     dma_channel_set_irq0_enabled(track1DMA, true);
     dma_channel_set_irq1_enabled(track2DMA, true);
 
-    //We regenerate the preamble and the data so we transfer perfect bits, we don't need to care about the ULA
-    //trash in the preambles or at the end of the data, our transfers always have the same size (the buffers are)
-    //prepared with the 4 bit displacements for track2 and the four trashs bit in the tail.
+    //The write machines generate the preamble (with the 4 bit displacement for track2), we only send the data.
+    //Both channels read the interleaved cartridge data in 16 bit transfers (a byte of each track), the
+    //halfword is replicated in the FIFO word and the machines autopull each 8 bits so they only send its low
+    //byte, the track 1 one. The track 2 channel swaps the bytes so its machine sends the track 2 byte.
 
     //Configure and start channels
-    dma_channel_configure(track1DMA, &track1WriteConfig, &pio1->txf[sm_write_head_1], buffer_track_1, isHeader? 
-        (QL_PREAMBLE_SIZE + QL_HEADER_SIZE) : (QL_PREAMBLE_SIZE + QL_SECTOR_SIZE), true);
-    dma_channel_configure(track2DMA, &track2WriteConfig, &pio1->txf[sm_write_head_2], buffer_track_2, isHeader? 
-        (QL_PREAMBLE_SIZE + QL_HEADER_SIZE) : (QL_PREAMBLE_SIZE + QL_SECTOR_SIZE), true);
+    dma_channel_configure(track1DMA, &track1WriteConfig, &pio1->txf[sm_write_head_1], source, isHeader? 
+        HEADER_TRACK_DATA_SIZE : SECTOR_TRACK_DATA_SIZE, true);
+    dma_channel_configure(track2DMA, &track2WriteConfig, &pio1->txf[sm_write_head_2], source, isHeader? 
+        HEADER_TRACK_DATA_SIZE : SECTOR_TRACK_DATA_SIZE, true);
 }
 
 //Disable DMAs. Should be called in gaps, status changes and shifter changes.
@@ -805,16 +965,6 @@ void disable_DMAs(bool readDMAs)
     track1DMAFired = false;
     track2DMAFired = false;
 
-
-    if(activeStatus == MDA_READ_HEADER)
-    {
-        int32_t transferA = dma_channel_hw_addr(track1DMA)->transfer_count;
-        dma_channel_abort(transferA);
-        int32_t transferB = dma_channel_hw_addr(track2DMA)->transfer_count;
-        dma_channel_abort(transferB);
-        int32_t final = transferA - transferB;
-    }
-
     //Abort the channels, configure as disabled and clear any pending interrupts
     dma_channel_set_irq0_enabled(track1DMA, false);
     dma_channel_abort(track1DMA);
@@ -840,6 +990,57 @@ void disable_DMAs(bool readDMAs)
     }
 }
 
+//Pushes the bits left in the ISR of a read machine. The machines autopush each 32 bits so when the ULA stops
+//writting up to 31 bits can be waiting in the ISR, we shift zeros in until the autopush sends them (already
+//aligned to the LSB) to the FIFO and the DMA stores them.
+//Returns if the buffer got all its words (the DMA may still be moving the last one from the FIFO)
+bool flush_PIO_read_machine(uint sm, uint dma, uint32_t totalTransfers)
+{
+    uint32_t pendingTransfers = dma_channel_hw_addr(dma)->transfer_count;
+
+    //The buffer is already full, nothing to flush
+    if(pendingTransfers == 0)
+        return true;
+
+    //Nothing received, the machine may be still hunting the preamble and its ISR has no data
+    if(pendingTransfers == totalTransfers && pio_sm_is_rx_fifo_empty(pio0, sm))
+        return false;
+
+    uint fifoLevel = pio_sm_get_rx_fifo_level(pio0, sm);
+
+    for(int buc = 0; buc < 32; buc++)
+    {
+        //Has the word been pushed? (check the FIFO and the DMA as it may have already taken it)
+        if(pio_sm_get_rx_fifo_level(pio0, sm) != fifoLevel || dma_channel_hw_addr(dma)->transfer_count != pendingTransfers)
+            break;
+
+        pio_sm_exec_wait_blocking(pio0, sm, pio_encode_in(pio_null, 1));
+    }
+
+    return dma_channel_hw_addr(dma)->transfer_count <= pio_sm_get_rx_fifo_level(pio0, sm);
+}
+
+//Pushes the last partial word of both read machines, returns if both tracks have been completely received
+bool flush_PIO_read_machines(bool isHeader)
+{
+    uint32_t totalTransfers = isHeader ? HEADER_RX_WORDS : SECTOR_RX_WORDS;
+
+    bool track1Received = flush_PIO_read_machine(sm_read_head_1, track1DMA, totalTransfers);
+    bool track2Received = flush_PIO_read_machine(sm_read_head_2, track2DMA, totalTransfers);
+
+    return track1Received && track2Received;
+}
+
+//Loads the sync pattern (24 zeros followed by 8 ones, newest bit at the MSB) in the X register of a read machine,
+//the machine must be stopped or in the read gap
+void load_PIO_read_pattern(uint sm)
+{
+    pio_sm_exec(pio0, sm, pio_encode_mov_not(pio_x, pio_null));
+    pio_sm_exec(pio0, sm, pio_encode_in(pio_x, 8));
+    pio_sm_exec(pio0, sm, pio_encode_mov(pio_x, pio_isr));
+    pio_sm_exec(pio0, sm, pio_encode_mov(pio_isr, pio_null));
+}
+
 void reset_transfer_machine(PIO pio, uint sm, uint initial_pc)
 {
     // Stop machine
@@ -865,6 +1066,10 @@ void reset_transfer_machine(PIO pio, uint sm, uint initial_pc)
     pio_sm_exec(pio, sm, pio_encode_mov(pio_y,pio_null));
     pio_sm_exec(pio, sm, pio_encode_irq_clear(false, 7));
 
+    //The read machines are the only transfer machines in PIO0, they keep the sync pattern in X
+    if(pio == pio0)
+        load_PIO_read_pattern(sm);
+
     //Set PC to the start
     pio_sm_exec(pio, sm, pio_encode_jmp(initial_pc));
 
@@ -947,16 +1152,18 @@ void init_PIO_machines()
 
     //Create a generic config common to both rx machines
     pio_sm_config rx_cfg = microdrive_read_program_get_default_config(rxProgramOffset);
-    sm_config_set_clkdiv(&rx_cfg, (200000000 / 100000) / 20); //we run 20 times faster than the ULA
+    sm_config_set_clkdiv(&rx_cfg, (200000000 / 100000) / 40); //we run 40 times faster than the ULA
 
     //Now the specific config for first state machine
     sm_config_set_set_pins(&rx_cfg, MD_READ_HEAD_1, 1);
     sm_config_set_in_pins(&rx_cfg, MD_READ_HEAD_1);
     sm_config_set_jmp_pin(&rx_cfg, MD_READ_HEAD_1);
-    sm_config_set_in_shift(&rx_cfg, false, false, 0);
+    sm_config_set_in_shift(&rx_cfg, true, true, 32); //shift right (first bit ends as LSB), autopush each 32 bits
+    sm_config_set_out_shift(&rx_cfg, true, false, 1); //OSR is the hunt flag, a single bit shifted out empties it
 
     //Initialize the state machine
     pio_sm_init(pio0, sm_read_head_1, rxProgramOffset, &rx_cfg);
+    load_PIO_read_pattern(sm_read_head_1);
 
     //start it
     pio_sm_set_enabled(pio0, sm_read_head_1, true);
@@ -965,10 +1172,12 @@ void init_PIO_machines()
     sm_config_set_set_pins(&rx_cfg, MD_READ_HEAD_2, 1);
     sm_config_set_in_pins(&rx_cfg, MD_READ_HEAD_2);
     sm_config_set_jmp_pin(&rx_cfg, MD_READ_HEAD_2);
-    sm_config_set_in_shift(&rx_cfg, false, false, 0);
+    sm_config_set_in_shift(&rx_cfg, true, true, 32);
+    sm_config_set_out_shift(&rx_cfg, true, false, 1);
 
     //Initialize the state machine
     pio_sm_init(pio0, sm_read_head_2, rxProgramOffset, &rx_cfg);
+    load_PIO_read_pattern(sm_read_head_2);
 
     //start it
     pio_sm_set_enabled(pio0, sm_read_head_2, true);
@@ -1014,7 +1223,7 @@ void init_PIO_machines()
     //Now the specific config for first state machine
     sm_config_set_set_pins(&tx_cfg, MD_WRITE_HEAD_1, 1);
     sm_config_set_sideset_pins(&tx_cfg, MD_WRITE_HEAD_1);
-    sm_config_set_out_shift(&tx_cfg, true, true, 1);
+    sm_config_set_out_shift(&tx_cfg, true, true, 8); //shift right (LSB first), autopull each byte
 
     //Initialize the state machine
     pio_sm_init(pio1, sm_write_head_1, txProgramOffset, &tx_cfg);
@@ -1025,7 +1234,7 @@ void init_PIO_machines()
     //Now go for second write state machine
     sm_config_set_set_pins(&tx_cfg, MD_WRITE_HEAD_2, 1);
     sm_config_set_sideset_pins(&tx_cfg, MD_WRITE_HEAD_2);
-    sm_config_set_out_shift(&tx_cfg, true, true, 1);
+    sm_config_set_out_shift(&tx_cfg, true, true, 8);
 
     //Initialize the state machine
     pio_sm_init(pio1, sm_write_head_2, txProgramOffset, &tx_cfg);
@@ -1082,22 +1291,38 @@ void init_GPIO()
     gpio_put(MD_HEAD_DIR, 1);
 }
 
-//Initialize alarms for the shifter and the write gap
+//Initialize alarms for the shifter, the write gap and the end of the writes
 void init_alarms()
 {
     hardware_alarm_claim(SHIFTER_ALARM);
     hardware_alarm_claim(WRITE_GAP_ALARM);
+    hardware_alarm_claim(WRITE_FINISH_ALARM);
 
     hardware_alarm_set_callback(SHIFTER_ALARM, shifter_alarm);
     hardware_alarm_set_callback(WRITE_GAP_ALARM, write_gap_alarm);
+    hardware_alarm_set_callback(WRITE_FINISH_ALARM, write_finish_alarm);
 }
 
-//Microdrive control routine, this is the core1 main loop
-void RunMDControl()
+//Event buffers of the MD core loop
+mdcontrolevent_t mdevtBuffer;
+utmevent_t utmevtBuffer;
+
+//The MD events are time critical, the cartridge insert/remove events can wait
+evtclass_t mdEventClasses[] =
+{
+    { &mdEventQueue, &mdevtBuffer, MD_EVENT_BUDGET_US },
+    { &uiToMdEventQueue, &utmevtBuffer, UI_EVENT_BUDGET_US }
+};
+
+//Initializes the event machines and the hardware of the MD control, the shifter is started once everything is ready
+void init_MD_control()
 {
     //Init event machines
+    //The IRQs and alarms push without waiting, the drops are counted in the machine
     event_machine_init(&mdEventQueue, &process_md_event, sizeof(mdcontrolevent_t), 16);
-    event_machine_init(&uiToMdEventQueue, &process_ui_event, sizeof(utmevent_t), 8);
+    event_set_coalescer(&mdEventQueue, &coalesce_md_event);
+    //The UI core is the only producer of its queue so it doesn't need locks
+    event_machine_init_spsc(&uiToMdEventQueue, &process_ui_event, sizeof(utmevent_t), 8);
 
     //Init GPIO for dir control
     init_GPIO();
@@ -1108,19 +1333,44 @@ void RunMDControl()
     //Initialize DMA channels
     init_DMAs();
 
-    //Declare event buffers
-    mdcontrolevent_t mdevtBuffer;
-    utmevent_t utmevtBuffer;
-
     start_PIO_shifter();
+}
 
-    PIO tp = pio1;
+//An iteration of the MD control loop, processes the pending events and sleeps until the next IRQ if there are none
+void run_MD_control_step()
+{
+    //Process the MD events first and then the UI ones
+    event_process_classes(mdEventClasses, 2);
 
-    while(true)
+#if IDLE_SLEEP
+    //Sleep until an IRQ or the UI core wakes us. An IRQ taken between the check and the WFE sets
+    //the event flag so the WFE returns at once and nothing is lost
+    event_mark_sleep(&mdEventQueue);
+    event_mark_sleep(&uiToMdEventQueue);
+
+    if(!event_pending(&mdEventQueue) && !event_pending(&uiToMdEventQueue))
     {
-        //Process MD event queue, we process all the available events
-        event_process_queue(&mdEventQueue, &mdevtBuffer, 16);
-        //Process UI events, we process up to two events
-        event_process_queue(&uiToMdEventQueue, &utmevtBuffer, 2);
+        perfCounters.mdSleeps++;
+        __wfe();
+
+        //The IRQ that woke us has already pushed its event, it must be back here well inside the gaps
+        uint32_t latency = event_wake_latency(&mdEventQueue);
+        uint32_t uiLatency = event_wake_latency(&uiToMdEventQueue);
+
+        if(uiLatency > latency)
+            latency = uiLatency;
+
+        if(latency > perfCounters.mdWakeLatencyMax)
+            perfCounters.mdWakeLatencyMax = latency;
     }
+#endif
+}
+
+//Microdrive control routine, this is the core1 main loop
+void RunMDControl()
+{
+    init_MD_control();
+
+    while(true)
+        run_MD_control_step();
 }
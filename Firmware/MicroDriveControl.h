@@ -20,10 +20,17 @@
 
 #define SHIFTER_ALARM 0
 #define WRITE_GAP_ALARM 1
+#define WRITE_FINISH_ALARM 2
 
 //2780
 #define QL_WRITE_GAP_US 3600
 #define SHIFTER_SELECT_US 10000
+//Period of the checks for the end of a transfer to the ULA once the DMAs are done, a bit lasts 10 us
+#define WRITE_FINISH_CHECK_US 10
+
+//Time budgets of the MD core event classes for each loop iteration
+#define MD_EVENT_BUDGET_US 200
+#define UI_EVENT_BUDGET_US 50
 
 //Enumeration with the meaning of the status lines
 typedef enum __attribute__((packed))
@@ -43,21 +50,68 @@ typedef enum __attribute__((packed))
 
 } mdstatus_t;
 
+//Transfer done in an active status
+typedef enum __attribute__((packed))
+{
+    MDX_NONE,
+    MDX_READ,   //The ULA writes to us
+    MDX_WRITE   //We write to the ULA
+
+} mdtransfer_t;
+
+//Transitions of the active status
+typedef enum __attribute__((packed))
+{
+    MDT_READ_GAP,   //The ULA entered a write gap, we get ready to read
+    MDT_WRITE_GAP,  //The ULA wants to read, we start a write gap
+    MDT_READ_DATA,  //The ULA started writting after its gap
+    MDT_WRITE_DATA, //Our write gap finished, the data goes to the ULA
+    MDT_COUNT       //Number of transitions, also used as "no transition"
+
+} mdtransition_t;
+
+//Selected substatus table, this is the spec of the active status. One row per state with:
+//state, next state on each transition (MDT_READ_GAP, MDT_WRITE_GAP, MDT_READ_DATA, MDT_WRITE_DATA, MDA_UNCHANGED if ignored),
+//buffer handled (true = header), transfer, is a gap, leaving it for a gap moves to the next buffer set,
+//event sent to the UI when it's left for a gap and event sent to the UI when it's entered.
+//The enum and the table are generated from these rows so every state has exactly one row
+//When the QL formats a cartridge it writes the header and the sector, but when it writes data it will read
+//the header and then write the sector, so a gap always continues with the buffer that follows the previous state
+#define MD_ACTIVE_STATUS_TABLE(ROW) \
+    ROW(MDA_IDLE,             MDA_READ_HEADER_GAP, MDA_WRITE_HEADER_GAP, MDA_UNCHANGED,   MDA_UNCHANGED,    false, MDX_NONE,  false, false, MTU_NONE,              MTU_NONE) \
+    ROW(MDA_READ_HEADER_GAP,  MDA_READ_HEADER_GAP, MDA_WRITE_HEADER_GAP, MDA_READ_HEADER, MDA_UNCHANGED,    true,  MDX_READ,  true,  false, MTU_NONE,              MTU_MD_READING) \
+    ROW(MDA_READ_HEADER,      MDA_READ_SECTOR_GAP, MDA_WRITE_SECTOR_GAP, MDA_UNCHANGED,   MDA_UNCHANGED,    true,  MDX_READ,  false, false, MTU_NONE,              MTU_NONE) \
+    ROW(MDA_READ_SECTOR_GAP,  MDA_READ_SECTOR_GAP, MDA_WRITE_SECTOR_GAP, MDA_READ_SECTOR, MDA_UNCHANGED,    false, MDX_READ,  true,  false, MTU_NONE,              MTU_MD_READING) \
+    ROW(MDA_READ_SECTOR,      MDA_READ_HEADER_GAP, MDA_WRITE_HEADER_GAP, MDA_UNCHANGED,   MDA_UNCHANGED,    false, MDX_READ,  false, true,  MTU_BUFFERSET_WRITTEN, MTU_NONE) \
+    ROW(MDA_WRITE_HEADER_GAP, MDA_READ_HEADER_GAP, MDA_WRITE_HEADER_GAP, MDA_UNCHANGED,   MDA_WRITE_HEADER, true,  MDX_WRITE, true,  false, MTU_NONE,              MTU_MD_WRITTING) \
+    ROW(MDA_WRITE_HEADER,     MDA_READ_SECTOR_GAP, MDA_WRITE_SECTOR_GAP, MDA_UNCHANGED,   MDA_UNCHANGED,    true,  MDX_WRITE, false, false, MTU_NONE,              MTU_NONE) \
+    ROW(MDA_WRITE_SECTOR_GAP, MDA_READ_SECTOR_GAP, MDA_WRITE_SECTOR_GAP, MDA_UNCHANGED,   MDA_WRITE_SECTOR, false, MDX_WRITE, true,  false, MTU_NONE,              MTU_MD_WRITTING) \
+    ROW(MDA_WRITE_SECTOR,     MDA_READ_HEADER_GAP, MDA_WRITE_HEADER_GAP, MDA_UNCHANGED,   MDA_UNCHANGED,    false, MDX_WRITE, false, true,  MTU_BUFFERSET_READ,    MTU_NONE)
+
+#define MD_ACTIVE_STATUS_ENUM(STATE, ...) STATE,
+
 //Selected substatus
 typedef enum __attribute__((packed))
 {
-    MDA_IDLE,
-    MDA_READ_HEADER_GAP,
-    MDA_READ_HEADER,
-    MDA_READ_SECTOR_GAP,
-    MDA_READ_SECTOR,
-    MDA_WRITE_HEADER_GAP,
-    MDA_WRITE_HEADER,
-    MDA_WRITE_SECTOR_GAP,
-    MDA_WRITE_SECTOR
+    MD_ACTIVE_STATUS_TABLE(MD_ACTIVE_STATUS_ENUM)
+    MDA_STATE_COUNT,
+    MDA_UNCHANGED = MDA_STATE_COUNT //Transition ignored in the state
 
 } mdactivestatus_t;
 
+//Row of the active status table
+typedef struct mdstatusrow
+{
+    mdactivestatus_t next[MDT_COUNT];
+    bool header;
+    mdtransfer_t transfer;
+    bool gap;
+    bool nextBufferSet;
+    uint8_t releaseEvent;   //mdtouievent_t
+    uint8_t enterEvent;     //mdtouievent_t
+
+} mdstatusrow_t;
+
 //Internal events for the md control
 typedef enum __attribute__((packed))
 {
@@ -81,27 +135,42 @@ typedef struct mdcontrolevent
 
 void select_md();
 void deselect_md();
+void set_active_status(mdactivestatus_t nextState);
 void check_ui_notifications(mdactivestatus_t previousState, bool fromGap);
-bool common_gap_code(uint8_t** selectedTrack1Buffer, uint8_t** selectedTrack2Buffer, bool forRead);
+uint8_t release_buffer_set(bool fromGap);
+mdactivestatus_t common_gap_code(mdtransition_t transition, uint8_t** selectedTrack1Buffer, uint8_t** selectedTrack2Buffer);
 void begin_write_gap();
 void end_write_gap();
 void begin_read_gap();
 void end_read_gap();
 void shifter_alarm(uint alarm_num);
 void write_gap_alarm(uint alarm_num);
+void write_finish_alarm(uint alarm_num);
+static inline uint8_t* get_bufferset_source(bool isHeader);
+static inline void set_header_received(bool received);
+static inline void set_sector_received(bool received);
+bool finish_read_transfer(mdactivestatus_t readStatus);
+static inline bool is_write_transfer_finished();
+void finish_transfer(mdactivestatus_t state);
+void record_gap_latency();
 static inline void abort_shifter_alarm();
 static inline void abort_write_gap_alarm();
+static inline void abort_write_finish_alarm();
 static inline void begin_shifter_alarm();
 static inline void begin_write_gap_alarm();
+static inline void begin_write_finish_alarm();
 static inline void start_PIO_shifter();
 static inline void deselect_PIO_status();
 static inline void select_PIO_status();
 static inline void begin_PIO_read_gap();
 static inline void end_PIO_read_gap();
+static inline void flush_PIO_write_machine(uint sm);
 static inline void sleep_PIO_write();
 static inline void begin_PIO_write_gap();
 static inline void end_PIO_write_gap();
+static inline bool is_PIO_write_finished(uint sm);
 void process_md_event(void* event);
+bool coalesce_md_event(void* current, void* next);
 void process_ui_event(void* event);
 void track1_write_irq();
 void track2_write_irq();
@@ -109,12 +178,17 @@ void status_irq();
 void shifter_irq();
 void init_DMAs();
 void enable_read_DMAs(uint8_t* buffer_track_1, uint8_t* buffer_track_2, bool isHeader);
-void enable_write_DMAs(uint8_t* buffer_track_1, uint8_t* buffer_track_2, bool isHeader);
+void enable_write_DMAs(uint8_t* source, bool isHeader);
 void disable_DMAs(bool readDMAs);
+bool flush_PIO_read_machine(uint sm, uint dma, uint32_t totalTransfers);
+bool flush_PIO_read_machines(bool isHeader);
+void load_PIO_read_pattern(uint sm);
 void reset_transfer_machine(PIO pio, uint sm, uint initial_pc);
 void reset_transfer_machines();
 void init_PIO_machines();
 void init_alarms();
+void init_MD_control();
+void run_MD_control_step();
 void RunMDControl();
 
 #endif
\ No newline at end of file
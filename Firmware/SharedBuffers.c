@@ -4,39 +4,34 @@
 /*
 
 Buffers for the microdrive PIO machines
-We have two sets so we can go ahead before the user interface core
-processes the received data or writes new sectors to it
+We have a ring of buffer sets so we can go ahead before the user interface core
+processes the received data or assigns new sectors to it. The UI core fills the sets
+ahead of the MD core and flags them as ready, the MD core uses them in order and clears
+the flag when it returns a set to the UI core.
 
-*/
-
-//First set of buffers
-//Header of a sector, two tracks
-uint8_t header_1_track_1[HEADER_BUFFER_SIZE];
-uint8_t header_1_track_2[HEADER_BUFFER_SIZE];
+The buffers are packed and word aligned as the DMAs move them from the PIO in 32 bit words
 
-//Content of a sector, two tracks
-uint8_t sector_1_track_1[SECTOR_BUFFER_SIZE];
-uint8_t sector_1_track_2[SECTOR_BUFFER_SIZE];
-uint8_t bufferset_1_sector_number = 0;
+*/
 
-//Second set of buffers
-//Header of a sector, two tracks
-uint8_t header_2_track_1[HEADER_BUFFER_SIZE];
-uint8_t header_2_track_2[HEADER_BUFFER_SIZE];
+bufferset_t bufferSets[BUFFER_SET_COUNT];
 
-//Content of a sector, two tracks
-uint8_t sector_2_track_1[SECTOR_BUFFER_SIZE];
-uint8_t sector_2_track_2[SECTOR_BUFFER_SIZE];
-uint8_t bufferset_2_sector_number = 0;
+//Counters of the MD core, always on, they are shown in the diagnostics page and dumped with the trace
+volatile perfcounters_t perfCounters;
 
 //Cartridge image buffer
-uint8_t cartridge_image[CART_SIZE];
+uint8_t cartridge_image[CART_SIZE] __attribute__((aligned(4)));
 
 /*
 Event machines
 */
 
-//Machine processed by the ui control, receives events from the md
+//Machine processed by the md control, receives events from its IRQs and alarms
+evtmachine_t mdEventQueue;
+//Machine processed by the ui control, receives the buffer sets and the selection changes from the md, the
+//selection changes go with the buffer sets as the ui must process them in the order they happened
 evtmachine_t mdToUiEventQueue;
+//Machine processed by the ui control, receives the read/write status of the md (only used for the leds)
+//so they never delay the buffer set notifications of mdToUiEventQueue
+evtmachine_t mdToUiStatusQueue;
 //Machine processed by the md control, receives events from the ui
 evtmachine_t uiToMdEventQueue;
\ No newline at end of file
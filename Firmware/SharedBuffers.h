@@ -6,8 +6,10 @@
 
 #define CART_SIZE 160140
 
-#define HEADER_BUFFER_SIZE 128
-#define SECTOR_BUFFER_SIZE 2980
+#define CARTRIDGE_HEADER_SIZE 16
+#define CARTRIDGE_DATA_SIZE 612
+#define CARTRIDGE_SECTOR_SIZE 628
+#define CARTRIDGE_SECTOR_COUNT 255
 
 #define HEADER_TRACK_DATA_SIZE 8
 #define SECTOR_TRACK_DATA_SIZE 306
@@ -18,25 +20,77 @@
 #define PREAMBLE_ZERO_BYTES 10
 #define PREAMBLE_ONE_BYTES 2
 
+//Zeros sent by each write machine before the ones, track 2 sends four more to respect the skewing done by the ULA
+#define TRACK_1_PREAMBLE_ZERO_BITS PREAMBLE_ZERO_BITS
+#define TRACK_2_PREAMBLE_ZERO_BITS (PREAMBLE_ZERO_BITS + 4)
+
+//The buffers are packed (LSB first) and moved by the DMAs in 32 bit words.
+//They are only used to receive, the data sent to the ULA is read by the DMAs straight from the cartridge image
+//and the write machines generate the preamble (PREAMBLE_ZERO_BITS zeros and PREAMBLE_ONE_BITS ones).
+
+//RX transfers are just the data bits, the read machines discard the preamble so the data starts at the LSB of the
+//first word. Sectors are not a multiple of 32 bits, the last half word is flushed when the ULA stops writting.
+#define HEADER_RX_WORDS 2
+#define SECTOR_RX_WORDS 77
+
+#define HEADER_BUFFER_SIZE (HEADER_RX_WORDS * 4)
+#define SECTOR_BUFFER_SIZE (SECTOR_RX_WORDS * 4)
+
+//Number of buffer sets in the ring, the UI core prefetches up to this number of sectors ahead of the MD core
+#ifndef BUFFER_SET_COUNT
+#define BUFFER_SET_COUNT 4
+#endif
+
 extern uint8_t cartridge_image[CART_SIZE];
 
-extern uint8_t header_1_track_1[HEADER_BUFFER_SIZE];
-extern uint8_t header_1_track_2[HEADER_BUFFER_SIZE];
+//A buffer set holds a header and a sector, two tracks each
+typedef struct bufferset
+{
+    uint8_t header_track_1[HEADER_BUFFER_SIZE] __attribute__((aligned(4)));
+    uint8_t header_track_2[HEADER_BUFFER_SIZE] __attribute__((aligned(4)));
+    uint8_t sector_track_1[SECTOR_BUFFER_SIZE] __attribute__((aligned(4)));
+    uint8_t sector_track_2[SECTOR_BUFFER_SIZE] __attribute__((aligned(4)));
+
+    uint8_t sector_number;  //Cartridge sector served/received by the set
+    bool header_received;   //The header of the set was written by the ULA (format)
+    bool sector_received;   //The sector of the set was completely written by the ULA
+    volatile bool ready;    //Set by the UI core once the set is filled, cleared by the MD core when it returns the set
+
+} bufferset_t;
+
+//Set to 0 to keep both cores polling their queues instead of sleeping (WFE) when they are idle
+#ifndef IDLE_SLEEP
+#define IDLE_SLEEP 1
+#endif
 
-extern uint8_t sector_1_track_1[SECTOR_BUFFER_SIZE];
-extern uint8_t sector_1_track_2[SECTOR_BUFFER_SIZE];
+//Longest sleep of the UI core, it polls the buttons so it wakes up periodically even without events
+#define UI_IDLE_SLEEP_MS 10
 
-extern uint8_t bufferset_1_sector_number;
+//Buckets of the gap latency histogram, bucket n counts latencies below 2^(n+1) us and the last one the rest
+#define GAP_LATENCY_BUCKETS 8
 
-extern uint8_t header_2_track_1[HEADER_BUFFER_SIZE];
-extern uint8_t header_2_track_2[HEADER_BUFFER_SIZE];
+//Performance counters, written by the MD core (except uiWakeLatencyMax) and read by the UI core
+typedef struct perfcounters
+{
+    uint32_t setsServed;        //Buffer sets sent to the ULA
+    uint32_t setsReceived;      //Buffer sets written by the ULA
+    uint32_t underruns;         //Sets started by the MD core before the UI core had filled them
+    uint32_t dmaAborts;         //Headers or sectors cut before all their data was received or sent (gaps not included)
+    uint32_t invalidStatus;     //MDL_INVALID status reads
+    uint32_t gapLatencyMax;     //Worst time from a status edge to the DMAs armed, in us
+    uint32_t mdSleeps;          //Times the MD core slept in WFE
+    uint32_t mdWakeLatencyMax;  //Worst time from the event that woke the MD core to its loop running again, in us
+    uint32_t uiWakeLatencyMax;  //Same for the buffer set events and the UI core, written by the UI core
+    uint32_t gapLatency[GAP_LATENCY_BUCKETS];
 
-extern uint8_t sector_2_track_1[SECTOR_BUFFER_SIZE];
-extern uint8_t sector_2_track_2[SECTOR_BUFFER_SIZE];
+} perfcounters_t;
 
-extern uint8_t bufferset_2_sector_number;
+extern bufferset_t bufferSets[BUFFER_SET_COUNT];
+extern volatile perfcounters_t perfCounters;
 
+extern evtmachine_t mdEventQueue;
 extern evtmachine_t mdToUiEventQueue;
+extern evtmachine_t mdToUiStatusQueue;
 extern evtmachine_t uiToMdEventQueue;
 
 #endif
\ No newline at end of file
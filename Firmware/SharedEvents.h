@@ -9,6 +9,7 @@ typedef enum __attribute__((packed))
     MTU_MD_WRITTING, //ULA is writting to the MD
     MTU_BUFFERSET_READ, //A buffer set (header + sector) has been read by the ULA
     MTU_BUFFERSET_WRITTEN, //A buffer set (header + sector) has been written by the ULA
+    MTU_NONE //No event, used by the MD status table
 
 } mdtouievent_t;
 
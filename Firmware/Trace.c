@@ -0,0 +1,71 @@
+#include "Trace.h"
+#include "pff/pff.h"
+
+/*
+
+Post-mortem trace of the MD control
+
+Each core writes its own ring, the MD core traces its IRQs, events and gap transitions and the UI core
+the buffer sets it processes. The rings are only frozen while they are dumped to the SD card so the dump
+shows the last events before it was requested, the performance counters, the event queue high-water
+marks and the checks of the sectors written by the QL are stored with them. Timestamps come from the same timer in both cores so the
+rings can be merged in a single timeline.
+
+*/
+
+//The decoder (FirmwareTrace.cs) reads the header with this layout
+_Static_assert(sizeof(tracedumpheader_t) == 36, "The trace decoder expects a 36 byte header");
+
+tracering_t traceRings[2];
+volatile bool traceFrozen = false;
+
+//Writes a block to the open file, returns false if it could not be written completely
+static bool trace_write(const void* data, UINT size)
+{
+    UINT writeSize;
+
+    if(pf_write(data, size, &writeSize))
+        return false;
+
+    return writeSize == size;
+}
+
+//Dumps both rings to TRACE_FILE with the sector checks of the UI, the file system must be mounted
+bool trace_dump(const sectorcheck_t* sectorChecks)
+{
+    if(pf_open(TRACE_FILE))
+        return false;
+
+    traceFrozen = true;
+
+    tracedumpheader_t header = { 0 };
+    header.magic = TRACE_MAGIC;
+    header.version = TRACE_VERSION;
+    header.entrySize = sizeof(traceentry_t);
+    header.entryCount = TRACE_ENTRIES;
+    header.head[0] = traceRings[0].head;
+    header.head[1] = traceRings[1].head;
+    header.timestamp = time_us_32();
+    header.queueHighWater[0] = mdEventQueue.highWater;
+    header.queueHighWater[1] = uiToMdEventQueue.highWater;
+    header.queueHighWater[2] = mdToUiEventQueue.highWater;
+    header.queueHighWater[3] = mdToUiStatusQueue.highWater;
+    header.countersSize = sizeof(perfcounters_t);
+    header.checksSize = sizeof(sectorcheck_t);
+
+    //Copy the counters, the MD core keeps updating them
+    perfcounters_t counters = perfCounters;
+
+    bool res = trace_write(&header, sizeof(header)) && trace_write(&counters, sizeof(counters)) &&
+        trace_write(sectorChecks, sizeof(sectorcheck_t));
+
+    for(int core = 0; core < 2 && res; core++)
+        res = trace_write(traceRings[core].entries, sizeof(traceRings[core].entries));
+
+    UINT writeSize;
+    pf_write(0, 0, &writeSize);
+
+    traceFrozen = false;
+
+    return res;
+}
@@ -0,0 +1,112 @@
+#ifndef __TRACE__
+#define __TRACE__
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "SharedBuffers.h"
+#include "UserInterface.h"
+
+//Set to 0 to remove the trace points from the firmware
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED 1
+#endif
+
+//Entries of the ring of each core, must be a power of two
+#ifndef TRACE_ENTRIES
+#define TRACE_ENTRIES 256
+#endif
+
+//The dump is written to this file, Petit FatFs can't create files so it must exist in the SD card
+//and be big enough (TRACE_DUMP_SIZE bytes, any bigger file is fine)
+#define TRACE_FILE "/MDTRACE.BIN"
+#define TRACE_MAGIC 0x5254444D //"MDTR"
+#define TRACE_VERSION 5
+
+//Status written by the UI core, it doesn't know the MD state
+#define TRACE_NO_STATUS 0xFF
+
+//Traced events
+typedef enum __attribute__((packed))
+{
+    TRC_MD_EVENT,           //MD event processed, args = (mdevents_t << 16) | event args
+    TRC_STATUS_IRQ,         //Status lines changed, args = mdlinestatus_t (invalid ones included)
+    TRC_SHIFTER_IRQ,        //Shifter changed, args = shifter bit
+    TRC_DMA_WRITE_IRQ,      //A write DMA finished, args = track
+    TRC_READ_DMA_ARMED,     //Read gap prepared, args = 1 header / 0 sector
+    TRC_READ_STARTED,       //Read machines released, the ULA writes
+    TRC_READ_FINISHED,      //Read transfer flushed, args = 1 if all the data was received
+    TRC_WRITE_DMA_ARMED,    //Write gap prepared, args = 1 header / 0 sector
+    TRC_WRITE_STARTED,      //Write machines released, the preamble starts
+    TRC_BUFFERSET_UNDERRUN, //The MD core got a buffer set not filled by the UI
+    TRC_BUFFERSET_READ,     //UI core processed a set read by the ULA, args = sector
+    TRC_BUFFERSET_WRITTEN,  //UI core processed a set written by the ULA, args = sector
+    TRC_STATE_CHANGED       //Active status changed, args = previous << 8 | next
+
+} traceevent_t;
+
+typedef struct traceentry
+{
+    uint32_t timestamp;     //time_us_32() when the event happened
+    uint32_t args;
+    traceevent_t event;
+    uint8_t activeStatus;   //mdactivestatus_t of the MD core or TRACE_NO_STATUS
+    uint8_t bufferSet;      //Current buffer set of the MD core or the set processed by the UI core
+    uint8_t reserved;
+
+} traceentry_t;
+
+//One ring per core so each ring has a single writer, the IRQs of the core are masked only to claim the slot
+typedef struct tracering
+{
+    volatile uint32_t head; //Total entries written, the last TRACE_ENTRIES are in the ring
+    traceentry_t entries[TRACE_ENTRIES];
+
+} tracering_t;
+
+//Header of the dump file, followed by the performance counters, the checks of the sectors written by the QL,
+//the entries of the ring of core 0 and the ones of core 1
+//The slots are dumped as they are, once a ring wraps its oldest entry is the one at head % entryCount
+typedef struct tracedumpheader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entrySize;
+    uint32_t entryCount;    //Entries of each ring
+    uint32_t head[2];       //Head of each ring
+    uint32_t timestamp;     //time_us_32() of the dump
+    uint8_t queueHighWater[4]; //MD, UI to MD, MD to UI (buffer sets) and MD to UI (status) event queues
+    uint32_t countersSize;  //Size of the perfcounters_t that follows the header
+    uint32_t checksSize;    //Size of the sectorcheck_t that follows the counters
+
+} tracedumpheader_t;
+
+#define TRACE_DUMP_SIZE (sizeof(tracedumpheader_t) + sizeof(perfcounters_t) + sizeof(sectorcheck_t) + 2 * TRACE_ENTRIES * sizeof(traceentry_t))
+
+extern tracering_t traceRings[2];
+extern volatile bool traceFrozen;
+
+bool trace_dump(const sectorcheck_t* sectorChecks);
+
+//Adds an entry to the ring of the calling core
+static inline void trace_event(traceevent_t event, uint32_t args, uint8_t activeStatus, uint8_t bufferSet)
+{
+#if TRACE_ENABLED
+    if(traceFrozen)
+        return;
+
+    tracering_t* ring = &traceRings[get_core_num()];
+
+    uint32_t irqStatus = save_and_disable_interrupts();
+    uint32_t index = ring->head++;
+    restore_interrupts(irqStatus);
+
+    traceentry_t* entry = &ring->entries[index & (TRACE_ENTRIES - 1)];
+    entry->timestamp = time_us_32();
+    entry->args = args;
+    entry->event = event;
+    entry->activeStatus = activeStatus;
+    entry->bufferSet = bufferSet;
+#endif
+}
+
+#endif
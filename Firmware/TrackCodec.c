@@ -0,0 +1,74 @@
+#include "TrackCodec.h"
+
+/*
+
+Bit level codec for the received track buffers
+
+The cartridge image interleaves both tracks byte by byte (even bytes are track 1, odd bytes are track 2)
+while the track buffers are packed bit streams (LSB first) as they are received by the PIO machines.
+The received tracks are already aligned (the read machines discard the preamble) so everything is done
+a word at a time, four bytes of each track are merged with masks and shifts into two cartridge words
+and the bytes of each word are added in two lanes at the same time to verify the checksums.
+Sending needs no codec, the write DMAs read the cartridge image directly.
+
+All the buffers must be word aligned and the track sizes must be even.
+
+*/
+
+//Adds the four bytes of a word in two 16 bit lanes
+static inline uint32_t sum_word_bytes(uint32_t word)
+{
+    return (word & 0x00FF00FF) + ((word >> 8) & 0x00FF00FF);
+}
+
+//Merges two packed tracks into interleaved cartridge data, the data of each track starts at the first bit of its buffer
+//While merging it adds the destination bytes between sumStart and sumEnd (word aligned offsets, up to 512 bytes
+//so the lanes can't overflow) and returns the sum, so the checksums can be verified without another pass
+uint16_t decode_track_pair(uint8_t* destination, const uint8_t* track1Buffer, const uint8_t* track2Buffer, uint16_t trackSize, uint16_t sumStart, uint16_t sumEnd)
+{
+    uint32_t* destinationWords = (uint32_t*)destination;
+    const uint32_t* track1 = (const uint32_t*)track1Buffer;
+    const uint32_t* track2 = (const uint32_t*)track2Buffer;
+
+    uint16_t wordPos = 0;
+    uint16_t sumStartWord = sumStart / 4;
+    uint16_t sumEndWord = sumEnd / 4;
+    uint32_t sum = 0;
+
+    //Four bytes of each track make two destination words
+    for(int buc = 0; buc < trackSize / 4; buc++)
+    {
+        uint32_t t1 = *track1++;
+        uint32_t t2 = *track2++;
+
+        uint32_t low = (t1 & 0xFF) | ((t2 & 0xFF) << 8) | ((t1 & 0xFF00) << 8) | ((t2 & 0xFF00) << 16);
+        uint32_t high = ((t1 >> 16) & 0xFF) | ((t2 >> 8) & 0xFF00) | ((t1 >> 8) & 0xFF0000) | (t2 & 0xFF000000);
+
+        *destinationWords++ = low;
+        *destinationWords++ = high;
+
+        if(wordPos >= sumStartWord && wordPos < sumEndWord)
+            sum += sum_word_bytes(low);
+
+        if(wordPos + 1 >= sumStartWord && wordPos + 1 < sumEndWord)
+            sum += sum_word_bytes(high);
+
+        wordPos += 2;
+    }
+
+    //Sector tracks are not a multiple of four, the last two bytes of each track make a single word
+    if(trackSize & 2)
+    {
+        uint32_t t1 = *track1;
+        uint32_t t2 = *track2;
+
+        uint32_t low = (t1 & 0xFF) | ((t2 & 0xFF) << 8) | ((t1 & 0xFF00) << 8) | ((t2 & 0xFF00) << 16);
+
+        *destinationWords = low;
+
+        if(wordPos >= sumStartWord && wordPos < sumEndWord)
+            sum += sum_word_bytes(low);
+    }
+
+    return (sum & 0xFFFF) + (sum >> 16);
+}
@@ -0,0 +1,8 @@
+#ifndef __TRACKCODEC__
+#define __TRACKCODEC__
+
+#include "pico/stdlib.h"
+
+uint16_t decode_track_pair(uint8_t* destination, const uint8_t* track1Buffer, const uint8_t* track2Buffer, uint16_t trackSize, uint16_t sumStart, uint16_t sumEnd);
+
+#endif
@@ -1,11 +1,15 @@
 #include <string.h>
+#include <stddef.h>
 #include <stdio.h>
 #include "hardware/spi.h"
 #include "hardware/gpio.h"
+#include "hardware/sync.h"
 #include "EventMachine.h"
 #include "UserInterface.h"
 #include "SharedBuffers.h"
 #include "SharedEvents.h"
+#include "TrackCodec.h"
+#include "Trace.h"
 #include "ssd1306/ssd1306.h"
 #include "pff/pff.h"
 
@@ -37,184 +41,293 @@ CARTRIDGE_FORMAT cfInserted = NONE;
 uint64_t delayEnd;
 USER_INTERFACE_STATE uiNextState;
 
-//Writes a pair of buffers of a buffer set (a buffer set are four buffers, two header ones and two sector ones)
-void write_buffer_set_pair(uint8_t* source, uint8_t* track1Buffer, uint8_t* track2Buffer, bool isHeader)
+uint8_t diagnosticsPage = 0;
+uint64_t diagnosticsRefresh = 0;
+
+//Duration of the last cartridge load and save, in ms
+uint32_t loadTime = 0;
+uint32_t saveTime = 0;
+
+//Staging buffer for the MDV saves, one transfer chunk
+uint8_t saveBuffer[TRANSFER_CHUNK_SIZE] __attribute__((aligned(4)));
+
+//Load or save in progress, position and size are in bytes except for MDV loads that go sector by sector
+uint32_t transferPos = 0;
+uint32_t transferSize = 0;
+uint32_t transferStart = 0;
+uint64_t transferRefresh = 0;
+
+//Run of dirty sectors being saved, it ends in the file at saveRunEnd
+uint16_t saveSector = 0;  //Next sector checked for the next run
+uint8_t saveRunFirst = 0;
+uint8_t saveRunLast = 0;
+uint32_t saveRunEnd = 0;
+
+#define SD_ALIGN_DOWN(POS) ((POS) & ~511u)
+#define SD_ALIGN_UP(POS) (((POS) + 511u) & ~511u)
+
+//How often the load and save progress is refreshed
+#define TRANSFER_REFRESH_US 250000
+
+//Pages of the diagnostics screen and how often they are refreshed
+#define DIAGNOSTICS_PAGES 11
+#define DIAGNOSTICS_REFRESH_US 500000
+
+//Assigns a cartridge sector to a buffer set, the write DMAs send it straight from the cartridge image
+//Once assigned the set is ready to be used by the MD core
+void write_buffer_set(uint8_t setNumber, uint8_t sector)
 {
-    track2Buffer += 4; //we skip four bits on buffer 2 to respect the skewing done by the ULA
+    bufferSets[setNumber].sector_number = sector;
 
-    for(int buc = 0; buc < PREAMBLE_ZERO_BITS; buc++)
-    {
-        track1Buffer[buc] = 0;
-        track2Buffer[buc] = 0;
-    } 
+    //The set must be visible to the MD core before it sees it ready
+    __dmb();
+    bufferSets[setNumber].ready = true;
+}
 
-    track1Buffer += PREAMBLE_ZERO_BITS;
-    track2Buffer += PREAMBLE_ZERO_BITS;
+bool inFormat = false;
+int skip = 0;
 
-    for(int buc = 0; buc < PREAMBLE_ONE_BITS; buc++)
-    {
-        track1Buffer[buc] = 1;
-        track2Buffer[buc] = 1;
-    } 
+sectorcheck_t sectorCheck = { 0, 0, 0, -1, 0 };
+
+#if REJECT_CORRUPT_SECTORS
+//Records are decoded here first, so a corrupt one is not stored over a good one
+uint8_t recordBuffer[CARTRIDGE_DATA_SIZE] __attribute__((aligned(4)));
+#endif
 
-    track1Buffer += PREAMBLE_ONE_BITS;
-    track2Buffer += PREAMBLE_ONE_BITS;
+//QL checksums are the sum of the bytes plus 0x0F0F
+#define QL_CHECKSUM(SUM) ((uint16_t)((SUM) + 0x0F0F))
 
-    uint16_t copySize = isHeader ? HEADER_TRACK_DATA_SIZE : SECTOR_TRACK_DATA_SIZE;
+//Offsets of the checksummed data of a record, the data is word aligned so the decoder adds it while merging the tracks
+#define RECORD_DATA_START offsetof(SECTOR_RECORD_t, Data)
+#define RECORD_DATA_END offsetof(SECTOR_RECORD_t, DataChecksum)
 
-    for(int buc = 0; buc < copySize; buc++)
+//Reads a pair of buffers from a buffer set (a buffer set are four buffers, two header ones and two sector ones)
+//The buffers are packed, the read machines discard the preamble so the data starts at the first bit
+//Returns the sum of the decoded bytes between sumStart and sumEnd
+uint16_t read_buffer_set_pair(uint8_t* destination, uint8_t* track1Buffer, uint8_t* track2Buffer, bool isHeader, uint16_t sumStart, uint16_t sumEnd)
+{
+    uint16_t size = isHeader ? HEADER_TRACK_DATA_SIZE : SECTOR_TRACK_DATA_SIZE;
+
+    //Check if we're writting sector 255, if true then this is a format
+    if(isHeader && !inFormat)
     {
-        uint8_t t1b = *source;
-        source++;
-        uint8_t t2b = *source;
-        source++;
+        uint8_t sectorNumber = track2Buffer[0];
 
-        for(int buc = 0; buc < 8; buc++)
+        if(sectorNumber == 255)
         {
-            *track1Buffer = (t1b >> buc) & 1;
-            *track2Buffer = (t2b >> buc) & 1;
-            track1Buffer++;
-            track2Buffer++;
+            inFormat = 1;
+            skip = currentSector;
         }
     }
+
+    return decode_track_pair(destination, track1Buffer, track2Buffer, size, sumStart, sumEnd);
 }
 
-//Writes a buffer set with cartridge data
-void write_buffer_set(uint8_t setNumber, uint8_t sector)
+//Checks the checksums of a record given the sum of its data, returns the SECTOR_CHECK_* flags of the failed ones
+uint8_t check_record(SECTOR_RECORD_t* record, uint16_t dataSum)
+{
+    uint8_t failed = 0;
+
+    if(record->HeaderChecksum != QL_CHECKSUM(record->HeaderData[0] + record->HeaderData[1]))
+        failed |= SECTOR_CHECK_RECORD_HEADER;
+
+    if(record->DataChecksum != QL_CHECKSUM(dataSum))
+        failed |= SECTOR_CHECK_DATA;
+
+    return failed;
+}
+
+#if REJECT_CORRUPT_SECTORS
+//Adds the data bytes of a record
+uint16_t sum_record_data(SECTOR_RECORD_t* record)
 {
-    if(setNumber == 0)
+    uint16_t sum = 0;
+
+    for(int buc = 0; buc < sizeof(record->Data); buc++)
+        sum += record->Data[buc];
+
+    return sum;
+}
+#endif
+
+//Sectors whose checksums have already been validated, one bit per sector
+uint8_t validatedSectors[(CARTRIDGE_SECTOR_COUNT + 7) / 8];
+uint8_t validateCursor = 0; //Next sector checked by the background validation
+
+#define SECTOR_VALIDATED(SECTOR) (validatedSectors[(SECTOR) >> 3] & (1 << ((SECTOR) & 7)))
+#define MARK_SECTOR_VALIDATED(SECTOR) validatedSectors[(SECTOR) >> 3] |= (1 << ((SECTOR) & 7))
+
+//Sectors validated by each background step, keeps each loop iteration short
+#define VALIDATE_SECTORS_PER_STEP 4
+
+//Sectors that differ from the image in the SD card, written by the QL or fixed by the validation, one bit per sector
+uint8_t dirtySectors[(CARTRIDGE_SECTOR_COUNT + 7) / 8];
+
+#define SECTOR_DIRTY(SECTOR) (dirtySectors[(SECTOR) >> 3] & (1 << ((SECTOR) & 7)))
+#define MARK_SECTOR_DIRTY(SECTOR) dirtySectors[(SECTOR) >> 3] |= (1 << ((SECTOR) & 7))
+#define CLEAR_SECTOR_DIRTY(SECTOR) dirtySectors[(SECTOR) >> 3] &= ~(1 << ((SECTOR) & 7))
+
+//Checks the checksums and the extra bytes of a sector, only the wrong ones are rewritten
+void validate_sector(uint8_t sectorNumber)
+{
+    SECTOR_t* sector = (SECTOR_t*)&cartridge_image[CARTRIDGE_SECTOR_SIZE * sectorNumber];
+    uint16_t computedChecksum = 0;
+    bool fixed = false;
+
+    for(int hBuc = 0; hBuc < 14; hBuc++)
+        computedChecksum += sector->Header.HeaderData[hBuc];
+
+    if(sector->Header.Checksum != QL_CHECKSUM(computedChecksum))
     {
-        write_buffer_set_pair(&cartridge_image[CARTRIDGE_SECTOR_SIZE * sector], header_1_track_1, header_1_track_2, true);
-        write_buffer_set_pair(&cartridge_image[CARTRIDGE_SECTOR_SIZE * sector + CARTRIDGE_HEADER_SIZE], sector_1_track_1, sector_1_track_2, false);
-        bufferset_1_sector_number = sector;
+        sector->Header.Checksum = QL_CHECKSUM(computedChecksum);
+        fixed = true;
     }
-    else
+
+    computedChecksum = sector->Record.HeaderData[0] + sector->Record.HeaderData[1];
+
+    if(sector->Record.HeaderChecksum != QL_CHECKSUM(computedChecksum))
     {
-        write_buffer_set_pair(&cartridge_image[CARTRIDGE_SECTOR_SIZE * sector], header_2_track_1, header_2_track_2, true);
-        write_buffer_set_pair(&cartridge_image[CARTRIDGE_SECTOR_SIZE * sector + CARTRIDGE_HEADER_SIZE], sector_2_track_1, sector_2_track_2, false);
-        bufferset_2_sector_number = sector;
+        sector->Record.HeaderChecksum = QL_CHECKSUM(computedChecksum);
+        fixed = true;
     }
-}
 
-//Find the end of a preamble from a track buffer
-int8_t find_preamble_end(uint8_t* buffer)
-{
-    uint8_t zeroCount = 0;
-    uint8_t oneCount = 0;
+    computedChecksum = 0;
 
-    //We need to find at least 16 zeros followed by 8 ones (0x00, 0x00, 0xFF)
-    for(int buc = 0; buc < 100; buc++)
+    for(int hdBuc = 0; hdBuc < 512; hdBuc++)
+        computedChecksum += sector->Record.Data[hdBuc];
+
+    if(sector->Record.DataChecksum != QL_CHECKSUM(computedChecksum))
     {
-        if(buffer[buc] == 0)
-        {
-            if(oneCount != 0) //Do we came here form a one?
-            {
-                //Reset everything
-                zeroCount = 1;
-                oneCount = 0;
-            }
-            else
-                zeroCount++; //Increment count
+        sector->Record.DataChecksum = QL_CHECKSUM(computedChecksum);
+        fixed = true;
+    }
 
-        }
-        else
+    for (int bExtra = 0; bExtra < 84; bExtra++)
+    {
+        uint8_t extra = bExtra % 2 == 0 ? 0xAA : 0x55;
+
+        if(sector->Record.ExtraBytes[bExtra] != extra)
         {
-            if(zeroCount < 16) //Did we found a one before having eight zeros?
-            {
-                //Reset everything
-                oneCount = 0;
-                zeroCount = 0;
-            }
-            else
-                oneCount++; //Increment count
+            sector->Record.ExtraBytes[bExtra] = extra;
+            fixed = true;
         }
+    }
 
-        //Have we found the eight ones?
-        if(oneCount == 8)
-            return buc + 1;
+    if (sector->Record.ExtraBytesChecksum != 0x3b19)
+    {
+        sector->Record.ExtraBytesChecksum = 0x3b19;
+        fixed = true;
     }
 
-    //Error! We haven't found the gap end!!
-    return -1;
+    //The fixed sector must be saved
+    if(fixed)
+        MARK_SECTOR_DIRTY(sectorNumber);
 
+    MARK_SECTOR_VALIDATED(sectorNumber);
 }
 
-bool inFormat = false;
-int skip = 0;
+//Validates a sector if it has not been validated yet
+void ensure_sector_validated(uint8_t sectorNumber)
+{
+    if(!SECTOR_VALIDATED(sectorNumber))
+        validate_sector(sectorNumber);
+}
 
-//Reads a pair of buffers from a buffer set (a buffer set are four buffers, two header ones and two sector ones)
-void read_buffer_set_pair(uint8_t* destination, uint8_t* track1Buffer, uint8_t* track2Buffer, bool isHeader)
+//Forgets the validation and the dirty state, used when a new cartridge is loaded
+void reset_sector_validation()
 {
-    uint16_t track1Pos = find_preamble_end(track1Buffer);
-    uint16_t track2Pos = find_preamble_end(track2Buffer);
+    memset(validatedSectors, 0, sizeof(validatedSectors));
+    memset(dirtySectors, 0, sizeof(dirtySectors));
+    validateCursor = 0;
+}
 
-    uint16_t size = isHeader ? HEADER_TRACK_DATA_SIZE : SECTOR_TRACK_DATA_SIZE;
+//Validates a few of the pending sectors, returns true once the whole cartridge has been validated
+//The sectors are also validated on demand before they are sent to the QL, so the cartridge can be
+//inserted before the validation finishes
+bool validate_cartridge_step()
+{
+    for(int buc = 0; buc < VALIDATE_SECTORS_PER_STEP && validateCursor < CARTRIDGE_SECTOR_COUNT; buc++)
+        ensure_sector_validated(validateCursor++);
 
-    //Check if we're writting sector 255, if true then this is a format
-    if(isHeader && !inFormat)
+    return validateCursor == CARTRIDGE_SECTOR_COUNT;
+}
+
+//Reads a buffer set to the cartridge buffer and verifies its checksums
+//The header is only decoded if the ULA has written it (format), on a file write the header buffers
+//still hold the packed header that we sent to the ULA. If the ULA didn't send a whole sector the
+//buffers contain trash so we keep the cartridge content. Returns true if the cartridge content was changed
+bool read_buffer_set(uint8_t setNumber)
+{
+    bufferset_t* set = &bufferSets[setNumber];
+    SECTOR_t* sector = (SECTOR_t*)&cartridge_image[CARTRIDGE_SECTOR_SIZE * set->sector_number];
+    uint8_t failed = 0;
+    bool stored = set->header_received;
+
+    if(set->header_received)
     {
-        uint8_t sectorNumber = track2Buffer[track2Pos] |
-            track2Buffer[track2Pos + 1] << 1 |
-            track2Buffer[track2Pos + 2] << 2 |
-            track2Buffer[track2Pos + 3] << 3 |
-            track2Buffer[track2Pos + 4] << 4 |
-            track2Buffer[track2Pos + 5] << 5 |
-            track2Buffer[track2Pos + 6] << 6 |
-            track2Buffer[track2Pos + 7] << 7;
+        //The first 12 bytes are added by the decoder, the last two bytes of the header data are not word aligned
+        uint16_t sum = read_buffer_set_pair((uint8_t*)&sector->Header, set->header_track_1, set->header_track_2, true, 0, 12);
+        sum += sector->Header.HeaderData[12] + sector->Header.HeaderData[13];
 
-        if(sectorNumber == 255)
+        if(sector->Header.Checksum != QL_CHECKSUM(sum))
+            failed |= SECTOR_CHECK_HEADER;
+    }
+
+    if(set->sector_received)
+    {
+#if REJECT_CORRUPT_SECTORS
+        SECTOR_RECORD_t* record = (SECTOR_RECORD_t*)recordBuffer;
+        uint16_t sum = read_buffer_set_pair(recordBuffer, set->sector_track_1, set->sector_track_2, false, RECORD_DATA_START, RECORD_DATA_END);
+        uint8_t recordFailed = check_record(record, sum);
+
+        //Keep the cartridge record if the new one is corrupt and the stored one is fine
+        if(recordFailed && !check_record(&sector->Record, sum_record_data(&sector->Record)))
+            sectorCheck.rejected++;
+        else
         {
-            inFormat = 1;
-            skip = currentSector;
+            memcpy(&sector->Record, recordBuffer, CARTRIDGE_DATA_SIZE);
+            stored = true;
         }
+#else
+        uint16_t sum = read_buffer_set_pair((uint8_t*)&sector->Record, set->sector_track_1, set->sector_track_2, false, RECORD_DATA_START, RECORD_DATA_END);
+        uint8_t recordFailed = check_record(&sector->Record, sum);
+        stored = true;
+#endif
+        failed |= recordFailed;
     }
 
-    for(uint16_t buc = 0; buc < size; buc++)
-    {
-        *destination = track1Buffer[track1Pos] |
-            track1Buffer[track1Pos + 1] << 1 |
-            track1Buffer[track1Pos + 2] << 2 |
-            track1Buffer[track1Pos + 3] << 3 |
-            track1Buffer[track1Pos + 4] << 4 |
-            track1Buffer[track1Pos + 5] << 5 |
-            track1Buffer[track1Pos + 6] << 6 |
-            track1Buffer[track1Pos + 7] << 7;
-
-        track1Pos += 8;
-        destination++;
-
-        *destination = track2Buffer[track2Pos] |
-            track2Buffer[track2Pos + 1] << 1 |
-            track2Buffer[track2Pos + 2] << 2 |
-            track2Buffer[track2Pos + 3] << 3 |
-            track2Buffer[track2Pos + 4] << 4 |
-            track2Buffer[track2Pos + 5] << 5 |
-            track2Buffer[track2Pos + 6] << 6 |
-            track2Buffer[track2Pos + 7] << 7;
-
-        track2Pos += 8;
-        destination++;
+    if(!set->header_received && !set->sector_received)
+        return false;
 
-    }
-}
+    //The QL owns the content of the sectors it writes, the validation must not fix them
+    MARK_SECTOR_VALIDATED(set->sector_number);
 
-//Reads a buffer set to the cartridge buffer
-void read_buffer_set(uint8_t setNumber)
-{
-    if(setNumber == 0)
+    if(failed)
     {
-        read_buffer_set_pair(&cartridge_image[CARTRIDGE_SECTOR_SIZE * bufferset_1_sector_number], header_1_track_1, header_1_track_2, true);
-        read_buffer_set_pair(&cartridge_image[CARTRIDGE_SECTOR_SIZE * bufferset_1_sector_number + CARTRIDGE_HEADER_SIZE], sector_1_track_1, sector_1_track_2, false);
+        sectorCheck.bad++;
+        sectorCheck.lastBadSector = set->sector_number;
+        sectorCheck.lastBadChecks = failed;
     }
     else
-    {
-        read_buffer_set_pair(&cartridge_image[CARTRIDGE_SECTOR_SIZE * bufferset_2_sector_number], header_2_track_1, header_2_track_2, true);
-        read_buffer_set_pair(&cartridge_image[CARTRIDGE_SECTOR_SIZE * bufferset_2_sector_number + CARTRIDGE_HEADER_SIZE], sector_2_track_1, sector_2_track_2, false);
-    }
+        sectorCheck.good++;
+
+    return stored;
 }
 
-//Process when a buffer set has been read by the ULA
-void process_md_read(uint8_t bufferSet)
+//Buffer sets whose sector must be damaged once it has been sent to the QL (Minerva format fix)
+bool damageAfterRead[BUFFER_SET_COUNT];
+
+//Damages sector 13 to make Minerva happy... The QL must receive the sector intact, the set is sent straight
+//from the cartridge image so it's done once the set has been read by the ULA
+void damage_format_sector(uint8_t sector)
+{
+    cartridge_image[CARTRIDGE_SECTOR_SIZE * sector + 13] += 13;
+    cartridge_image[CARTRIDGE_SECTOR_SIZE * sector + 128] += 13;
+    MARK_SECTOR_DIRTY(sector);
+}
+
+//Fills a buffer set with the next sector of the cartridge
+void fill_buffer_set(uint8_t bufferSet)
 {
     uint8_t secNum = cartridge_image[CARTRIDGE_SECTOR_SIZE * currentSector + 1];
 
@@ -227,14 +340,12 @@ void process_md_read(uint8_t bufferSet)
             currentSector = 0;
     }
 
+    //The sector is sent straight from the cartridge image, it must be valid before the MD core uses it
+    ensure_sector_validated(currentSector);
     write_buffer_set(bufferSet, currentSector);
 
-    //If we are in the middle of a format and we're going to send sector 13, damage it to make Minerva happy...
-    if(inFormat && secNum == 13)
-    {
-        cartridge_image[CARTRIDGE_SECTOR_SIZE * currentSector + 13] += 13;
-        cartridge_image[CARTRIDGE_SECTOR_SIZE * currentSector + 128] += 13;
-    }
+    //If we are in the middle of a format and we're going to send sector 13, it's damaged after sending it
+    damageAfterRead[bufferSet] = inFormat && secNum == 13;
 
     currentSector++;
 
@@ -242,34 +353,43 @@ void process_md_read(uint8_t bufferSet)
         currentSector = 0;
 }
 
-//Process when a buffer set has been written by the ULA
-void process_md_write(uint8_t bufferSet)
+//Fills the whole ring with the first sectors of the cartridge
+void init_buffer_sets()
 {
-    read_buffer_set(bufferSet);
+    for(int buc = 0; buc < BUFFER_SET_COUNT; buc++)
+    {
+        ensure_sector_validated(buc);
+        write_buffer_set(buc, buc);
+        damageAfterRead[buc] = false;
+    }
 
-    uint8_t secNum = cartridge_image[CARTRIDGE_SECTOR_SIZE * currentSector + 1];
+    currentSector = BUFFER_SET_COUNT;
+}
 
-    //If we are in the middle of a format and we're going to send sector 254, skip it to make Minerva happy...
-    if(inFormat && secNum == 254)
-    {
-        currentSector++;
+//Process when a buffer set has been read by the ULA
+//The set is refilled when its event is processed, the MD core clears its ready flag before sending the event
+//so the flag can't tell us if the set has been processed (a set written by the QL must be decoded first)
+void process_md_read(uint8_t bufferSet)
+{
+    trace_event(TRC_BUFFERSET_READ, bufferSets[bufferSet].sector_number, TRACE_NO_STATUS, bufferSet);
 
-        if(currentSector > 253)
-            currentSector = 0;
-    }
+    if(damageAfterRead[bufferSet])
+        damage_format_sector(bufferSets[bufferSet].sector_number);
 
-    write_buffer_set(bufferSet, currentSector);
+    fill_buffer_set(bufferSet);
+}
 
-    //If we are in the middle of a format and we're going to send sector 13, damage it to make Minerva happy...
-    if(inFormat && secNum == 13)
-    {
-        cartridge_image[CARTRIDGE_SECTOR_SIZE * currentSector + 13] += 13;
-        cartridge_image[CARTRIDGE_SECTOR_SIZE * currentSector + 128] += 13;
-    }
+//Process when a buffer set has been written by the ULA
+void process_md_write(uint8_t bufferSet)
+{
+    trace_event(TRC_BUFFERSET_WRITTEN, bufferSets[bufferSet].sector_number, TRACE_NO_STATUS, bufferSet);
 
-    currentSector++;
-    if(currentSector == 255)
-        currentSector = 0;
+    //Only the sectors really changed by the QL must be saved
+    if(read_buffer_set(bufferSet))
+        MARK_SECTOR_DIRTY(bufferSets[bufferSet].sector_number);
+
+    //A sector written by the QL is not damaged, its data would replace the damage anyway
+    fill_buffer_set(bufferSet);
 }
 
 //Process events from the MD control
@@ -294,14 +414,23 @@ void process_md_to_ui_event(void* event)
             LED_ON(PIN_LED_SELECT);
             break;
 
+        //The leds events come in their own queue, one sent before a deselection can arrive after it
         case MTU_MD_READING:
-            LED_ON(PIN_LED_READ);
-            LED_OFF(PIN_LED_WRITE);
+
+            if(mdInUse)
+            {
+                LED_ON(PIN_LED_READ);
+                LED_OFF(PIN_LED_WRITE);
+            }
             break;
 
         case MTU_MD_WRITTING:
-            LED_ON(PIN_LED_WRITE);
-            LED_OFF(PIN_LED_READ);
+
+            if(mdInUse)
+            {
+                LED_ON(PIN_LED_WRITE);
+                LED_OFF(PIN_LED_READ);
+            }
             break;
 
         case MTU_BUFFERSET_READ:
@@ -374,252 +503,281 @@ void debounce_button(uint button)
     sleep_ms(200);
 }
 
-void fix_cartridge_checksums()
+//Layout of a MDV sector, each segment is copied from the cartridge sector or filled with a constant
+static const mdvsegment_t mdvSegments[] =
 {
-    SECTOR_t* sector = (SECTOR_t*)cartridge_image;
-
-    for(int buc = 0; buc < 255; buc++)
+    { PREAMBLE_ZERO_BYTES, -1, 0x00 },
+    { MDV_PREAMBLE_SIZE, -1, 0xFF },
+    { MDV_PREAMBLE_SIZE + CARTRIDGE_HEADER_SIZE, 0, 0 },
+    { MDV_PREAMBLE_SIZE * 2 + CARTRIDGE_HEADER_SIZE - PREAMBLE_ONE_BYTES, -1, 0x00 },
+    { MDV_PREAMBLE_SIZE * 2 + CARTRIDGE_HEADER_SIZE, -1, 0xFF },
+    { MDV_PREAMBLE_SIZE * 2 + CARTRIDGE_SECTOR_SIZE, CARTRIDGE_HEADER_SIZE, 0 },
+    { MDV_SECTOR_SIZE, -1, 'Z' }
+};
+
+//Generates the bytes of a MDV image from filePos to filePos + length
+void build_mdv_range(uint8_t* buffer, uint32_t filePos, uint32_t length)
+{
+    while(length)
     {
-        uint16_t computedChecksum = 0;
-
-        for(int hBuc = 0; hBuc < 14; hBuc++)
-            computedChecksum += sector->Header.HeaderData[hBuc];
-
-        computedChecksum += 0x0f0f;
-        sector->Header.Checksum = computedChecksum;
-
-        computedChecksum = 0;
-
-        for(int hrBuc = 0; hrBuc < 2; hrBuc++)
-            computedChecksum += sector->Record.HeaderData[hrBuc];
-
-        computedChecksum += 0x0f0f;
-        sector->Record.HeaderChecksum = computedChecksum;
+        uint8_t sector = filePos / MDV_SECTOR_SIZE;
+        uint16_t offset = filePos % MDV_SECTOR_SIZE;
+        uint16_t start = 0;
+        int segment = 0;
 
-        computedChecksum = 0;
+        //Find the segment that contains the offset
+        while(offset >= mdvSegments[segment].end)
+            start = mdvSegments[segment++].end;
 
-        for(int hdBuc = 0; hdBuc < 512; hdBuc++)
-            computedChecksum += sector->Record.Data[hdBuc];
+        uint32_t count = mdvSegments[segment].end - offset;
 
-        computedChecksum += 0x0f0f;
-        sector->Record.DataChecksum = computedChecksum;
+        if(count > length)
+            count = length;
 
-        for (int bExtra = 0; bExtra < 84; bExtra++)
-                sector->Record.ExtraBytes[bExtra] = bExtra % 2 == 0 ? 0xAA : 0x55;
-
-        if (sector->Record.ExtraBytesChecksum != 0x3b19)
-            sector->Record.ExtraBytesChecksum = 0x3b19;
+        if(mdvSegments[segment].source < 0)
+            memset(buffer, mdvSegments[segment].fill, count);
+        else
+            memcpy(buffer, &cartridge_image[CARTRIDGE_SECTOR_SIZE * sector + mdvSegments[segment].source + offset - start], count);
 
-        sector++;
+        buffer += count;
+        filePos += count;
+        length -= count;
     }
 }
 
-//Save the cartridge to a mdv image
-bool save_mdv_cartridge()
+//Loads a MDV sector to the cartridge buffer
+bool load_mdv_sector(uint8_t sector)
 {
-    if(pf_open(currentPath))
-        return false;
-
-    UINT writeSize;
-    uint8_t tmpByte = 0;
-    int bufferPos = 0;
-
-    uint8_t padBuffer[MDV_PAD_SIZE];
-    memset(padBuffer, 'Z', MDV_PAD_SIZE);
+    UINT readSize = 0;
 
-    for(int buc = 0; buc < 255; buc++)
-    {
-        tmpByte = 0;
+    int bufferPos = sector * CARTRIDGE_SECTOR_SIZE;
+    int filePos = sector * MDV_SECTOR_SIZE + MDV_PREAMBLE_SIZE; //skip preamble
 
-        for(int zeros = 0; zeros < PREAMBLE_ZERO_BYTES; zeros++)
-        {
-            if(pf_write(&tmpByte, 1, &writeSize))
-            {
-                pf_write(0, 0, &writeSize);
-                return false;
-            }
+    if(pf_lseek(filePos))
+        return false;
 
-            if(writeSize != 1)
-            {
-                pf_write(0, 0, &writeSize);
-                return false;
-            }
-        }
+    if(pf_read(&cartridge_image[bufferPos], MDV_HEADER_SIZE, &readSize))
+        return false;
 
-        tmpByte = 0xff;
+    if(readSize != MDV_HEADER_SIZE)
+        return false;
 
-        for(int ones = 0; ones < PREAMBLE_ONE_BYTES; ones++)
-        {
-            if(pf_write(&tmpByte, 1, &writeSize))
-            {
-                pf_write(0, 0, &writeSize);
-                return false;
-            }
+    filePos += MDV_HEADER_SIZE + MDV_PREAMBLE_SIZE;
+    bufferPos += MPD_HEADER_SIZE;
 
-            if(writeSize != 1)
-            {
-                pf_write(0, 0, &writeSize);
-                return false;
-            }
-        }
+    if(pf_lseek(filePos))
+        return false;
 
-        if(pf_write(&cartridge_image[bufferPos], CARTRIDGE_HEADER_SIZE, &writeSize))
-        {
-            pf_write(0, 0, &writeSize);
-            return false;
-        }
+    if(pf_read(&cartridge_image[bufferPos], MPD_DATA_SIZE, &readSize))
+        return false;
 
-        if(writeSize != CARTRIDGE_HEADER_SIZE)
-        {
-            pf_write(0, 0, &writeSize);
-            return false;
-        }
+    if(readSize != MPD_DATA_SIZE)
+        return false;
 
-        bufferPos += CARTRIDGE_HEADER_SIZE;
+    return true;
+}
 
-        tmpByte = 0;
+//Opens the selected image and starts loading it, the load goes on with load_cartridge_step
+bool begin_load_cartridge()
+{
+    if(pf_open(currentPath))
+        return false;
 
-        for(int zeros = 0; zeros < PREAMBLE_ZERO_BYTES; zeros++)
-        {
-            if(pf_write(&tmpByte, 1, &writeSize))
-            {
-                pf_write(0, 0, &writeSize);
-                return false;
-            }
+    //MDV images are loaded sector by sector, MPD images in chunks of bytes
+    transferPos = 0;
+    transferSize = cfInserted == MDV ? CARTRIDGE_SECTOR_COUNT : CART_MPD_SIZE;
+    transferStart = to_ms_since_boot(get_absolute_time());
+    transferRefresh = 0;
 
-            if(writeSize != 1)
-            {
-                pf_write(0, 0, &writeSize);
-                return false;
-            }
-        }
+    return true;
+}
 
-        tmpByte = 0xff;
+//Gets the bytes moved by a load or save step, the steps are shorter while the QL uses the drive
+uint32_t get_transfer_chunk_size()
+{
+    return mdInUse ? TRANSFER_CHUNK_SIZE_IN_USE : TRANSFER_CHUNK_SIZE;
+}
 
-        for(int ones = 0; ones < PREAMBLE_ONE_BYTES; ones++)
-        {
-            if(pf_write(&tmpByte, 1, &writeSize))
-            {
-                pf_write(0, 0, &writeSize);
-                return false;
-            }
+//Loads the next chunk of the image
+transferstatus_t load_cartridge_step()
+{
+    UINT readSize = 0;
 
-            if(writeSize != 1)
-            {
-                pf_write(0, 0, &writeSize);
-                return false;
-            }
-        }
+    if(cfInserted == MDV)
+    {
+        int sectorsPerStep = mdInUse ? MDV_LOAD_SECTORS_PER_STEP_IN_USE : MDV_LOAD_SECTORS_PER_STEP;
 
-        if(pf_write(&cartridge_image[bufferPos], CARTRIDGE_DATA_SIZE, &writeSize))
+        for(int sector = 0; sector < sectorsPerStep && transferPos < transferSize; sector++)
         {
-            pf_write(0, 0, &writeSize);
-            return false;
+            if(!load_mdv_sector(transferPos++))
+                return TRANSFER_ERROR;
         }
+    }
+    else
+    {
+        uint32_t length = transferSize - transferPos;
 
-        if(writeSize != CARTRIDGE_DATA_SIZE)
-            return false;
+        if(length > get_transfer_chunk_size())
+            length = get_transfer_chunk_size();
 
-        bufferPos += CARTRIDGE_DATA_SIZE;
+        if(pf_read_stream(&cartridge_image[transferPos], length, &readSize))
+            return TRANSFER_ERROR;
 
-        if(pf_write(padBuffer, MDV_PAD_SIZE, &writeSize))
-        {
-            pf_write(0, 0, &writeSize);
-            return false;
-        }
+        if(readSize != length)
+            return TRANSFER_ERROR;
 
-        if(writeSize != MDV_PAD_SIZE)
-            return false;
+        transferPos += length;
     }
 
-    pf_write(0, 0, &writeSize);
+    if(transferPos < transferSize)
+        return TRANSFER_BUSY;
 
-    return true;
+    loadTime = to_ms_since_boot(get_absolute_time()) - transferStart;
+
+    return TRANSFER_DONE;
 }
 
-//Save the cartridge to a mpd image
-bool save_mpd_cartridge()
+//Opens the image and starts saving the dirty sectors of the cartridge to it, the save goes on with save_cartridge_step
+bool begin_save_cartridge()
 {
     if(pf_open(currentPath))
         return false;
 
-    UINT writeSize;
+    saveSector = 0;
+    transferPos = 0;
+    saveRunEnd = 0;
+    transferSize = cfInserted == MDV ? CART_MDV_SIZE : CART_SIZE;
+    transferStart = to_ms_since_boot(get_absolute_time());
+    transferRefresh = 0;
+
+    return true;
+}
+
+//Finds the next run of dirty sectors, returns false if there are no more
+//Petit FatFs writes whole SD sectors so the run is widened to the SD sectors that contain it, the clean sectors
+//inside it are rewritten with the same content. Dirty sectors close to the end of the run are added to it as
+//writting a few more blocks costs less than another multiple block write
+bool next_save_run()
+{
+    uint16_t sectorSize = cfInserted == MDV ? MDV_SECTOR_SIZE : CARTRIDGE_SECTOR_SIZE;
 
-    if(pf_write(cartridge_image, CART_SIZE, &writeSize))
+    //The sectors are validated before checking them as fixing their checksums makes them dirty
+    while(saveSector < CARTRIDGE_SECTOR_COUNT)
     {
-        pf_write(0, 0, &writeSize);
-        return false;
+        ensure_sector_validated(saveSector);
+
+        if(SECTOR_DIRTY(saveSector))
+            break;
+
+        saveSector++;
     }
 
-    if(writeSize != CART_SIZE)
-    {
-        pf_write(0, 0, &writeSize);
+    if(saveSector == CARTRIDGE_SECTOR_COUNT)
         return false;
+
+    saveRunFirst = saveSector;
+    saveRunLast = saveSector;
+    uint32_t runEnd = SD_ALIGN_UP((saveSector + 1) * sectorSize);
+
+    for(saveSector++; saveSector < CARTRIDGE_SECTOR_COUNT && saveSector * sectorSize < runEnd + SAVE_MERGE_GAP; saveSector++)
+    {
+        ensure_sector_validated(saveSector);
+
+        if(SECTOR_DIRTY(saveSector))
+        {
+            saveRunLast = saveSector;
+            runEnd = SD_ALIGN_UP((saveSector + 1) * sectorSize);
+        }
     }
 
-    pf_write(0, 0, &writeSize);
+    //Continue the search after the last sector of the run
+    saveSector = saveRunLast + 1;
+
+    //The QL may write the sectors again while they are saved, they will be dirty again
+    for(int sector = saveRunFirst; sector <= saveRunLast; sector++)
+        CLEAR_SECTOR_DIRTY(sector);
+
+    transferPos = SD_ALIGN_DOWN(saveRunFirst * sectorSize);
+    saveRunEnd = runEnd < transferSize ? runEnd : transferSize;
 
     return true;
 }
 
-//Load a MDV image to the cartridge buffer
-bool load_mdv_cartridge()
+//Marks the current run as dirty again when it could not be saved
+void restore_save_run()
 {
-    if(pf_open(currentPath))
-        return false;
-
-    UINT readSize = 0;
+    for(int sector = saveRunFirst; sector <= saveRunLast; sector++)
+        MARK_SECTOR_DIRTY(sector);
+}
 
-    int bufferPos = 0;
-    int filePos = 0;
+//Saves the next chunk of the current run of dirty sectors, each chunk is a whole number of SD sectors so it goes to the card in a single multiple block write
+transferstatus_t save_cartridge_step()
+{
+    UINT writeSize;
+    const uint8_t* source;
 
-    for(int buc = 0; buc < 255; buc++)
+    if(transferPos == saveRunEnd)
     {
-        filePos = buc * MDV_SECTOR_SIZE + MDV_PREAMBLE_SIZE; //skip preamble
-
-        if(pf_lseek(filePos))
-            return false;
-
-        if(pf_read(&cartridge_image[bufferPos], MDV_HEADER_SIZE, &readSize))
-            return false;
+        //A run that ends in the last partial SD sector of the file leaves it in progress
+        if(pf_write(0, 0, &writeSize))
+        {
+            restore_save_run();
+            return TRANSFER_ERROR;
+        }
 
-        if(readSize != MDV_HEADER_SIZE)
-            return false;
+        if(!next_save_run())
+        {
+            saveTime = to_ms_since_boot(get_absolute_time()) - transferStart;
+            return TRANSFER_DONE;
+        }
 
-        filePos += MDV_HEADER_SIZE + MDV_PREAMBLE_SIZE;
-        bufferPos += MPD_HEADER_SIZE;
+        if(pf_lseek(transferPos))
+        {
+            restore_save_run();
+            return TRANSFER_ERROR;
+        }
+    }
 
-        if(pf_lseek(filePos))
-            return false;
+    uint32_t length = saveRunEnd - transferPos;
 
-        if(pf_read(&cartridge_image[bufferPos], MPD_DATA_SIZE, &readSize))
-            return false;
+    if(length > get_transfer_chunk_size())
+        length = get_transfer_chunk_size();
 
-        if(readSize != MPD_DATA_SIZE)
-            return false;
+    if(cfInserted == MDV)
+    {
+        build_mdv_range(saveBuffer, transferPos, length);
+        source = saveBuffer;
+    }
+    else
+        source = &cartridge_image[transferPos];
 
-        bufferPos += MPD_DATA_SIZE;
+    if(pf_write_stream(source, length, &writeSize) || writeSize != length)
+    {
+        pf_write(0, 0, &writeSize);
+        restore_save_run();
+        return TRANSFER_ERROR;
     }
 
-    return true;
+    transferPos += length;
+
+    return TRANSFER_BUSY;
 }
 
-//Load a MPD image to the cartridge buffer
-bool load_mpd_cartridge()
+//Shows the progress of the current load or save, the screen is refreshed only from time to time as rendering it takes a while
+//While the QL uses the drive the screen is not refreshed, the buffer sets can't wait for the display
+void show_transfer_progress(const char* title)
 {
-    if(pf_open(currentPath))
-        return false;
-
-    UINT readSize = 0;
-
-    if(pf_read(cartridge_image, CART_MPD_SIZE, &readSize))
-        return false;
-
-    if(readSize != CART_MPD_SIZE)
-        return false;
+    if(mdInUse || time_us_64() < transferRefresh)
+        return;
 
-    return true;
+    CLEAR_SCREEN();
+    PRINT_STR(title, 0, 1);
+    PRINT_STR("cartridge..", 0, 2);
+    snprintf(lineBuffer, sizeof(lineBuffer), "%3lu%%", (unsigned long)(transferPos * 100 / transferSize));
+    PRINT_STR(lineBuffer, 0, 3);
+    RENDER_SCREEN();
 
+    transferRefresh = time_us_64() + TRANSFER_REFRESH_US;
 }
 
 //Check if cancel was requested
@@ -653,6 +811,196 @@ void check_delay()
         uiState = uiNextState;
 }
 
+//Shows the error of a failed load and goes back to the file selection
+void show_load_error()
+{
+    CLEAR_SCREEN();
+    PRINT_STR("Error", 0, 1);
+    PRINT_STR("loading", 0, 2);
+    PRINT_STR("cartridge.", 0, 3);
+    RENDER_SCREEN();
+    rewind_path();
+    sleep_ms(4000);
+    show_file_name();
+    cfInserted = NONE;
+    uiState = SELECT_FILE;
+}
+
+//Shows the result of a save for a while without blocking the loop, then the cartridge is ready again
+void show_save_result(bool saved)
+{
+    CLEAR_SCREEN();
+
+    if(saved)
+    {
+        PRINT_STR("Cartridge  ", 0, 1);
+        PRINT_STR("saved.     ", 0, 2);
+    }
+    else
+    {
+        PRINT_STR("Error      ", 0, 1);
+        PRINT_STR("saving     ", 0, 2);
+        PRINT_STR("cartridge. ", 0, 3);
+    }
+
+    RENDER_SCREEN();
+    program_delay(2000, SHOW_CARTRIDGE_READY);
+}
+
+//Shows the cartridge ready screen
+void show_cartridge_ready()
+{
+    CLEAR_SCREEN();
+    PRINT_STR("Cartridge  ", 0, 1);
+    PRINT_STR("ready.     ", 0, 2);
+    RENDER_SCREEN();
+}
+
+//Prints a line of the diagnostics page, a short label followed by its value
+void print_counter(const char* label, uint32_t value, int row)
+{
+    snprintf(lineBuffer, sizeof(lineBuffer), "%-5s%6lu", label, (unsigned long)value);
+    PRINT_STR(lineBuffer, 0, row);
+}
+
+//Shows a page of the diagnostics screen, the counters are read while the MD core updates them
+void show_diagnostics_page(uint8_t page)
+{
+    static const char* latencyLabels[GAP_LATENCY_BUCKETS] = { "L<2", "L<4", "L<8", "L<16", "L<32", "L<64", "L<128", "L>127" };
+
+    CLEAR_SCREEN();
+
+    switch(page)
+    {
+        case 0:
+            print_counter("Out", perfCounters.setsServed, 1);
+            print_counter("In", perfCounters.setsReceived, 2);
+            print_counter("Late", perfCounters.underruns, 3);
+            break;
+
+        case 1:
+            print_counter("Abort", perfCounters.dmaAborts, 1);
+            print_counter("Inval", perfCounters.invalidStatus, 2);
+            snprintf(lineBuffer, sizeof(lineBuffer), "Q %3u%3u%3u", mdEventQueue.highWater, uiToMdEventQueue.highWater, mdToUiEventQueue.highWater);
+            PRINT_STR(lineBuffer, 0, 3);
+            break;
+
+        case 2:
+            print_counter("Drop", mdEventQueue.dropped, 1);
+            print_counter("Coal", mdEventQueue.coalesced, 2);
+            print_counter("SLed", mdToUiStatusQueue.starved, 3);
+            break;
+
+        case 3:
+            //Starved event classes, MD events, cartridge events and buffer sets
+            print_counter("SMd", mdEventQueue.starved, 1);
+            print_counter("SCart", uiToMdEventQueue.starved, 2);
+            print_counter("SSet", mdToUiEventQueue.starved, 3);
+            break;
+
+        case 4:
+            print_counter("Good", sectorCheck.good, 1);
+            print_counter("Bad", sectorCheck.bad, 2);
+            print_counter("Rej", sectorCheck.rejected, 3);
+            break;
+
+        case 5:
+            //Last sector written with wrong checksums and the ones that failed (H header, R record header, D data)
+            if(sectorCheck.lastBadSector < 0)
+                PRINT_STR("LBad      -", 0, 1);
+            else
+            {
+                print_counter("LBad", sectorCheck.lastBadSector, 1);
+                snprintf(lineBuffer, sizeof(lineBuffer), "Chk     %c%c%c",
+                    sectorCheck.lastBadChecks & SECTOR_CHECK_HEADER ? 'H' : '-',
+                    sectorCheck.lastBadChecks & SECTOR_CHECK_RECORD_HEADER ? 'R' : '-',
+                    sectorCheck.lastBadChecks & SECTOR_CHECK_DATA ? 'D' : '-');
+                PRINT_STR(lineBuffer, 0, 2);
+            }
+            break;
+
+        case 6:
+            //SD card timings, compare them with PF_USE_DMA enabled and disabled
+            print_counter("Load", loadTime, 1);
+            print_counter("Save", saveTime, 2);
+            print_counter("SDma", PF_USE_DMA, 3);
+            break;
+
+        case 7:
+            //Idle sleeps of the MD core and the worst wake up latencies of both cores, in us
+            print_counter("Sleep", perfCounters.mdSleeps, 1);
+            print_counter("WMd", perfCounters.mdWakeLatencyMax, 2);
+            print_counter("WUi", perfCounters.uiWakeLatencyMax, 3);
+            break;
+
+        default:
+        {
+            //Gap latency histogram, three buckets per page and the worst latency at the end
+            int first = (page - 8) * 3;
+
+            for(int row = 0; row < 3; row++)
+            {
+                int bucket = first + row;
+
+                if(bucket < GAP_LATENCY_BUCKETS)
+                    print_counter(latencyLabels[bucket], perfCounters.gapLatency[bucket], row + 1);
+                else
+                    print_counter("Lmax", perfCounters.gapLatencyMax, row + 1);
+            }
+        }
+            break;
+    }
+
+    RENDER_SCREEN();
+}
+
+//Dumps the MD trace and the performance counters to the SD card
+void dump_trace()
+{
+    CLEAR_SCREEN();
+    PRINT_STR("Dumping    ", 0, 1);
+    PRINT_STR("trace...   ", 0, 2);
+    RENDER_SCREEN();
+
+    if(trace_dump(&sectorCheck))
+    {
+        CLEAR_SCREEN();
+        PRINT_STR("Trace      ", 0, 1);
+        PRINT_STR("saved.     ", 0, 2);
+        RENDER_SCREEN();
+    }
+    else
+    {
+        CLEAR_SCREEN();
+        PRINT_STR("Error      ", 0, 1);
+        PRINT_STR("saving     ", 0, 2);
+        PRINT_STR("trace.     ", 0, 3);
+        RENDER_SCREEN();
+    }
+
+    //The result is shown for a while without blocking the loop, then the diagnostics page is drawn again
+    diagnosticsRefresh = 0;
+    program_delay(2000, DIAGNOSTICS);
+}
+
+//Checks if the UI is only polling the buttons or a delay, the rest of the states go on without waiting
+bool is_ui_waiting()
+{
+    switch(uiState)
+    {
+        case IDLE:
+        case DELAY:
+        case WAITING_SD_CARD:
+        case SELECT_FILE:
+        case CARTRIDGE_READY:
+        case DIAGNOSTICS:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
 //Process the user interface state machine
 void process_user_interface()
 {
@@ -896,53 +1244,53 @@ void process_user_interface()
             {
                 CONCAT(currentPath, fno.fname);
 
-                bool res = false;
-                
-                switch(cfInserted)
+                if(!begin_load_cartridge())
+                    show_load_error();
+                else
+                    uiState = LOADING;
+            }
+
+            break;
+
+        case LOADING:
+
+            if(IS_UI_DISCONNECTED())
+            {
+                cfInserted = NONE;
+                uiState = IDLE;
+            }
+            else
+            {
+                //The image is loaded a chunk per loop iteration so the screen can show the progress
+                switch(load_cartridge_step())
                 {
-                    case MDV:
-                        res = load_mdv_cartridge();
+                    case TRANSFER_BUSY:
+
+                        show_transfer_progress(cfInserted == MDV ? "Loading MDV" : "Loading MPD");
                         break;
-                    case MPD:
-                        res = load_mpd_cartridge();
+
+                    case TRANSFER_ERROR:
+
+                        show_load_error();
                         break;
-                }
-                
-                if(!res)
-                {
-                    CLEAR_SCREEN();
-                    PRINT_STR("Error", 0, 1);
-                    PRINT_STR("loading", 0, 2);
-                    PRINT_STR("cartridge.", 0, 3);
-                    RENDER_SCREEN();
-                    rewind_path();
-                    sleep_ms(4000);
-                    show_file_name();
-                    cfInserted = NONE;
-                    uiState = SELECT_FILE;
-                }
-                else
-                {
 
-                    CLEAR_SCREEN();
-                    PRINT_STR("Validating", 0, 1);
-                    PRINT_STR("cartridge", 0, 2);
-                    PRINT_STR("format...", 0, 3);
-                    RENDER_SCREEN();
+                    case TRANSFER_DONE:
 
-                    fix_cartridge_checksums();
+                        CLEAR_SCREEN();
+                        PRINT_STR("Validating", 0, 1);
+                        PRINT_STR("cartridge", 0, 2);
+                        PRINT_STR("format...", 0, 3);
+                        RENDER_SCREEN();
 
-                    write_buffer_set(0, 0);
-                    write_buffer_set(1, 1);
-                    currentSector = 2;
-                    uiState = CARTRIDGE_READY;
-                    utmevent_t insertEvt;
-                    insertEvt.event = UTM_CARTRIDGE_INSERTED;
-                    event_push(&uiToMdEventQueue, &insertEvt);
-                    CLEAR_SCREEN();
-                    PRINT_STR("Cartridge  ", 0, 1);
-                    PRINT_STR("ready.     ", 0, 2);
-                    RENDER_SCREEN();
+                        //Only the first sectors are validated here, the rest are validated in background
+                        reset_sector_validation();
+                        init_buffer_sets();
+                        uiState = CARTRIDGE_READY;
+                        utmevent_t insertEvt;
+                        insertEvt.event = UTM_CARTRIDGE_INSERTED;
+                        event_push(&uiToMdEventQueue, &insertEvt);
+                        show_cartridge_ready();
+                        break;
                 }
             }
 
@@ -964,53 +1312,91 @@ void process_user_interface()
                     removeEvt.event = UTM_CARTRIDGE_REMOVED;
                     event_push(&uiToMdEventQueue, &removeEvt);
                 }
+                else if(BUTTON_PRESSED(PIN_BTN_NEXT))
+                {
+                    debounce_button(PIN_BTN_NEXT);
+                    diagnosticsPage = 0;
+                    diagnosticsRefresh = 0;
+                    uiState = DIAGNOSTICS;
+                }
                 else if(BUTTON_PRESSED(PIN_BTN_SELECT))
                 {
-                    CLEAR_SCREEN();
-                    PRINT_STR("Saving     ", 0, 1);
-                    PRINT_STR("cartridge..", 0, 2);
-                    RENDER_SCREEN();
-
-                    bool res = false;
-
-                    switch(cfInserted)
+                    //The save runs a chunk per loop iteration, the buffer sets are still served while it runs
+                    if(begin_save_cartridge())
                     {
-                        case MDV:
-                            res = save_mdv_cartridge();
-                            break;
-                        //case IMG:
-                        //    res = save_img_cartridge();
-                        //    break;
-                        case MPD:
-                            res = save_mpd_cartridge();
-                            break;
+                        show_transfer_progress("Saving     ");
+                        uiState = SAVING;
                     }
+                    else
+                        show_save_result(false);
+                }
+            }
+
+            break;
+
+        case SAVING:
+
+            //The save goes on even if the QL selects the drive, the main loop keeps calling us
+            switch(save_cartridge_step())
+            {
+                case TRANSFER_BUSY:
+
+                    show_transfer_progress("Saving     ");
+                    break;
+
+                case TRANSFER_DONE:
+
+                    show_save_result(true);
+                    break;
+
+                case TRANSFER_ERROR:
+
+                    show_save_result(false);
+                    break;
+            }
+
+            break;
+
+        case SHOW_CARTRIDGE_READY:
 
-                    if(res)
+            show_cartridge_ready();
+            uiState = CARTRIDGE_READY;
+            break;
+
+        case DIAGNOSTICS:
+
+            if(IS_UI_DISCONNECTED())
+                uiState = IDLE;
+            else
+            {
+                if(BUTTON_PRESSED(PIN_BTN_BACK))
+                {
+                    debounce_button(PIN_BTN_BACK);
+                    show_cartridge_ready();
+                    uiState = CARTRIDGE_READY;
+                }
+                else if(BUTTON_PRESSED(PIN_BTN_NEXT))
+                {
+                    debounce_button(PIN_BTN_NEXT);
+
+                    //After the last page we go back to the cartridge
+                    if(++diagnosticsPage == DIAGNOSTICS_PAGES)
                     {
-                        CLEAR_SCREEN();
-                        PRINT_STR("Cartridge  ", 0, 1);
-                        PRINT_STR("saved.     ", 0, 2);
-                        RENDER_SCREEN();
-                        sleep_ms(2000);
-                        CLEAR_SCREEN();
-                        PRINT_STR("Cartridge  ", 0, 1);
-                        PRINT_STR("ready.     ", 0, 2);
-                        RENDER_SCREEN();
+                        show_cartridge_ready();
+                        uiState = CARTRIDGE_READY;
                     }
                     else
-                    {
-                        CLEAR_SCREEN();
-                        PRINT_STR("Error      ", 0, 1);
-                        PRINT_STR("saving     ", 0, 2);
-                        PRINT_STR("cartridge. ", 0, 3);
-                        RENDER_SCREEN();
-                        sleep_ms(2000);
-                        CLEAR_SCREEN();
-                        PRINT_STR("Cartridge  ", 0, 1);
-                        PRINT_STR("ready.     ", 0, 2);
-                        RENDER_SCREEN();
-                    }
+                        diagnosticsRefresh = 0;
+                }
+                else if(BUTTON_PRESSED(PIN_BTN_SELECT))
+                {
+                    debounce_button(PIN_BTN_SELECT);
+                    dump_trace();
+                }
+                else if(time_us_64() >= diagnosticsRefresh)
+                {
+                    show_diagnostics_page(diagnosticsPage);
+                    diagnosticsRefresh = time_us_64() + DIAGNOSTICS_REFRESH_US;
                 }
             }
 
@@ -1066,24 +1452,69 @@ void init_i2c()
     gpio_pull_up(I2C_SCL);
 }
 
-//Main user interface loop
-void RunUserInterface()
+//Event buffer of the user interface loop
+mtuevent_t mtuevtBuffer;
+
+//The buffer sets and selection changes must be processed before the MD core needs them again, the status changes only update the leds
+evtclass_t uiEventClasses[] =
+{
+    { &mdToUiEventQueue, &mtuevtBuffer, BUFFERSET_EVENT_BUDGET_US },
+    { &mdToUiStatusQueue, &mtuevtBuffer, STATUS_EVENT_BUDGET_US }
+};
+
+//Initializes the event machines and the hardware of the user interface
+void init_user_interface()
 {
-    event_machine_init(&mdToUiEventQueue, &process_md_to_ui_event, sizeof(mtuevent_t), 8);
-    mtuevent_t mtuevtBuffer;
+    //Only the MD core main loop pushes to these queues (never its IRQs) so they don't need locks
+    //The buffer set queue also carries the selection changes, two per selection
+    event_machine_init_spsc(&mdToUiEventQueue, &process_md_to_ui_event, sizeof(mtuevent_t), 16);
+    event_machine_init_spsc(&mdToUiStatusQueue, &process_md_to_ui_event, sizeof(mtuevent_t), 8);
 
     init_leds();
     init_buttons();
     init_i2c();
+}
 
-    while(true)
+//An iteration of the user interface loop
+void run_user_interface_step()
+{
+    event_process_classes(uiEventClasses, 2);
+
+    //A load or a save in progress must go on while the QL uses the drive
+    bool transferring = uiState == LOADING || uiState == SAVING;
+
+    if(!mdInUse || transferring)
+        process_user_interface();
+    else
+        check_cancel();
+
+    //The cartridge is validated in background once it has been loaded, the format is known before that
+    bool loaded = cfInserted != NONE && uiState != FILE_LOAD && uiState != LOADING;
+    bool validating = loaded && !validate_cartridge_step();
+
+#if IDLE_SLEEP
+    //Sleep until the MD core sends an event or it's time to poll the buttons again, never in the middle of a transfer
+    event_mark_sleep(&mdToUiEventQueue);
+    event_mark_sleep(&mdToUiStatusQueue);
+
+    if((mdInUse || is_ui_waiting()) && !transferring && !validating && !event_pending(&mdToUiEventQueue) && !event_pending(&mdToUiStatusQueue))
     {
-        event_process_queue(&mdToUiEventQueue, &mtuevtBuffer, 16);
+        best_effort_wfe_or_timeout(make_timeout_time_ms(UI_IDLE_SLEEP_MS));
 
-        if(!mdInUse)
-            process_user_interface();
-        else
-            check_cancel();
+        //Only the buffer sets are time critical, the MD core needs them refilled before it uses them again
+        uint32_t latency = event_wake_latency(&mdToUiEventQueue);
 
+        if(latency > perfCounters.uiWakeLatencyMax)
+            perfCounters.uiWakeLatencyMax = latency;
     }
+#endif
+}
+
+//Main user interface loop
+void RunUserInterface()
+{
+    init_user_interface();
+
+    while(true)
+        run_user_interface_step();
 }
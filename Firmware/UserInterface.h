@@ -30,13 +30,30 @@
 #define MPD_HEADER_SIZE 16
 #define MPD_DATA_SIZE 612
 
-#define CARTRIDGE_HEADER_SIZE 16
-#define CARTRIDGE_DATA_SIZE 612
-#define CARTRIDGE_SECTOR_SIZE 628
-#define CARTRIDGE_SECTOR_COUNT 255
+//Loads and saves advance this many bytes per step of the UI loop, it must be a multiple of the SD sector size
+#define TRANSFER_CHUNK_SIZE 4096
+//MDV loads advance this many sectors per step
+#define MDV_LOAD_SECTORS_PER_STEP 8
+//Steps used while the QL has the drive selected. The UI loop must get back to the buffer set events before the MD
+//core has served the BUFFER_SET_COUNT - 1 prefetched sets (each one takes about 25 ms) and before mdToUiEventQueue
+//(one event per set) fills up, a SD block takes well under a millisecond at CLK_FAST plus the card busy time
+#define TRANSFER_CHUNK_SIZE_IN_USE 1024
+#define MDV_LOAD_SECTORS_PER_STEP_IN_USE 2
+//Dirty sectors that start less than this many bytes after the end of a save run are written in the same run
+#define SAVE_MERGE_GAP 1024
 
 #define PATH_BUFFER_SIZE 300
 
+//Time budgets of the UI core event classes for each loop iteration
+#define BUFFERSET_EVENT_BUDGET_US 1000
+#define STATUS_EVENT_BUDGET_US 100
+
+//Set to 1 to keep the record of the cartridge when the QL writes a corrupt one over a good one.
+//Disabled by default so the image stores exactly what the QL writes.
+#ifndef REJECT_CORRUPT_SECTORS
+#define REJECT_CORRUPT_SECTORS 0
+#endif
+
 typedef enum
 {
     IDLE,
@@ -50,7 +67,11 @@ typedef enum
     SELECT_FILE,
     FILE_SELECTED,
     FILE_LOAD,
-    CARTRIDGE_READY
+    LOADING,
+    CARTRIDGE_READY,
+    SAVING,
+    SHOW_CARTRIDGE_READY,
+    DIAGNOSTICS
 
 } USER_INTERFACE_STATE;
 
@@ -61,6 +82,15 @@ typedef enum
     MPD
 } CARTRIDGE_FORMAT;
 
+//Result of a load or save step
+typedef enum
+{
+    TRANSFER_BUSY,
+    TRANSFER_DONE,
+    TRANSFER_ERROR
+
+} transferstatus_t;
+
 typedef struct __attribute__((__packed__)) SECTOR_HEADER
 {
     uint8_t HeaderData[14];
@@ -87,6 +117,33 @@ typedef struct __attribute__((__packed__)) SECTOR
 
 } SECTOR_t;
 
+//Checksums that failed in a sector written by the QL
+#define SECTOR_CHECK_HEADER 1
+#define SECTOR_CHECK_RECORD_HEADER 2
+#define SECTOR_CHECK_DATA 4
+
+//Verification of the sectors written by the QL
+typedef struct sectorcheck
+{
+    uint32_t good;          //Sectors written with correct checksums
+    uint32_t bad;           //Sectors written with any wrong checksum
+    uint32_t rejected;      //Corrupt records not stored to keep a good one
+    int16_t lastBadSector;  //Last sector written with a wrong checksum, -1 if none
+    uint8_t lastBadChecks;  //SECTOR_CHECK_* flags of the last bad sector
+
+} sectorcheck_t;
+
+//Segment of a MDV sector, copied from the cartridge sector at source or filled if source is -1
+typedef struct mdvsegment
+{
+    uint16_t end;       //Offset in the MDV sector where the segment ends
+    int16_t source;     //Offset in the cartridge sector
+    uint8_t fill;
+
+} mdvsegment_t;
+
+void init_user_interface();
+void run_user_interface_step();
 void RunUserInterface();
 
 #endif
\ No newline at end of file
@@ -5,6 +5,9 @@
 #include "diskio.h"
 #include "pico/stdlib.h"
 #include "hardware/spi.h"
+#if PF_USE_DMA
+#include "hardware/dma.h"
+#endif
 /*--------------------------------------------------------------------------
    SPI and Pin selection
 ---------------------------------------------------------------------------*/
@@ -29,6 +32,21 @@ static inline uint32_t _millis(void)
 /* SPI controls (Platform dependent)                                     */
 /*-----------------------------------------------------------------------*/
 
+#if PF_USE_DMA
+/* DMA channels for the data blocks, claimed once as init_spi runs on each mount */
+static int dmaTx = -1;
+static int dmaRx = -1;
+
+/* Claim the SPI DMA channels */
+static void init_spi_dma(void)
+{
+	if (dmaTx < 0) {
+		dmaTx = dma_claim_unused_channel(true);
+		dmaRx = dma_claim_unused_channel(true);
+	}
+}
+#endif
+
 /* Initialize MMC interface */
 void init_spi(void)
 {
@@ -76,6 +94,10 @@ void init_spi(void)
 		SPI_CPHA_0, /* cpha */
 		SPI_MSB_FIRST /* order */
 	);
+
+#if PF_USE_DMA
+	init_spi_dma();
+#endif
 }
 
 /* Exchange a byte */
@@ -99,6 +121,78 @@ static inline BYTE rcv_spi(void)
 	return spi_exchange(0xFF);
 }
 
+#if PF_USE_DMA
+
+/* Exchange a block with DMA, both channels run so the RX FIFO never overflows */
+/* A NULL tx sends 0xFF, a NULL rx discards the received bytes */
+static void spi_dma_exchange(const BYTE* tx, BYTE* rx, UINT count)
+{
+	static BYTE fill = 0xFF;
+	static BYTE sink;
+
+	dma_channel_config txConfig = dma_channel_get_default_config(dmaTx);
+	channel_config_set_transfer_data_size(&txConfig, DMA_SIZE_8);
+	channel_config_set_dreq(&txConfig, spi_get_dreq(spi, true));
+	channel_config_set_read_increment(&txConfig, tx != NULL);
+	channel_config_set_write_increment(&txConfig, false);
+
+	dma_channel_config rxConfig = dma_channel_get_default_config(dmaRx);
+	channel_config_set_transfer_data_size(&rxConfig, DMA_SIZE_8);
+	channel_config_set_dreq(&rxConfig, spi_get_dreq(spi, false));
+	channel_config_set_read_increment(&rxConfig, false);
+	channel_config_set_write_increment(&rxConfig, rx != NULL);
+
+	dma_channel_configure(dmaRx, &rxConfig, rx ? rx : &sink, &spi_get_hw(spi)->dr, count, false);
+	dma_channel_configure(dmaTx, &txConfig, &spi_get_hw(spi)->dr, tx ? tx : &fill, count, false);
+
+	/* Start both at once, the RX channel must be armed before the first byte comes back */
+	dma_start_channel_mask((1u << dmaTx) | (1u << dmaRx));
+	dma_channel_wait_for_finish_blocking(dmaRx);
+}
+#endif
+
+/* Receive a block, NULL skips the bytes */
+static void rcv_spi_block(BYTE* buff, UINT count)
+{
+#if PF_USE_DMA
+	if (count >= PF_DMA_MIN_BYTES) {
+		spi_dma_exchange(NULL, buff, count);
+		return;
+	}
+#endif
+	while (count--) {
+		BYTE d = rcv_spi();
+		if (buff)
+			*buff++ = d;
+	}
+}
+
+/* Send a block, NULL sends count filler bytes */
+static void xmit_spi_block(const BYTE* buff, BYTE filler, UINT count)
+{
+#if PF_USE_DMA
+	if (count >= PF_DMA_MIN_BYTES && buff) {
+		spi_dma_exchange(buff, NULL, count);
+		return;
+	}
+#endif
+	while (count--)
+		xmit_spi(buff ? *buff++ : filler);
+}
+
+/* Wait for the card to leave the busy state, returns 0 on timeout */
+static int wait_ready(UINT ms)
+{
+	uint32_t start = _millis();
+
+	while (rcv_spi() != 0xFF) {
+		if (_millis() - start >= ms)
+			return 0;
+	}
+
+	return 1;
+}
+
 /*-----------------------------------------------------------------------*/
 /* Send a command packet to MMC                                          */
 /*-----------------------------------------------------------------------*/
@@ -115,11 +209,13 @@ static BYTE send_cmd(BYTE  cmd, /* 1st byte (Start + Index) */
 			return res;
 	}
 
-	/* Select the card */
-	DESELECT();
-	rcv_spi();
-	SELECT();
-	rcv_spi();
+	/* Select the card, CMD12 stops a running transfer so the card stays selected */
+	if (cmd != CMD12) {
+		DESELECT();
+		rcv_spi();
+		SELECT();
+		rcv_spi();
+	}
 
 	/* Send a command packet */
 	xmit_spi(cmd);               /* Start + Command index */
@@ -134,6 +230,10 @@ static BYTE send_cmd(BYTE  cmd, /* 1st byte (Start + Index) */
 		n = 0x87; /* Valid CRC for CMD8(0x1AA) */
 	xmit_spi(n);
 
+	/* Discard the stuff byte that follows CMD12 */
+	if (cmd == CMD12)
+		rcv_spi();
+
 	/* Receive a command response */
 	n = 10; /* Wait for a valid response in timeout of 10 attempts */
 	do {
@@ -251,24 +351,13 @@ DRESULT disk_readp(BYTE *buff,   /* Pointer to the read buffer (NULL:Forward to
 			bc = 512 + 2 - offset - count; /* Number of trailing bytes to skip */
 
 			/* Skip leading bytes */
-			while (offset--)
-				rcv_spi();
-
-			/* Receive a part of the sector */
-			if (buff) { /* Store data to the memory */
-				do {
-					*buff++ = rcv_spi();
-				} while (--count);
-			} else { /* Forward data to the outgoing stream */
-				do {
-					// FORWARD(rcv_spi());
-				} while (--count);
-			}
+			rcv_spi_block(NULL, offset);
+
+			/* Receive a part of the sector, without a buffer the data is discarded (no stream forwarding) */
+			rcv_spi_block(buff, count);
 
 			/* Skip trailing bytes and CRC */
-			do
-				rcv_spi();
-			while (--bc);
+			rcv_spi_block(NULL, bc);
 
 			res = RES_OK;
 		}
@@ -282,6 +371,54 @@ DRESULT disk_readp(BYTE *buff,   /* Pointer to the read buffer (NULL:Forward to
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Read Multiple Sectors                                                 */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_readm(BYTE *buff,   /* Pointer to the read buffer */
+                   DWORD sector, /* Start sector number (LBA) */
+                   UINT  count   /* Number of whole sectors to read (1..) */
+)
+{
+	DRESULT res;
+	BYTE    rc;
+	UINT    bc;
+
+	if (!(CardType & CT_BLOCK))
+		sector *= 512; /* Convert to byte address if needed */
+
+	res = RES_ERROR;
+	if (send_cmd(CMD18, sector) == 0) { /* READ_MULTIPLE_BLOCK */
+
+		do {
+			bc = 40000; /* Time counter, the card may need some time to start each block */
+			do { /* Wait for the data token */
+				rc = rcv_spi();
+			} while (rc == 0xFF && --bc);
+
+			if (rc != 0xFE) /* Error token or timeout */
+				break;
+
+			rcv_spi_block(buff, 512); /* Receive the sector */
+			rcv_spi_block(NULL, 2);   /* Skip the CRC */
+			buff += 512;
+		} while (--count);
+
+		/* Stop the transmission and wait for the card to leave the busy state */
+		send_cmd(CMD12, 0);
+
+		if (wait_ready(500) && !count)
+			res = RES_OK;
+	}
+
+	DESELECT();
+	rcv_spi();
+
+	return res;
+}
+
+
+
 #if PF_USE_WRITE
 DRESULT disk_writep(const BYTE *buff, /* Pointer to the bytes to be written (NULL:Initiate/Finalize sector write) */
                     DWORD       sc    /* Number of bytes to send, Sector number (LBA) or zero */
@@ -294,12 +431,9 @@ DRESULT disk_writep(const BYTE *buff, /* Pointer to the bytes to be written (NUL
 	res = RES_ERROR;
 
 	if (buff) { /* Send data bytes */
-		bc = sc;
-		while (bc && wc) { /* Send data bytes to the card */
-			xmit_spi(*buff++);
-			wc--;
-			bc--;
-		}
+		bc = sc < wc ? sc : wc; /* Send data bytes to the card */
+		xmit_spi_block(buff, 0, bc);
+		wc -= bc;
 		res = RES_OK;
 	} else {
 		if (sc) { /* Initiate sector write process */
@@ -312,10 +446,7 @@ DRESULT disk_writep(const BYTE *buff, /* Pointer to the bytes to be written (NUL
 				res = RES_OK;
 			}
 		} else { /* Finalize sector write process */
-			bc = wc + 2;
-			while (bc--) {
-				xmit_spi(0); /* Fill left bytes and CRC with zeros */
-			}
+			xmit_spi_block(NULL, 0, wc + 2); /* Fill left bytes and CRC with zeros */
 			do {
 				res = rcv_spi();
 			} while (res == 0xFF);
@@ -332,4 +463,59 @@ DRESULT disk_writep(const BYTE *buff, /* Pointer to the bytes to be written (NUL
 
 	return res;
 }
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write Multiple Sectors                                                */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_writem(const BYTE *buff, /* Pointer to the data to be written */
+                    DWORD sector,     /* Start sector number (LBA) */
+                    UINT  count       /* Number of whole sectors to write (1..) */
+)
+{
+	DRESULT res;
+	BYTE    rc;
+
+	if (!(CardType & CT_BLOCK))
+		sector *= 512; /* Convert to byte address if needed */
+
+	/* Tell SD cards how many blocks follow so they can pre-erase them, it's only a hint */
+	if (CardType & (CT_SD1 | CT_SD2))
+		send_cmd(ACMD23, count);
+
+	res = RES_ERROR;
+	if (send_cmd(CMD25, sector) == 0) { /* WRITE_MULTIPLE_BLOCK */
+
+		do {
+			xmit_spi(0xFF);
+			xmit_spi(0xFC);                /* Multiple block write data token */
+			xmit_spi_block(buff, 0, 512);  /* Send the sector */
+			xmit_spi_block(NULL, 0xFF, 2); /* Dummy CRC */
+
+			rc = rcv_spi();
+			if ((rc & 0x1F) != 0x05) /* Data rejected */
+				break;
+
+			/* The card accepts the block into its buffer, this wait is short */
+			if (!wait_ready(500))
+				break;
+
+			buff += 512;
+		} while (--count);
+
+		/* Stop token, the card programs the run now so this is the long busy wait */
+		xmit_spi(0xFD);
+		rcv_spi();
+
+		if (wait_ready(500) && !count)
+			res = RES_OK;
+	}
+
+	DESELECT();
+	rcv_spi();
+
+	return res;
+}
 #endif
@@ -30,7 +30,9 @@ typedef enum {
 
 DSTATUS disk_initialize (void);
 DRESULT disk_readp (BYTE* buff, DWORD sector, UINT offser, UINT count);
+DRESULT disk_readm (BYTE* buff, DWORD sector, UINT count);
 DRESULT disk_writep (const BYTE* buff, DWORD sc);
+DRESULT disk_writem (const BYTE* buff, DWORD sector, UINT count);
 
 #define STA_NOINIT		0x01	/* Drive not initialized */
 #define STA_NODISK		0x02	/* No medium in the drive */
@@ -51,10 +53,14 @@ DRESULT disk_writep (const BYTE* buff, DWORD sc);
 #define CMD0 (0x40 + 0)    /* GO_IDLE_STATE */
 #define CMD1 (0x40 + 1)    /* SEND_OP_COND (MMC) */
 #define ACMD41 (0xC0 + 41) /* SEND_OP_COND (SDC) */
+#define ACMD23 (0xC0 + 23) /* SET_WR_BLK_ERASE_COUNT (SDC) */
 #define CMD8 (0x40 + 8)    /* SEND_IF_COND */
+#define CMD12 (0x40 + 12)  /* STOP_TRANSMISSION */
 #define CMD16 (0x40 + 16)  /* SET_BLOCKLEN */
 #define CMD17 (0x40 + 17)  /* READ_SINGLE_BLOCK */
+#define CMD18 (0x40 + 18)  /* READ_MULTIPLE_BLOCK */
 #define CMD24 (0x40 + 24)  /* WRITE_BLOCK */
+#define CMD25 (0x40 + 25)  /* WRITE_MULTIPLE_BLOCK */
 #define CMD55 (0x40 + 55)  /* APP_CMD */
 #define CMD58 (0x40 + 58)  /* READ_OCR */
 
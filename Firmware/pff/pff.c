@@ -973,6 +973,87 @@ FRESULT pf_read (
 
 	return FR_OK;
 }
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read File with multiple block reads                                   */
+/*-----------------------------------------------------------------------*/
+/* Whole sectors are read in runs of consecutive sectors, a run continues */
+/* over the following clusters while the cluster chain is contiguous      */
+
+FRESULT pf_read_stream (
+	void* buff,		/* Pointer to the read buffer */
+	UINT btr,		/* Number of bytes to read */
+	UINT* br		/* Pointer to number of bytes read */
+)
+{
+	FRESULT res;
+	CLUST clst;
+	DWORD sect, remain;
+	UINT rcnt, run;
+	BYTE cs, *rbuff = buff;
+	FATFS *fs = FatFs;
+
+
+	*br = 0;
+	if (!fs) return FR_NOT_ENABLED;		/* Check file system */
+	if (!(fs->flag & FA_OPENED)) return FR_NOT_OPENED;	/* Check if opened */
+	if (!rbuff) return pf_read(buff, btr, br);	/* Stream forwarding is done sector by sector */
+
+	remain = fs->fsize - fs->fptr;
+	if (btr > remain) btr = (UINT)remain;			/* Truncate btr by remaining bytes */
+
+	/* Read up to the sector boundary */
+	rcnt = (512 - (UINT)fs->fptr % 512) % 512;
+	if (rcnt > btr) rcnt = btr;
+	if (rcnt) {
+		res = pf_read(rbuff, rcnt, &rcnt);
+		if (res) return res;
+		btr -= rcnt; *br += rcnt; rbuff += rcnt;
+	}
+
+	while (btr >= 512) {							/* Repeat while there are whole sectors */
+		cs = (BYTE)(fs->fptr / 512 & (fs->csize - 1));	/* Sector offset in the cluster */
+		if (!cs) {									/* On the cluster boundary? */
+			if (fs->fptr == 0) {					/* On the top of the file? */
+				clst = fs->org_clust;
+			} else {
+				clst = get_fat(fs->curr_clust);
+			}
+			if (clst <= 1) ABORT(FR_DISK_ERR);
+			fs->curr_clust = clst;					/* Update current cluster */
+		}
+		sect = clust2sect(fs->curr_clust);			/* Get current sector */
+		if (!sect) ABORT(FR_DISK_ERR);
+		sect += cs;
+
+		run = fs->csize - cs;						/* Sectors left in this cluster */
+		while (run < btr / 512) {					/* Extend the run while the next cluster follows this one */
+			clst = get_fat(fs->curr_clust);
+			if (clst != fs->curr_clust + 1) break;
+			fs->curr_clust = clst;
+			run += fs->csize;
+		}
+		if (run > btr / 512) run = btr / 512;
+
+		if (disk_readm(rbuff, sect, run)) ABORT(FR_DISK_ERR);
+		fs->dsect = sect + run - 1;
+		rcnt = run * 512;
+		fs->fptr += rcnt;							/* Advances file read pointer */
+		btr -= rcnt; *br += rcnt;					/* Update read counter */
+		rbuff += rcnt;
+	}
+
+	/* Read the last partial sector */
+	if (btr) {
+		res = pf_read(rbuff, btr, &rcnt);
+		if (res) return res;
+		*br += rcnt;
+	}
+
+	return FR_OK;
+}
 #endif
 
 
@@ -1043,6 +1124,89 @@ FRESULT pf_write (
 
 	return FR_OK;
 }
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write File with multiple block writes                                 */
+/*-----------------------------------------------------------------------*/
+/* Whole sectors are written in runs of consecutive sectors like         */
+/* pf_read_stream, the last partial sector is left in progress as in     */
+/* pf_write and must be finalized with pf_write(0, 0, &bw)               */
+
+FRESULT pf_write_stream (
+	const void* buff,	/* Pointer to the data to be written */
+	UINT btw,			/* Number of bytes to write */
+	UINT* bw			/* Pointer to number of bytes written */
+)
+{
+	FRESULT res;
+	CLUST clst;
+	DWORD sect, remain;
+	const BYTE *p = buff;
+	BYTE cs;
+	UINT wcnt, run;
+	FATFS *fs = FatFs;
+
+
+	*bw = 0;
+	if (!fs) return FR_NOT_ENABLED;		/* Check file system */
+	if (!(fs->flag & FA_OPENED)) return FR_NOT_OPENED;	/* Check if opened */
+	if (!btw) return pf_write(0, 0, bw);	/* Finalize request */
+
+	if (fs->flag & FA__WIP) {			/* Complete the sector in progress */
+		wcnt = 512 - (UINT)fs->fptr % 512;
+		if (wcnt > btw) wcnt = btw;
+		res = pf_write(p, wcnt, &wcnt);
+		if (res) return res;
+		p += wcnt; btw -= wcnt; *bw += wcnt;
+		if (fs->flag & FA__WIP) return FR_OK;	/* All the data fitted in the sector */
+	} else {							/* Round-down fptr to the sector boundary */
+		fs->fptr &= 0xFFFFFE00;
+	}
+	remain = fs->fsize - fs->fptr;
+	if (btw > remain) btw = (UINT)remain;			/* Truncate btw by remaining bytes */
+
+	while (btw >= 512) {							/* Repeat while there are whole sectors */
+		cs = (BYTE)(fs->fptr / 512 & (fs->csize - 1));	/* Sector offset in the cluster */
+		if (!cs) {									/* On the cluster boundary? */
+			if (fs->fptr == 0) {					/* On the top of the file? */
+				clst = fs->org_clust;
+			} else {
+				clst = get_fat(fs->curr_clust);
+			}
+			if (clst <= 1) ABORT(FR_DISK_ERR);
+			fs->curr_clust = clst;					/* Update current cluster */
+		}
+		sect = clust2sect(fs->curr_clust);			/* Get current sector */
+		if (!sect) ABORT(FR_DISK_ERR);
+		sect += cs;
+
+		run = fs->csize - cs;						/* Sectors left in this cluster */
+		while (run < btw / 512) {					/* Extend the run while the next cluster follows this one */
+			clst = get_fat(fs->curr_clust);
+			if (clst != fs->curr_clust + 1) break;
+			fs->curr_clust = clst;
+			run += fs->csize;
+		}
+		if (run > btw / 512) run = btw / 512;
+
+		if (disk_writem(p, sect, run)) ABORT(FR_DISK_ERR);
+		fs->dsect = sect + run - 1;
+		wcnt = run * 512;
+		fs->fptr += wcnt; p += wcnt;				/* Update pointers and counters */
+		btw -= wcnt; *bw += wcnt;
+	}
+
+	/* Start the last partial sector */
+	if (btw) {
+		res = pf_write(p, btw, &wcnt);
+		if (res) return res;
+		*bw += wcnt;
+	}
+
+	return FR_OK;
+}
 #endif
 
 
@@ -121,7 +121,9 @@ typedef enum {
 FRESULT pf_mount (FATFS* fs);								/* Mount/Unmount a logical drive */
 FRESULT pf_open (const char* path);							/* Open a file */
 FRESULT pf_read (void* buff, UINT btr, UINT* br);			/* Read data from the open file */
+FRESULT pf_read_stream (void* buff, UINT btr, UINT* br);	/* Read data from the open file with multiple block reads */
 FRESULT pf_write (const void* buff, UINT btw, UINT* bw);	/* Write data to the open file */
+FRESULT pf_write_stream (const void* buff, UINT btw, UINT* bw);	/* Write data to the open file with multiple block writes */
 FRESULT pf_lseek (DWORD ofs);								/* Move file pointer of the open file */
 FRESULT pf_opendir (DIR* dj, const char* path);				/* Open a directory */
 FRESULT pf_readdir (DIR* dj, FILINFO* fno);					/* Read a directory item from the open directory */
@@ -69,5 +69,11 @@
 #define CLK_FAST	20000000
 //Select if we need a weak pull up in MISO or the card adapter already contains one
 #define PF_MISO_PULLUP
+//Move the data blocks with DMA instead of byte by byte, set to 0 to use only the per-byte path
+#ifndef PF_USE_DMA
+#define PF_USE_DMA 1
+#endif
+//Shorter transfers are done byte by byte, the DMA setup costs more than it saves
+#define PF_DMA_MIN_BYTES 16
 
 #endif /* PF_CONF */
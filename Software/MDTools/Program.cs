@@ -20,7 +20,8 @@ bool MainMenu()
     Console.WriteLine("5. View current directory");
     Console.WriteLine("6. Remove file from directory");
     Console.WriteLine("7. Export cartridge");
-    Console.WriteLine("8. Exit");
+    Console.WriteLine("8. Decode firmware trace");
+    Console.WriteLine("9. Exit");
     Console.WriteLine();
 
     Console.Write("Option: ");
@@ -48,12 +49,39 @@ bool MainMenu()
             ExportCartridge();
             return true;
         case "8":
+            DecodeFirmwareTrace();
+            return true;
+        case "9":
             return false;
         default:
             Console.WriteLine("Invalid option");
             return true;
     }
 }
+void DecodeFirmwareTrace()
+{
+    try
+    {
+        Console.WriteLine("Enter trace file name:");
+        string fileName = Console.ReadLine();
+
+        if (!File.Exists(fileName))
+        {
+            Console.WriteLine("File not found.");
+            return;
+        }
+
+        FirmwareTrace trace = FirmwareTrace.Load(fileName);
+
+        Console.WriteLine(trace.GetTimeline());
+        Console.WriteLine(trace.GetCounters());
+        Console.WriteLine(trace.GetLatencies());
+    }
+    catch(Exception ex)
+    {
+        Console.WriteLine($"Error decoding trace: {ex.Message}");
+    }
+}
 void ExportCartridge()
 {
     try
@@ -0,0 +1,251 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+using System.Text;
+
+namespace MicroDriveTools.Classes
+{
+    //Decoder for the MDTRACE.BIN dumps of the firmware (Trace.h)
+    public class FirmwareTrace
+    {
+        const uint TRACE_MAGIC = 0x5254444D;
+        const ushort TRACE_VERSION = 5;
+        const int HEADER_SIZE = 36;
+        const byte NO_STATUS = 0xFF;
+
+        static readonly string[] CounterNames = { "Sets served", "Sets received", "Late sets", "DMA aborts", "Invalid status", "Max gap latency (us)",
+            "MD sleeps", "Max MD wake latency (us)", "Max UI wake latency (us)" };
+        static readonly string[] LatencyBucketNames = { "< 2 us", "< 4 us", "< 8 us", "< 16 us", "< 32 us", "< 64 us", "< 128 us", ">= 128 us" };
+        static readonly string[] QueueNames = { "MD", "UI to MD", "MD to UI (buffer sets)", "MD to UI (status)" };
+        static readonly string[] EventNames = { "MD_EVENT", "STATUS_IRQ", "SHIFTER_IRQ", "DMA_WRITE_IRQ", "READ_DMA_ARMED", "READ_STARTED", "READ_FINISHED", "WRITE_DMA_ARMED", "WRITE_STARTED", "BUFFERSET_UNDERRUN", "BUFFERSET_READ", "BUFFERSET_WRITTEN", "STATE_CHANGED" };
+        static readonly string[] MdEventNames = { "SHIFT_CHANGED", "SELECT_TIMEOUT_EXPIRED", "MD_STATUS_CHANGED", "DMA_READ_IRQ", "DMA_WRITE_IRQ", "CHECK_WRITE_FINISH", "WRITE_GAP_FINISHED" };
+        static readonly string[] LineStatusNames = { "WRITE", "WRITE_GAP", "INVALID", "READ" };
+        static readonly string[] ActiveStatusNames = { "IDLE", "READ_HEADER_GAP", "READ_HEADER", "READ_SECTOR_GAP", "READ_SECTOR", "WRITE_HEADER_GAP", "WRITE_HEADER", "WRITE_SECTOR_GAP", "WRITE_SECTOR" };
+
+        const byte TRC_MD_EVENT = 0;
+        const byte TRC_STATUS_IRQ = 1;
+        const byte TRC_READ_DMA_ARMED = 4;
+        const byte TRC_WRITE_DMA_ARMED = 7;
+        const byte TRC_WRITE_STARTED = 8;
+        const byte TRC_STATE_CHANGED = 12;
+        const uint MDE_WRITE_GAP_FINISHED = 6;
+        const uint MDL_WRITE_GAP = 1;
+        const uint MDL_READ = 3;
+
+        public class TraceEntry
+        {
+            public int Core { get; set; }
+            public long Time { get; set; }
+            public byte Event { get; set; }
+            public uint Args { get; set; }
+            public byte ActiveStatus { get; set; }
+            public byte BufferSet { get; set; }
+        }
+
+        public TraceEntry[] Entries { get; private set; }
+        public uint[] Counters { get; private set; }
+        public byte[] QueueHighWater { get; private set; }
+
+        //Checks of the sectors written by the QL (sectorcheck_t)
+        public uint GoodSectors { get; private set; }
+        public uint BadSectors { get; private set; }
+        public uint RejectedRecords { get; private set; }
+        public short LastBadSector { get; private set; }
+        public byte LastBadChecks { get; private set; }
+
+        private FirmwareTrace(TraceEntry[] entries, uint[] counters, byte[] queueHighWater)
+        {
+            Entries = entries;
+            Counters = counters;
+            QueueHighWater = queueHighWater;
+        }
+
+        public static FirmwareTrace Load(string fileName)
+        {
+            using var reader = new BinaryReader(File.OpenRead(fileName));
+
+            if (reader.ReadUInt32() != TRACE_MAGIC)
+                throw new InvalidDataException("Not a trace dump.");
+
+            if (reader.ReadUInt16() != TRACE_VERSION)
+                throw new InvalidDataException("Unsupported trace version.");
+
+            int entrySize = reader.ReadUInt16();
+            int entryCount = (int)reader.ReadUInt32();
+            uint[] heads = { reader.ReadUInt32(), reader.ReadUInt32() };
+            uint dumpTime = reader.ReadUInt32();
+            byte[] queueHighWater = reader.ReadBytes(4);
+            int countersSize = (int)reader.ReadUInt32();
+            int checksSize = (int)reader.ReadUInt32();
+
+            reader.BaseStream.Position = HEADER_SIZE;
+
+            uint[] counters = new uint[countersSize / 4];
+
+            for (int buc = 0; buc < counters.Length; buc++)
+                counters[buc] = reader.ReadUInt32();
+
+            reader.BaseStream.Position = HEADER_SIZE + countersSize;
+
+            uint goodSectors = reader.ReadUInt32();
+            uint badSectors = reader.ReadUInt32();
+            uint rejectedRecords = reader.ReadUInt32();
+            short lastBadSector = reader.ReadInt16();
+            byte lastBadChecks = reader.ReadByte();
+
+            List<TraceEntry> entries = new List<TraceEntry>();
+
+            for (int core = 0; core < 2; core++)
+            {
+                long ringStart = HEADER_SIZE + countersSize + checksSize + core * entryCount * entrySize;
+                int valid = (int)Math.Min(heads[core], (uint)entryCount);
+
+                //Walk from the oldest entry to the newest
+                for (uint index = heads[core] - (uint)valid; index != heads[core]; index++)
+                {
+                    reader.BaseStream.Position = ringStart + (index % entryCount) * entrySize;
+
+                    uint timestamp = reader.ReadUInt32();
+
+                    TraceEntry entry = new TraceEntry();
+                    entry.Core = core;
+                    entry.Args = reader.ReadUInt32();
+                    entry.Event = reader.ReadByte();
+                    entry.ActiveStatus = reader.ReadByte();
+                    entry.BufferSet = reader.ReadByte();
+                    //The timer wraps each 71 minutes, times are relative to the dump
+                    entry.Time = -(long)unchecked(dumpTime - timestamp);
+
+                    entries.Add(entry);
+                }
+            }
+
+            FirmwareTrace trace = new FirmwareTrace(entries.OrderBy(e => e.Time).ToArray(), counters, queueHighWater);
+            trace.GoodSectors = goodSectors;
+            trace.BadSectors = badSectors;
+            trace.RejectedRecords = rejectedRecords;
+            trace.LastBadSector = lastBadSector;
+            trace.LastBadChecks = lastBadChecks;
+
+            return trace;
+        }
+
+        //Performance counters of the MD core at the time of the dump
+        public string GetCounters()
+        {
+            StringBuilder sb = new StringBuilder();
+
+            for (int buc = 0; buc < Counters.Length; buc++)
+            {
+                string name = buc < CounterNames.Length ? CounterNames[buc] : $"Gap latency {Name(LatencyBucketNames, (uint)(buc - CounterNames.Length))}";
+                sb.AppendLine($"{name}: {Counters[buc]}");
+            }
+
+            for (int buc = 0; buc < QueueHighWater.Length; buc++)
+                sb.AppendLine($"{QueueNames[buc]} queue high-water: {QueueHighWater[buc]}");
+
+            sb.AppendLine($"Sectors written with good checksums: {GoodSectors}");
+            sb.AppendLine($"Sectors written with bad checksums: {BadSectors}");
+            sb.AppendLine($"Corrupt records rejected: {RejectedRecords}");
+
+            if (LastBadSector < 0)
+                sb.AppendLine("Last bad sector: none");
+            else
+                sb.AppendLine($"Last bad sector: {LastBadSector}, failed {DescribeChecks(LastBadChecks)}");
+
+            return sb.ToString();
+        }
+
+        //Timeline with the time elapsed since the previous entry
+        public string GetTimeline()
+        {
+            StringBuilder sb = new StringBuilder();
+            long? previous = null;
+
+            foreach (var entry in Entries)
+            {
+                long delta = previous == null ? 0 : entry.Time - previous.Value;
+                previous = entry.Time;
+
+                string status = entry.ActiveStatus == NO_STATUS ? "UI" : Name(ActiveStatusNames, entry.ActiveStatus);
+                sb.AppendLine($"{entry.Time,12} us (+{delta,6}) core{entry.Core} [{status}, set {entry.BufferSet}] {Describe(entry)}");
+            }
+
+            return sb.ToString();
+        }
+
+        //Latencies of the transitions that must be handled inside the gaps
+        public string GetLatencies()
+        {
+            StringBuilder sb = new StringBuilder();
+
+            AppendLatency(sb, "ERASE edge -> read DMA armed", e => e.Event == TRC_STATUS_IRQ && e.Args == MDL_WRITE_GAP, e => e.Event == TRC_READ_DMA_ARMED);
+            AppendLatency(sb, "READ status -> write DMA armed", e => e.Event == TRC_STATUS_IRQ && e.Args == MDL_READ, e => e.Event == TRC_WRITE_DMA_ARMED);
+            AppendLatency(sb, "WRITE_GAP_FINISHED -> first bit out", e => e.Event == TRC_MD_EVENT && (e.Args >> 16) == MDE_WRITE_GAP_FINISHED, e => e.Event == TRC_WRITE_STARTED);
+
+            return sb.ToString();
+        }
+
+        private void AppendLatency(StringBuilder sb, string name, Func<TraceEntry, bool> start, Func<TraceEntry, bool> end)
+        {
+            List<long> latencies = new List<long>();
+            TraceEntry? pending = null;
+
+            foreach (var entry in Entries.Where(e => e.Core == 0))
+            {
+                if (start(entry))
+                    pending = entry;
+                else if (pending != null && end(entry))
+                {
+                    latencies.Add(entry.Time - pending.Time);
+                    pending = null;
+                }
+            }
+
+            if (latencies.Count == 0)
+                sb.AppendLine($"{name}: no samples");
+            else
+                sb.AppendLine($"{name}: {latencies.Count} samples, min {latencies.Min()} us, avg {latencies.Average():0.0} us, max {latencies.Max()} us");
+        }
+
+        private static string Describe(TraceEntry entry)
+        {
+            string name = Name(EventNames, entry.Event);
+
+            switch (entry.Event)
+            {
+                case TRC_MD_EVENT:
+                    return $"{name} {Name(MdEventNames, entry.Args >> 16)} ({entry.Args & 0xFFFF})";
+                case TRC_STATUS_IRQ:
+                    return $"{name} {Name(LineStatusNames, entry.Args)}";
+                case TRC_STATE_CHANGED:
+                    return $"{name} {Name(ActiveStatusNames, (entry.Args >> 8) & 0xFF)} -> {Name(ActiveStatusNames, entry.Args & 0xFF)}";
+                default:
+                    return $"{name} ({entry.Args})";
+            }
+        }
+
+        //SECTOR_CHECK_* flags of UserInterface.h
+        private static string DescribeChecks(byte checks)
+        {
+            List<string> failed = new List<string>();
+
+            if ((checks & 1) != 0)
+                failed.Add("header");
+
+            if ((checks & 2) != 0)
+                failed.Add("record header");
+
+            if ((checks & 4) != 0)
+                failed.Add("data");
+
+            return string.Join(", ", failed);
+        }
+
+        private static string Name(string[] names, uint value)
+        {
+            return value < names.Length ? names[value] : $"#{value}";
+        }
+    }
+}